@@ -0,0 +1,161 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace NewRelic { namespace Profiler
+{
+    enum class CoalescingWorkState : int32_t
+    {
+        //the ticket has not been issued
+        Unknown = 0,
+        Queued = 1,
+        Running = 2,
+        Completed = 3,
+    };
+
+    //Runs requests one at a time on a persistent worker thread.  At most one request waits behind the one that is running: a
+    //request posted while another is still waiting is merged into it with the coalesce function, so a burst of requests costs
+    //at most two runs instead of queueing one run each.
+    //
+    //Every request gets a ticket, and tickets increase in the order requests are posted.  A ticket is completed once a run that
+    //includes its request has finished, so a ticket whose request was merged into a later one completes with that later one.
+    template <typename Request>
+    class CoalescingWorker
+    {
+    public:
+        typedef std::function<void(Request request, uint64_t ticket)> Handler;
+        typedef std::function<Request(Request pending, Request latest)> Coalesce;
+
+        CoalescingWorker(Handler handler, Coalesce coalesce) :
+            _handler(handler),
+            _coalesce(coalesce)
+        {}
+
+        ~CoalescingWorker()
+        {
+            Stop();
+        }
+
+        CoalescingWorker(const CoalescingWorker&) = delete;
+        CoalescingWorker& operator=(const CoalescingWorker&) = delete;
+
+        //returns the ticket for the request, or 0 if the worker has been stopped; may throw if the worker thread cannot be started
+        uint64_t Post(Request request)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stopped)
+            {
+                return 0;
+            }
+
+            if (!_thread.joinable())
+            {
+                _thread = std::thread(&CoalescingWorker::Run, this);
+            }
+
+            _pendingRequest = _pendingTicket > _runningTicket ? _coalesce(_pendingRequest, request) : request;
+            _pendingTicket = ++_lastTicket;
+            _changed.notify_all();
+            return _pendingTicket;
+        }
+
+        CoalescingWorkState GetState(uint64_t ticket) const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return GetStateLocked(ticket);
+        }
+
+        //false if the ticket did not complete within the timeout
+        bool WaitForCompletion(uint64_t ticket, std::chrono::milliseconds timeout) const
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _changed.wait_for(lock, timeout, [&]() { return GetStateLocked(ticket) == CoalescingWorkState::Completed; });
+        }
+
+        //waits for the running request to finish; a request that is still waiting is dropped
+        void Stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stopped = true;
+                _changed.notify_all();
+            }
+            if (_thread.joinable() && _thread.get_id() != std::this_thread::get_id())
+            {
+                _thread.join();
+            }
+        }
+
+    private:
+        CoalescingWorkState GetStateLocked(uint64_t ticket) const
+        {
+            if (ticket == 0 || ticket > _lastTicket)
+            {
+                return CoalescingWorkState::Unknown;
+            }
+            if (ticket <= _completedTicket)
+            {
+                return CoalescingWorkState::Completed;
+            }
+            if (ticket <= _runningTicket)
+            {
+                return CoalescingWorkState::Running;
+            }
+            return CoalescingWorkState::Queued;
+        }
+
+        void Run()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true)
+            {
+                _changed.wait(lock, [this]() { return _stopped || _pendingTicket > _runningTicket; });
+                if (_stopped)
+                {
+                    return;
+                }
+
+                auto request = _pendingRequest;
+                auto ticket = _pendingTicket;
+                _runningTicket = ticket;
+                _changed.notify_all();
+
+                lock.unlock();
+                try
+                {
+                    _handler(request, ticket);
+                }
+                catch (...)
+                {
+                    //the handler reports its own failures; the worker has to keep running
+                }
+                lock.lock();
+
+                _completedTicket = ticket;
+                _changed.notify_all();
+            }
+        }
+
+        Handler _handler;
+        Coalesce _coalesce;
+
+        mutable std::mutex _mutex;
+        mutable std::condition_variable _changed;
+        Request _pendingRequest{};
+        uint64_t _lastTicket = 0;
+        //the ticket of the waiting request, or of the running one if nothing is waiting
+        uint64_t _pendingTicket = 0;
+        uint64_t _runningTicket = 0;
+        uint64_t _completedTicket = 0;
+        bool _stopped = false;
+        std::thread _thread;
+    };
+}}
@@ -8,10 +8,17 @@
 #include <codecvt>
 #include <fstream>
 #include <iostream>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 
 #include "xplat.h"
 #include "../Logging/Logger.h"
 
+#ifndef PAL_STDCPP_COMPAT
+#include <Windows.h>
+#endif
+
 namespace NewRelic {
     namespace Profiler
     {
@@ -37,5 +44,43 @@ namespace NewRelic {
 
             return ss.str();
         }
+
+        /// <summary>
+        /// The size and last write time of a file, used to tell whether a file has changed since it was last read.
+        /// </summary>
+        struct FileStamp
+        {
+            uint64_t size = 0;
+            // seconds since the epoch
+            int64_t lastWriteTime = 0;
+            // within lastWriteTime, to the resolution of the file system
+            uint32_t lastWriteTimeNanoseconds = 0;
+        };
+
+        /// <summary>
+        /// Gets the size and last write time of a file. Returns false if the file does not exist or cannot be accessed.
+        /// </summary>
+        static bool TryGetFileStamp(const xstring_t& filePath, FileStamp& stamp) {
+#ifdef PAL_STDCPP_COMPAT
+            struct stat fileStat;
+            if (stat(to_pathstring(filePath).c_str(), &fileStat) != 0) {
+                return false;
+            }
+            stamp.size = static_cast<uint64_t>(fileStat.st_size);
+            stamp.lastWriteTime = static_cast<int64_t>(fileStat.st_mtim.tv_sec);
+            stamp.lastWriteTimeNanoseconds = static_cast<uint32_t>(fileStat.st_mtim.tv_nsec);
+#else
+            WIN32_FILE_ATTRIBUTE_DATA attributes;
+            if (!GetFileAttributesExW(filePath.c_str(), GetFileExInfoStandard, &attributes)) {
+                return false;
+            }
+            stamp.size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+            // 100 nanosecond intervals since 1601
+            auto ticks = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+            stamp.lastWriteTime = static_cast<int64_t>(ticks / 10000000) - 11644473600ll;
+            stamp.lastWriteTimeNanoseconds = static_cast<uint32_t>(ticks % 10000000) * 100;
+#endif
+            return true;
+        }
     }
 };
@@ -0,0 +1,111 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "xplat.h"
+
+namespace NewRelic { namespace Profiler
+{
+    //FNV-1a, the hash behind the profiler's string pool, name prefilters and lookup tables and the keys and checksums of its on disk
+    //caches.  Strings are hashed one code unit at a time and bytes one byte at a time; a hash can be continued by passing the result
+    //of one call as the starting hash of the next.
+    class Fnv1a
+    {
+    public:
+        static constexpr uint64_t OffsetBasis = 14695981039346656037ull;
+        static constexpr uint64_t Prime = 1099511628211ull;
+        static constexpr uint32_t OffsetBasis32 = 2166136261u;
+        static constexpr uint32_t Prime32 = 16777619u;
+
+        //folds one value, of any width up to 64 bits, into the hash
+        static uint64_t Mix(uint64_t hash, uint64_t value) noexcept
+        {
+            return (hash ^ value) * Prime;
+        }
+
+        static uint64_t Hash(const xchar_t* chars, size_t length, uint64_t hash = OffsetBasis) noexcept
+        {
+            for (size_t index = 0; index < length; ++index)
+            {
+                hash = Mix(hash, static_cast<uint64_t>(chars[index]));
+            }
+            return hash;
+        }
+
+        static uint64_t Hash(const xstring_t& value, uint64_t hash = OffsetBasis) noexcept
+        {
+            return Hash(value.data(), value.size(), hash);
+        }
+
+        //two strings hash the same when Strings::AreEqualCaseInsensitive finds them equal, which is exactly when their code units
+        //are equal with bit 5 set
+        static uint64_t HashCaseFolded(const xstring_t& value, uint64_t hash = OffsetBasis) noexcept
+        {
+            for (auto character : value)
+            {
+                hash = Mix(hash, static_cast<uint64_t>(character | 32));
+            }
+            return hash;
+        }
+
+        static uint64_t HashBytes(const uint8_t* bytes, size_t size, uint64_t hash = OffsetBasis) noexcept
+        {
+            for (size_t index = 0; index < size; ++index)
+            {
+                hash = Mix(hash, bytes[index]);
+            }
+            return hash;
+        }
+
+        //the 32 bit variant, for checksums
+        static uint32_t HashBytes32(const uint8_t* bytes, size_t size, uint32_t hash = OffsetBasis32) noexcept
+        {
+            for (size_t index = 0; index < size; ++index)
+            {
+                hash = (hash ^ bytes[index]) * Prime32;
+            }
+            return hash;
+        }
+    };
+
+    //Hashes a sequence of values into one 64 bit FNV-1a hash, for the keys of the on disk caches.  A separator follows every value
+    //so that ("ab", "c") and ("a", "bc") hash differently.
+    class Fnv1aHasher
+    {
+    public:
+        Fnv1aHasher& Add(const xstring_t& value) noexcept
+        {
+            _hash = Fnv1a::Mix(Fnv1a::Hash(value, _hash), 0x10000);
+            return *this;
+        }
+
+        Fnv1aHasher& Add(bool value) noexcept
+        {
+            _hash = Fnv1a::Mix(_hash, value ? 0x10001 : 0x10002);
+            return *this;
+        }
+
+        Fnv1aHasher& Add(uint64_t value) noexcept
+        {
+            _hash = Fnv1a::Mix(Fnv1a::Mix(_hash, value), 0x10003);
+            return *this;
+        }
+
+        Fnv1aHasher& AddBytes(const uint8_t* bytes, size_t size) noexcept
+        {
+            _hash = Fnv1a::Mix(Fnv1a::HashBytes(bytes, size, _hash), 0x10004);
+            return *this;
+        }
+
+        uint64_t Get() const noexcept
+        {
+            return _hash;
+        }
+
+    private:
+        uint64_t _hash = Fnv1a::OffsetBasis;
+    };
+}}
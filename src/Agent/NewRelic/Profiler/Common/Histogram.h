@@ -0,0 +1,104 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <array>
+
+namespace NewRelic { namespace Profiler
+{
+    //A fixed size, lock-free histogram of non-negative integer values in the style of HdrHistogram: each power of two range is split into
+    //SubBucketCount linear buckets, so every recorded value is kept with a relative error below 1 / SubBucketCount (6.25%) while the whole
+    //range up to MaxValue fits in BucketCount counters.  Values above MaxValue are counted in the last bucket.
+    //
+    //Record may be called concurrently from any number of threads and never blocks.  Harvest atomically takes each counter and resets it,
+    //so every recorded value is reported by exactly one harvest.
+    class Histogram
+    {
+    public:
+        static constexpr uint32_t SubBucketBits = 4;
+        static constexpr uint32_t SubBucketCount = 1 << SubBucketBits;
+        static constexpr uint32_t MaxValueBits = 36;
+        static constexpr uint64_t MaxValue = (uint64_t(1) << MaxValueBits) - 1;
+        static constexpr uint32_t BucketCount = (MaxValueBits - SubBucketBits + 1) * SubBucketCount;
+
+        struct Snapshot
+        {
+            uint64_t count = 0;
+            uint64_t sum = 0;
+            uint64_t max = 0;
+            std::array<uint64_t, BucketCount> buckets{};
+        };
+
+        void Record(uint64_t value) noexcept
+        {
+            _buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+            _sum.fetch_add(value, std::memory_order_relaxed);
+
+            auto max = _max.load(std::memory_order_relaxed);
+            while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        //Take and reset the counters.  The count of the snapshot is the sum of its buckets.
+        void Harvest(Snapshot& snapshot) noexcept
+        {
+            snapshot.count = 0;
+            for (uint32_t index = 0; index != BucketCount; ++index)
+            {
+                snapshot.buckets[index] = _buckets[index].exchange(0, std::memory_order_relaxed);
+                snapshot.count += snapshot.buckets[index];
+            }
+            snapshot.sum = _sum.exchange(0, std::memory_order_relaxed);
+            snapshot.max = _max.exchange(0, std::memory_order_relaxed);
+        }
+
+        static uint32_t BucketIndex(uint64_t value) noexcept
+        {
+            if (value > MaxValue)
+            {
+                value = MaxValue;
+            }
+            if (value < 2 * SubBucketCount)
+            {
+                return static_cast<uint32_t>(value);
+            }
+            const auto shift = HighestBit(value) - SubBucketBits;
+            return (shift + 1) * SubBucketCount + static_cast<uint32_t>((value >> shift) - SubBucketCount);
+        }
+
+        //the smallest value counted in the bucket
+        static uint64_t BucketLowerBound(uint32_t index) noexcept
+        {
+            if (index < 2 * SubBucketCount)
+            {
+                return index;
+            }
+            const auto shift = index / SubBucketCount - 1;
+            return static_cast<uint64_t>(index % SubBucketCount + SubBucketCount) << shift;
+        }
+
+    private:
+        //index of the highest set bit; value must not be 0
+        static uint32_t HighestBit(uint64_t value) noexcept
+        {
+            uint32_t bit = 0;
+            for (uint32_t step = 32; step != 0; step >>= 1)
+            {
+                if (value >> step)
+                {
+                    value >>= step;
+                    bit += step;
+                }
+            }
+            return bit;
+        }
+
+        std::array<std::atomic<uint64_t>, BucketCount> _buckets{};
+        std::atomic<uint64_t> _sum{ 0 };
+        std::atomic<uint64_t> _max{ 0 };
+    };
+}}
@@ -0,0 +1,130 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include "xplat.h"
+
+#ifdef PAL_STDCPP_COMPAT
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <Windows.h>
+#endif
+
+namespace NewRelic { namespace Profiler
+{
+    //A read-only view of a whole file.  The pages are mapped shared, so every process that maps the same file shares one copy
+    //of it in physical memory.  The view is released when the object is destroyed.
+    class MappedFile
+    {
+    public:
+        //returns nullptr if the file does not exist, is empty or cannot be mapped
+        static std::unique_ptr<MappedFile> TryOpen(const xstring_t& filePath) noexcept
+        {
+            std::unique_ptr<MappedFile> mappedFile(new (std::nothrow) MappedFile());
+            if (mappedFile == nullptr || !mappedFile->Map(filePath))
+            {
+                return nullptr;
+            }
+            return mappedFile;
+        }
+
+        ~MappedFile()
+        {
+#ifdef PAL_STDCPP_COMPAT
+            if (_data != nullptr)
+            {
+                ::munmap(const_cast<uint8_t*>(_data), _size);
+            }
+#else
+            if (_data != nullptr)
+            {
+                ::UnmapViewOfFile(_data);
+            }
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const uint8_t* Data() const noexcept { return _data; }
+        size_t Size() const noexcept { return _size; }
+
+    private:
+        MappedFile() = default;
+
+#ifdef PAL_STDCPP_COMPAT
+        bool Map(const xstring_t& filePath) noexcept
+        {
+            const int fd = ::open(to_pathstring(filePath).c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                return false;
+            }
+
+            struct stat fileStat;
+            if (::fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0)
+            {
+                ::close(fd);
+                return false;
+            }
+
+            //the mapping keeps its own reference to the file, so the descriptor is not needed once it exists
+            auto data = ::mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED)
+            {
+                return false;
+            }
+
+            _data = static_cast<const uint8_t*>(data);
+            _size = static_cast<size_t>(fileStat.st_size);
+            return true;
+        }
+#else
+        bool Map(const xstring_t& filePath) noexcept
+        {
+            auto file = ::CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                return false;
+            }
+
+            LARGE_INTEGER fileSize;
+            if (!::GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0)
+            {
+                ::CloseHandle(file);
+                return false;
+            }
+
+            //the view keeps its own reference to the mapping and the file, so neither handle is needed once it exists
+            auto mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            ::CloseHandle(file);
+            if (mapping == nullptr)
+            {
+                return false;
+            }
+
+            auto data = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            ::CloseHandle(mapping);
+            if (data == nullptr)
+            {
+                return false;
+            }
+
+            _data = static_cast<const uint8_t*>(data);
+            _size = static_cast<size_t>(fileSize.QuadPart);
+            return true;
+        }
+#endif
+
+        const uint8_t* _data = nullptr;
+        size_t _size = 0;
+    };
+}}
@@ -0,0 +1,57 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace NewRelic { namespace Profiler
+{
+    //the profiler only uses a handful of threads at startup so it does not compete with the runtime it is starting
+    static constexpr size_t ParallelForMaxWorkers = 4;
+
+    //Calls work(index) once for every index in [0, count) on a small pool of short lived threads, and returns when every call
+    //has returned.  The calling thread is one of the workers.  Indexes are handed out in order but may complete in any order,
+    //so work should write its result to a slot owned by its index and the caller should merge the slots afterwards.
+    //
+    //work must not throw.  If a thread cannot be created the remaining indexes are processed by the threads that exist.
+    template <typename Work>
+    void ParallelFor(size_t count, Work work)
+    {
+        std::atomic<size_t> next{ 0 };
+        auto worker = [&next, count, &work]()
+        {
+            for (auto index = next++; index < count; index = next++)
+            {
+                work(index);
+            }
+        };
+
+        const auto hardwareThreads = std::max(size_t{ std::thread::hardware_concurrency() }, size_t{ 1 });
+        const auto workerCount = std::min({ count, hardwareThreads, ParallelForMaxWorkers });
+
+        std::vector<std::thread> threads;
+        for (size_t created = 1; created < workerCount; ++created)
+        {
+            try
+            {
+                threads.emplace_back(worker);
+            }
+            catch (...)
+            {
+                break;
+            }
+        }
+
+        worker();
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+}}
@@ -0,0 +1,150 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace NewRelic { namespace Profiler
+{
+    struct ModuleAndMethodID
+    {
+        uintptr_t moduleID;
+        uint32_t methodID;
+
+        ModuleAndMethodID(uintptr_t moduleID, uint32_t methodID) :
+            moduleID(moduleID),
+            methodID(methodID)
+        {}
+
+        bool operator==(const ModuleAndMethodID& other) const
+        {
+            return moduleID == other.moduleID && methodID == other.methodID;
+        }
+
+        bool operator<(const ModuleAndMethodID& other) const
+        {
+            return moduleID < other.moduleID || (moduleID == other.moduleID && methodID < other.methodID);
+        }
+    };
+
+    struct ModuleAndMethodIDHash
+    {
+        size_t operator()(const ModuleAndMethodID& key) const
+        {
+            // module ids are pointers, so their low bits carry little; the method token's row number is in its low bits
+            auto hash = static_cast<uint64_t>(key.moduleID) * 0x9e3779b97f4a7c15ull;
+            hash ^= static_cast<uint64_t>(key.methodID) + (hash >> 29);
+            return static_cast<size_t>(hash ^ (hash >> 32));
+        }
+    };
+
+    // The function ids seen for each method that is waiting to be rejitted, and the methods whose rejit is waiting for a function
+    // id, for FunctionResolver.  A generic method has one function id per instantiation (value type instantiations are not shared)
+    // and every one of them is kept until the rejit takes one, since any of them will do.
+    //
+    // The methods are spread over shards that each have their own lock, so callbacks for different methods rarely wait on each
+    // other, and each shard counts the methods in it that are waiting for a function id so that the check made for every rejit
+    // compilation is a single atomic load when nothing is waiting.
+    class ReJITFunctionTable
+    {
+    public:
+        static const size_t ShardCount = 16;
+
+        // Records one function id of the method.  Returns true if it is the first one recorded since the method was last rejitted,
+        // which is when a rejit needs to be requested; a rejit requested for another instantiation is still on its way otherwise.
+        bool AddFunction(const ModuleAndMethodID& method, uintptr_t functionId)
+        {
+            auto& shard = GetShard(method);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto& entry = shard.methods[method];
+            if (entry.pending)
+            {
+                // the rejit requested for this function id supplies the one that was waited for
+                entry.pending = false;
+                --shard.pendingCount;
+            }
+            if (std::find(entry.functionIds.begin(), entry.functionIds.end(), functionId) == entry.functionIds.end())
+            {
+                entry.functionIds.push_back(functionId);
+            }
+            return entry.functionIds.size() == 1;
+        }
+
+        // Takes a function id of the method for its rejit, and forgets the others.  Returns 0 if none has been recorded, in which
+        // case the method is marked as waiting for one (see TryResolvePending).
+        uintptr_t TakeFunctionOrMarkPending(const ModuleAndMethodID& method)
+        {
+            auto& shard = GetShard(method);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto& entry = shard.methods[method];
+            if (!entry.functionIds.empty())
+            {
+                auto functionId = entry.functionIds.front();
+                if (entry.pending)
+                {
+                    --shard.pendingCount;
+                }
+                shard.methods.erase(method);
+                return functionId;
+            }
+
+            if (!entry.pending)
+            {
+                entry.pending = true;
+                ++shard.pendingCount;
+            }
+            return 0;
+        }
+
+        // If the method is waiting for a function id, records this one and returns true, in which case the caller requests another
+        // rejit.  Only one caller gets true for each time the method was marked as waiting.
+        bool TryResolvePending(const ModuleAndMethodID& method, uintptr_t functionId)
+        {
+            auto& shard = GetShard(method);
+            if (shard.pendingCount.load(std::memory_order_acquire) == 0)
+            {
+                return false;
+            }
+
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto entry = shard.methods.find(method);
+            if (entry == shard.methods.end() || !entry->second.pending)
+            {
+                return false;
+            }
+
+            entry->second.pending = false;
+            --shard.pendingCount;
+            entry->second.functionIds.push_back(functionId);
+            return true;
+        }
+
+    private:
+        struct Entry
+        {
+            std::vector<uintptr_t> functionIds;
+            bool pending = false;
+        };
+
+        struct Shard
+        {
+            std::mutex mutex;
+            std::unordered_map<ModuleAndMethodID, Entry, ModuleAndMethodIDHash> methods;
+            // methods in this shard with pending set; only changed with the mutex held
+            std::atomic<uint32_t> pendingCount{ 0 };
+        };
+
+        Shard& GetShard(const ModuleAndMethodID& method)
+        {
+            return _shards[ModuleAndMethodIDHash()(method) % ShardCount];
+        }
+
+        Shard _shards[ShardCount];
+    };
+}}
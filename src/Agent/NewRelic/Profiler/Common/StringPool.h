@@ -0,0 +1,232 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include "Fnv1a.h"
+#include "xplat.h"
+#include "../Logging/Logger.h"
+
+namespace NewRelic { namespace Profiler
+{
+    //A process wide pool of immutable strings.  Every distinct string is stored once, in an arena that only grows, so a handle to
+    //a pooled string stays valid for the life of the process and two handles are equal exactly when they point at the same entry.
+    //
+    //The pool is meant for configuration strings (assembly, class, method and tracer names) that are read once and compared many
+    //times; it never frees anything, so it must not be used for strings that are created per call.
+    //
+    //Interning takes a lock.  TryFind, which runs for every JIT compiled method, doesn't: the hash table is published through an
+    //atomic pointer, slots are filled with release stores, and growing the table publishes a new one rather than rehashing in place.
+    class StringPool
+    {
+    public:
+        struct Entry
+        {
+            xstring_t value;
+            size_t hash;
+        };
+
+        static StringPool& Global()
+        {
+            static StringPool pool;
+            return pool;
+        }
+
+        static size_t Hash(const xchar_t* chars, size_t length) noexcept
+        {
+            return static_cast<size_t>(Fnv1a::Hash(chars, length));
+        }
+
+        //the entry for the empty string, which is shared by every pool and never needs a lock
+        static const Entry* Empty() noexcept
+        {
+            static const Entry empty{ xstring_t(), Hash(nullptr, 0) };
+            return &empty;
+        }
+
+        const Entry* Intern(const xchar_t* chars, size_t length)
+        {
+            if (length == 0)
+            {
+                return Empty();
+            }
+
+            const auto hash = Hash(chars, length);
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto& table = *_tables.back();
+            auto& slot = table.slots[FindSlot(table, chars, length, hash, std::memory_order_relaxed)];
+            auto existing = slot.load(std::memory_order_relaxed);
+            if (existing != nullptr)
+            {
+                return existing;
+            }
+
+            //the entry is complete before the release store makes it visible to TryFind
+            _entries.push_back(Entry{ xstring_t(chars, length), hash });
+            slot.store(&_entries.back(), std::memory_order_release);
+            if (_entries.size() * 2 > table.size)
+            {
+                Grow();
+            }
+            return &_entries.back();
+        }
+
+        //returns nullptr if the string has never been interned (or is being interned by another thread); never allocates or locks
+        const Entry* TryFind(const xchar_t* chars, size_t length) const noexcept
+        {
+            if (length == 0)
+            {
+                return Empty();
+            }
+
+            const auto hash = Hash(chars, length);
+            auto& table = *_current.load(std::memory_order_acquire);
+            return table.slots[FindSlot(table, chars, length, hash, std::memory_order_acquire)].load(std::memory_order_acquire);
+        }
+
+        size_t Count() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _entries.size();
+        }
+
+        StringPool()
+        {
+            _tables.emplace_back(new SlotTable(InitialSlotCount));
+            _current.store(_tables.back().get(), std::memory_order_release);
+        }
+
+        StringPool(const StringPool&) = delete;
+        StringPool& operator=(const StringPool&) = delete;
+
+    private:
+        static constexpr size_t InitialSlotCount = 1024;
+
+        //open addressing hash table over _entries, never more than half full; slots only ever go from nullptr to an entry
+        struct SlotTable
+        {
+            explicit SlotTable(size_t slotCount) : size(slotCount), slots(new std::atomic<const Entry*>[slotCount])
+            {
+                for (size_t slot = 0; slot != size; ++slot)
+                {
+                    slots[slot].store(nullptr, std::memory_order_relaxed);
+                }
+            }
+
+            size_t size;
+            std::unique_ptr<std::atomic<const Entry*>[]> slots;
+        };
+
+        //the slot that holds the string, or the empty slot where it belongs
+        static size_t FindSlot(const SlotTable& table, const xchar_t* chars, size_t length, size_t hash, std::memory_order order) noexcept
+        {
+            const auto mask = table.size - 1;
+            for (auto slot = hash & mask; ; slot = (slot + 1) & mask)
+            {
+                const auto entry = table.slots[slot].load(order);
+                if (entry == nullptr || (entry->hash == hash && entry->value.compare(0, xstring_t::npos, chars, length) == 0))
+                {
+                    return slot;
+                }
+            }
+        }
+
+        void Grow()
+        {
+            _tables.emplace_back(new SlotTable(_tables.back()->size * 2));
+            auto& table = *_tables.back();
+            const auto mask = table.size - 1;
+            for (auto& entry : _entries)
+            {
+                auto slot = entry.hash & mask;
+                while (table.slots[slot].load(std::memory_order_relaxed) != nullptr)
+                {
+                    slot = (slot + 1) & mask;
+                }
+                table.slots[slot].store(&entry, std::memory_order_relaxed);
+            }
+            _current.store(&table, std::memory_order_release);
+        }
+
+        mutable std::mutex _mutex;
+        //the arena; a deque never moves its elements when it grows
+        std::deque<Entry> _entries;
+        //every table the pool has had, the current one last.  The old ones are kept because a TryFind may still be probing one it
+        //loaded before it was replaced; each is half the size of the next, so together they are smaller than the current one.
+        std::vector<std::unique_ptr<SlotTable>> _tables;
+        std::atomic<SlotTable*> _current;
+    };
+
+    //A handle to a string in the global StringPool.  It is the size of a pointer, copying it never allocates and comparing two
+    //handles is a pointer compare.  It reads like a const xstring_t everywhere else.
+    class InternedString
+    {
+    public:
+        InternedString() noexcept : _entry(StringPool::Empty())
+        {}
+
+        InternedString(const xstring_t& value) : _entry(StringPool::Global().Intern(value.data(), value.size()))
+        {}
+
+        InternedString(const xchar_t* value) : InternedString(xstring_t(value))
+        {}
+
+        //false if the string has never been interned, in which case no handle to it can exist either; never allocates
+        static bool TryFind(const xstring_t& value, InternedString& interned) noexcept
+        {
+            auto entry = StringPool::Global().TryFind(value.data(), value.size());
+            if (entry == nullptr)
+            {
+                return false;
+            }
+            interned._entry = entry;
+            return true;
+        }
+
+        const xstring_t& str() const noexcept { return _entry->value; }
+        operator const xstring_t&() const noexcept { return _entry->value; }
+        const xchar_t* c_str() const noexcept { return _entry->value.c_str(); }
+        size_t size() const noexcept { return _entry->value.size(); }
+        bool empty() const noexcept { return _entry->value.empty(); }
+        size_t Hash() const noexcept { return _entry->hash; }
+        //a stable identity for ordering and hashing handles; not related to the order of the strings
+        const void* Id() const noexcept { return _entry; }
+
+        bool operator==(const InternedString& other) const noexcept { return _entry == other._entry; }
+        bool operator!=(const InternedString& other) const noexcept { return _entry != other._entry; }
+
+    private:
+        const StringPool::Entry* _entry;
+    };
+
+    inline bool operator==(const InternedString& left, const xstring_t& right) { return left.str() == right; }
+    inline bool operator==(const xstring_t& left, const InternedString& right) { return left == right.str(); }
+    inline bool operator!=(const InternedString& left, const xstring_t& right) { return left.str() != right; }
+    inline bool operator!=(const xstring_t& left, const InternedString& right) { return left != right.str(); }
+    inline bool operator==(const InternedString& left, const xchar_t* right) { return left.str() == right; }
+    inline bool operator==(const xchar_t* left, const InternedString& right) { return left == right.str(); }
+    inline bool operator!=(const InternedString& left, const xchar_t* right) { return left.str() != right; }
+    inline bool operator!=(const xchar_t* left, const InternedString& right) { return left != right.str(); }
+
+    inline xstring_t operator+(const xstring_t& left, const InternedString& right) { return left + right.str(); }
+    inline xstring_t operator+(const xchar_t* left, const InternedString& right) { return left + right.str(); }
+    inline xstring_t operator+(const InternedString& left, const xstring_t& right) { return left.str() + right; }
+    inline xstring_t operator+(const InternedString& left, const xchar_t* right) { return left.str() + right; }
+
+    inline std::wostream& operator<<(std::wostream& stream, const InternedString& value)
+    {
+#ifdef PAL_STDCPP_COMPAT
+        return ::operator<<(stream, value.str());
+#else
+        return stream << value.str();
+#endif
+    }
+}}
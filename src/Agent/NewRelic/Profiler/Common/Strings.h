@@ -5,6 +5,7 @@
 #pragma once
 #include <string>
 #include <algorithm>
+#include <stdint.h>
 #include "xplat.h"
 
 namespace NewRelic { namespace Profiler
@@ -69,5 +70,59 @@ namespace NewRelic { namespace Profiler
             return source;
         }
 
+        // Appends the UTF-8 encoding of the UTF-16 code units in [source, source + length) to destination.
+        // Unpaired surrogates are replaced with U+FFFD.
+        static void AppendUtf8(std::string& destination, const xchar_t* source, size_t length)
+        {
+            for (size_t i = 0; i < length; ++i)
+            {
+                uint32_t codePoint = static_cast<uint16_t>(source[i]);
+                if (codePoint >= 0xD800 && codePoint <= 0xDBFF && (i + 1) < length)
+                {
+                    const uint32_t low = static_cast<uint16_t>(source[i + 1]);
+                    if (low >= 0xDC00 && low <= 0xDFFF)
+                    {
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                        ++i;
+                    }
+                }
+                if (codePoint >= 0xD800 && codePoint <= 0xDFFF)
+                {
+                    codePoint = 0xFFFD;
+                }
+
+                if (codePoint < 0x80)
+                {
+                    destination.push_back(static_cast<char>(codePoint));
+                }
+                else if (codePoint < 0x800)
+                {
+                    destination.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+                    destination.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+                }
+                else if (codePoint < 0x10000)
+                {
+                    destination.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+                    destination.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+                    destination.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+                }
+                else
+                {
+                    destination.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+                    destination.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+                    destination.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+                    destination.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+                }
+            }
+        }
+
+        static std::string ToUtf8(const xstring_t& source)
+        {
+            std::string result;
+            result.reserve(source.size());
+            AppendUtf8(result, source.data(), source.size());
+            return result;
+        }
+
     };
 }}
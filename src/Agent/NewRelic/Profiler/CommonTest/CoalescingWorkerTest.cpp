@@ -0,0 +1,75 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stdafx.h"
+#include <atomic>
+#include <vector>
+#include "CppUnitTest.h"
+#include "../Common/CoalescingWorker.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic {
+    namespace Profiler {
+        namespace Common
+        {
+            TEST_CLASS(CoalescingWorkerTest)
+            {
+            public:
+                TEST_METHOD(posted_request_runs_and_completes)
+                {
+                    std::atomic<int> runs(0);
+                    CoalescingWorker<int> worker([&](int request, uint64_t) { runs += request; }, [](int, int latest) { return latest; });
+
+                    auto ticket = worker.Post(5);
+                    Assert::AreEqual(uint64_t(1), ticket);
+                    Assert::IsTrue(worker.WaitForCompletion(ticket, std::chrono::seconds(10)));
+                    Assert::IsTrue(worker.GetState(ticket) == CoalescingWorkState::Completed);
+                    Assert::AreEqual(5, runs.load());
+                }
+
+                TEST_METHOD(unknown_tickets_are_reported_as_unknown)
+                {
+                    CoalescingWorker<int> worker([](int, uint64_t) {}, [](int, int latest) { return latest; });
+                    Assert::IsTrue(worker.GetState(0) == CoalescingWorkState::Unknown);
+                    Assert::IsTrue(worker.GetState(1) == CoalescingWorkState::Unknown);
+                }
+
+                TEST_METHOD(requests_posted_while_one_runs_are_coalesced)
+                {
+                    std::mutex gate;
+                    std::unique_lock<std::mutex> hold(gate);
+                    std::vector<int> handled;
+                    CoalescingWorker<int> worker(
+                        [&](int request, uint64_t) { std::lock_guard<std::mutex> wait(gate); handled.push_back(request); },
+                        [](int pending, int latest) { return pending | latest; });
+
+                    auto first = worker.Post(1);
+                    while (worker.GetState(first) != CoalescingWorkState::Running)
+                    {
+                        std::this_thread::yield();
+                    }
+
+                    auto second = worker.Post(2);
+                    auto third = worker.Post(4);
+                    Assert::IsTrue(worker.GetState(second) == CoalescingWorkState::Queued);
+                    Assert::IsTrue(worker.GetState(third) == CoalescingWorkState::Queued);
+
+                    hold.unlock();
+                    Assert::IsTrue(worker.WaitForCompletion(third, std::chrono::seconds(10)));
+                    Assert::IsTrue(worker.GetState(second) == CoalescingWorkState::Completed);
+                    Assert::AreEqual(size_t(2), handled.size());
+                    Assert::AreEqual(1, handled[0]);
+                    Assert::AreEqual(6, handled[1]);
+                }
+
+                TEST_METHOD(stopped_worker_does_not_accept_requests)
+                {
+                    CoalescingWorker<int> worker([](int, uint64_t) {}, [](int, int latest) { return latest; });
+                    worker.Stop();
+                    Assert::AreEqual(uint64_t(0), worker.Post(1));
+                }
+            };
+        }
+    }
+}
@@ -0,0 +1,56 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "../Common/Fnv1a.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic {
+    namespace Profiler {
+        namespace Common
+        {
+            TEST_CLASS(Fnv1aTest)
+            {
+            public:
+                TEST_METHOD(hashes_match_the_published_test_vectors)
+                {
+                    const uint8_t bytes[] = { 'f', 'o', 'o', 'b', 'a', 'r' };
+                    Assert::AreEqual(uint64_t(Fnv1a::OffsetBasis), Fnv1a::HashBytes(bytes, 0));
+                    Assert::AreEqual(uint64_t(0xaf63dc4c8601ec8cull), Fnv1a::HashBytes(bytes + 4, 1));
+                    Assert::AreEqual(uint64_t(0x85944171f73967e8ull), Fnv1a::HashBytes(bytes, sizeof(bytes)));
+                    Assert::AreEqual(uint32_t(0xe40c292cu), Fnv1a::HashBytes32(bytes + 4, 1));
+                    Assert::AreEqual(uint32_t(0xbf9cf968u), Fnv1a::HashBytes32(bytes, sizeof(bytes)));
+                }
+
+                TEST_METHOD(strings_of_ascii_characters_hash_like_their_bytes)
+                {
+                    const uint8_t bytes[] = { 'f', 'o', 'o', 'b', 'a', 'r' };
+                    Assert::AreEqual(Fnv1a::HashBytes(bytes, sizeof(bytes)), Fnv1a::Hash(xstring_t(_X("foobar"))));
+                }
+
+                TEST_METHOD(hashes_continue_from_a_previous_hash)
+                {
+                    const auto whole = Fnv1a::Hash(xstring_t(_X("foobar")));
+                    Assert::AreEqual(whole, Fnv1a::Hash(xstring_t(_X("bar")), Fnv1a::Hash(xstring_t(_X("foo")))));
+                }
+
+                TEST_METHOD(case_folded_hashes_ignore_case)
+                {
+                    Assert::AreEqual(Fnv1a::HashCaseFolded(_X("System.Web")), Fnv1a::HashCaseFolded(_X("SYSTEM.WEB")));
+                    Assert::AreNotEqual(Fnv1a::HashCaseFolded(_X("System.Web")), Fnv1a::HashCaseFolded(_X("System.Net")));
+                    Assert::AreNotEqual(Fnv1a::Hash(xstring_t(_X("System.Web"))), Fnv1a::Hash(xstring_t(_X("SYSTEM.WEB"))));
+                }
+
+                TEST_METHOD(hasher_separates_the_values_it_adds)
+                {
+                    Assert::AreEqual(Fnv1aHasher().Add(xstring_t(_X("ab"))).Add(true).Get(), Fnv1aHasher().Add(xstring_t(_X("ab"))).Add(true).Get());
+                    Assert::AreNotEqual(Fnv1aHasher().Add(xstring_t(_X("ab"))).Add(xstring_t(_X("c"))).Get(), Fnv1aHasher().Add(xstring_t(_X("a"))).Add(xstring_t(_X("bc"))).Get());
+                    Assert::AreNotEqual(Fnv1aHasher().Add(true).Get(), Fnv1aHasher().Add(false).Get());
+                    Assert::AreNotEqual(Fnv1aHasher().Add(uint64_t(1)).Get(), Fnv1aHasher().Add(uint64_t(2)).Get());
+                }
+            };
+        }
+    }
+}
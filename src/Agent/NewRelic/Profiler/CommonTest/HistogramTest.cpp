@@ -0,0 +1,71 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "../Common/Histogram.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic {
+    namespace Profiler {
+        namespace Common
+        {
+            TEST_CLASS(HistogramTest)
+            {
+            public:
+                TEST_METHOD(histogram_small_values_have_their_own_bucket)
+                {
+                    for (uint64_t value = 0; value != 2 * Histogram::SubBucketCount; ++value)
+                    {
+                        Assert::AreEqual(value, Histogram::BucketLowerBound(Histogram::BucketIndex(value)));
+                    }
+                }
+
+                TEST_METHOD(histogram_bucket_lower_bound_is_within_relative_error)
+                {
+                    for (uint64_t value = 1; value < Histogram::MaxValue; value = value * 3 + 1)
+                    {
+                        const auto lowerBound = Histogram::BucketLowerBound(Histogram::BucketIndex(value));
+                        Assert::IsTrue(lowerBound <= value);
+                        Assert::IsTrue((value - lowerBound) * Histogram::SubBucketCount <= value);
+                    }
+                }
+
+                TEST_METHOD(histogram_bucket_indexes_are_contiguous)
+                {
+                    for (uint32_t index = 0; index != Histogram::BucketCount; ++index)
+                    {
+                        Assert::AreEqual(index, Histogram::BucketIndex(Histogram::BucketLowerBound(index)));
+                    }
+                }
+
+                TEST_METHOD(histogram_values_above_max_go_in_last_bucket)
+                {
+                    Assert::AreEqual(Histogram::BucketCount - 1, Histogram::BucketIndex(UINT64_MAX));
+                }
+
+                TEST_METHOD(histogram_harvest_returns_and_resets_counters)
+                {
+                    Histogram histogram;
+                    histogram.Record(3);
+                    histogram.Record(3);
+                    histogram.Record(1000);
+
+                    Histogram::Snapshot snapshot;
+                    histogram.Harvest(snapshot);
+                    Assert::AreEqual(uint64_t(3), snapshot.count);
+                    Assert::AreEqual(uint64_t(1006), snapshot.sum);
+                    Assert::AreEqual(uint64_t(1000), snapshot.max);
+                    Assert::AreEqual(uint64_t(2), snapshot.buckets[3]);
+                    Assert::AreEqual(uint64_t(1), snapshot.buckets[Histogram::BucketIndex(1000)]);
+
+                    histogram.Harvest(snapshot);
+                    Assert::AreEqual(uint64_t(0), snapshot.count);
+                    Assert::AreEqual(uint64_t(0), snapshot.sum);
+                    Assert::AreEqual(uint64_t(0), snapshot.max);
+                }
+            };
+        }
+    }
+}
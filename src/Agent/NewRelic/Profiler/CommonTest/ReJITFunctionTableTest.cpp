@@ -0,0 +1,121 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stdafx.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "CppUnitTest.h"
+#include "../Common/ReJITFunctionTable.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic {
+    namespace Profiler {
+        namespace Common
+        {
+            TEST_CLASS(ReJITFunctionTableTest)
+            {
+            public:
+                TEST_METHOD(module_and_method_id_ordering_is_a_strict_weak_ordering)
+                {
+                    ModuleAndMethodID first(1, 5);
+                    ModuleAndMethodID second(2, 1);
+                    Assert::IsTrue(first < second);
+                    Assert::IsFalse(second < first);
+                    Assert::IsFalse(first < first);
+                    Assert::IsTrue(ModuleAndMethodID(1, 1) < first);
+                }
+
+                TEST_METHOD(only_the_first_instantiation_requests_a_rejit)
+                {
+                    ReJITFunctionTable table;
+                    ModuleAndMethodID method(1, 2);
+                    Assert::IsTrue(table.AddFunction(method, 10));
+                    Assert::IsFalse(table.AddFunction(method, 11));
+                    Assert::IsFalse(table.AddFunction(method, 10));
+                    Assert::IsTrue(table.AddFunction(ModuleAndMethodID(2, 2), 20));
+                }
+
+                TEST_METHOD(taking_a_function_forgets_the_method)
+                {
+                    ReJITFunctionTable table;
+                    ModuleAndMethodID method(1, 2);
+                    table.AddFunction(method, 10);
+                    table.AddFunction(method, 11);
+                    Assert::AreEqual(uintptr_t(10), table.TakeFunctionOrMarkPending(method));
+                    Assert::IsTrue(table.AddFunction(method, 11));
+                }
+
+                TEST_METHOD(pending_method_is_resolved_once)
+                {
+                    ReJITFunctionTable table;
+                    ModuleAndMethodID method(1, 2);
+                    Assert::IsFalse(table.TryResolvePending(method, 10));
+                    Assert::AreEqual(uintptr_t(0), table.TakeFunctionOrMarkPending(method));
+                    Assert::IsFalse(table.TryResolvePending(ModuleAndMethodID(1, 3), 10));
+                    Assert::IsTrue(table.TryResolvePending(method, 10));
+                    Assert::IsFalse(table.TryResolvePending(method, 11));
+                    Assert::AreEqual(uintptr_t(10), table.TakeFunctionOrMarkPending(method));
+                }
+
+                TEST_METHOD(adding_a_function_resolves_a_pending_method)
+                {
+                    ReJITFunctionTable table;
+                    ModuleAndMethodID method(1, 2);
+                    table.TakeFunctionOrMarkPending(method);
+                    Assert::IsTrue(table.AddFunction(method, 10));
+                    Assert::IsFalse(table.TryResolvePending(method, 11));
+                }
+
+                // Every instantiation of every method is seen from several threads at once, the way JIT callbacks arrive.  Exactly one
+                // rejit must be requested per method; a resolver keyed by function id requested one per instantiation.
+                TEST_METHOD(concurrent_instantiations_request_one_rejit_per_method)
+                {
+                    const uint32_t methodCount = 2000;
+                    const uintptr_t instantiationCount = 8;
+                    const int threadCount = 8;
+                    ReJITFunctionTable table;
+                    std::atomic<uint32_t> rejitRequests(0);
+
+                    std::vector<std::thread> threads;
+                    for (int thread = 0; thread < threadCount; ++thread)
+                    {
+                        threads.emplace_back([&, thread]()
+                        {
+                            for (uint32_t method = 0; method < methodCount; ++method)
+                            {
+                                // pairs of methods with the same token in different modules
+                                ModuleAndMethodID key(0x1000 + (method % 2) * 0x10, method / 2);
+                                for (uintptr_t instantiation = 0; instantiation < instantiationCount; ++instantiation)
+                                {
+                                    auto functionId = (method + 1) * 100 + (instantiation + thread) % instantiationCount;
+                                    if (table.AddFunction(key, functionId))
+                                    {
+                                        ++rejitRequests;
+                                    }
+                                    if (table.TryResolvePending(key, functionId))
+                                    {
+                                        ++rejitRequests;
+                                    }
+                                }
+                            }
+                        });
+                    }
+                    for (auto& thread : threads)
+                    {
+                        thread.join();
+                    }
+
+                    Assert::AreEqual(methodCount, rejitRequests.load());
+                    for (uint32_t method = 0; method < methodCount; ++method)
+                    {
+                        ModuleAndMethodID key(0x1000 + (method % 2) * 0x10, method / 2);
+                        auto functionId = table.TakeFunctionOrMarkPending(key);
+                        Assert::IsTrue(functionId / 100 == method + 1);
+                    }
+                }
+            };
+        }
+    }
+}
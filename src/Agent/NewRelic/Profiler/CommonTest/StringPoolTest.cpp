@@ -0,0 +1,151 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stdafx.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "CppUnitTest.h"
+#include "../Common/StringPool.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic {
+    namespace Profiler {
+        namespace Common
+        {
+            TEST_CLASS(StringPoolTest)
+            {
+            public:
+                TEST_METHOD(equal_strings_share_one_entry)
+                {
+                    InternedString first(xstring_t(_X("System.Data.SqlClient")));
+                    InternedString second(_X("System.Data.SqlClient"));
+                    Assert::IsTrue(first == second);
+                    Assert::IsTrue(first.Id() == second.Id());
+                    Assert::IsTrue(first.c_str() == second.c_str());
+                }
+
+                TEST_METHOD(different_strings_have_different_entries)
+                {
+                    InternedString first(_X("ExecuteReader"));
+                    InternedString second(_X("executereader"));
+                    Assert::IsFalse(first == second);
+                    Assert::IsTrue(first.str() == _X("ExecuteReader"));
+                    Assert::IsTrue(second.str() == _X("executereader"));
+                }
+
+                TEST_METHOD(empty_string_is_the_default)
+                {
+                    InternedString defaulted;
+                    InternedString empty(_X(""));
+                    Assert::IsTrue(defaulted == empty);
+                    Assert::IsTrue(defaulted.empty());
+                    Assert::AreEqual(size_t(0), defaulted.size());
+                }
+
+                TEST_METHOD(try_find_only_finds_interned_strings)
+                {
+                    InternedString interned(_X("StringPoolTest.try_find_only_finds_interned_strings"));
+
+                    InternedString found;
+                    Assert::IsTrue(InternedString::TryFind(xstring_t(_X("StringPoolTest.try_find_only_finds_interned_strings")), found));
+                    Assert::IsTrue(found == interned);
+
+                    const auto count = StringPool::Global().Count();
+                    Assert::IsFalse(InternedString::TryFind(xstring_t(_X("StringPoolTest.never_interned")), found));
+                    Assert::AreEqual(count, StringPool::Global().Count());
+                }
+
+                TEST_METHOD(entries_survive_the_table_growing)
+                {
+                    StringPool pool;
+                    std::vector<const StringPool::Entry*> entries;
+                    for (uint32_t index = 0; index != 5000; ++index)
+                    {
+                        const auto value = to_xstring(index);
+                        entries.push_back(pool.Intern(value.data(), value.size()));
+                    }
+
+                    Assert::AreEqual(size_t(5000), pool.Count());
+                    for (uint32_t index = 0; index != 5000; ++index)
+                    {
+                        const auto value = to_xstring(index);
+                        Assert::IsTrue(entries[index] == pool.Intern(value.data(), value.size()));
+                        Assert::IsTrue(entries[index]->value == value);
+                    }
+                }
+
+                TEST_METHOD(concurrent_interning_yields_one_entry_per_string)
+                {
+                    StringPool pool;
+                    std::vector<std::vector<const StringPool::Entry*>> results(4);
+                    std::vector<std::thread> threads;
+                    for (size_t thread = 0; thread != results.size(); ++thread)
+                    {
+                        threads.emplace_back([&pool, &results, thread]()
+                        {
+                            for (uint32_t index = 0; index != 1000; ++index)
+                            {
+                                const auto value = to_xstring(index);
+                                results[thread].push_back(pool.Intern(value.data(), value.size()));
+                            }
+                        });
+                    }
+                    for (auto& thread : threads)
+                    {
+                        thread.join();
+                    }
+
+                    Assert::AreEqual(size_t(1000), pool.Count());
+                    for (size_t thread = 1; thread != results.size(); ++thread)
+                    {
+                        Assert::IsTrue(results[0] == results[thread]);
+                    }
+                }
+
+                TEST_METHOD(try_find_finds_interned_strings_while_the_table_grows)
+                {
+                    StringPool pool;
+                    std::vector<const StringPool::Entry*> entries;
+                    for (uint32_t index = 0; index != 100; ++index)
+                    {
+                        const auto value = to_xstring(index);
+                        entries.push_back(pool.Intern(value.data(), value.size()));
+                    }
+
+                    std::atomic<bool> interning(true);
+                    std::thread interner([&pool, &interning]()
+                    {
+                        for (uint32_t index = 100; index != 20000; ++index)
+                        {
+                            const auto value = to_xstring(index);
+                            pool.Intern(value.data(), value.size());
+                        }
+                        interning = false;
+                    });
+
+                    bool allFound = true;
+                    do
+                    {
+                        for (uint32_t index = 0; index != 100; ++index)
+                        {
+                            const auto value = to_xstring(index);
+                            allFound = allFound && pool.TryFind(value.data(), value.size()) == entries[index];
+                        }
+                    } while (interning);
+                    interner.join();
+
+                    Assert::IsTrue(allFound);
+                    Assert::AreEqual(size_t(20000), pool.Count());
+                }
+
+                TEST_METHOD(interned_strings_concatenate_like_strings)
+                {
+                    InternedString className(_X("MyNamespace.MyClass"));
+                    Assert::IsTrue((xstring_t(_X("[MyAssembly]")) + className + _X(".MyMethod")) == _X("[MyAssembly]MyNamespace.MyClass.MyMethod"));
+                }
+            };
+        }
+    }
+}
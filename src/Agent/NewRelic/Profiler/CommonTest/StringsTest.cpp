@@ -55,6 +55,22 @@ namespace NewRelic {
                 {
                     Assert::IsFalse(Strings::AreEqualCaseInsensitive(L"tester", L"TeSted"));
                 }
+
+                TEST_METHOD(strings_ToUtf8_ascii)
+                {
+                    Assert::AreEqual(std::string("System.Threading.Monitor.Wait"), Strings::ToUtf8(L"System.Threading.Monitor.Wait"));
+                }
+
+                TEST_METHOD(strings_ToUtf8_multibyte)
+                {
+                    // U+00E9, U+20AC and U+1F600 (surrogate pair) encode to 2, 3 and 4 bytes respectively
+                    Assert::AreEqual(std::string("\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80"), Strings::ToUtf8(L"\x00E9\x20AC\xD83D\xDE00"));
+                }
+
+                TEST_METHOD(strings_ToUtf8_unpaired_surrogate_is_replaced)
+                {
+                    Assert::AreEqual(std::string("a\xEF\xBF\xBD" "b"), Strings::ToUtf8(L"a\xD83D" L"b"));
+                }
             };
         }
     }
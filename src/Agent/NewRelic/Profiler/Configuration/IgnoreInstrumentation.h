@@ -6,8 +6,11 @@
 #pragma once
 
 #include "Strings.h"
+#include "../Common/Fnv1a.h"
+#include <stdint.h>
 #include <memory>
 #include <list>
+#include <unordered_map>
 
 namespace NewRelic { namespace Profiler { namespace Configuration
 {
@@ -49,6 +52,32 @@ namespace NewRelic { namespace Profiler { namespace Configuration
                 return false;
             }
 
+            // true if both lists have the same entries in the same order; a missing list is the same as an empty one
+            static bool AreEqual(IgnoreInstrumentationListPtr left, IgnoreInstrumentationListPtr right)
+            {
+                auto leftSize = left == nullptr ? 0 : left->size();
+                auto rightSize = right == nullptr ? 0 : right->size();
+                if (leftSize != rightSize)
+                {
+                    return false;
+                }
+                if (leftSize == 0)
+                {
+                    return true;
+                }
+                auto rightItem = right->begin();
+                for (IgnoreInstrumentationPtr leftItem : *left)
+                {
+                    if (!Strings::AreEqualCaseInsensitive(leftItem->AssemblyName, (*rightItem)->AssemblyName) ||
+                        !Strings::AreEqualCaseInsensitive(leftItem->ClassName, (*rightItem)->ClassName))
+                    {
+                        return false;
+                    }
+                    ++rightItem;
+                }
+                return true;
+            }
+
         private:
             bool Matches(xstring_t assembly, xstring_t className)
             {
@@ -64,4 +93,84 @@ namespace NewRelic { namespace Profiler { namespace Configuration
             }
     };
 
+    // The ignore list compiled into two hash tables, one of assembly-only entries and one of (assembly, class) entries, so that
+    // checking a name costs the same however long the list is.  Names are hashed case-folded the same way
+    // Strings::AreEqualCaseInsensitive compares them, and a hash hit is confirmed with that compare, so this matches exactly what
+    // IgnoreInstrumentation::Matches matches.  It is immutable once built.
+    class IgnoreInstrumentationMatcher
+    {
+        public:
+            IgnoreInstrumentationMatcher(IgnoreInstrumentationListPtr list) :
+                _list(list)
+            {
+                if (list == nullptr)
+                {
+                    return;
+                }
+                for (auto& item : *list)
+                {
+                    if (item->ClassName.empty())
+                    {
+                        _assemblies.emplace(Hash(item->AssemblyName), item);
+                    }
+                    else
+                    {
+                        _classes.emplace(Hash(item->AssemblyName, item->ClassName), item);
+                    }
+                }
+            }
+
+            IgnoreInstrumentationListPtr GetList() const
+            {
+                return _list;
+            }
+
+            // never allocates
+            bool Matches(const xstring_t& assembly, const xstring_t& className) const noexcept
+            {
+                auto assemblies = _assemblies.equal_range(Hash(assembly));
+                for (auto item = assemblies.first; item != assemblies.second; ++item)
+                {
+                    if (Strings::AreEqualCaseInsensitive(item->second->AssemblyName, assembly))
+                    {
+                        return true;
+                    }
+                }
+
+                if (_classes.empty())
+                {
+                    return false;
+                }
+
+                auto classes = _classes.equal_range(Hash(assembly, className));
+                for (auto item = classes.first; item != classes.second; ++item)
+                {
+                    if (Strings::AreEqualCaseInsensitive(item->second->AssemblyName, assembly) &&
+                        Strings::AreEqualCaseInsensitive(item->second->ClassName, className))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+        private:
+            // case folded so that names AreEqualCaseInsensitive finds equal hash the same
+            static size_t Hash(const xstring_t& assembly) noexcept
+            {
+                return static_cast<size_t>(Fnv1a::HashCaseFolded(assembly));
+            }
+
+            static size_t Hash(const xstring_t& assembly, const xstring_t& className) noexcept
+            {
+                // fold in a separator so that ("ab", "c") and ("a", "bc") hash differently
+                auto hash = Fnv1a::Mix(Fnv1a::HashCaseFolded(assembly), 0x100);
+                return static_cast<size_t>(Fnv1a::HashCaseFolded(className, hash));
+            }
+
+            IgnoreInstrumentationListPtr _list;
+            std::unordered_multimap<size_t, IgnoreInstrumentationPtr> _assemblies;
+            std::unordered_multimap<size_t, IgnoreInstrumentationPtr> _classes;
+    };
+
 } } }
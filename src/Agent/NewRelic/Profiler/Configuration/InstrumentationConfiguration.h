@@ -6,13 +6,17 @@
 #include <memory>
 #include <string>
 #include <map>
+#include <vector>
 #include "../Logging/Logger.h"
 #include "InstrumentationPoint.h"
+#include "InstrumentationPatternMatcher.h"
 #include "TracerFlags.h"
 #include "../MethodRewriter/IFunction.h"
 #include "../SignatureParser/SignatureParser.h"
+#include "../SignatureParser/FlatSignature.h"
 #include "../RapidXML/rapidxml.hpp"
 #include "../Common/AssemblyVersion.h"
+#include "../Common/ParallelFor.h"
 #include "IgnoreInstrumentation.h"
 #include "../Configuration/Strings.h"
 #include "../Logging/DefaultFileLogLocation.h"
@@ -28,40 +32,59 @@ namespace NewRelic { namespace Profiler { namespace Configuration
     public:
         InstrumentationConfiguration(InstrumentationXmlSetPtr instrumentationXmls, IgnoreInstrumentationListPtr ignoreList, std::shared_ptr<NewRelic::Profiler::Logger::IFileDestinationSystemCalls> systemCalls = nullptr) :
             _instrumentationPointsSet(new InstrumentationPointSet())
-            , _ignoreList(ignoreList)
+            , _ignoreMatcher(ignoreList)
             , _systemCalls(systemCalls)
             , _foundServerlessInstrumentationPoint(false)
         {
-            // pull instrumentation points from every xml string
-            for (auto instrumentationXml : *instrumentationXmls)
+            // parse every xml string on a small worker pool, each into its own slot, then merge the slots in file name order so the
+            // resulting collections are the same as if the files had been parsed one after another; the workers don't log, each file's
+            // warnings are kept in its slot and logged here, in order and with the file's name
+            std::vector<const InstrumentationXmlSet::value_type*> instrumentationXmlFiles;
+            for (auto& instrumentationXml : *instrumentationXmls)
             {
-                try
+                if (InstrumentationXmlIsDeprecated(instrumentationXml.first))
                 {
-                    if (InstrumentationXmlIsDeprecated(instrumentationXml.first))
-                    {
-                        LogWarn("Deprecated instrumentation file being ignored: ", instrumentationXml.first);
-                    }
-                    else
-                    {
-                        LogDebug(L"Parsing instrumentation file '", instrumentationXml.first);
-                        GetInstrumentationPoints(instrumentationXml.second);
-                    }                    
+                    LogWarn("Deprecated instrumentation file being ignored: ", instrumentationXml.first);
+                }
+                else
+                {
+                    instrumentationXmlFiles.push_back(&instrumentationXml);
+                }
+            }
+
+            std::vector<ParsedInstrumentationFile> parsedFiles(instrumentationXmlFiles.size());
+            ParallelFor(instrumentationXmlFiles.size(), [&instrumentationXmlFiles, &parsedFiles](size_t index)
+            {
+                parsedFiles[index] = ParseInstrumentationFile(*instrumentationXmlFiles[index]);
+            });
+
+            for (size_t index = 0; index < parsedFiles.size(); ++index)
+            {
+                const auto& fileName = instrumentationXmlFiles[index]->first;
+                LogDebug(L"Parsing instrumentation file '", fileName, L"'");
+                for (auto& warning : parsedFiles[index].warnings)
+                {
+                    LogWarn(L"In instrumentation file '", fileName, L"': ", warning);
                 }
-                catch (...)
+
+                for (auto& instrumentationPoint : parsedFiles[index].instrumentationPoints)
+                {
+                    AddInstrumentationPointToCollectionsIfNotIgnored(instrumentationPoint);
+                }
+
+                if (!parsedFiles[index].valid)
                 {
                     _invalidFileCount++;
-                    // if an exception is thrown while parsing a file just move on to the next one
-                    LogWarn(L"Exception thrown while attempting to parse instrumentation file '", instrumentationXml.first, L"'. Please validate your instrumentation files against extensions/extension.xsd or contact New Relic support.");
-                    continue;
+                    LogWarn(L"Exception thrown while attempting to parse instrumentation file '", fileName, L"'. Please validate your instrumentation files against extensions/extension.xsd or contact New Relic support.");
                 }
             }
             LogInfo("Identified ", _instrumentationPointsSet->size(), " Instrumentation points (not ignored) in .xml files");
         }
 
-        InstrumentationConfiguration(InstrumentationPointSetPtr instrumentationPoints, IgnoreInstrumentationListPtr ignoreList) :
+        InstrumentationConfiguration(InstrumentationPointSetPtr instrumentationPoints, IgnoreInstrumentationListPtr ignoreList, std::shared_ptr<NewRelic::Profiler::Logger::IFileDestinationSystemCalls> systemCalls = nullptr) :
             _instrumentationPointsSet(new InstrumentationPointSet())
-            , _ignoreList(ignoreList)
-            , _systemCalls(nullptr)
+            , _ignoreMatcher(ignoreList)
+            , _systemCalls(systemCalls)
             , _foundServerlessInstrumentationPoint(false)
         {
             for (auto instrumentationPoint : *instrumentationPoints)
@@ -82,14 +105,62 @@ namespace NewRelic { namespace Profiler { namespace Configuration
 
         IgnoreInstrumentationListPtr GetIgnoreList() const
         {
-            return _ignoreList;
+            return _ignoreMatcher.GetList();
+        }
+
+        // true if the ignore list in newrelic.config excludes the class (or its whole assembly) from instrumentation; never allocates
+        bool IsIgnored(const xstring_t& assemblyName, const xstring_t& className) const noexcept
+        {
+            return _ignoreMatcher.Matches(assemblyName, className);
+        }
+
+        // true if any instrumentation point has a wildcard in its class or method name (see InstrumentationPatternMatcher)
+        bool HasPatterns() const
+        {
+            return !_patternMatcher.IsEmpty();
+        }
+
+        // true if any point, exact or wildcard, instruments some overload of the method
+        bool HasInstrumentationPoints(const xstring_t& assemblyName, const xstring_t& className, const xstring_t& methodName) const
+        {
+            InstrumentationPointKey key;
+            if (InstrumentationPoint::TryGetKey(assemblyName, className, methodName, nullptr, key) &&
+                (_parameterizedNames.find(key) != _parameterizedNames.end() || _instrumentationPointsMap->find(key) != _instrumentationPointsMap->end()))
+            {
+                return true;
+            }
+            return !_patternMatcher.IsEmpty() && !IsIgnored(assemblyName, className) && _patternMatcher.MatchesNames(assemblyName, className, methodName);
         }
 
         InstrumentationPointPtr TryGetInstrumentationPoint(const MethodRewriter::IFunctionPtr function) const
         {
-            const auto methodSignature = SignatureParser::SignatureParser::ParseMethodSignature(function->GetSignature()->begin(), function->GetSignature()->end());
-            const auto params = methodSignature->ToString(function->GetTokenResolver());
-            const auto instPoints = TryGetInstrumentationPoints(function->GetAssemblyName(), function->GetTypeName(), function->GetFunctionName(), params);
+            // the signature is only parsed and printed when a point for this method's name depends on its parameters, and then only
+            // once, into buffers each thread reuses from one method to the next
+            thread_local SignatureParser::FlatSignature methodSignature;
+            thread_local xstring_t parameters;
+            bool hasParameters = false;
+            const auto getParameters = [&function, &hasParameters]() -> const xstring_t&
+            {
+                if (hasParameters)
+                {
+                    return parameters;
+                }
+
+                const auto signature = function->GetSignature();
+                if (!methodSignature.TryParse(*signature))
+                {
+                    // the tree parser logs what is wrong with the signature and throws
+                    parameters = SignatureParser::SignatureParser::ParseMethodSignature(signature->begin(), signature->end())->ToString(function->GetTokenResolver());
+                }
+                else
+                {
+                    parameters.clear();
+                    methodSignature.AppendParameters(*function->GetTokenResolver(), parameters);
+                }
+                hasParameters = true;
+                return parameters;
+            };
+            const auto instPoints = TryGetInstrumentationPoints(function->GetAssemblyName(), function->GetTypeName(), function->GetFunctionName(), getParameters);
 
             if (instPoints.empty())
             {
@@ -171,13 +242,38 @@ namespace NewRelic { namespace Profiler { namespace Configuration
             instrumentationPoint->Parameters = nullptr;
             instrumentationPoint->TracerFactoryArgs = 0;
 
-            (*_instrumentationPointsMap)[instrumentationPoint->GetMatchKey()].insert(instrumentationPoint);
+            AddInstrumentationPointToMap(instrumentationPoint);
             _instrumentationPointsSet->insert(instrumentationPoint);
 
             return true;
         }
 
     private:
+        // the result of parsing a single instrumentation file, before the ignore list is applied
+        struct ParsedInstrumentationFile
+        {
+            bool valid = true;
+            std::vector<InstrumentationPointPtr> instrumentationPoints;
+            // logged by the constructor once the file's turn comes
+            std::vector<xstring_t> warnings;
+        };
+
+        // called on a worker thread, so this must not touch any member state
+        static ParsedInstrumentationFile ParseInstrumentationFile(const InstrumentationXmlSet::value_type& instrumentationXml) noexcept
+        {
+            ParsedInstrumentationFile parsedFile;
+            try
+            {
+                GetInstrumentationPoints(instrumentationXml.second, parsedFile);
+            }
+            catch (...)
+            {
+                // if an exception is thrown while parsing a file keep the points found so far and move on to the next one
+                parsedFile.valid = false;
+            }
+            return parsedFile;
+        }
+
         static bool InstrumentationXmlIsDeprecated(xstring_t instrumentationXmlFilePath)
         {
             bool returnValue = false;
@@ -197,33 +293,56 @@ namespace NewRelic { namespace Profiler { namespace Configuration
             return returnValue;
         }
 
+        // getParameters returns the method's parameters as they are written in instrumentation xml, as a reference that stays valid
+        // until this returns; it is only called if a point with parameters could match, so a method that matches nothing is rejected
+        // without allocating
+        template <typename GetParameters>
         InstrumentationPointSet TryGetInstrumentationPoints(
             const xstring_t& assemblyName,
             const xstring_t& className,
             const xstring_t& methodName,
-            const xstring_t& parameters) const
+            const GetParameters& getParameters) const
         {
+            // a name that was never interned cannot belong to any instrumentation point, so most methods are rejected here
+            InstrumentationPointKey key;
+            if (InstrumentationPoint::TryGetKey(assemblyName, className, methodName, nullptr, key))
+            {
+                if (_parameterizedNames.find(key) != _parameterizedNames.end())
+                {
+                    const auto& parameters = getParameters();
+                    InstrumentationPointKey parameterizedKey;
+                    if (InstrumentationPoint::TryGetKey(assemblyName, className, methodName, &parameters, parameterizedKey))
+                    {
+                        auto matchInstrumentation = TryGetInstrumentationPoints(parameterizedKey);
+                        if (!matchInstrumentation.empty())
+                        {
+                            return matchInstrumentation;
+                        }
+                    }
+                }
 
-            auto matchKey = InstrumentationPoint::GetMatchKey(assemblyName, className, methodName, parameters);
-            auto matchInstrumentation = TryGetInstrumentationPoints(matchKey);
+                auto matchInstrumentation = TryGetInstrumentationPoints(key);
+                if (!matchInstrumentation.empty())
+                {
+                    return matchInstrumentation;
+                }
+            }
 
-            if (!matchInstrumentation.empty())
+            // exact matches take precedence over wildcard patterns; a pattern's class name was only checked against the ignore list
+            // as written, so the concrete class is checked here
+            if (_patternMatcher.IsEmpty() || IsIgnored(assemblyName, className))
             {
-                return matchInstrumentation;
+                return InstrumentationPointSet();
             }
-
-            matchKey = InstrumentationPoint::GetMatchKey(assemblyName, className, methodName);
-            return TryGetInstrumentationPoints(matchKey);
+            return _patternMatcher.Match(assemblyName, className, methodName, getParameters);
         }
 
         InstrumentationPointSet TryGetInstrumentationPoints(const InstrumentationPointPtr ipToFind) const
         {
-            auto const key = ipToFind->GetMatchKey();
-
-            return TryGetInstrumentationPoints(key);
+            return TryGetInstrumentationPoints(ipToFind->GetKey());
         }
 
-        InstrumentationPointSet TryGetInstrumentationPoints(const xstring_t& key) const
+        InstrumentationPointSet TryGetInstrumentationPoints(const InstrumentationPointKey& key) const
         {
             auto matches = _instrumentationPointsMap->find(key);
             if (matches == _instrumentationPointsMap->end())
@@ -234,31 +353,31 @@ namespace NewRelic { namespace Profiler { namespace Configuration
             return matches->second;
         }
 
-        void GetInstrumentationPoints(xstring_t instrumentationXml)
+        static void GetInstrumentationPoints(xstring_t instrumentationXml, ParsedInstrumentationFile& parsedFile)
         {
             rapidxml::xml_document<xchar_t> document;
             document.parse<rapidxml::parse_trim_whitespace | rapidxml::parse_normalize_whitespace>(const_cast<xchar_t*>(instrumentationXml.c_str()));
             auto extensionNode = document.first_node(_X("extension"), 0, false);
             if (extensionNode == nullptr)
             {
-                LogWarn(L"extension node not found in instrumentation file. Please validate your instrumentation files against extensions/extension.xsd or contact New Relic support.");
+                parsedFile.warnings.push_back(_X("extension node not found. Please validate your instrumentation files against extensions/extension.xsd or contact New Relic support."));
                 return;
             }
 
             auto instrumentationNode = extensionNode->first_node(_X("instrumentation"), 0, false);
             if (instrumentationNode == nullptr)
             {
-                LogWarn(L"instrumentation node not found in instrumentation file. Please validate your instrumentation files against extensions/extension.xsd or contact New Relic support.");
+                parsedFile.warnings.push_back(_X("instrumentation node not found. Please validate your instrumentation files against extensions/extension.xsd or contact New Relic support."));
                 return;
             }
             
             for (auto tracerFactoryNode = instrumentationNode->first_node(_X("tracerFactory"), 0, false); tracerFactoryNode; tracerFactoryNode = tracerFactoryNode->next_sibling(_X("tracerFactory"), 0, false))
             {
-                GetInstrumentationPointsForTracer(tracerFactoryNode);
+                GetInstrumentationPointsForTracer(tracerFactoryNode, parsedFile);
             }
         }
 
-        void GetInstrumentationPointsForTracer(rapidxml::xml_node<xchar_t>* tracerFactoryNode)
+        static void GetInstrumentationPointsForTracer(rapidxml::xml_node<xchar_t>* tracerFactoryNode, ParsedInstrumentationFile& parsedFile)
         {
             // if this tracer factory isn't enabled then bail
             auto enabled = GetAttributeOrEmptyString(tracerFactoryNode, _X("enabled"));
@@ -270,20 +389,20 @@ namespace NewRelic { namespace Profiler { namespace Configuration
             // get the instrumentation points for every match node in this tracer factory
             for (auto matchNode = tracerFactoryNode->first_node(_X("match"), 0, false); matchNode; matchNode = matchNode->next_sibling(_X("match"), 0, false))
             {
-                GetInstrumentationPointsForMatch(matchNode);
+                GetInstrumentationPointsForMatch(matchNode, parsedFile);
             }
         }
 
-        void GetInstrumentationPointsForMatch(rapidxml::xml_node<xchar_t>* matchNode)
+        static void GetInstrumentationPointsForMatch(rapidxml::xml_node<xchar_t>* matchNode, ParsedInstrumentationFile& parsedFile)
         {
             // get the instrumentation points for every matcher node in this tracer factory
             for (auto matcherNode = matchNode->first_node(_X("exactMethodMatcher"), 0, false); matcherNode; matcherNode = matcherNode->next_sibling(_X("exactMethodMatcher"), 0, false))
             {
-                GetInstrumentationPointForMatcher(matcherNode);
+                GetInstrumentationPointForMatcher(matcherNode, parsedFile);
             }
         }
 
-        void GetInstrumentationPointForMatcher(rapidxml::xml_node<xchar_t>* matcherNode)
+        static void GetInstrumentationPointForMatcher(rapidxml::xml_node<xchar_t>* matcherNode, ParsedInstrumentationFile& parsedFile)
         {
             InstrumentationPointPtr instrumentationPoint(new InstrumentationPoint());
 
@@ -312,7 +431,7 @@ namespace NewRelic { namespace Profiler { namespace Configuration
             // But the safest thing to do is disallow mscorlib instrumentation and make that very clear to users.
             if (instrumentationPoint->AssemblyName == _X("mscorlib"))
             {
-                LogWarn(L"Skipping instrumentation targeted at the mscorlib assembly for class ", instrumentationPoint->ClassName);
+                parsedFile.warnings.push_back(_X("Skipping instrumentation targeted at the mscorlib assembly for class ") + instrumentationPoint->ClassName);
                 return;
             }
 
@@ -403,21 +522,28 @@ namespace NewRelic { namespace Profiler { namespace Configuration
             }
 
             // if the ClassName includes multiple classes, we have to split this into multiple instrumentation points
-            auto instrumentationPoints = SplitInstrumentationPointsOnClassNames(instrumentationPoint);
+            auto splitInstrumentationPoints = SplitInstrumentationPointsOnClassNames(instrumentationPoint);
 
-            for (auto iPoint : instrumentationPoints) {
+            for (auto iPoint : splitInstrumentationPoints) {
 
-                // finally add the new instrumentation point(s) to our set of instrumentation points
+                // finally add the new instrumentation point(s) to the points found in this file
                 // Note that there may be "duplicated" instrumentation points that target different assembly versions
-                AddInstrumentationPointToCollectionsIfNotIgnored(iPoint);
+                parsedFile.instrumentationPoints.push_back(iPoint);
             }
         }
 
         void AddInstrumentationPointToCollectionsIfNotIgnored(InstrumentationPointPtr instrumentationPoint)
         {
-            if (!IgnoreInstrumentation::Matches(_ignoreList, instrumentationPoint->AssemblyName, instrumentationPoint->ClassName))
+            if (!IsIgnored(instrumentationPoint->AssemblyName, instrumentationPoint->ClassName))
             {
-                (*_instrumentationPointsMap)[instrumentationPoint->GetMatchKey()].insert(instrumentationPoint);
+                if (InstrumentationPatternMatcher::IsPattern(*instrumentationPoint))
+                {
+                    _patternMatcher.Add(instrumentationPoint);
+                }
+                else
+                {
+                    AddInstrumentationPointToMap(instrumentationPoint);
+                }
                 _instrumentationPointsSet->insert(instrumentationPoint);
             }
             else
@@ -426,6 +552,18 @@ namespace NewRelic { namespace Profiler { namespace Configuration
             }
         }
 
+        void AddInstrumentationPointToMap(InstrumentationPointPtr instrumentationPoint)
+        {
+            auto key = instrumentationPoint->GetKey();
+            (*_instrumentationPointsMap)[key].insert(instrumentationPoint);
+            if (key.HasParameters)
+            {
+                key.HasParameters = false;
+                key.Parameters = InternedString();
+                _parameterizedNames.insert(key);
+            }
+        }
+
         // the class name field of an instrumentation point may have multiple clasess listed (comma separated), we have to build instrumentation points for each
         static std::set<InstrumentationPointPtr> SplitInstrumentationPointsOnClassNames(InstrumentationPointPtr instrumentationPoint)
         {
@@ -433,8 +571,9 @@ namespace NewRelic { namespace Profiler { namespace Configuration
 
             // look for commas outside matching brackets and split on them
             uint32_t bracketLevel = 0;
-            auto classNameBeginPosition = instrumentationPoint->ClassName.cbegin();
-            for (auto character = instrumentationPoint->ClassName.cbegin(); character != instrumentationPoint->ClassName.cend(); ++character)
+            const auto& className = instrumentationPoint->ClassName.str();
+            auto classNameBeginPosition = className.cbegin();
+            for (auto character = className.cbegin(); character != className.cend(); ++character)
             {
                 if (*character == L'<' || *character == L'[')
                 {
@@ -456,7 +595,7 @@ namespace NewRelic { namespace Profiler { namespace Configuration
             }
 
             // add one last instrumentation point for the last split section
-            auto newInstrumentationPoint = GetInstrumentationPointFromClassSplitIterators(instrumentationPoint, classNameBeginPosition, instrumentationPoint->ClassName.end());
+            auto newInstrumentationPoint = GetInstrumentationPointFromClassSplitIterators(instrumentationPoint, classNameBeginPosition, className.cend());
             instrumentationPoints.emplace(newInstrumentationPoint);
 
             return instrumentationPoints;
@@ -518,9 +657,12 @@ namespace NewRelic { namespace Profiler { namespace Configuration
 
     private:
         InstrumentationPointMapPtr _instrumentationPointsMap = InstrumentationPointMapPtr(new InstrumentationPointMap());
+        // the names (with no parameters) that have at least one point with parameters
+        InstrumentationPointKeySet _parameterizedNames;
+        InstrumentationPatternMatcher _patternMatcher;
         InstrumentationPointSetPtr _instrumentationPointsSet;
         uint16_t _invalidFileCount = 0;
-        IgnoreInstrumentationListPtr _ignoreList;
+        IgnoreInstrumentationMatcher _ignoreMatcher;
         std::shared_ptr<NewRelic::Profiler::Logger::IFileDestinationSystemCalls> _systemCalls;
         bool _foundServerlessInstrumentationPoint;
     };
@@ -0,0 +1,139 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <map>
+#include <set>
+#include "InstrumentationPoint.h"
+#include "InstrumentationPatternMatcher.h"
+
+namespace NewRelic { namespace Profiler { namespace Configuration
+{
+    // The difference between the instrumentation points of two configurations, reduced to the methods whose instrumentation
+    // actually changed.  The profiler finds the methods for a point by assembly, class and method name, so a change to any point
+    // for a name affects every overload with that name: all of the new points for that name have to be rejitted, and if no new
+    // point has that name its methods have to be reverted.
+    //
+    // The ignore list is applied to the classes a wildcard point matches as they are matched, not to the point itself, so a change
+    // to the ignore list can change which methods a wildcard point instruments without changing the point.  When it changes every
+    // old wildcard point is reverted and every new one rejitted; the profiler leaves alone the methods that are still instrumented.
+    class InstrumentationDiff
+    {
+    public:
+        InstrumentationDiff(const InstrumentationPointSet& oldPoints, const InstrumentationPointSet& newPoints, bool ignoreListChanged = false) :
+            _addedPoints(std::make_shared<InstrumentationPointSet>()),
+            _removedPoints(std::make_shared<InstrumentationPointSet>()),
+            _pointsToRejit(std::make_shared<InstrumentationPointSet>()),
+            _pointsToRevert(std::make_shared<InstrumentationPointSet>())
+        {
+            auto oldDefinitions = GetDefinitions(oldPoints);
+            auto newDefinitions = GetDefinitions(newPoints);
+
+            std::set<xstring_t> changedNames;
+            for (auto& definition : newDefinitions)
+            {
+                if (oldDefinitions.find(definition.first) == oldDefinitions.end())
+                {
+                    _addedPoints->insert(definition.second);
+                    changedNames.insert(GetName(*definition.second));
+                }
+            }
+            for (auto& definition : oldDefinitions)
+            {
+                if (newDefinitions.find(definition.first) == newDefinitions.end())
+                {
+                    _removedPoints->insert(definition.second);
+                    changedNames.insert(GetName(*definition.second));
+                }
+            }
+
+            std::set<xstring_t> newNames;
+            for (auto& point : newPoints)
+            {
+                auto name = GetName(*point);
+                if (changedNames.find(name) != changedNames.end())
+                {
+                    _pointsToRejit->insert(point);
+                }
+                newNames.insert(name);
+            }
+            for (auto& point : *_removedPoints)
+            {
+                if (newNames.find(GetName(*point)) == newNames.end())
+                {
+                    _pointsToRevert->insert(point);
+                }
+            }
+
+            if (ignoreListChanged)
+            {
+                for (auto& point : newPoints)
+                {
+                    if (InstrumentationPatternMatcher::IsPattern(*point))
+                    {
+                        _pointsToRejit->insert(point);
+                    }
+                }
+                for (auto& point : oldPoints)
+                {
+                    if (InstrumentationPatternMatcher::IsPattern(*point))
+                    {
+                        _pointsToRevert->insert(point);
+                    }
+                }
+            }
+        }
+
+        // true when no method has to be rejitted or reverted
+        bool IsEmpty() const
+        {
+            return _addedPoints->empty() && _removedPoints->empty() && _pointsToRejit->empty() && _pointsToRevert->empty();
+        }
+
+        // points in the new configuration that are not in the old one
+        InstrumentationPointSetPtr GetAddedPoints() const
+        {
+            return _addedPoints;
+        }
+
+        // points in the old configuration that are not in the new one
+        InstrumentationPointSetPtr GetRemovedPoints() const
+        {
+            return _removedPoints;
+        }
+
+        // every new point whose name has a point that was added or removed, and every new wildcard point if the ignore list changed
+        InstrumentationPointSetPtr GetPointsToRejit() const
+        {
+            return _pointsToRejit;
+        }
+
+        // removed points whose name has no point left in the new configuration, and every old wildcard point if the ignore list changed
+        InstrumentationPointSetPtr GetPointsToRevert() const
+        {
+            return _pointsToRevert;
+        }
+
+    private:
+        static std::map<xstring_t, InstrumentationPointPtr> GetDefinitions(const InstrumentationPointSet& points)
+        {
+            std::map<xstring_t, InstrumentationPointPtr> definitions;
+            for (auto& point : points)
+            {
+                definitions.emplace(point->GetDefinitionKey(), point);
+            }
+            return definitions;
+        }
+
+        static xstring_t GetName(const InstrumentationPoint& point)
+        {
+            return InstrumentationPoint::GetMatchKey(point.AssemblyName, point.ClassName, point.MethodName);
+        }
+
+        InstrumentationPointSetPtr _addedPoints;
+        InstrumentationPointSetPtr _removedPoints;
+        InstrumentationPointSetPtr _pointsToRejit;
+        InstrumentationPointSetPtr _pointsToRevert;
+    };
+}}}
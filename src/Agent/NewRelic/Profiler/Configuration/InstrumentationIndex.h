@@ -0,0 +1,497 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+#include "InstrumentationPoint.h"
+#include "../Common/FileUtils.h"
+#include "../Common/Fnv1a.h"
+#include "../Common/MappedFile.h"
+#include "../Logging/Logger.h"
+
+/*
+INSTRUMENTATION INDEX LAYOUT
+An instrumentation index is the instrumentation points of a set of extension xml files, compiled ahead of time by
+NewRelicInstrumentationIndexCompiler so that the profiler can map it instead of reading and parsing the xml.  All offsets are
+relative to the start of the file and all strings are UTF-16, so the file can be mapped at any address and is the same on every
+platform of the same endianness.
+
+    InstrumentationIndexHeader
+    InstrumentationIndexSource[sourceCount]     the xml files the index was compiled from, sorted by path
+    InstrumentationIndexPoint[pointCount]       the instrumentation points, sorted by definition
+    string table                                uint32_t length followed by length UTF-16 code units, padded to 4 bytes.
+                                                Every distinct string is stored once.
+
+An index is stale, and the profiler falls back to the xml, when the set of xml files, or the size or contents of any of them, no
+longer matches the sources recorded in it.  Contents are compared by hash rather than by last write time, which some file systems
+only keep to the second or coarser.  The ignore list in newrelic.config is not part of the index; it is applied
+when the index is loaded.
+*/
+namespace NewRelic { namespace Profiler { namespace Configuration
+{
+    static constexpr uint32_t InstrumentationIndexMagic = 0x4949524E; // "NRII"
+    static constexpr uint16_t InstrumentationIndexVersion = 2;
+    static constexpr uint32_t InstrumentationIndexNoString = 0xFFFFFFFF;
+
+    static constexpr uint32_t InstrumentationIndexPointHasMinVersion = 0x1;
+    static constexpr uint32_t InstrumentationIndexPointHasMaxVersion = 0x2;
+
+#pragma region Index Layouts
+    //!!!FILE LAYOUT!!!
+    //These structures are written by NewRelicInstrumentationIndexCompiler.  Do not change without bumping InstrumentationIndexVersion.
+    struct InstrumentationIndexHeader
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t headerSize;
+        uint32_t totalSize;
+        uint32_t sourceCount;
+        uint32_t sourceTableOffset;
+        uint32_t pointCount;
+        uint32_t pointTableOffset;
+        uint32_t stringTableSize;
+        uint32_t stringTableOffset;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(InstrumentationIndexHeader) == 40, "InstrumentationIndexHeader is part of the file layout");
+
+    struct InstrumentationIndexSource
+    {
+        //relative to the extensions directory
+        uint32_t path;
+        uint32_t reserved;
+        uint64_t size;
+        //64 bit FNV-1a of the bytes of the file
+        uint64_t contentHash;
+    };
+    static_assert(sizeof(InstrumentationIndexSource) == 24, "InstrumentationIndexSource is part of the file layout");
+
+    struct InstrumentationIndexVersionNumber
+    {
+        uint16_t major;
+        uint16_t minor;
+        uint16_t build;
+        uint16_t revision;
+    };
+
+    struct InstrumentationIndexPoint
+    {
+        uint32_t tracerFactoryName;
+        uint32_t assemblyName;
+        uint32_t className;
+        uint32_t methodName;
+        //InstrumentationIndexNoString when the matcher has no parameters attribute
+        uint32_t parameters;
+        uint32_t metricType;
+        uint32_t metricName;
+        uint32_t tracerFactoryArgs;
+        uint32_t flags;
+        uint32_t reserved;
+        InstrumentationIndexVersionNumber minVersion;
+        InstrumentationIndexVersionNumber maxVersion;
+    };
+    static_assert(sizeof(InstrumentationIndexPoint) == 56, "InstrumentationIndexPoint is part of the file layout");
+#pragma endregion
+
+    //what an index records about each of its source files
+    struct InstrumentationIndexSourceStamp
+    {
+        uint64_t size = 0;
+        uint64_t contentHash = 0;
+    };
+
+    //a source file of an index: its path relative to the extensions directory and its stamp when the index was compiled
+    typedef std::map<xstring_t, InstrumentationIndexSourceStamp> InstrumentationIndexSources;
+
+    //returns false if the file cannot be read
+    inline bool TryGetInstrumentationIndexSourceStamp(const xstring_t& filePath, InstrumentationIndexSourceStamp& stamp)
+    {
+        std::ifstream file(to_pathstring(filePath), std::ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+
+        uint64_t size = 0;
+        uint64_t hash = Fnv1a::OffsetBasis;
+        char buffer[16 * 1024];
+        while (file)
+        {
+            file.read(buffer, sizeof(buffer));
+            const auto count = file.gcount();
+            hash = Fnv1a::HashBytes(reinterpret_cast<const uint8_t*>(buffer), static_cast<size_t>(count), hash);
+            size += static_cast<uint64_t>(count);
+        }
+        if (file.bad())
+        {
+            return false;
+        }
+
+        stamp.size = size;
+        stamp.contentHash = hash;
+        return true;
+    }
+
+    //the index of the xml files in extensionsDirectory and in its runtimeDirectoryName (netcore or netframework) subdirectory
+    inline xstring_t GetInstrumentationIndexPath(const xstring_t& extensionsDirectory, const xstring_t& runtimeDirectoryName)
+    {
+        return extensionsDirectory + PATH_SEPARATOR + _X("instrumentation.") + runtimeDirectoryName + _X(".idx");
+    }
+
+    //Serializes a set of instrumentation points and the sources they were read from as described above.  The output only depends
+    //on the content of the points, not on the order they are given in, so compiling the same xml twice gives the same file.
+    class InstrumentationIndexWriter
+    {
+    public:
+        static std::vector<uint8_t> Write(const InstrumentationIndexSources& sources, const InstrumentationPointSet& instrumentationPoints)
+        {
+            InstrumentationIndexWriter writer;
+            return writer.WriteIndex(sources, instrumentationPoints);
+        }
+
+    private:
+        std::vector<uint8_t> WriteIndex(const InstrumentationIndexSources& sources, const InstrumentationPointSet& instrumentationPoints)
+        {
+            std::vector<InstrumentationIndexSource> sourceTable;
+            for (auto& source : sources)
+            {
+                InstrumentationIndexSource entry{};
+                entry.path = AddString(source.first);
+                entry.size = source.second.size;
+                entry.contentHash = source.second.contentHash;
+                sourceTable.push_back(entry);
+            }
+
+            // sort before any point string is added so the string table is in a deterministic order too
+            std::vector<std::pair<xstring_t, InstrumentationPoint*>> pendingPoints;
+            for (auto& instrumentationPoint : instrumentationPoints)
+            {
+                pendingPoints.emplace_back(instrumentationPoint->GetDefinitionKey(), instrumentationPoint.get());
+            }
+            std::sort(pendingPoints.begin(), pendingPoints.end());
+
+            std::vector<InstrumentationIndexPoint> points;
+            for (auto& pendingPoint : pendingPoints)
+            {
+                points.push_back(ToIndexPoint(*pendingPoint.second));
+            }
+
+            InstrumentationIndexHeader header{};
+            header.magic = InstrumentationIndexMagic;
+            header.version = InstrumentationIndexVersion;
+            header.headerSize = static_cast<uint16_t>(sizeof(InstrumentationIndexHeader));
+            header.sourceCount = static_cast<uint32_t>(sourceTable.size());
+            header.sourceTableOffset = sizeof(InstrumentationIndexHeader);
+            header.pointCount = static_cast<uint32_t>(points.size());
+            header.pointTableOffset = header.sourceTableOffset + header.sourceCount * sizeof(InstrumentationIndexSource);
+            header.stringTableOffset = header.pointTableOffset + header.pointCount * sizeof(InstrumentationIndexPoint);
+            header.stringTableSize = static_cast<uint32_t>(_stringTable.size());
+            header.totalSize = header.stringTableOffset + header.stringTableSize;
+
+            std::vector<uint8_t> index;
+            index.reserve(header.totalSize);
+            Append(index, &header, sizeof(header));
+            Append(index, sourceTable.data(), sourceTable.size() * sizeof(InstrumentationIndexSource));
+            Append(index, points.data(), points.size() * sizeof(InstrumentationIndexPoint));
+            Append(index, _stringTable.data(), _stringTable.size());
+            return index;
+        }
+
+        InstrumentationIndexPoint ToIndexPoint(InstrumentationPoint& instrumentationPoint)
+        {
+            InstrumentationIndexPoint point{};
+            point.tracerFactoryName = AddString(instrumentationPoint.TracerFactoryName);
+            point.assemblyName = AddString(instrumentationPoint.AssemblyName);
+            point.className = AddString(instrumentationPoint.ClassName);
+            point.methodName = AddString(instrumentationPoint.MethodName);
+            point.parameters = instrumentationPoint.Parameters == nullptr ? InstrumentationIndexNoString : AddString(*instrumentationPoint.Parameters);
+            point.metricType = AddString(instrumentationPoint.MetricType);
+            point.metricName = AddString(instrumentationPoint.MetricName);
+            point.tracerFactoryArgs = instrumentationPoint.TracerFactoryArgs;
+            if (instrumentationPoint.MinVersion != nullptr)
+            {
+                point.flags |= InstrumentationIndexPointHasMinVersion;
+                point.minVersion = ToIndexVersion(*instrumentationPoint.MinVersion);
+            }
+            if (instrumentationPoint.MaxVersion != nullptr)
+            {
+                point.flags |= InstrumentationIndexPointHasMaxVersion;
+                point.maxVersion = ToIndexVersion(*instrumentationPoint.MaxVersion);
+            }
+            return point;
+        }
+
+        static InstrumentationIndexVersionNumber ToIndexVersion(const AssemblyVersion& version)
+        {
+            return InstrumentationIndexVersionNumber{ version.Major, version.Minor, version.Build, version.Revision };
+        }
+
+        uint32_t AddString(const xstring_t& value)
+        {
+            auto existing = _strings.find(value);
+            if (existing != _strings.end())
+            {
+                return existing->second;
+            }
+
+            const auto offset = static_cast<uint32_t>(_stringTable.size());
+            const auto length = static_cast<uint32_t>(value.size());
+            Append(_stringTable, &length, sizeof(length));
+            for (auto character : value)
+            {
+                const auto codeUnit = static_cast<uint16_t>(character);
+                Append(_stringTable, &codeUnit, sizeof(codeUnit));
+            }
+            _stringTable.resize((_stringTable.size() + 3) & ~size_t{ 3 });
+
+            _strings.emplace(value, offset);
+            return offset;
+        }
+
+        static void Append(std::vector<uint8_t>& buffer, const void* data, size_t size)
+        {
+            auto bytes = static_cast<const uint8_t*>(data);
+            buffer.insert(buffer.end(), bytes, bytes + size);
+        }
+
+        std::map<xstring_t, uint32_t> _strings;
+        std::vector<uint8_t> _stringTable;
+    };
+
+    //A read-only view of an instrumentation index.  Open validates the layout once, so the accessors can trust every offset.  The
+    //profiler only reads the index once, at startup, to build the same InstrumentationPointSet the xml would have produced.
+    class InstrumentationIndex
+    {
+    public:
+        //returns nullptr if the file does not exist or is not a valid index of this version
+        static std::unique_ptr<InstrumentationIndex> TryOpen(const xstring_t& indexPath)
+        {
+            auto mappedFile = MappedFile::TryOpen(indexPath);
+            if (mappedFile == nullptr)
+            {
+                return nullptr;
+            }
+
+            std::unique_ptr<InstrumentationIndex> index(new InstrumentationIndex(mappedFile->Data(), mappedFile->Size()));
+            if (!index->IsValid())
+            {
+                LogWarn(L"The instrumentation index ", indexPath, L" is not valid and will be ignored.");
+                return nullptr;
+            }
+            index->_mappedFile = std::move(mappedFile);
+            return index;
+        }
+
+        //the index does not own data, which must outlive it and must be 4 byte aligned
+        static std::unique_ptr<InstrumentationIndex> TryOpen(const uint8_t* data, size_t size)
+        {
+            std::unique_ptr<InstrumentationIndex> index(new InstrumentationIndex(data, size));
+            if (!index->IsValid())
+            {
+                return nullptr;
+            }
+            return index;
+        }
+
+        //sourcePaths are the full paths of the xml files that would be loaded, all of which are in extensionsDirectory
+        bool IsCurrent(const xstring_t& extensionsDirectory, const std::set<xstring_t>& sourcePaths) const
+        {
+            if (sourcePaths.size() != Header().sourceCount)
+            {
+                return false;
+            }
+
+            // the paths share the prefix, so both are in the same order; sizes are compared before anything is read
+            const auto prefix = extensionsDirectory + PATH_SEPARATOR;
+            auto indexSource = Sources().begin();
+            for (auto& sourcePath : sourcePaths)
+            {
+                FileStamp fileStamp;
+                if (sourcePath.compare(0, prefix.size(), prefix) != 0 || !StringEquals(indexSource->path, sourcePath.substr(prefix.size())) ||
+                    !TryGetFileStamp(sourcePath, fileStamp) || fileStamp.size != indexSource->size)
+                {
+                    return false;
+                }
+                ++indexSource;
+            }
+
+            indexSource = Sources().begin();
+            for (auto& sourcePath : sourcePaths)
+            {
+                InstrumentationIndexSourceStamp stamp;
+                if (!TryGetInstrumentationIndexSourceStamp(sourcePath, stamp) || stamp.size != indexSource->size || stamp.contentHash != indexSource->contentHash)
+                {
+                    return false;
+                }
+                ++indexSource;
+            }
+            return true;
+        }
+
+        uint32_t GetInstrumentationPointCount() const
+        {
+            return Header().pointCount;
+        }
+
+        InstrumentationPointSetPtr GetInstrumentationPoints() const
+        {
+            auto instrumentationPoints = std::make_shared<InstrumentationPointSet>();
+            for (auto& point : Points())
+            {
+                instrumentationPoints->insert(ToInstrumentationPoint(point));
+            }
+            return instrumentationPoints;
+        }
+
+    private:
+        template <typename T>
+        struct Table
+        {
+            const T* first;
+            uint32_t count;
+            const T* begin() const { return first; }
+            const T* end() const { return first + count; }
+            const T& operator[](uint32_t index) const { return first[index]; }
+        };
+
+        InstrumentationIndex(const uint8_t* data, size_t size) : _data(data), _size(size)
+        {}
+
+        const InstrumentationIndexHeader& Header() const
+        {
+            return *reinterpret_cast<const InstrumentationIndexHeader*>(_data);
+        }
+
+        Table<InstrumentationIndexSource> Sources() const
+        {
+            return Table<InstrumentationIndexSource>{ reinterpret_cast<const InstrumentationIndexSource*>(_data + Header().sourceTableOffset), Header().sourceCount };
+        }
+
+        Table<InstrumentationIndexPoint> Points() const
+        {
+            return Table<InstrumentationIndexPoint>{ reinterpret_cast<const InstrumentationIndexPoint*>(_data + Header().pointTableOffset), Header().pointCount };
+        }
+
+        bool IsValid() const
+        {
+            if (_size < sizeof(InstrumentationIndexHeader) || (reinterpret_cast<uintptr_t>(_data) & 3) != 0)
+            {
+                return false;
+            }
+
+            const auto& header = Header();
+            if (header.magic != InstrumentationIndexMagic || header.version != InstrumentationIndexVersion ||
+                header.headerSize != sizeof(InstrumentationIndexHeader) || header.totalSize != _size ||
+                !IsTableValid(header.sourceTableOffset, header.sourceCount, sizeof(InstrumentationIndexSource)) ||
+                !IsTableValid(header.pointTableOffset, header.pointCount, sizeof(InstrumentationIndexPoint)) ||
+                !IsTableValid(header.stringTableOffset, header.stringTableSize, 1))
+            {
+                return false;
+            }
+
+            for (auto& source : Sources())
+            {
+                if (!IsStringValid(source.path))
+                {
+                    return false;
+                }
+            }
+
+            for (auto& point : Points())
+            {
+                for (auto stringOffset : { point.tracerFactoryName, point.assemblyName, point.className, point.methodName, point.metricType, point.metricName })
+                {
+                    if (!IsStringValid(stringOffset))
+                    {
+                        return false;
+                    }
+                }
+                if (point.parameters != InstrumentationIndexNoString && !IsStringValid(point.parameters))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool IsTableValid(uint64_t offset, uint64_t count, uint64_t entrySize) const
+        {
+            return (offset & 3) == 0 && offset + count * entrySize <= _size;
+        }
+
+        bool IsStringValid(uint32_t offset) const
+        {
+            const auto& header = Header();
+            if ((offset & 3) != 0 || uint64_t{ offset } + sizeof(uint32_t) > header.stringTableSize)
+            {
+                return false;
+            }
+            const auto length = *reinterpret_cast<const uint32_t*>(_data + header.stringTableOffset + offset);
+            return uint64_t{ offset } + sizeof(uint32_t) + uint64_t{ length } * sizeof(uint16_t) <= header.stringTableSize;
+        }
+
+        uint32_t GetStringLength(uint32_t offset) const
+        {
+            return *reinterpret_cast<const uint32_t*>(_data + Header().stringTableOffset + offset);
+        }
+
+        const uint16_t* GetStringData(uint32_t offset) const
+        {
+            return reinterpret_cast<const uint16_t*>(_data + Header().stringTableOffset + offset + sizeof(uint32_t));
+        }
+
+        xstring_t GetString(uint32_t offset) const
+        {
+            const auto data = GetStringData(offset);
+            return xstring_t(data, data + GetStringLength(offset));
+        }
+
+        bool StringEquals(uint32_t offset, const xstring_t& value) const
+        {
+            const auto data = GetStringData(offset);
+            return GetStringLength(offset) == value.size() && std::equal(value.begin(), value.end(), data, [](xchar_t character, uint16_t codeUnit)
+            {
+                return static_cast<uint16_t>(character) == codeUnit;
+            });
+        }
+
+        InstrumentationPointPtr ToInstrumentationPoint(const InstrumentationIndexPoint& point) const
+        {
+            auto instrumentationPoint = std::make_shared<InstrumentationPoint>();
+            instrumentationPoint->TracerFactoryName = GetString(point.tracerFactoryName);
+            instrumentationPoint->AssemblyName = GetString(point.assemblyName);
+            instrumentationPoint->ClassName = GetString(point.className);
+            instrumentationPoint->MethodName = GetString(point.methodName);
+            if (point.parameters != InstrumentationIndexNoString)
+            {
+                instrumentationPoint->Parameters.reset(new xstring_t(GetString(point.parameters)));
+            }
+            instrumentationPoint->MetricType = GetString(point.metricType);
+            instrumentationPoint->MetricName = GetString(point.metricName);
+            instrumentationPoint->TracerFactoryArgs = point.tracerFactoryArgs;
+            if ((point.flags & InstrumentationIndexPointHasMinVersion) != 0)
+            {
+                instrumentationPoint->MinVersion.reset(new AssemblyVersion(point.minVersion.major, point.minVersion.minor, point.minVersion.build, point.minVersion.revision));
+            }
+            if ((point.flags & InstrumentationIndexPointHasMaxVersion) != 0)
+            {
+                instrumentationPoint->MaxVersion.reset(new AssemblyVersion(point.maxVersion.major, point.maxVersion.minor, point.maxVersion.build, point.maxVersion.revision));
+            }
+            return instrumentationPoint;
+        }
+
+        const uint8_t* _data;
+        size_t _size;
+        std::unique_ptr<MappedFile> _mappedFile;
+    };
+    typedef std::unique_ptr<InstrumentationIndex> InstrumentationIndexPtr;
+}}}
@@ -0,0 +1,274 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "InstrumentationPoint.h"
+#include "Strings.h"
+
+namespace NewRelic { namespace Profiler { namespace Configuration
+{
+    // Instrumentation points whose class or method name contains a '*' wildcard, e.g. className="MyNamespace.*" or
+    // methodName="Get*".  A '*' matches any run of characters (including none) within the class name or within the method name,
+    // never across the two, and names are compared case-insensitively the way Strings::AreEqualCaseInsensitive compares them.
+    //
+    // The patterns for each assembly are compiled into a trie over the case-folded class name, a separator and the case-folded
+    // method name, with a '*' compiled into a node that loops on every character.  A method is classified in a single pass over
+    // its class and method names however many patterns there are.  Assemblies are matched exactly, by their interned name, so a
+    // method in an assembly with no patterns costs one lookup.  Immutable once the configuration has been loaded.
+    class InstrumentationPatternMatcher
+    {
+    public:
+        static bool IsPattern(const InstrumentationPoint& instrumentationPoint)
+        {
+            return IsPattern(instrumentationPoint.ClassName) || IsPattern(instrumentationPoint.MethodName);
+        }
+
+        // true if a class or method name contains a wildcard
+        static bool IsPattern(const xstring_t& name)
+        {
+            return name.find(_X('*')) != xstring_t::npos;
+        }
+
+        void Add(InstrumentationPointPtr instrumentationPoint)
+        {
+            auto& automaton = _automata[instrumentationPoint->AssemblyName.Id()];
+            if (automaton.nodes.empty())
+            {
+                automaton.nodes.emplace_back();
+            }
+
+            uint32_t node = 0;
+            for (auto character : instrumentationPoint->ClassName.str())
+            {
+                node = AddTransition(automaton, node, character);
+            }
+            node = AddTransition(automaton, node, Separator);
+            for (auto character : instrumentationPoint->MethodName.str())
+            {
+                node = AddTransition(automaton, node, character);
+            }
+            automaton.nodes[node].instrumentationPoints.push_back(instrumentationPoint);
+        }
+
+        bool IsEmpty() const
+        {
+            return _automata.empty();
+        }
+
+        // The patterns matching the method.  Like the exact lookup, patterns with parameters equal to the method's take precedence
+        // over patterns without parameters, which match every overload.  getParameters is only called if a pattern with parameters
+        // matches the names, and returns a reference that stays valid until this returns.
+        template <typename GetParameters>
+        InstrumentationPointSet Match(const xstring_t& assemblyName, const xstring_t& className, const xstring_t& methodName, const GetParameters& getParameters) const
+        {
+            InstrumentationPointSet matches;
+
+            auto automaton = Find(assemblyName);
+            if (automaton == nullptr)
+            {
+                return matches;
+            }
+            std::vector<uint32_t> states;
+            Walk(*automaton, className, &methodName, states);
+
+            InstrumentationPointSet allOverloads;
+            const xstring_t* parameters = nullptr;
+            for (auto state : states)
+            {
+                for (auto& instrumentationPoint : automaton->nodes[state].instrumentationPoints)
+                {
+                    if (instrumentationPoint->Parameters == nullptr)
+                    {
+                        allOverloads.insert(instrumentationPoint);
+                        continue;
+                    }
+
+                    if (parameters == nullptr)
+                    {
+                        parameters = &getParameters();
+                    }
+                    if (*instrumentationPoint->Parameters == *parameters)
+                    {
+                        matches.insert(instrumentationPoint);
+                    }
+                }
+            }
+            return matches.empty() ? allOverloads : matches;
+        }
+
+        // true if a pattern matches the names, whatever the pattern's parameters
+        bool MatchesNames(const xstring_t& assemblyName, const xstring_t& className, const xstring_t& methodName) const
+        {
+            auto automaton = Find(assemblyName);
+            if (automaton == nullptr)
+            {
+                return false;
+            }
+            std::vector<uint32_t> states;
+            Walk(*automaton, className, &methodName, states);
+            for (auto state : states)
+            {
+                if (!automaton->nodes[state].instrumentationPoints.empty())
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // true if a pattern could match some method of the class, so that a class no pattern can match is rejected without
+        // looking at its methods
+        bool MatchesClass(const xstring_t& assemblyName, const xstring_t& className) const
+        {
+            auto automaton = Find(assemblyName);
+            if (automaton == nullptr)
+            {
+                return false;
+            }
+            std::vector<uint32_t> states;
+            Walk(*automaton, className, nullptr, states);
+            return !states.empty();
+        }
+
+    private:
+        static constexpr xchar_t Wildcard = _X('*');
+        // between the class name and the method name; Fold never returns it
+        static constexpr xchar_t Separator = 0;
+
+        struct Node
+        {
+            // sorted by character
+            std::vector<std::pair<xchar_t, uint32_t>> transitions;
+            // the node a '*' leads to, 0 if there is none (the root is never the target of a transition)
+            uint32_t wildcard = 0;
+            // true if this node is the target of a '*', so that it loops on every character except the separator
+            bool loops = false;
+            std::vector<InstrumentationPointPtr> instrumentationPoints;
+        };
+
+        struct Automaton
+        {
+            std::vector<Node> nodes;
+        };
+
+        // two characters are equal to AreEqualCaseInsensitive exactly when they are equal with bit 5 set
+        static xchar_t Fold(xchar_t character)
+        {
+            return static_cast<xchar_t>(character | 32);
+        }
+
+        static uint32_t AddTransition(Automaton& automaton, uint32_t node, xchar_t character)
+        {
+            if (character == Wildcard)
+            {
+                // "**" is the same as "*"
+                if (automaton.nodes[node].loops)
+                {
+                    return node;
+                }
+                if (automaton.nodes[node].wildcard == 0)
+                {
+                    auto target = static_cast<uint32_t>(automaton.nodes.size());
+                    automaton.nodes.emplace_back();
+                    automaton.nodes[target].loops = true;
+                    automaton.nodes[node].wildcard = target;
+                }
+                return automaton.nodes[node].wildcard;
+            }
+
+            if (character != Separator)
+            {
+                character = Fold(character);
+            }
+            auto& transitions = automaton.nodes[node].transitions;
+            auto transition = std::lower_bound(transitions.begin(), transitions.end(), character, CompareCharacter);
+            if (transition != transitions.end() && transition->first == character)
+            {
+                return transition->second;
+            }
+
+            auto target = static_cast<uint32_t>(automaton.nodes.size());
+            transitions.insert(transition, std::make_pair(character, target));
+            automaton.nodes.emplace_back();
+            return target;
+        }
+
+        const Automaton* Find(const xstring_t& assemblyName) const
+        {
+            InternedString internedAssemblyName;
+            if (!InternedString::TryFind(assemblyName, internedAssemblyName))
+            {
+                return nullptr;
+            }
+            auto automaton = _automata.find(internedAssemblyName.Id());
+            return automaton == _automata.end() ? nullptr : &automaton->second;
+        }
+
+        // the states after the class name and the separator, then after the method name unless it is null
+        static void Walk(const Automaton& automaton, const xstring_t& className, const xstring_t* methodName, std::vector<uint32_t>& states)
+        {
+            std::vector<uint32_t> nextStates;
+            AddState(automaton, states, 0);
+            for (auto character : className)
+            {
+                Step(automaton, states, nextStates, Fold(character));
+            }
+            Step(automaton, states, nextStates, Separator);
+            if (methodName == nullptr)
+            {
+                return;
+            }
+            for (auto character : *methodName)
+            {
+                Step(automaton, states, nextStates, Fold(character));
+            }
+        }
+
+        static bool CompareCharacter(const std::pair<xchar_t, uint32_t>& transition, xchar_t character)
+        {
+            return transition.first < character;
+        }
+
+        // adds the state along with the states reachable from it through a '*' matching nothing
+        static void AddState(const Automaton& automaton, std::vector<uint32_t>& states, uint32_t state)
+        {
+            while (std::find(states.begin(), states.end(), state) == states.end())
+            {
+                states.push_back(state);
+                state = automaton.nodes[state].wildcard;
+                if (state == 0)
+                {
+                    return;
+                }
+            }
+        }
+
+        static void Step(const Automaton& automaton, std::vector<uint32_t>& states, std::vector<uint32_t>& nextStates, xchar_t character)
+        {
+            nextStates.clear();
+            for (auto state : states)
+            {
+                auto& node = automaton.nodes[state];
+                if (node.loops && character != Separator)
+                {
+                    AddState(automaton, nextStates, state);
+                }
+
+                auto transition = std::lower_bound(node.transitions.begin(), node.transitions.end(), character, CompareCharacter);
+                if (transition != node.transitions.end() && transition->first == character)
+                {
+                    AddState(automaton, nextStates, transition->second);
+                }
+            }
+            states.swap(nextStates);
+        }
+
+        std::unordered_map<const void*, Automaton> _automata;
+    };
+}}}
@@ -9,22 +9,70 @@
 #include <stdint.h>
 #include <set>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include "Strings.h"
 #include "../Logging/Logger.h"
 #include "../Common/AssemblyVersion.h"
+#include "../Common/Fnv1a.h"
+#include "../Common/StringPool.h"
 
 namespace NewRelic { namespace Profiler { namespace Configuration
 {
+    //The identity an instrumentation point is looked up by.  Every part is interned, so building a key for a point never copies
+    //a string and comparing two keys compares five words.
+    struct InstrumentationPointKey
+    {
+        InternedString AssemblyName;
+        InternedString ClassName;
+        InternedString MethodName;
+        InternedString Parameters;
+        bool HasParameters = false;
+
+        bool operator==(const InstrumentationPointKey& other) const noexcept
+        {
+            return AssemblyName == other.AssemblyName &&
+                ClassName == other.ClassName &&
+                MethodName == other.MethodName &&
+                Parameters == other.Parameters &&
+                HasParameters == other.HasParameters;
+        }
+
+        //orders by the identity of the pooled strings, not alphabetically
+        bool operator<(const InstrumentationPointKey& other) const noexcept
+        {
+            if (AssemblyName != other.AssemblyName) return AssemblyName.Id() < other.AssemblyName.Id();
+            if (ClassName != other.ClassName) return ClassName.Id() < other.ClassName.Id();
+            if (MethodName != other.MethodName) return MethodName.Id() < other.MethodName.Id();
+            if (Parameters != other.Parameters) return Parameters.Id() < other.Parameters.Id();
+            return HasParameters < other.HasParameters;
+        }
+    };
+
+    //combines the hashes the string pool computed when each part was interned, so hashing a key never looks at a character
+    struct InstrumentationPointKeyHash
+    {
+        size_t operator()(const InstrumentationPointKey& key) const noexcept
+        {
+            size_t hash = key.AssemblyName.Hash();
+            for (auto part : { &key.ClassName, &key.MethodName, &key.Parameters })
+            {
+                hash = static_cast<size_t>(Fnv1a::Mix(hash, part->Hash()));
+            }
+            return hash ^ size_t(key.HasParameters);
+        }
+    };
+
     class InstrumentationPoint
     {
     public:
-        xstring_t TracerFactoryName;                    // represented by 'name' on the <tracerFactory> node
-        xstring_t AssemblyName;                         // on the <match> node
-        xstring_t ClassName;                            // on the <match> node
-        xstring_t MethodName;                           // on the <exactMethodMatcher> node
+        InternedString TracerFactoryName;               // represented by 'name' on the <tracerFactory> node
+        InternedString AssemblyName;                    // on the <match> node
+        InternedString ClassName;                       // on the <match> node
+        InternedString MethodName;                      // on the <exactMethodMatcher> node
         std::unique_ptr<xstring_t> Parameters;          // on the <exactMethodMatcher> node
-        xstring_t MetricType;                           // represented by 'metric' on the <tracerFactory> node
-        xstring_t MetricName;                           // on the <tracerFactory> node
+        InternedString MetricType;                      // represented by 'metric' on the <tracerFactory> node
+        InternedString MetricName;                      // on the <tracerFactory> node
         uint32_t TracerFactoryArgs;
         std::unique_ptr<AssemblyVersion> MinVersion;    // on the <match> node
         std::unique_ptr<AssemblyVersion> MaxVersion;    // on the <match> node
@@ -70,6 +118,59 @@ namespace NewRelic { namespace Profiler { namespace Configuration
                 : GetMatchKey(AssemblyName, ClassName, MethodName, *Parameters);
         }
 
+        //every field of the point, so two points have the same definition key exactly when they are equal in every respect
+        xstring_t GetDefinitionKey()
+        {
+            const xchar_t separator = 0;
+            auto key = GetMatchKey();
+            for (auto field : { &TracerFactoryName.str(), &MetricType.str(), &MetricName.str() })
+            {
+                key += separator;
+                key += *field;
+            }
+            key += separator;
+            key += to_xstring(TracerFactoryArgs);
+            for (auto version : { MinVersion.get(), MaxVersion.get() })
+            {
+                key += separator;
+                if (version != nullptr)
+                {
+                    key += version->ToString();
+                }
+            }
+            return key;
+        }
+
+        InstrumentationPointKey GetKey() const
+        {
+            InstrumentationPointKey key;
+            key.AssemblyName = AssemblyName;
+            key.ClassName = ClassName;
+            key.MethodName = MethodName;
+            if (Parameters != nullptr)
+            {
+                key.Parameters = *Parameters;
+                key.HasParameters = true;
+            }
+            return key;
+        }
+
+        //builds the key for a method without allocating; false if any part has never been interned, in which case no
+        //instrumentation point can have that key
+        static bool TryGetKey(const xstring_t& assemblyName, const xstring_t& className, const xstring_t& methodName, const xstring_t* parameters, InstrumentationPointKey& key) noexcept
+        {
+            if (!InternedString::TryFind(assemblyName, key.AssemblyName) ||
+                !InternedString::TryFind(className, key.ClassName) ||
+                !InternedString::TryFind(methodName, key.MethodName))
+            {
+                return false;
+            }
+
+            key.HasParameters = parameters != nullptr;
+            key.Parameters = InternedString();
+            return parameters == nullptr || InternedString::TryFind(*parameters, key.Parameters);
+        }
+
         static xstring_t GetMatchKey(const xstring_t& assemblyName, const xstring_t& className, const xstring_t& methodName)
         {
             return xstring_t(_X("[")) + assemblyName + _X("]") + className + _X(".") + methodName;
@@ -108,7 +209,8 @@ namespace NewRelic { namespace Profiler { namespace Configuration
     typedef std::set<InstrumentationPointPtr> InstrumentationPointSet;
     typedef std::shared_ptr<InstrumentationPointSet> InstrumentationPointSetPtr;
 
-    typedef std::map<xstring_t, InstrumentationPointSet> InstrumentationPointMap;
+    typedef std::unordered_map<InstrumentationPointKey, InstrumentationPointSet, InstrumentationPointKeyHash> InstrumentationPointMap;
+    typedef std::unordered_set<InstrumentationPointKey, InstrumentationPointKeyHash> InstrumentationPointKeySet;
     typedef std::shared_ptr<InstrumentationPointMap> InstrumentationPointMapPtr;
 
     inline bool operator==(std::nullptr_t /*leftSide*/, InstrumentationPointPtr rightSide)
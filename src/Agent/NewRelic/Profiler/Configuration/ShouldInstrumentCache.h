@@ -0,0 +1,283 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include "../Common/FileUtils.h"
+#include "../Common/Fnv1a.h"
+#include "../Common/xplat.h"
+#include "../Logging/Logger.h"
+
+#ifdef PAL_STDCPP_COMPAT
+#include <stdio.h>
+#else
+#include <Windows.h>
+#endif
+
+namespace NewRelic { namespace Profiler { namespace Configuration
+{
+    // Builds the key a should-instrument decision is cached under from everything the decision depends on (see Fnv1aHasher).
+    class ShouldInstrumentCacheKey
+    {
+    public:
+        ShouldInstrumentCacheKey& Add(const xstring_t& value)
+        {
+            _hasher.Add(value);
+            return *this;
+        }
+
+        ShouldInstrumentCacheKey& Add(bool value)
+        {
+            _hasher.Add(value);
+            return *this;
+        }
+
+        ShouldInstrumentCacheKey& Add(uint64_t value)
+        {
+            _hasher.Add(value);
+            return *this;
+        }
+
+        // A file by its path, size and last write time rather than its contents, so that the key changes whenever the file is
+        // written without the file having to be read.
+        ShouldInstrumentCacheKey& AddFile(const xstring_t& filePath)
+        {
+            Add(filePath);
+            FileStamp stamp;
+            auto exists = TryGetFileStamp(filePath, stamp);
+            Add(exists);
+            if (exists)
+            {
+                Add(stamp.size).Add(static_cast<uint64_t>(stamp.lastWriteTime)).Add(static_cast<uint64_t>(stamp.lastWriteTimeNanoseconds));
+            }
+            return *this;
+        }
+
+        // never 0, which marks an empty slot in the cache
+        uint64_t Get() const
+        {
+            auto hash = _hasher.Get();
+            return hash == 0 ? 1 : hash;
+        }
+
+    private:
+        Fnv1aHasher _hasher;
+    };
+
+    // The verdicts of recent ShouldInstrument evaluations, as a fixed size direct mapped table: a key always goes in the same slot,
+    // and a new verdict simply replaces whatever was in its slot.  Kept as the bytes that are stored on disk, so that a verdict can
+    // be looked up from the stored header and the key's slot alone, with no parsing.
+    class ShouldInstrumentDecisionTable
+    {
+    public:
+        static const uint32_t SlotCount = 1024;
+        static const size_t HeaderSize = 16;
+        static const size_t SlotSize = 16;
+        static const size_t Size = HeaderSize + SlotCount * SlotSize;
+
+        ShouldInstrumentDecisionTable() :
+            _bytes(Size, 0)
+        {
+            Header header = { Magic, Version, SlotCount, 0 };
+            memcpy(_bytes.data(), &header, sizeof(header));
+        }
+
+        // false if the bytes are not a table of this version, in which case the table is left empty
+        bool Load(const std::vector<uint8_t>& bytes)
+        {
+            if (bytes.size() != Size || !IsValidHeader(bytes.data()))
+            {
+                return false;
+            }
+            _bytes = bytes;
+            return true;
+        }
+
+        const std::vector<uint8_t>& GetBytes() const
+        {
+            return _bytes;
+        }
+
+        bool TryGet(uint64_t key, bool& shouldInstrument) const
+        {
+            return TryGetFromSlot(SlotAddress(key), key, shouldInstrument);
+        }
+
+        // Where the slot a key goes in starts in the stored table.
+        static size_t GetSlotOffset(uint64_t key)
+        {
+            return HeaderSize + (key % SlotCount) * SlotSize;
+        }
+
+        // Looks a key up given only the header of a stored table and the SlotSize bytes at the key's slot offset.
+        static bool TryGet(const uint8_t* header, const uint8_t* slot, uint64_t key, bool& shouldInstrument)
+        {
+            return IsValidHeader(header) && TryGetFromSlot(slot, key, shouldInstrument);
+        }
+
+        void Put(uint64_t key, bool shouldInstrument)
+        {
+            Slot slot = { key, shouldInstrument ? Instrument : DoNotInstrument };
+            memcpy(SlotAddress(key), &slot, sizeof(slot));
+        }
+
+    private:
+        static const uint32_t Magic = 0x4344524e; // "NRDC"
+        static const uint32_t Version = 1;
+        static const uint64_t Empty = 0;
+        static const uint64_t DoNotInstrument = 1;
+        static const uint64_t Instrument = 2;
+
+        //!!!ON DISK LAYOUT!!!
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t slotCount;
+            uint32_t reserved;
+        };
+        static_assert(sizeof(Header) == HeaderSize, "Header is part of the on disk layout");
+
+        struct Slot
+        {
+            uint64_t key;
+            uint64_t verdict;
+        };
+        static_assert(sizeof(Slot) == SlotSize, "Slot is part of the on disk layout");
+
+        static bool IsValidHeader(const uint8_t* bytes)
+        {
+            Header header;
+            memcpy(&header, bytes, sizeof(header));
+            return header.magic == Magic && header.version == Version && header.slotCount == SlotCount;
+        }
+
+        static bool TryGetFromSlot(const uint8_t* bytes, uint64_t key, bool& shouldInstrument)
+        {
+            Slot slot;
+            memcpy(&slot, bytes, sizeof(slot));
+            if (slot.key != key || slot.verdict == Empty)
+            {
+                return false;
+            }
+            shouldInstrument = slot.verdict == Instrument;
+            return true;
+        }
+
+        uint8_t* SlotAddress(uint64_t key)
+        {
+            return _bytes.data() + GetSlotOffset(key);
+        }
+
+        const uint8_t* SlotAddress(uint64_t key) const
+        {
+            return _bytes.data() + GetSlotOffset(key);
+        }
+
+        std::vector<uint8_t> _bytes;
+    };
+
+    // An optional file that remembers whether processes should be instrumented, so that a host starting many short lived processes
+    // with the same executable, command line and configuration evaluates the decision once.  A lookup reads the header and one slot
+    // of the file.  A process that adds a verdict reads the whole file and replaces it, so concurrent writers can lose each other's
+    // verdicts but never leave a torn file behind; a lost verdict only costs a later process a full evaluation.  Deleting the file
+    // clears the cache.
+    class ShouldInstrumentCache
+    {
+    public:
+        // processId keeps the temporary files of processes writing at the same time apart
+        ShouldInstrumentCache(const xstring_t& filePath, uint32_t processId) :
+            _filePath(filePath),
+            _temporaryFilePath(filePath + _X(".") + to_xstring(processId) + _X(".tmp"))
+        {}
+
+        bool TryGet(uint64_t key, bool& shouldInstrument) const
+        {
+            std::ifstream file(to_pathstring(_filePath), std::ios::binary | std::ios::ate);
+            if (!file || static_cast<size_t>(file.tellg()) != ShouldInstrumentDecisionTable::Size)
+            {
+                return false;
+            }
+
+            char header[ShouldInstrumentDecisionTable::HeaderSize];
+            char slot[ShouldInstrumentDecisionTable::SlotSize];
+            file.seekg(0);
+            file.read(header, sizeof(header));
+            file.seekg(ShouldInstrumentDecisionTable::GetSlotOffset(key));
+            file.read(slot, sizeof(slot));
+            if (!file)
+            {
+                return false;
+            }
+            return ShouldInstrumentDecisionTable::TryGet(reinterpret_cast<const uint8_t*>(header), reinterpret_cast<const uint8_t*>(slot), key, shouldInstrument);
+        }
+
+        // best effort; a failure is logged and otherwise ignored
+        void Put(uint64_t key, bool shouldInstrument)
+        {
+            // keeps the verdicts other processes have added
+            ShouldInstrumentDecisionTable table;
+            Read(table);
+            table.Put(key, shouldInstrument);
+
+            {
+                std::ofstream file(to_pathstring(_temporaryFilePath), std::ios::binary | std::ios::trunc);
+                auto& bytes = table.GetBytes();
+                file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+                if (!file)
+                {
+                    LogDebug(L"Unable to write the should instrument cache to ", _temporaryFilePath);
+                    return;
+                }
+            }
+
+            if (!ReplaceCacheFile(_temporaryFilePath, _filePath))
+            {
+                LogDebug(L"Unable to replace the should instrument cache at ", _filePath);
+                DeleteCacheFile(_temporaryFilePath);
+            }
+        }
+
+    private:
+        void Read(ShouldInstrumentDecisionTable& table) const
+        {
+            std::ifstream file(to_pathstring(_filePath), std::ios::binary);
+            if (!file)
+            {
+                return;
+            }
+
+            std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            if (!table.Load(bytes))
+            {
+                LogDebug(L"Ignoring the should instrument cache at ", _filePath, L" because it was written by a different version of the profiler or is damaged.");
+            }
+        }
+
+        static bool ReplaceCacheFile(const xstring_t& source, const xstring_t& destination)
+        {
+#ifdef PAL_STDCPP_COMPAT
+            return ::rename(to_pathstring(source).c_str(), to_pathstring(destination).c_str()) == 0;
+#else
+            return ::MoveFileExW(source.c_str(), destination.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#endif
+        }
+
+        static void DeleteCacheFile(const xstring_t& filePath)
+        {
+#ifdef PAL_STDCPP_COMPAT
+            ::remove(to_pathstring(filePath).c_str());
+#else
+            ::DeleteFileW(filePath.c_str());
+#endif
+        }
+
+        xstring_t _filePath;
+        xstring_t _temporaryFilePath;
+    };
+}}}
@@ -145,6 +145,62 @@ namespace NewRelic { namespace Profiler { namespace Configuration { namespace Te
             Assert::IsTrue(instrumentationPoint == nullptr);
         }
 
+        TEST_METHOD(ignore_matcher_matches_the_same_names_as_the_list)
+        {
+            IgnoreInstrumentationListPtr ignoreList(new IgnoreInstrumentationList());
+            ignoreList->push_back(std::make_shared<IgnoreInstrumentation>(_X("MyAssembly"), _X("MyNamespace.MyClass")));
+            ignoreList->push_back(std::make_shared<IgnoreInstrumentation>(_X("alpha")));
+            ignoreList->push_back(std::make_shared<IgnoreInstrumentation>(_X("foo"), _X("bar")));
+            for (auto index = 0; index < 500; ++index)
+            {
+                ignoreList->push_back(std::make_shared<IgnoreInstrumentation>(_X("Assembly") + to_xstring(unsigned(index)), _X("Class") + to_xstring(unsigned(index))));
+            }
+            IgnoreInstrumentationMatcher matcher(ignoreList);
+
+            const std::pair<xstring_t, xstring_t> names[] = {
+                { _X("foo"), _X("bar") },
+                { _X("FOO"), _X("Bar") },
+                { _X("myassembly"), _X("mynamespace.myclass") },
+                { _X("alpha"), _X("") },
+                { _X("ALPHA"), _X("something") },
+                { _X("assembly42"), _X("CLASS42") },
+                { _X("Assembly42"), _X("Class43") },
+                { _X("foo"), _X("") },
+                { _X("myassembly"), _X("") },
+                { _X("foo"), _X("MyNamespace.MyClass") },
+                { _X("fo"), _X("obar") },
+                { _X("alphabet"), _X("") },
+                { _X(""), _X("") } };
+            for (auto& name : names)
+            {
+                Assert::AreEqual(IgnoreInstrumentation::Matches(ignoreList, name.first, name.second), matcher.Matches(name.first, name.second));
+            }
+            Assert::IsTrue(matcher.Matches(_X("Assembly499"), _X("Class499")));
+            Assert::IsFalse(matcher.Matches(_X("Assembly499"), _X("Class498")));
+        }
+
+        TEST_METHOD(ignore_matcher_without_a_list_matches_nothing)
+        {
+            IgnoreInstrumentationMatcher matcher(nullptr);
+            Assert::IsFalse(matcher.Matches(_X("MyAssembly"), _X("MyNamespace.MyClass")));
+            Assert::IsFalse(matcher.Matches(_X(""), _X("")));
+        }
+
+        TEST_METHOD(ignore_lists_with_the_same_entries_are_equal)
+        {
+            auto list = std::make_shared<IgnoreInstrumentationList>();
+            list->push_back(std::make_shared<IgnoreInstrumentation>(_X("MyAssembly"), _X("MyNamespace.MyClass")));
+            auto sameList = std::make_shared<IgnoreInstrumentationList>();
+            sameList->push_back(std::make_shared<IgnoreInstrumentation>(_X("myassembly"), _X("mynamespace.myclass")));
+            auto otherList = std::make_shared<IgnoreInstrumentationList>();
+            otherList->push_back(std::make_shared<IgnoreInstrumentation>(_X("MyAssembly")));
+
+            Assert::IsTrue(IgnoreInstrumentation::AreEqual(list, sameList));
+            Assert::IsFalse(IgnoreInstrumentation::AreEqual(list, otherList));
+            Assert::IsFalse(IgnoreInstrumentation::AreEqual(list, nullptr));
+            Assert::IsTrue(IgnoreInstrumentation::AreEqual(nullptr, std::make_shared<IgnoreInstrumentationList>()));
+        }
+
     private:
         const std::pair<xstring_t, bool> _missingAgentEnabledConfigPair = std::make_pair(L"<?xml version=\"1.0\"?><configuration/>", false);
 
@@ -404,6 +404,45 @@ namespace NewRelic { namespace Profiler { namespace Configuration { namespace Te
             Assert::IsFalse(instrumentationPoint2 == nullptr);
         }
 
+        TEST_METHOD(many_xml_files_with_invalid_files)
+        {
+            // enough files that they are parsed on more than one thread
+            InstrumentationXmlSetPtr xmlSet(new InstrumentationXmlSet());
+            for (auto fileIndex = 0; fileIndex < 40; ++fileIndex)
+            {
+                if (fileIndex % 10 == 3)
+                {
+                    xmlSet->emplace(L"invalid" + std::to_wstring(fileIndex), L"<?xml version=\"1.0\" encoding=\"utf-8\"?><blah");
+                    continue;
+                }
+
+                xmlSet->emplace(L"file" + std::to_wstring(fileIndex), L"\
+                    <?xml version=\"1.0\" encoding=\"utf-8\"?>\
+                    <extension>\
+                        <instrumentation>\
+                            <tracerFactory>\
+                                <match assemblyName=\"MyAssembly\" className=\"MyNamespace.MyClass\">\
+                                    <exactMethodMatcher methodName=\"MyMethod" + std::to_wstring(fileIndex) + L"\"/>\
+                                </match>\
+                            </tracerFactory>\
+                        </instrumentation>\
+                    </extension>\
+                    ");
+            }
+
+            InstrumentationConfiguration instrumentation(xmlSet, nullptr);
+            Assert::AreEqual(4, int(instrumentation.GetInvalidFileCount()));
+            Assert::AreEqual(size_t(36), instrumentation.GetInstrumentationPoints()->size());
+
+            auto function = std::make_shared<MethodRewriter::Test::MockFunction>();
+            for (auto fileIndex = 0; fileIndex < 40; ++fileIndex)
+            {
+                function->_functionName = L"MyMethod" + std::to_wstring(fileIndex);
+                auto instrumentationPoint = instrumentation.TryGetInstrumentationPoint(function);
+                Assert::AreEqual(fileIndex % 10 != 3, instrumentationPoint != nullptr);
+            }
+        }
+
         TEST_METHOD(multiple_matchers)
         {
             InstrumentationXmlSetPtr xmlSet(new InstrumentationXmlSet());
@@ -987,5 +1026,171 @@ namespace NewRelic { namespace Profiler { namespace Configuration { namespace Te
             auto instrumentationPoint = instrumentation.TryGetInstrumentationPoint(std::make_shared<MethodRewriter::Test::MockFunction>());
             Assert::IsFalse(instrumentationPoint == nullptr);
         }
+
+        TEST_METHOD(signature_is_not_parsed_when_no_point_for_the_name_has_parameters)
+        {
+            InstrumentationConfiguration instrumentation(CreatePatternXmlSet(L"MyNamespace.MyClass", L"MyMethod"), nullptr);
+
+            // parsing an empty signature throws, so these only pass if the lookup never looks at it
+            auto function = std::make_shared<MethodRewriter::Test::MockFunction>();
+            function->_signature = std::make_shared<ByteVector>();
+            Assert::IsFalse(instrumentation.TryGetInstrumentationPoint(function) == nullptr);
+            function->_functionName = L"MyOtherMethod";
+            Assert::IsTrue(instrumentation.TryGetInstrumentationPoint(function) == nullptr);
+        }
+
+        TEST_METHOD(wildcard_class_name_matches_every_class_in_the_namespace)
+        {
+            InstrumentationConfiguration instrumentation(CreatePatternXmlSet(L"MyNamespace.*", L"MyMethod"), nullptr);
+            Assert::IsTrue(instrumentation.HasPatterns());
+
+            auto function = std::make_shared<MethodRewriter::Test::MockFunction>();
+            Assert::IsFalse(instrumentation.TryGetInstrumentationPoint(function) == nullptr);
+            function->_typeName = L"MyNamespace.Inner.MyOtherClass";
+            Assert::IsFalse(instrumentation.TryGetInstrumentationPoint(function) == nullptr);
+            function->_typeName = L"MyOtherNamespace.MyClass";
+            Assert::IsTrue(instrumentation.TryGetInstrumentationPoint(function) == nullptr);
+        }
+
+        TEST_METHOD(wildcard_method_name_matches_by_prefix_and_suffix)
+        {
+            InstrumentationConfiguration instrumentation(CreatePatternXmlSet(L"MyNamespace.MyClass", L"My*od"), nullptr);
+
+            auto function = std::make_shared<MethodRewriter::Test::MockFunction>();
+            Assert::IsFalse(instrumentation.TryGetInstrumentationPoint(function) == nullptr);
+            function->_functionName = L"MyOtherMethod";
+            Assert::IsFalse(instrumentation.TryGetInstrumentationPoint(function) == nullptr);
+            function->_functionName = L"MyMethods";
+            Assert::IsTrue(instrumentation.TryGetInstrumentationPoint(function) == nullptr);
+        }
+
+        TEST_METHOD(wildcard_does_not_match_across_class_and_method_names)
+        {
+            InstrumentationConfiguration instrumentation(CreatePatternXmlSet(L"MyNamespace.*", L"Method"), nullptr);
+            Assert::IsTrue(instrumentation.TryGetInstrumentationPoint(std::make_shared<MethodRewriter::Test::MockFunction>()) == nullptr);
+        }
+
+        TEST_METHOD(wildcard_patterns_are_case_insensitive)
+        {
+            InstrumentationConfiguration instrumentation(CreatePatternXmlSet(L"mynamespace.*", L"MYMETHOD"), nullptr);
+            Assert::IsFalse(instrumentation.TryGetInstrumentationPoint(std::make_shared<MethodRewriter::Test::MockFunction>()) == nullptr);
+        }
+
+        TEST_METHOD(exact_match_takes_precedence_over_wildcard)
+        {
+            InstrumentationXmlSetPtr xmlSet(new InstrumentationXmlSet());
+            xmlSet->emplace(L"filename", L"\
+                <?xml version=\"1.0\" encoding=\"utf-8\"?>\
+                <extension>\
+                    <instrumentation>\
+                        <tracerFactory name=\"Wildcard.Factory\">\
+                            <match assemblyName=\"MyAssembly\" className=\"MyNamespace.*\">\
+                                <exactMethodMatcher methodName=\"*\"/>\
+                            </match>\
+                        </tracerFactory>\
+                        <tracerFactory name=\"Exact.Factory\">\
+                            <match assemblyName=\"MyAssembly\" className=\"MyNamespace.MyClass\">\
+                                <exactMethodMatcher methodName=\"MyMethod\"/>\
+                            </match>\
+                        </tracerFactory>\
+                    </instrumentation>\
+                </extension>\
+                ");
+            InstrumentationConfiguration instrumentation(xmlSet, nullptr);
+
+            auto function = std::make_shared<MethodRewriter::Test::MockFunction>();
+            Assert::AreEqual(std::wstring(L"Exact.Factory"), instrumentation.TryGetInstrumentationPoint(function)->TracerFactoryName.str());
+            function->_functionName = L"MyOtherMethod";
+            Assert::AreEqual(std::wstring(L"Wildcard.Factory"), instrumentation.TryGetInstrumentationPoint(function)->TracerFactoryName.str());
+        }
+
+        TEST_METHOD(ignored_wildcard_instrumentation_does_not_match)
+        {
+            IgnoreInstrumentationListPtr ignoreList(new IgnoreInstrumentationList());
+            ignoreList->push_back(std::make_shared<IgnoreInstrumentation>(L"MyAssembly"));
+
+            InstrumentationConfiguration instrumentation(CreatePatternXmlSet(L"MyNamespace.*", L"*"), ignoreList);
+            Assert::IsFalse(instrumentation.HasPatterns());
+            Assert::IsTrue(instrumentation.TryGetInstrumentationPoint(std::make_shared<MethodRewriter::Test::MockFunction>()) == nullptr);
+        }
+
+        TEST_METHOD(wildcard_does_not_match_an_ignored_class)
+        {
+            IgnoreInstrumentationListPtr ignoreList(new IgnoreInstrumentationList());
+            ignoreList->push_back(std::make_shared<IgnoreInstrumentation>(L"MyAssembly", L"MyNamespace.MyClass"));
+
+            InstrumentationConfiguration instrumentation(CreatePatternXmlSet(L"MyNamespace.*", L"MyMethod"), ignoreList);
+            Assert::IsTrue(instrumentation.HasPatterns());
+
+            auto function = std::make_shared<MethodRewriter::Test::MockFunction>();
+            Assert::IsTrue(instrumentation.TryGetInstrumentationPoint(function) == nullptr);
+            function->_typeName = L"MyNamespace.MyOtherClass";
+            Assert::IsFalse(instrumentation.TryGetInstrumentationPoint(function) == nullptr);
+        }
+
+        TEST_METHOD(has_instrumentation_points_for_exact_and_wildcard_names_whatever_the_parameters)
+        {
+            InstrumentationXmlSetPtr xmlSet(new InstrumentationXmlSet());
+            xmlSet->emplace(L"filename", L"\
+                <?xml version=\"1.0\" encoding=\"utf-8\"?>\
+                <extension>\
+                    <instrumentation>\
+                        <tracerFactory>\
+                            <match assemblyName=\"MyAssembly\" className=\"MyNamespace.MyClass\">\
+                                <exactMethodMatcher methodName=\"MyMethod\" parameters=\"System.String\"/>\
+                            </match>\
+                            <match assemblyName=\"MyAssembly\" className=\"MyNamespace.Wild*\">\
+                                <exactMethodMatcher methodName=\"Get*\" parameters=\"System.Int32\"/>\
+                            </match>\
+                        </tracerFactory>\
+                    </instrumentation>\
+                </extension>\
+                ");
+            IgnoreInstrumentationListPtr ignoreList(new IgnoreInstrumentationList());
+            ignoreList->push_back(std::make_shared<IgnoreInstrumentation>(L"MyAssembly", L"MyNamespace.WildIgnored"));
+            InstrumentationConfiguration instrumentation(xmlSet, ignoreList);
+
+            Assert::IsTrue(instrumentation.HasInstrumentationPoints(L"MyAssembly", L"MyNamespace.MyClass", L"MyMethod"));
+            Assert::IsFalse(instrumentation.HasInstrumentationPoints(L"MyAssembly", L"MyNamespace.MyClass", L"MyOtherMethod"));
+            Assert::IsTrue(instrumentation.HasInstrumentationPoints(L"MyAssembly", L"MyNamespace.WildClass", L"GetValue"));
+            Assert::IsFalse(instrumentation.HasInstrumentationPoints(L"MyAssembly", L"MyNamespace.WildClass", L"SetValue"));
+            Assert::IsFalse(instrumentation.HasInstrumentationPoints(L"MyAssembly", L"MyNamespace.WildIgnored", L"GetValue"));
+            Assert::IsFalse(instrumentation.HasInstrumentationPoints(L"MyOtherAssembly", L"MyNamespace.WildClass", L"GetValue"));
+        }
+
+        TEST_METHOD(pattern_matcher_matches_classes_and_names_without_parameters)
+        {
+            InstrumentationConfiguration instrumentation(CreatePatternXmlSet(L"MyNamespace.*Service", L"Get*"), nullptr);
+
+            InstrumentationPatternMatcher matcher;
+            for (auto& instrumentationPoint : *instrumentation.GetInstrumentationPoints())
+            {
+                matcher.Add(instrumentationPoint);
+            }
+            Assert::IsTrue(matcher.MatchesClass(L"MyAssembly", L"MyNamespace.OrderService"));
+            Assert::IsFalse(matcher.MatchesClass(L"MyAssembly", L"MyNamespace.OrderRepository"));
+            Assert::IsFalse(matcher.MatchesClass(L"MyOtherAssembly", L"MyNamespace.OrderService"));
+            Assert::IsTrue(matcher.MatchesNames(L"MyAssembly", L"MyNamespace.OrderService", L"GetOrder"));
+            Assert::IsFalse(matcher.MatchesNames(L"MyAssembly", L"MyNamespace.OrderService", L"SaveOrder"));
+        }
+
+    private:
+        static InstrumentationXmlSetPtr CreatePatternXmlSet(const std::wstring& className, const std::wstring& methodName)
+        {
+            InstrumentationXmlSetPtr xmlSet(new InstrumentationXmlSet());
+            xmlSet->emplace(L"filename", L"\
+                <?xml version=\"1.0\" encoding=\"utf-8\"?>\
+                <extension>\
+                    <instrumentation>\
+                        <tracerFactory>\
+                            <match assemblyName=\"MyAssembly\" className=\"" + className + L"\">\
+                                <exactMethodMatcher methodName=\"" + methodName + L"\"/>\
+                            </match>\
+                        </tracerFactory>\
+                    </instrumentation>\
+                </extension>\
+                ");
+            return xmlSet;
+        }
     };
 }}}}
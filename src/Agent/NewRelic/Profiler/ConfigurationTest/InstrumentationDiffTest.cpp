@@ -0,0 +1,133 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "../Configuration/InstrumentationDiff.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic { namespace Profiler { namespace Configuration { namespace Test
+{
+    TEST_CLASS(InstrumentationDiffTest)
+    {
+    public:
+        TEST_METHOD(identical_configurations_have_no_difference)
+        {
+            InstrumentationPointSet oldPoints{ CreatePoint(_X("MyMethod")), CreatePoint(_X("MyOtherMethod")) };
+            InstrumentationPointSet newPoints{ CreatePoint(_X("MyMethod")), CreatePoint(_X("MyOtherMethod")) };
+
+            InstrumentationDiff diff(oldPoints, newPoints);
+            Assert::IsTrue(diff.IsEmpty());
+            Assert::IsTrue(diff.GetPointsToRejit()->empty());
+            Assert::IsTrue(diff.GetPointsToRevert()->empty());
+        }
+
+        TEST_METHOD(added_point_is_rejitted)
+        {
+            auto added = CreatePoint(_X("MyNewMethod"));
+            InstrumentationPointSet oldPoints{ CreatePoint(_X("MyMethod")) };
+            InstrumentationPointSet newPoints{ CreatePoint(_X("MyMethod")), added };
+
+            InstrumentationDiff diff(oldPoints, newPoints);
+            Assert::AreEqual(size_t(1), diff.GetAddedPoints()->size());
+            Assert::IsTrue(diff.GetRemovedPoints()->empty());
+            Assert::AreEqual(size_t(1), diff.GetPointsToRejit()->size());
+            Assert::IsTrue(*diff.GetPointsToRejit()->begin() == added);
+            Assert::IsTrue(diff.GetPointsToRevert()->empty());
+        }
+
+        TEST_METHOD(removed_point_is_reverted)
+        {
+            InstrumentationPointSet oldPoints{ CreatePoint(_X("MyMethod")), CreatePoint(_X("MyOldMethod")) };
+            InstrumentationPointSet newPoints{ CreatePoint(_X("MyMethod")) };
+
+            InstrumentationDiff diff(oldPoints, newPoints);
+            Assert::AreEqual(size_t(1), diff.GetRemovedPoints()->size());
+            Assert::IsTrue(diff.GetPointsToRejit()->empty());
+            Assert::AreEqual(size_t(1), diff.GetPointsToRevert()->size());
+            Assert::AreEqual(xstring_t(_X("MyOldMethod")), (*diff.GetPointsToRevert()->begin())->MethodName.str());
+        }
+
+        TEST_METHOD(changed_tracer_is_rejitted_not_reverted)
+        {
+            auto changed = CreatePoint(_X("MyMethod"));
+            changed->TracerFactoryName = _X("MyOtherTracer");
+            InstrumentationPointSet oldPoints{ CreatePoint(_X("MyMethod")) };
+            InstrumentationPointSet newPoints{ changed };
+
+            InstrumentationDiff diff(oldPoints, newPoints);
+            Assert::AreEqual(size_t(1), diff.GetAddedPoints()->size());
+            Assert::AreEqual(size_t(1), diff.GetRemovedPoints()->size());
+            Assert::AreEqual(size_t(1), diff.GetPointsToRejit()->size());
+            Assert::IsTrue(diff.GetPointsToRevert()->empty());
+        }
+
+        TEST_METHOD(removing_one_overload_rejits_the_remaining_points_for_the_name)
+        {
+            auto withParameters = CreatePoint(_X("MyMethod"));
+            withParameters->Parameters.reset(new xstring_t(_X("System.String")));
+            auto remaining = CreatePoint(_X("MyMethod"));
+            remaining->Parameters.reset(new xstring_t(_X("System.Int32")));
+            InstrumentationPointSet oldPoints{ withParameters, remaining, CreatePoint(_X("MyOtherMethod")) };
+            InstrumentationPointSet newPoints{ remaining, CreatePoint(_X("MyOtherMethod")) };
+
+            InstrumentationDiff diff(oldPoints, newPoints);
+            Assert::AreEqual(size_t(1), diff.GetPointsToRejit()->size());
+            Assert::IsTrue(*diff.GetPointsToRejit()->begin() == remaining);
+            Assert::IsTrue(diff.GetPointsToRevert()->empty());
+        }
+
+        TEST_METHOD(version_range_is_part_of_a_point)
+        {
+            auto versioned = CreatePoint(_X("MyMethod"));
+            versioned->MaxVersion.reset(AssemblyVersion::Create(_X("2.0")));
+            InstrumentationPointSet oldPoints{ CreatePoint(_X("MyMethod")) };
+            InstrumentationPointSet newPoints{ versioned };
+
+            InstrumentationDiff diff(oldPoints, newPoints);
+            Assert::IsFalse(diff.IsEmpty());
+            Assert::AreEqual(size_t(1), diff.GetPointsToRejit()->size());
+        }
+
+        TEST_METHOD(changed_ignore_list_redoes_the_wildcard_points)
+        {
+            auto oldWildcard = CreatePoint(_X("Get*"));
+            auto newWildcard = CreatePoint(_X("Get*"));
+            InstrumentationPointSet oldPoints{ CreatePoint(_X("MyMethod")), oldWildcard };
+            InstrumentationPointSet newPoints{ CreatePoint(_X("MyMethod")), newWildcard };
+
+            InstrumentationDiff unchanged(oldPoints, newPoints);
+            Assert::IsTrue(unchanged.IsEmpty());
+
+            InstrumentationDiff diff(oldPoints, newPoints, true);
+            Assert::IsFalse(diff.IsEmpty());
+            Assert::IsTrue(diff.GetAddedPoints()->empty());
+            Assert::IsTrue(diff.GetRemovedPoints()->empty());
+            Assert::AreEqual(size_t(1), diff.GetPointsToRejit()->size());
+            Assert::IsTrue(*diff.GetPointsToRejit()->begin() == newWildcard);
+            Assert::AreEqual(size_t(1), diff.GetPointsToRevert()->size());
+            Assert::IsTrue(*diff.GetPointsToRevert()->begin() == oldWildcard);
+        }
+
+        TEST_METHOD(changed_ignore_list_without_wildcard_points_has_no_difference)
+        {
+            InstrumentationPointSet oldPoints{ CreatePoint(_X("MyMethod")) };
+            InstrumentationPointSet newPoints{ CreatePoint(_X("MyMethod")) };
+
+            InstrumentationDiff diff(oldPoints, newPoints, true);
+            Assert::IsTrue(diff.IsEmpty());
+        }
+
+    private:
+        static InstrumentationPointPtr CreatePoint(const xstring_t& methodName)
+        {
+            auto point = std::make_shared<InstrumentationPoint>();
+            point->TracerFactoryName = _X("MyTracer");
+            point->AssemblyName = _X("MyAssembly");
+            point->ClassName = _X("MyNamespace.MyClass");
+            point->MethodName = methodName;
+            return point;
+        }
+    };
+}}}}
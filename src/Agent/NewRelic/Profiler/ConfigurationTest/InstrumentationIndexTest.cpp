@@ -0,0 +1,161 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "../Configuration/InstrumentationConfiguration.h"
+#include "../Configuration/InstrumentationIndex.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic { namespace Profiler { namespace Configuration { namespace Test
+{
+    TEST_CLASS(InstrumentationIndexTest)
+    {
+    public:
+        TEST_METHOD(points_round_trip_through_the_index)
+        {
+            auto points = ParseInstrumentationPoints();
+            auto indexData = InstrumentationIndexWriter::Write(InstrumentationIndexSources(), *points);
+            auto index = InstrumentationIndex::TryOpen(indexData.data(), indexData.size());
+            Assert::IsFalse(index == nullptr);
+            Assert::AreEqual(uint32_t(4), index->GetInstrumentationPointCount());
+
+            auto indexPoints = index->GetInstrumentationPoints();
+            Assert::AreEqual(points->size(), indexPoints->size());
+            for (auto& point : *points)
+            {
+                auto match = FindByDefinition(*indexPoints, point->GetDefinitionKey());
+                Assert::IsFalse(match == nullptr);
+                Assert::AreEqual(point->TracerFactoryName, match->TracerFactoryName);
+                Assert::AreEqual(point->AssemblyName, match->AssemblyName);
+                Assert::AreEqual(point->ClassName, match->ClassName);
+                Assert::AreEqual(point->MethodName, match->MethodName);
+                Assert::AreEqual(point->MetricName, match->MetricName);
+                Assert::AreEqual(point->MetricType, match->MetricType);
+                Assert::AreEqual(point->TracerFactoryArgs, match->TracerFactoryArgs);
+                Assert::AreEqual(point->Parameters == nullptr, match->Parameters == nullptr);
+                if (point->Parameters != nullptr)
+                {
+                    Assert::AreEqual(*point->Parameters, *match->Parameters);
+                }
+                Assert::AreEqual(point->MinVersion == nullptr, match->MinVersion == nullptr);
+                if (point->MinVersion != nullptr)
+                {
+                    Assert::AreEqual(point->MinVersion->ToString(), match->MinVersion->ToString());
+                }
+                Assert::AreEqual(point->MaxVersion == nullptr, match->MaxVersion == nullptr);
+                if (point->MaxVersion != nullptr)
+                {
+                    Assert::AreEqual(point->MaxVersion->ToString(), match->MaxVersion->ToString());
+                }
+            }
+        }
+
+        TEST_METHOD(empty_index_is_valid)
+        {
+            auto indexData = InstrumentationIndexWriter::Write(InstrumentationIndexSources(), InstrumentationPointSet());
+            auto index = InstrumentationIndex::TryOpen(indexData.data(), indexData.size());
+            Assert::IsFalse(index == nullptr);
+            Assert::AreEqual(uint32_t(0), index->GetInstrumentationPointCount());
+            Assert::IsTrue(index->GetInstrumentationPoints()->empty());
+        }
+
+        TEST_METHOD(index_does_not_depend_on_parse_order)
+        {
+            auto first = InstrumentationIndexWriter::Write(InstrumentationIndexSources(), *ParseInstrumentationPoints());
+            auto second = InstrumentationIndexWriter::Write(InstrumentationIndexSources(), *ParseInstrumentationPoints());
+            Assert::IsTrue(first == second);
+        }
+
+        TEST_METHOD(truncated_or_corrupt_index_is_rejected)
+        {
+            auto indexData = InstrumentationIndexWriter::Write(InstrumentationIndexSources(), *ParseInstrumentationPoints());
+            Assert::IsTrue(InstrumentationIndex::TryOpen(indexData.data(), indexData.size() - 4) == nullptr);
+
+            auto wrongVersion = indexData;
+            reinterpret_cast<InstrumentationIndexHeader*>(wrongVersion.data())->version = InstrumentationIndexVersion + 1;
+            Assert::IsTrue(InstrumentationIndex::TryOpen(wrongVersion.data(), wrongVersion.size()) == nullptr);
+
+            auto badString = indexData;
+            auto header = reinterpret_cast<InstrumentationIndexHeader*>(badString.data());
+            reinterpret_cast<InstrumentationIndexPoint*>(badString.data() + header->pointTableOffset)->className = header->stringTableSize;
+            Assert::IsTrue(InstrumentationIndex::TryOpen(badString.data(), badString.size()) == nullptr);
+        }
+
+        TEST_METHOD(index_is_stale_when_the_xml_files_differ)
+        {
+            InstrumentationIndexSources sources;
+            sources.emplace(_X("NewRelic.Providers.Wrapper.Sql.Instrumentation.xml"), InstrumentationIndexSourceStamp());
+            auto indexData = InstrumentationIndexWriter::Write(sources, *ParseInstrumentationPoints());
+            auto index = InstrumentationIndex::TryOpen(indexData.data(), indexData.size());
+
+            Assert::IsFalse(index->IsCurrent(_X("extensions"), std::set<xstring_t>()));
+            Assert::IsFalse(index->IsCurrent(_X("extensions"), { xstring_t(_X("extensions")) + PATH_SEPARATOR + _X("NewRelic.Providers.Wrapper.Sql.Instrumentation.xml") }));
+        }
+
+        TEST_METHOD(index_is_stale_when_an_xml_file_changes_without_changing_size)
+        {
+            const xstring_t sourcePath = xstring_t(_X(".")) + PATH_SEPARATOR + _X("temp_instrumentation_index_source.xml");
+            WriteFile(sourcePath, "<extension/>");
+            InstrumentationIndexSourceStamp stamp;
+            Assert::IsTrue(TryGetInstrumentationIndexSourceStamp(sourcePath, stamp));
+            Assert::AreEqual(uint64_t(12), stamp.size);
+
+            InstrumentationIndexSources sources;
+            sources.emplace(_X("temp_instrumentation_index_source.xml"), stamp);
+            auto indexData = InstrumentationIndexWriter::Write(sources, *ParseInstrumentationPoints());
+            auto index = InstrumentationIndex::TryOpen(indexData.data(), indexData.size());
+            Assert::IsTrue(index->IsCurrent(_X("."), { sourcePath }));
+
+            // the same size, and likely the same last write time
+            WriteFile(sourcePath, "<Extension/>");
+            Assert::IsFalse(index->IsCurrent(_X("."), { sourcePath }));
+        }
+
+    private:
+        static void WriteFile(const xstring_t& filePath, const std::string& contents)
+        {
+            std::ofstream file(to_pathstring(filePath), std::ios::binary | std::ios::trunc);
+            file << contents;
+        }
+
+        static InstrumentationPointPtr FindByDefinition(const InstrumentationPointSet& instrumentationPoints, const xstring_t& definitionKey)
+        {
+            for (auto& instrumentationPoint : instrumentationPoints)
+            {
+                if (instrumentationPoint->GetDefinitionKey() == definitionKey)
+                {
+                    return instrumentationPoint;
+                }
+            }
+            return nullptr;
+        }
+
+        static InstrumentationPointSetPtr ParseInstrumentationPoints()
+        {
+            InstrumentationXmlSetPtr xmlSet(new InstrumentationXmlSet());
+            xmlSet->emplace(L"filename", L"\
+                <?xml version=\"1.0\" encoding=\"utf-8\"?>\
+                <extension>\
+                    <instrumentation>\
+                        <tracerFactory name=\"MyTracer\" metricName=\"instance\" transactionNamingPriority=\"3\">\
+                            <match assemblyName=\"MyAssembly\" className=\"MyNamespace.MyClass\" minVersion=\"1.2\" maxVersion=\"3.0.0.1\">\
+                                <exactMethodMatcher methodName=\"MyMethod\"/>\
+                                <exactMethodMatcher methodName=\"MyMethod\" parameters=\"void\"/>\
+                                <exactMethodMatcher methodName=\"MyOtherMethod\" parameters=\"System.String, System.Int32\"/>\
+                            </match>\
+                        </tracerFactory>\
+                        <tracerFactory>\
+                            <match assemblyName=\"MyAssembly\" className=\"MyNamespace.MyOtherClass\">\
+                                <exactMethodMatcher methodName=\"MyMethod\"/>\
+                            </match>\
+                        </tracerFactory>\
+                    </instrumentation>\
+                </extension>\
+                ");
+            InstrumentationConfiguration instrumentation(xmlSet, nullptr);
+            return instrumentation.GetInstrumentationPoints();
+        }
+    };
+}}}}
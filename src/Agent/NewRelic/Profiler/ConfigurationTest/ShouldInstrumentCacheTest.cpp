@@ -0,0 +1,142 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include <stdio.h>
+#include <fstream>
+#include "../Configuration/ShouldInstrumentCache.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic { namespace Profiler { namespace Configuration { namespace Test
+{
+    TEST_CLASS(ShouldInstrumentCacheTest)
+    {
+    public:
+        TEST_METHOD(keys_depend_on_where_values_are_split)
+        {
+            auto first = ShouldInstrumentCacheKey().Add(xstring_t(_X("ab"))).Add(xstring_t(_X("c"))).Get();
+            auto second = ShouldInstrumentCacheKey().Add(xstring_t(_X("a"))).Add(xstring_t(_X("bc"))).Get();
+            auto again = ShouldInstrumentCacheKey().Add(xstring_t(_X("ab"))).Add(xstring_t(_X("c"))).Get();
+            Assert::AreNotEqual(first, second);
+            Assert::AreEqual(first, again);
+        }
+
+        TEST_METHOD(keys_depend_on_flags)
+        {
+            auto coreClr = ShouldInstrumentCacheKey().Add(xstring_t(_X("dotnet"))).Add(true).Get();
+            auto netFramework = ShouldInstrumentCacheKey().Add(xstring_t(_X("dotnet"))).Add(false).Get();
+            Assert::AreNotEqual(coreClr, netFramework);
+        }
+
+        TEST_METHOD(keys_depend_on_the_size_of_files_and_whether_they_exist)
+        {
+            remove("temp_newrelic.config");
+            auto missing = ShouldInstrumentCacheKey().AddFile(_X("temp_newrelic.config")).Get();
+            WriteFile("temp_newrelic.config", "<configuration/>");
+            auto written = ShouldInstrumentCacheKey().AddFile(_X("temp_newrelic.config")).Get();
+            auto again = ShouldInstrumentCacheKey().AddFile(_X("temp_newrelic.config")).Get();
+            WriteFile("temp_newrelic.config", "<configuration></configuration>");
+            auto edited = ShouldInstrumentCacheKey().AddFile(_X("temp_newrelic.config")).Get();
+            remove("temp_newrelic.config");
+
+            Assert::AreNotEqual(missing, written);
+            Assert::AreEqual(written, again);
+            Assert::AreNotEqual(written, edited);
+        }
+
+        TEST_METHOD(empty_table_has_no_verdicts)
+        {
+            ShouldInstrumentDecisionTable table;
+            bool shouldInstrument = false;
+            Assert::IsFalse(table.TryGet(1, shouldInstrument));
+            Assert::IsFalse(table.TryGet(12345, shouldInstrument));
+        }
+
+        TEST_METHOD(verdicts_round_trip_through_bytes)
+        {
+            ShouldInstrumentDecisionTable table;
+            table.Put(7, true);
+            table.Put(8, false);
+
+            ShouldInstrumentDecisionTable loaded;
+            Assert::IsTrue(loaded.Load(table.GetBytes()));
+
+            bool shouldInstrument = false;
+            Assert::IsTrue(loaded.TryGet(7, shouldInstrument));
+            Assert::IsTrue(shouldInstrument);
+            Assert::IsTrue(loaded.TryGet(8, shouldInstrument));
+            Assert::IsFalse(shouldInstrument);
+        }
+
+        TEST_METHOD(new_verdict_replaces_the_one_in_its_slot)
+        {
+            ShouldInstrumentDecisionTable table;
+            table.Put(5, true);
+            table.Put(5 + ShouldInstrumentDecisionTable::SlotCount, false);
+
+            bool shouldInstrument = false;
+            Assert::IsFalse(table.TryGet(5, shouldInstrument));
+            Assert::IsTrue(table.TryGet(5 + ShouldInstrumentDecisionTable::SlotCount, shouldInstrument));
+            Assert::IsFalse(shouldInstrument);
+        }
+
+        TEST_METHOD(damaged_bytes_are_not_loaded)
+        {
+            ShouldInstrumentDecisionTable table;
+            table.Put(7, true);
+            auto bytes = table.GetBytes();
+
+            ShouldInstrumentDecisionTable truncated;
+            Assert::IsFalse(truncated.Load(std::vector<uint8_t>(bytes.begin(), bytes.end() - 1)));
+
+            bytes[0] ^= 0xff;
+            ShouldInstrumentDecisionTable wrongMagic;
+            Assert::IsFalse(wrongMagic.Load(bytes));
+            bool shouldInstrument = false;
+            Assert::IsFalse(wrongMagic.TryGet(7, shouldInstrument));
+        }
+
+        TEST_METHOD(verdicts_round_trip_through_the_file)
+        {
+            remove("temp_decision_cache");
+            ShouldInstrumentCache(_X("temp_decision_cache"), 1).Put(7, true);
+            // a second process keeps the first one's verdict
+            ShouldInstrumentCache(_X("temp_decision_cache"), 2).Put(8, false);
+
+            ShouldInstrumentCache cache(_X("temp_decision_cache"), 3);
+            bool shouldInstrument = false;
+            Assert::IsTrue(cache.TryGet(7, shouldInstrument));
+            Assert::IsTrue(shouldInstrument);
+            Assert::IsTrue(cache.TryGet(8, shouldInstrument));
+            Assert::IsFalse(shouldInstrument);
+            Assert::IsFalse(cache.TryGet(9, shouldInstrument));
+            remove("temp_decision_cache");
+        }
+
+        TEST_METHOD(missing_or_damaged_file_has_no_verdicts)
+        {
+            remove("temp_decision_cache");
+            ShouldInstrumentCache cache(_X("temp_decision_cache"), 1);
+            bool shouldInstrument = false;
+            Assert::IsFalse(cache.TryGet(7, shouldInstrument));
+
+            cache.Put(7, true);
+            WriteFile("temp_decision_cache", "NRDC");
+            Assert::IsFalse(cache.TryGet(7, shouldInstrument));
+
+            // a damaged file is replaced by the next verdict
+            cache.Put(8, true);
+            Assert::IsTrue(cache.TryGet(8, shouldInstrument));
+            remove("temp_decision_cache");
+        }
+
+    private:
+        static void WriteFile(const char* filePath, const char* contents)
+        {
+            std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+            file << contents;
+        }
+    };
+}}}}
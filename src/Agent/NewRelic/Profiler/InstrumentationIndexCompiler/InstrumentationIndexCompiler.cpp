@@ -0,0 +1,181 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+// Compiles the instrumentation xml in an agent's extensions directory into the instrumentation index the profiler maps at
+// startup instead of parsing the xml (see Configuration/InstrumentationIndex.h).
+//
+//     NewRelicInstrumentationIndexCompiler <extensions directory> <netcore|netframework>
+//
+// The index is written next to the xml as instrumentation.<runtime>.idx.  It has to be compiled again whenever the xml changes;
+// until it is, the profiler detects that the index is stale and reads the xml.
+
+#define LOGGER_DEFINE_STDLOG
+
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include "../Common/FileUtils.h"
+#include "../Common/Strings.h"
+#include "../Configuration/InstrumentationConfiguration.h"
+#include "../Configuration/InstrumentationIndex.h"
+#include "../Logging/Logger.h"
+
+#ifdef PAL_STDCPP_COMPAT
+#include <dirent.h>
+#else
+#include <Windows.h>
+#endif
+
+namespace NewRelic { namespace Profiler { namespace InstrumentationIndexCompiler
+{
+    using namespace Configuration;
+
+    // the same files, with the same paths, as the profiler's SystemCalls::GetFilesInDirectory(directoryPath, "xml")
+    static std::set<xstring_t> GetXmlFilesInDirectory(const xstring_t& directoryPath)
+    {
+        std::set<xstring_t> filePaths;
+#ifdef PAL_STDCPP_COMPAT
+        auto directory = opendir(to_pathstring(directoryPath).c_str());
+        if (directory == nullptr)
+        {
+            return filePaths;
+        }
+
+        while (auto entry = readdir(directory))
+        {
+            const std::string fileName(entry->d_name);
+            if (fileName.size() >= 3 && fileName.compare(fileName.size() - 3, 3, "xml") == 0)
+            {
+                filePaths.emplace(directoryPath + PATH_SEPARATOR + ToWideString(entry->d_name));
+            }
+        }
+        closedir(directory);
+#else
+        WIN32_FIND_DATAW fileData;
+        auto handle = FindFirstFileW((directoryPath + _X("\\*.xml")).c_str(), &fileData);
+        if (handle == INVALID_HANDLE_VALUE)
+        {
+            return filePaths;
+        }
+        do
+        {
+            filePaths.emplace(directoryPath + PATH_SEPARATOR + fileData.cFileName);
+        } while (FindNextFileW(handle, &fileData));
+        FindClose(handle);
+#endif
+        return filePaths;
+    }
+
+    static bool WriteIndex(const xstring_t& indexPath, const std::vector<uint8_t>& index)
+    {
+        // write to a temporary file and rename it over the old index, so a profiler starting up never maps a partial index
+        const auto temporaryPath = to_pathstring(indexPath + _X(".tmp"));
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(index.data()), index.size());
+            if (!file)
+            {
+                return false;
+            }
+        }
+
+#ifdef PAL_STDCPP_COMPAT
+        return std::rename(temporaryPath.c_str(), to_pathstring(indexPath).c_str()) == 0;
+#else
+        return MoveFileExW(temporaryPath.c_str(), indexPath.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#endif
+    }
+
+    static int Compile(const xstring_t& extensionsDirectory, const xstring_t& runtimeDirectoryName)
+    {
+        auto filePaths = GetXmlFilesInDirectory(extensionsDirectory);
+        auto runtimeFilePaths = GetXmlFilesInDirectory(extensionsDirectory + PATH_SEPARATOR + runtimeDirectoryName);
+        filePaths.insert(runtimeFilePaths.begin(), runtimeFilePaths.end());
+
+        // stamp each file before it is read, so a file that changes while this runs makes the index stale rather than wrong
+        InstrumentationIndexSources sources;
+        InstrumentationXmlSetPtr instrumentationXmls(new InstrumentationXmlSet());
+        for (auto& filePath : filePaths)
+        {
+            InstrumentationIndexSourceStamp stamp;
+            if (!TryGetInstrumentationIndexSourceStamp(filePath, stamp))
+            {
+                std::cerr << "Unable to read " << Profiler::Strings::ToUtf8(filePath) << std::endl;
+                return 1;
+            }
+            try
+            {
+                instrumentationXmls->emplace(filePath, ReadFile(filePath));
+            }
+            catch (...)
+            {
+                std::cerr << "Unable to read " << Profiler::Strings::ToUtf8(filePath) << std::endl;
+                return 1;
+            }
+            sources.emplace(filePath.substr(extensionsDirectory.size() + 1), stamp);
+        }
+
+        // the index must hold exactly what the profiler would have parsed, so a file it cannot parse fails the build of the index
+        InstrumentationConfiguration instrumentationConfiguration(instrumentationXmls, nullptr);
+        if (instrumentationConfiguration.GetInvalidFileCount() > 0)
+        {
+            std::cerr << "Unable to parse one or more instrumentation files, no index was written." << std::endl;
+            return 1;
+        }
+
+        const auto indexPath = GetInstrumentationIndexPath(extensionsDirectory, runtimeDirectoryName);
+        const auto index = InstrumentationIndexWriter::Write(sources, *instrumentationConfiguration.GetInstrumentationPoints());
+        if (!WriteIndex(indexPath, index))
+        {
+            std::cerr << "Unable to write " << Profiler::Strings::ToUtf8(indexPath) << std::endl;
+            return 1;
+        }
+
+        std::cout << "Wrote " << instrumentationConfiguration.GetInstrumentationPoints()->size() << " instrumentation points from " << sources.size()
+            << " files to " << Profiler::Strings::ToUtf8(indexPath) << std::endl;
+        return 0;
+    }
+
+    static int Run(const xstring_t& extensionsDirectory, const xstring_t& runtimeDirectoryName)
+    {
+        if (runtimeDirectoryName != _X("netcore") && runtimeDirectoryName != _X("netframework"))
+        {
+            std::cerr << "usage: NewRelicInstrumentationIndexCompiler <extensions directory> <netcore|netframework>" << std::endl;
+            return 2;
+        }
+
+        auto directory = extensionsDirectory;
+        while (directory.size() > 1 && (directory.back() == _X('/') || directory.back() == _X('\\')))
+        {
+            directory.pop_back();
+        }
+
+        // report the same warnings the profiler would log for the xml
+        nrlog::StdLog.SetLevel(nrlog::Level::LEVEL_WARN);
+        nrlog::StdLog.SetConsoleLogging(true);
+        nrlog::StdLog.SetEnabled(true);
+        nrlog::StdLog.SetInitalized();
+
+        return Compile(directory, runtimeDirectoryName);
+    }
+}}}
+
+#ifdef PAL_STDCPP_COMPAT
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        return NewRelic::Profiler::InstrumentationIndexCompiler::Run(xstring_t(), xstring_t());
+    }
+    return NewRelic::Profiler::InstrumentationIndexCompiler::Run(ToWideString(argv[1]), ToWideString(argv[2]));
+}
+#else
+int wmain(int argc, wchar_t* argv[])
+{
+    if (argc != 3)
+    {
+        return NewRelic::Profiler::InstrumentationIndexCompiler::Run(xstring_t(), xstring_t());
+    }
+    return NewRelic::Profiler::InstrumentationIndexCompiler::Run(argv[1], argv[2]);
+}
+#endif
@@ -34,7 +34,7 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
         void BuildApiInstructions()
         {
             LogTrace(_function->ToString(), L": Generating API bytecode instrumentation.");
-            // set the max stack size to be big enough for our code
+            // set the max stack size to be big enough for our code, unless Instrument can work out the exact one
             GetHeader()->SetMaxStack(10);
 
             auto tokenizer = _function->GetTokenizer();
@@ -14,6 +14,7 @@
 #include "IFunction.h"
 #include "ISystemCalls.h"
 #include "InstructionSet.h"
+#include "StackDepthAnalyzer.h"
 #include "InstantiatedGenericType.h"
 #include "ExceptionHandlerManipulator.h"
 #include "../Logging/Logger.h"
@@ -85,6 +86,9 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
             // combine the header, instructions and extra sections into a single ByteVector
             auto newMethod = CombineHeaderInstructionsAndExtraSections();
 
+            // replace the max stack the instrumentation estimated with what the new method actually needs
+            SetExactMaxStack(newMethod);
+
             // write the new method to the function so it can be JIT compiled; this is the part that could be fatal
             try
             {
@@ -386,7 +390,7 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
             _instructions->Append(CEE_RETHROW);
 #endif
 
-            _instructions->AppendJump(afterCatch, CEE_LEAVE);
+            _instructions->AppendJump(CEE_LEAVE, afterCatch);
 
             // } // catch end
             _instructions->AppendCatchEnd();
@@ -479,6 +483,36 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
             return bytecodeGenerator.TypeToBytes(type);
         }
 
+        // Works out the max stack of the combined method, and keeps the estimate already in the header if the method can't be
+        // analyzed (for instance a call whose signature can't be read).
+        void SetExactMaxStack(ByteVector& method)
+        {
+            auto resolveSignature = [this](uint32_t token) -> ByteVectorPtr
+            {
+                try
+                {
+                    return _function->GetSignatureFromToken(token);
+                }
+                catch (...)
+                {
+                    return nullptr;
+                }
+            };
+            bool returnsValue = _methodSignature->_returnType->_kind != SignatureParser::ReturnType::VOID_RETURN_TYPE;
+            uint16_t maxStack = 0;
+            if (!StackDepthAnalyzer::TryGetMaxStack(method, returnsValue, resolveSignature, maxStack))
+            {
+                LogDebug(_function->ToString(), L": Unable to work out the max stack of the instrumented method, keeping ", GetHeader()->GetMaxStack(), L".");
+                return;
+            }
+
+            LogTrace(_function->ToString(), L": Setting the max stack to ", maxStack, L" in place of ", GetHeader()->GetMaxStack(), L".");
+            GetHeader()->SetMaxStack(maxStack);
+            // the header has already been copied to the start of the method
+            method[2] = uint8_t(maxStack);
+            method[3] = uint8_t(maxStack >> 8);
+        }
+
         ByteVector CombineHeaderInstructionsAndExtraSections()
         {
             LogTrace(_function->ToString(), L": Building the byte array for this method.");
@@ -84,20 +84,22 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
             _instructions->Append(CEE_LDARG_2);
             _instructions->Append(CEE_LDARG_3);
 
+            auto afterGetMethod = _instructions->CreateLabel();
+
             // if (methodParameterTypes != null)
             auto typeArrayIsNullLabel = _instructions->AppendJump(CEE_BRFALSE);
             {
                 _instructions->Append(CEE_LDARG_3);
                 _instructions->Append(CEE_CALLVIRT, _X("instance class System.Reflection.MethodInfo System.Type::GetMethod(string,class System.Type[])"));
-                _instructions->AppendJump(CEE_BR, _X("after_GetMethod"));
+                _instructions->AppendJump(CEE_BR, afterGetMethod);
             }
             // else
             _instructions->AppendLabel(typeArrayIsNullLabel);
             {
                 _instructions->Append(CEE_CALLVIRT, _X("instance class System.Reflection.MethodInfo System.Type::GetMethod(string)"));
-                _instructions->AppendJump(CEE_BR, _X("after_GetMethod"));
+                _instructions->AppendJump(CEE_BR, afterGetMethod);
             }
-            _instructions->AppendLabel(_X("after_GetMethod"));
+            _instructions->AppendLabel(afterGetMethod);
 
             ThrowExceptionIfStackItemIsNull(_instructions, _X("Failed to load method from type via reflection."), true);
             _instructions->Append(CEE_RET);
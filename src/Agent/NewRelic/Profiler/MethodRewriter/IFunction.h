@@ -19,11 +19,11 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
     {
     public:
         virtual uintptr_t GetFunctionId() = 0;
-        virtual xstring_t GetAssemblyName() = 0;
+        virtual const xstring_t& GetAssemblyName() = 0;
         virtual xstring_t GetModuleName() = 0;
         virtual xstring_t GetAppDomainName() = 0;
-        virtual xstring_t GetTypeName() = 0;
-        virtual xstring_t GetFunctionName() = 0;
+        virtual const xstring_t& GetTypeName() = 0;
+        virtual const xstring_t& GetFunctionName() = 0;
         virtual uint32_t GetMethodToken() = 0;
         virtual uint32_t GetTypeToken() = 0;
         virtual DWORD GetClassAttributes() = 0;
@@ -35,6 +35,8 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
         virtual bool IsValid() = 0;
         virtual bool IsCoreClr() = 0;
         virtual uint32_t GetTracerFlags() = 0;
+        // the MVID of the module this method is in, or nullptr if it can't be read
+        virtual ByteVectorPtr GetModuleVersionId() = 0;
 
         // get the signature for this method
         virtual ByteVectorPtr GetSignature() = 0;
@@ -44,7 +46,7 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
         virtual sicily::codegen::ITokenizerPtr GetTokenizer() = 0;
         // get the token resolver that should be used to modify the code bytes
         virtual SignatureParser::ITokenResolverPtr GetTokenResolver() = 0;
-        // get a signature given a signature token
+        // get a signature given a signature token, or the signature of the method a MethodDef, MemberRef or MethodSpec token refers to
         virtual ByteVectorPtr GetSignatureFromToken(uint32_t token) = 0;
         // get a token for a given signature
         virtual uint32_t GetTokenFromSignature(const ByteVector& signature) = 0;
@@ -71,6 +71,51 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter {
             return GetEnvironmentVariableWithFallback(_X("NEW_RELIC_PROFILER_DELAY_IN_SEC"), _X("NEWRELIC_PROFILER_DELAY_IN_SEC"));
         }
 
+        virtual std::unique_ptr<xstring_t> GetThreadProfilerMaxPauseMicroseconds()
+        {
+            return TryGetEnvironmentVariable(_X("NEW_RELIC_THREAD_PROFILER_MAX_PAUSE_MICROSECONDS"));
+        }
+
+        virtual std::unique_ptr<xstring_t> GetThreadProfilerMaxCpuPercent()
+        {
+            return TryGetEnvironmentVariable(_X("NEW_RELIC_THREAD_PROFILER_MAX_CPU_PERCENT"));
+        }
+
+        virtual bool GetGcStatisticsEnabled()
+        {
+            return GetEnvironmentBool(_X("NEW_RELIC_PROFILER_GC_STATISTICS_ENABLED"), false);
+        }
+
+        // lets GC statistics fall back to COR_PRF_MONITOR_GC, which disables concurrent garbage collection, on runtimes without
+        // basic GC events
+        virtual bool GetGcStatisticsMonitorGcEnabled()
+        {
+            return GetEnvironmentBool(_X("NEW_RELIC_PROFILER_GC_STATISTICS_MONITOR_GC_ENABLED"), false);
+        }
+
+        virtual bool GetWatchExtensionsEnabled()
+        {
+            return GetEnvironmentBool(_X("NEW_RELIC_PROFILER_WATCH_EXTENSIONS_ENABLED"), false);
+        }
+
+        // the file to cache should instrument decisions in, or nullptr to evaluate every process from scratch
+        virtual std::unique_ptr<xstring_t> GetDecisionCachePath()
+        {
+            return TryGetEnvironmentVariable(_X("NEW_RELIC_PROFILER_DECISION_CACHE_PATH"));
+        }
+
+        // the file to cache rewritten methods in, or nullptr to rewrite every method in every process
+        virtual std::unique_ptr<xstring_t> GetRewriteCachePath()
+        {
+            return TryGetEnvironmentVariable(_X("NEW_RELIC_PROFILER_REWRITE_CACHE_PATH"));
+        }
+
+        // the path of the profiler's own module, or nullptr when it can't be found
+        virtual std::unique_ptr<xstring_t> GetProfilerModulePath()
+        {
+            return nullptr;
+        }
+
         std::unique_ptr<xstring_t> GetNewRelicProfilerLogDirectory() override
         {
             return GetEnvironmentVariableWithFallback(_X("NEW_RELIC_PROFILER_LOG_DIRECTORY"), _X("NEWRELIC_PROFILER_LOG_DIRECTORY"));
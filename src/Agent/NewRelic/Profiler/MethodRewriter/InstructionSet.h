@@ -21,11 +21,22 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
     class InstructionSet
     {
     public:
+        // a position in the instructions that jumps can target, created by CreateLabel or AppendJump and placed with AppendLabel
+        class Label
+        {
+        public:
+            explicit Label(uint32_t index) : _index(index) {}
+
+            uint32_t GetIndex() const { return _index; }
+
+        private:
+            uint32_t _index;
+        };
+
         InstructionSet(sicily::codegen::ITokenizerPtr tokenizer, ExceptionHandlerManipulatorPtr exceptionHandlerManipulator) :
             _tokenizer(tokenizer),
             _exceptionHandlerManipulator(exceptionHandlerManipulator),
-            _userCodeOffset(0),
-            _labelCounter(0)
+            _userCodeOffset(0)
         {
             // we need a little over 400 bytes to store the bytes we inject so lets allocate at least that many up front, if we need more the vector will re-allocate
             _bytes.reserve(500);
@@ -254,46 +265,42 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
             AppendOperand(token);
         }
 
-        void AppendJump(const uint8_t& instruction, const xstring_t& label)
+        // create a label to be placed with AppendLabel
+        Label CreateLabel()
         {
-            AppendJump(label, instruction);
+            _labelOffsets.push_back(uint32_t(UnplacedLabel));
+            return Label(uint32_t(_labelOffsets.size() - 1));
         }
 
-        // append a long jump instruction that jumps to a label (defined later). will be a noop if the matching label is never defined.
-        void AppendJump(const xstring_t& label, uint8_t instruction)
+        // append a jump instruction (br, brtrue, leave, etc. in either form) that jumps to a label placed before or after it.  The
+        // jump is written in its long form and switched to the short form by GetBytes if the distance fits.  Jumps to a label that
+        // is never placed jump to the next instruction.
+        void AppendJump(uint8_t instruction, Label label)
         {
-            _bytes.push_back(instruction);
-            // store the offset of the jump distance in our jumps map so we can updated it with a distance later
-            _jumps.emplace(label, _bytes.size());
-            _bytes.push_back(0x00);
-            _bytes.push_back(0x00);
-            _bytes.push_back(0x00);
-            _bytes.push_back(0x00);
+            auto longInstruction = GetLongJumpInstruction(instruction);
+            _jumps.push_back(Jump{ uint32_t(_bytes.size()), longInstruction, label.GetIndex() });
+            _bytes.push_back(longInstruction);
+            AppendOperand(uint32_t(0));
         }
 
-        // append a long jump instruction that jumps to the label returned.  Will be a noop if the label is never appended with AppendLabel.
-        xstring_t AppendJump(const uint8_t& instruction)
+        // append a jump instruction that jumps to the label returned, which is then placed with AppendLabel
+        Label AppendJump(uint8_t instruction)
         {
-            auto label = to_xstring(++_labelCounter) + _X("unique_jump_label");
-            AppendJump(label, instruction);
+            auto label = CreateLabel();
+            AppendJump(instruction, label);
             return label;
         }
 
-        // append a label that can be jumped to.
-        void AppendLabel(const xstring_t& label)
+        // place a label after the instructions appended so far
+        void AppendLabel(Label label)
         {
-            auto jumpLocations = _jumps.equal_range(label);
-            std::for_each(jumpLocations.first, jumpLocations.second, [this](std::pair<xstring_t, size_t> jumpLocationPair)
+            auto& offset = _labelOffsets.at(label.GetIndex());
+            if (offset != UnplacedLabel)
             {
-                auto jumpLocation = jumpLocationPair.second;
-                auto distance = _bytes.size() - jumpLocation - 1;
-                // because the jump instruction takes 3 extra bytes, we need to reduce the distance by 3
-                distance -= 3;
-                _bytes[jumpLocation + 0] = uint8_t(distance & 0xFF);
-                _bytes[jumpLocation + 1] = uint8_t((distance >> 8) & 0xFF);
-                _bytes[jumpLocation + 2] = uint8_t((distance >> 16) & 0xFF);
-                _bytes[jumpLocation + 3] = uint8_t((distance >> 24) & 0xFF);
-            });
+                LogError(L"Attempted to place the same label twice.");
+                throw InstructionSetException();
+            }
+            offset = uint32_t(_bytes.size());
         }
 
         // append a box instruction if necessary and a load argument instruction
@@ -449,6 +456,8 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
 
             // this exception handler is finished, add it to the set of exception handlers
             _exceptionHandlerManipulator->AddExceptionHandlingClause(exception);
+            // remember where it is before the jumps are shortened, GetBytes moves it to where it ends up
+            _exceptionClauses.push_back(ExceptionClauseOffsets{ exception, exception->_tryOffset, exception->_tryLength, exception->_handlerOffset, exception->_handlerLength });
 
             // pop this exception off of our stack
             _exceptionStack.pop();
@@ -460,19 +469,173 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
             Append(userCode);
         }
 
-        // returns the byte array for this set of instructions
-        const ByteVector GetBytes() const
+        // returns the byte array for this set of instructions.  Every jump whose distance fits in a signed byte is shortened, and
+        // the exception handling clauses appended here are moved to match.
+        const ByteVector GetBytes()
         {
-            return _bytes;
+            auto shortJumps = ChooseShortJumps();
+            MoveExceptionClauses(shortJumps);
+
+            ByteVector bytes;
+            bytes.reserve(_bytes.size());
+            uint32_t copied = 0;
+            for (size_t i = 0; i < _jumps.size(); ++i)
+            {
+                auto& jump = _jumps[i];
+                bytes.insert(bytes.end(), _bytes.begin() + copied, _bytes.begin() + jump._offset);
+                copied = jump._offset + LongJumpSize;
+
+                auto distance = GetJumpDistance(i, shortJumps);
+                if (shortJumps[i])
+                {
+                    bytes.push_back(GetShortJumpInstruction(jump._instruction));
+                    bytes.push_back(uint8_t(int8_t(distance)));
+                }
+                else
+                {
+                    bytes.push_back(jump._instruction);
+                    for (int shift = 0; shift < 32; shift += 8)
+                    {
+                        bytes.push_back(uint8_t((uint32_t(distance) >> shift) & 0xff));
+                    }
+                }
+            }
+            bytes.insert(bytes.end(), _bytes.begin() + copied, _bytes.end());
+            return bytes;
         }
 
-        // returns the offset to the user's original code (needed to offset the exception handling clauses)
+        // returns the offset to the user's original code in GetBytes (needed to offset the exception handling clauses)
         uint32_t GetUserCodeOffset() const
         {
-            return _userCodeOffset;
+            return MoveOffset(_userCodeOffset, ChooseShortJumps());
         }
 
     private:
+        // a jump as appended, in its long form
+        struct Jump
+        {
+            uint32_t _offset;
+            uint8_t _instruction;
+            uint32_t _label;
+        };
+
+        // the offsets of an exception clause appended here before any jumps are shortened
+        struct ExceptionClauseOffsets
+        {
+            ExceptionHandlingClausePtr _clause;
+            uint32_t _tryOffset;
+            uint32_t _tryLength;
+            uint32_t _handlerOffset;
+            uint32_t _handlerLength;
+        };
+
+        static constexpr uint32_t LongJumpSize = 5;
+        static constexpr uint32_t ShortJumpSize = 2;
+        static constexpr uint32_t UnplacedLabel = 0xffffffff;
+
+        // br.s through blt.un.s have the same order as br through blt.un (ECMA-335 III.3)
+        static uint8_t GetLongJumpInstruction(uint8_t instruction)
+        {
+            if (instruction >= CEE_BR_S && instruction <= CEE_BLT_UN_S)
+            {
+                return uint8_t(instruction - CEE_BR_S + CEE_BR);
+            }
+            if (instruction == CEE_LEAVE_S)
+            {
+                return uint8_t(CEE_LEAVE);
+            }
+            if ((instruction >= CEE_BR && instruction <= CEE_BLT_UN) || instruction == CEE_LEAVE)
+            {
+                return instruction;
+            }
+            LogError(L"Attempted to append a jump with an instruction that isn't a branch. Instruction: ", std::hex, std::showbase, uint32_t(instruction), std::resetiosflags(std::ios_base::basefield|std::ios_base::showbase));
+            throw InstructionSetException();
+        }
+
+        static uint8_t GetShortJumpInstruction(uint8_t longInstruction)
+        {
+            if (longInstruction == CEE_LEAVE)
+            {
+                return uint8_t(CEE_LEAVE_S);
+            }
+            return uint8_t(longInstruction - CEE_BR + CEE_BR_S);
+        }
+
+        // Every jump starts out long.  Shortening a jump only ever brings the instructions around it closer together, so jumps are
+        // shortened until no more of them fit in the short form.
+        std::vector<bool> ChooseShortJumps() const
+        {
+            std::vector<bool> shortJumps(_jumps.size(), false);
+            bool changed = true;
+            while (changed)
+            {
+                changed = false;
+                for (size_t i = 0; i < _jumps.size(); ++i)
+                {
+                    if (shortJumps[i])
+                    {
+                        continue;
+                    }
+                    shortJumps[i] = true;
+                    auto distance = GetJumpDistance(i, shortJumps);
+                    if (distance >= INT8_MIN && distance <= INT8_MAX)
+                    {
+                        changed = true;
+                    }
+                    else
+                    {
+                        shortJumps[i] = false;
+                    }
+                }
+            }
+            return shortJumps;
+        }
+
+        // the distance from the end of a jump to its label once the given jumps are shortened
+        int64_t GetJumpDistance(size_t jumpIndex, const std::vector<bool>& shortJumps) const
+        {
+            auto& jump = _jumps[jumpIndex];
+            auto target = _labelOffsets.at(jump._label);
+            if (target == UnplacedLabel)
+            {
+                return 0;
+            }
+            auto end = MoveOffset(jump._offset, shortJumps) + LongJumpSize;
+            if (shortJumps[jumpIndex])
+            {
+                end -= LongJumpSize - ShortJumpSize;
+            }
+            return int64_t(MoveOffset(target, shortJumps)) - int64_t(end);
+        }
+
+        // where an offset into the appended instructions ends up once the given jumps are shortened
+        uint32_t MoveOffset(uint32_t offset, const std::vector<bool>& shortJumps) const
+        {
+            uint32_t removed = 0;
+            // an offset is never inside a jump, so any jump that starts before it also ends before it
+            for (size_t i = 0; i < _jumps.size() && _jumps[i]._offset < offset; ++i)
+            {
+                if (shortJumps[i])
+                {
+                    removed += LongJumpSize - ShortJumpSize;
+                }
+            }
+            return offset - removed;
+        }
+
+        void MoveExceptionClauses(const std::vector<bool>& shortJumps)
+        {
+            for (auto& offsets : _exceptionClauses)
+            {
+                auto tryOffset = MoveOffset(offsets._tryOffset, shortJumps);
+                auto handlerOffset = MoveOffset(offsets._handlerOffset, shortJumps);
+                offsets._clause->_tryOffset = tryOffset;
+                offsets._clause->_tryLength = MoveOffset(offsets._tryOffset + offsets._tryLength, shortJumps) - tryOffset;
+                offsets._clause->_handlerOffset = handlerOffset;
+                offsets._clause->_handlerLength = MoveOffset(offsets._handlerOffset + offsets._handlerLength, shortJumps) - handlerOffset;
+            }
+        }
+
         void Append(const ByteVector& newBytes)
         {
             Append(newBytes.begin(), newBytes.end());
@@ -773,20 +936,22 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
         }
 
     private:
-        // our vector of bytes that make up this method
+        // our vector of bytes that make up this method, with every jump in its long form and a distance of 0
         ByteVector _bytes;
-        // a map of jump labels to the source of the jump
-        std::unordered_multimap<xstring_t, ByteVector::size_type> _jumps;
+        // the jumps in _bytes, in the order they were appended
+        std::vector<Jump> _jumps;
+        // the offset in _bytes of each label, indexed by Label::GetIndex
+        std::vector<uint32_t> _labelOffsets;
+        // the exception clauses appended here and where they were before any jumps were shortened
+        std::vector<ExceptionClauseOffsets> _exceptionClauses;
         // the tokenizer we should use for tokenizing things
         sicily::codegen::ITokenizerPtr _tokenizer;
         // exception handler manipulator
         ExceptionHandlerManipulatorPtr _exceptionHandlerManipulator;
         // exception handling clauses currently being built
         std::stack<ExceptionHandlingClausePtr> _exceptionStack;
-        // the offset to the original user code (used to build exception handler clauses)
+        // the offset to the original user code in _bytes (used to build exception handler clauses)
         uint32_t _userCodeOffset;
-        // counter for generating unique jump labels
-        uint32_t _labelCounter;
     };
 
     typedef std::shared_ptr<InstructionSet> InstructionSetPtr;
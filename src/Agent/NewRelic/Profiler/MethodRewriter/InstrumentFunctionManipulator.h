@@ -39,6 +39,7 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
         void BuildDefaultInstructions(Configuration::InstrumentationPointPtr instrumentationPoint)
         {
             // set the stack size required to handle these instructions (remember that we push all of this functions arguments onto the stack to recursively call)
+            // this is only an estimate, kept if Instrument can't work out the exact max stack of the new method
             auto originalStackSize = GetHeader()->GetMaxStack();
             unsigned maxStackSize = std::max<unsigned>(std::max<unsigned>(originalStackSize, 10), unsigned(_methodSignature->_parameters->size() + 1));
             GetHeader()->SetMaxStack(maxStackSize);
@@ -52,7 +53,6 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
             _instructions->AppendTryStart();
 
             // Inject the original method
-            _instructions->AppendLabel(_X("user_code"));
             _instructions->AppendUserCode(_oldCodeBytes);
 
             if (_methodSignature->_returnType->_kind != SignatureParser::ReturnType::VOID_RETURN_TYPE)
@@ -72,7 +72,7 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
             _instructions->Append(_X("rethrow"));
 
             // } // end catch
-            _instructions->AppendJump(afterOriginalMethodCatch, CEE_LEAVE);
+            _instructions->AppendJump(CEE_LEAVE, afterOriginalMethodCatch);
             _instructions->AppendCatchEnd();
             _instructions->AppendLabel(afterOriginalMethodCatch);
 
@@ -0,0 +1,84 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "../Common/Fnv1a.h"
+#include "../Common/xplat.h"
+
+namespace NewRelic { namespace Profiler { namespace MethodRewriter
+{
+    // Hashes of the assembly, type and method names MethodRewriter instruments, so that the JIT callback can reject most methods
+    // straight from the name buffers the metadata APIs fill, without allocating a string or a Function.  A method that passes may
+    // still not be instrumented, since two names can hash the same; the MethodRewriter's own checks come after.  Built along with
+    // the MethodRewriter and immutable afterwards.
+    class InstrumentationPrefilter
+    {
+    public:
+        static uint64_t Hash(const xchar_t* name, size_t length)
+        {
+            return Fnv1a::Hash(name, length);
+        }
+
+        static uint64_t Hash(const xstring_t& name)
+        {
+            return Hash(name.data(), name.size());
+        }
+
+        void AddAssembly(const xstring_t& assemblyName) { Add(_assemblies, assemblyName); }
+        void AddType(const xstring_t& typeName) { Add(_types, typeName); }
+        void AddFunction(const xstring_t& functionName) { Add(_functions, functionName); }
+        void AllowAnyType() { _anyType = true; }
+        void AllowAnyFunction() { _anyFunction = true; }
+
+        // Sorts the hashes; call once everything has been added.
+        void Compile()
+        {
+            Compile(_assemblies);
+            Compile(_types);
+            Compile(_functions);
+        }
+
+        bool MayInstrumentAssembly(uint64_t assemblyNameHash) const
+        {
+            return Contains(_assemblies, assemblyNameHash);
+        }
+
+        bool MayInstrumentType(const xchar_t* typeName, size_t length) const
+        {
+            return _anyType || Contains(_types, Hash(typeName, length));
+        }
+
+        bool MayInstrumentFunction(const xchar_t* functionName, size_t length) const
+        {
+            return _anyFunction || Contains(_functions, Hash(functionName, length));
+        }
+
+    private:
+        std::vector<uint64_t> _assemblies;
+        std::vector<uint64_t> _types;
+        std::vector<uint64_t> _functions;
+        bool _anyType = false;
+        bool _anyFunction = false;
+
+        static void Add(std::vector<uint64_t>& hashes, const xstring_t& name)
+        {
+            hashes.push_back(Hash(name));
+        }
+
+        static void Compile(std::vector<uint64_t>& hashes)
+        {
+            std::sort(hashes.begin(), hashes.end());
+            hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+            hashes.shrink_to_fit();
+        }
+
+        static bool Contains(const std::vector<uint64_t>& hashes, uint64_t hash)
+        {
+            return std::binary_search(hashes.begin(), hashes.end(), hash);
+        }
+    };
+}}}
@@ -5,14 +5,16 @@
 #pragma once
 #include "../Configuration/Configuration.h"
 #include "../Configuration/InstrumentationConfiguration.h"
+#include "RewrittenMethodCache.h"
 
 namespace NewRelic { namespace Profiler { namespace MethodRewriter
 {
     class InstrumentationSettings {
     public:
-        InstrumentationSettings(Configuration::InstrumentationConfigurationPtr instrumentationConfig, xstring_t corePath) :
+        InstrumentationSettings(Configuration::InstrumentationConfigurationPtr instrumentationConfig, xstring_t corePath, RewrittenMethodCachePtr rewrittenMethodCache = nullptr) :
             _instrumentationConfig(instrumentationConfig),
-            _corePath(corePath)
+            _corePath(corePath),
+            _rewrittenMethodCache(rewrittenMethodCache)
         {}
 
         xstring_t GetCorePath()
@@ -25,9 +27,16 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
             return _instrumentationConfig;
         }
 
+        // nullptr if rewritten methods aren't cached
+        RewrittenMethodCachePtr GetRewrittenMethodCache()
+        {
+            return _rewrittenMethodCache;
+        }
+
     private:
         Configuration::InstrumentationConfigurationPtr _instrumentationConfig;
         xstring_t _corePath;
+        RewrittenMethodCachePtr _rewrittenMethodCache;
     };
 
     typedef std::shared_ptr<InstrumentationSettings> InstrumentationSettingsPtr;
@@ -15,6 +15,7 @@
 #include "../Configuration/InstrumentationConfiguration.h"
 #include "../Common/CorStandIn.h"
 #include "InstrumentationSettings.h"
+#include "RewrittenMethodCache.h"
 
 namespace NewRelic { namespace Profiler { namespace MethodRewriter
 {
@@ -34,7 +35,10 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
             {
                 if (!function->ShouldTrace())
                 {
-                    LogTrace(L"No instrumentation point for ", function->ToString());
+                    if (nrlog::Level::LEVEL_TRACE >= nrlog::StdLog.GetLevel())
+                    {
+                        LogTrace(L"No instrumentation point for ", function->ToString());
+                    }
                     return false;
                 }
 
@@ -72,7 +76,21 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
 
             LogInfo(L"Instrumenting method: ", function->ToString());
 
-            InstrumentFunctionManipulator manipulator(function, instrumentationSettings);
+            // the key is taken from the method as it was before the manipulator preprocesses it
+            auto rewrittenMethodCache = instrumentationSettings->GetRewrittenMethodCache();
+            RewrittenMethodKey cacheKey;
+            if (rewrittenMethodCache != nullptr && rewrittenMethodCache->TryGetKey(*function, *instrumentationPoint, instrumentationSettings->GetCorePath(), cacheKey)) {
+                if (rewrittenMethodCache->TryWriteMethod(cacheKey, *function)) {
+                    LogDebug(L"Instrumented method from the rewrite cache: ", function->ToString());
+                    return true;
+                }
+            }
+            else {
+                rewrittenMethodCache = nullptr;
+            }
+
+            auto recordingFunction = rewrittenMethodCache != nullptr ? std::make_shared<RecordingFunction>(function) : nullptr;
+            InstrumentFunctionManipulator manipulator(recordingFunction != nullptr ? recordingFunction : function, instrumentationSettings);
             if (!function->IsValid()) {
                 // we might have mucked the method up trying to re-write multiple RETs
                 LogInfo(L"Skipping invalid method: ", function->ToString());
@@ -80,6 +98,9 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
             }
             else {
                 manipulator.InstrumentDefault(instrumentationPoint);
+                if (recordingFunction != nullptr) {
+                    rewrittenMethodCache->Put(cacheKey, *recordingFunction, *function->GetMethodBytes());
+                }
                 return true;
             }
         }
@@ -118,12 +139,13 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter
     {
         bool Instrument(IFunctionPtr function, InstrumentationSettingsPtr) override
         {
-            if (!Strings::EndsWith(function->GetModuleName(), _X("mscorlib.dll")))
-                return false;
-            
+            // the type name first since the module name is only fetched when it is asked for
             if (function->GetTypeName() != _X("System.CannotUnloadAppDomainException"))
                 return false;
 
+            if (!Strings::EndsWith(function->GetModuleName(), _X("mscorlib.dll")))
+                return false;
+
             if (function->GetFunctionName() != _X("GetThreadLocalBoolean") &&
                 function->GetFunctionName() != _X("SetThreadLocalBoolean") &&
                 function->GetFunctionName() != _X("GetAppDomainBoolean") &&
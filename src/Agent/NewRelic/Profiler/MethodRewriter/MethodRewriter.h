@@ -10,7 +10,9 @@
 #include "Exceptions.h"
 #include "FunctionManipulator.h"
 #include "IFunction.h"
+#include "InstrumentationPrefilter.h"
 #include "Instrumentors.h"
+#include "RewrittenMethodCache.h"
 #include <iomanip>
 #include <memory>
 #include <stdint.h>
@@ -23,7 +25,7 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter {
 
     class MethodRewriter {
     public:
-        MethodRewriter(Configuration::InstrumentationConfigurationPtr instrumentationConfiguration, const xstring_t& corePath)
+        MethodRewriter(Configuration::InstrumentationConfigurationPtr instrumentationConfiguration, const xstring_t& corePath, RewrittenMethodCachePtr rewrittenMethodCache = nullptr)
             : _instrumentationConfiguration(instrumentationConfiguration)
             , _instrumentedAssemblies(new std::set<xstring_t>())
             , _instrumentedFunctionNames(new std::set<xstring_t>())
@@ -32,6 +34,7 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter {
             , _apiInstrumentor(std::make_unique<ApiInstrumentor>())
             , _defaultInstrumentor(std::make_unique<DefaultInstrumentor>())
             , _corePath(corePath)
+            , _rewrittenMethodCache(rewrittenMethodCache)
         {
             Initialize();
         }
@@ -56,10 +59,38 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter {
 
             for (auto instrumentationPoint : *instrumentationPoints) {
 
-                _instrumentedAssemblies->emplace(instrumentationPoint->AssemblyName);
-                _instrumentedFunctionNames->emplace(instrumentationPoint->MethodName);
-                _instrumentedTypes->emplace(instrumentationPoint->ClassName);
+                _instrumentedAssemblies->emplace(instrumentationPoint->AssemblyName.str());
+
+                // a wildcard can match names we cannot list up front, so it lets every name through and leaves the decision to
+                // the instrumentation configuration
+                if (Configuration::InstrumentationPatternMatcher::IsPattern(instrumentationPoint->MethodName)) {
+                    _anyFunctionName = true;
+                } else {
+                    _instrumentedFunctionNames->emplace(instrumentationPoint->MethodName.str());
+                }
+                if (Configuration::InstrumentationPatternMatcher::IsPattern(instrumentationPoint->ClassName)) {
+                    _anyType = true;
+                } else {
+                    _instrumentedTypes->emplace(instrumentationPoint->ClassName.str());
+                }
+            }
+
+            for (auto& assemblyName : *_instrumentedAssemblies) {
+                _prefilter.AddAssembly(assemblyName);
+            }
+            for (auto& typeName : *_instrumentedTypes) {
+                _prefilter.AddType(typeName);
+            }
+            for (auto& functionName : *_instrumentedFunctionNames) {
+                _prefilter.AddFunction(functionName);
             }
+            if (_anyType) {
+                _prefilter.AllowAnyType();
+            }
+            if (_anyFunctionName) {
+                _prefilter.AllowAnyFunction();
+            }
+            _prefilter.Compile();
         }
 
         virtual ~MethodRewriter()
@@ -82,6 +113,13 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter {
             return set;
         }
 
+        // The same decisions as ShouldInstrumentAssembly, ShouldInstrumentType and ShouldInstrumentFunction, made from name hashes
+        // and allowed to let through some names those reject.
+        const InstrumentationPrefilter& GetPrefilter() const
+        {
+            return _prefilter;
+        }
+
         bool ShouldInstrumentAssembly(xstring_t assemblyName)
         {
             return InSet(_instrumentedAssemblies, assemblyName);
@@ -89,20 +127,24 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter {
 
         bool ShouldInstrumentType(xstring_t typeName)
         {
-            return InSet(_instrumentedTypes, typeName);
+            return _anyType || InSet(_instrumentedTypes, typeName);
         }
 
         bool ShouldInstrumentFunction(xstring_t functionName)
         {
-            return InSet(_instrumentedFunctionNames, functionName);
+            return _anyFunctionName || InSet(_instrumentedFunctionNames, functionName);
         }
 
         // instrument the provided method (if necessary)
         void Instrument(IFunctionPtr function)
         {
-            LogTrace("Possibly instrumenting: ", function->ToString());
+            // ToString fetches parts of the function that are otherwise only fetched for methods that are rewritten
+            if (nrlog::Level::LEVEL_TRACE >= nrlog::StdLog.GetLevel())
+            {
+                LogTrace("Possibly instrumenting: ", function->ToString());
+            }
 
-            InstrumentationSettingsPtr instrumentationSettings = std::make_shared<InstrumentationSettings>(_instrumentationConfiguration, _corePath);
+            InstrumentationSettingsPtr instrumentationSettings = std::make_shared<InstrumentationSettings>(_instrumentationConfiguration, _corePath, _rewrittenMethodCache);
 
             if (_helperInstrumentor->Instrument(function, instrumentationSettings) || _apiInstrumentor->Instrument(function, instrumentationSettings) || _defaultInstrumentor->Instrument(function, instrumentationSettings)) {
             }
@@ -110,10 +152,14 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter {
 
     private:
         xstring_t _corePath;
+        RewrittenMethodCachePtr _rewrittenMethodCache;
         Configuration::InstrumentationConfigurationPtr _instrumentationConfiguration;
         std::shared_ptr<std::set<xstring_t>> _instrumentedAssemblies;
         std::shared_ptr<std::set<xstring_t>> _instrumentedTypes;
         std::shared_ptr<std::set<xstring_t>> _instrumentedFunctionNames;
+        bool _anyType = false;
+        bool _anyFunctionName = false;
+        InstrumentationPrefilter _prefilter;
 
         std::unique_ptr<HelperInstrumentor> _helperInstrumentor;
         std::unique_ptr<ApiInstrumentor> _apiInstrumentor;
@@ -0,0 +1,230 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "../Common/Macros.h"
+
+namespace NewRelic { namespace Profiler { namespace MethodRewriter
+{
+    // What opcode.def says about one IL opcode: the operand that follows it, how many values it pops off and pushes onto the
+    // evaluation stack and where control goes next.
+    struct OpCodeInfo
+    {
+        enum OperandKind : uint8_t
+        {
+            NoOperand,
+            OneByte,
+            TwoBytes,
+            FourBytes,
+            EightBytes,
+            Token,
+            ShortBranchTarget,
+            BranchTarget,
+            Switch
+        };
+
+        enum FlowControl : uint8_t
+        {
+            // also breakpoints and prefixes
+            Next,
+            Call,
+            Branch,
+            ConditionalBranch,
+            Return,
+            Throw
+        };
+
+        // the pop or push count of call, callvirt, calli, newobj and ret, which depends on a signature
+        static const uint8_t VariableStack = 0xff;
+
+        bool isValid;
+        OperandKind operand;
+        uint8_t pop;
+        uint8_t push;
+        FlowControl flow;
+
+        // Reads the opcode at offset, leaving offset at its operand and index at its ILCODE.  Two byte opcodes start with 0xfe and
+        // follow the 256 one byte opcodes in opcode.def.  nullptr if the opcode doesn't fit before end or isn't a real opcode.
+        static const OpCodeInfo* Decode(const ByteVector& code, size_t& offset, size_t end, size_t& index)
+        {
+            if (offset >= end)
+            {
+                return nullptr;
+            }
+            index = code[offset++];
+            if (index == 0xfe)
+            {
+                if (offset >= end)
+                {
+                    return nullptr;
+                }
+                index = 256 + code[offset++];
+            }
+
+            auto& opCodes = GetOpCodes();
+            if (index >= opCodes.size() || !opCodes[index].isValid)
+            {
+                return nullptr;
+            }
+            return &opCodes[index];
+        }
+
+        // The size of the operand at offset, false if it doesn't fit before end.
+        bool TryGetOperandSize(const ByteVector& code, size_t offset, size_t end, size_t& operandSize) const
+        {
+            switch (operand)
+            {
+                case NoOperand: operandSize = 0; break;
+                case OneByte: operandSize = 1; break;
+                case ShortBranchTarget: operandSize = 1; break;
+                case TwoBytes: operandSize = 2; break;
+                case FourBytes: operandSize = 4; break;
+                case Token: operandSize = 4; break;
+                case BranchTarget: operandSize = 4; break;
+                case EightBytes: operandSize = 8; break;
+                case Switch:
+                    if (offset + 4 > end)
+                    {
+                        return false;
+                    }
+                    operandSize = 4 + size_t(Read32(code, offset)) * 4;
+                    break;
+            }
+            return offset + operandSize <= end;
+        }
+
+        static uint32_t Read32(const ByteVector& bytes, size_t offset)
+        {
+            return uint32_t(bytes[offset]) | (uint32_t(bytes[offset + 1]) << 8) | (uint32_t(bytes[offset + 2]) << 16) | (uint32_t(bytes[offset + 3]) << 24);
+        }
+
+        static const std::vector<OpCodeInfo>& GetOpCodes()
+        {
+            static const std::vector<OpCodeInfo> opCodes = BuildOpCodes();
+            return opCodes;
+        }
+
+    private:
+        static std::vector<OpCodeInfo> BuildOpCodes()
+        {
+            // the columns are stringized rather than used, since OpCodes.h defines the operand names as operand sizes and the
+            // control flow names as numbers
+            #undef OPDEF
+            #define OPDEF(id, name, pop, push, operand, type, len, OpCode1, OpCode2, cf) { name, #pop, #push, #operand, #cf },
+            static const char* const columns[][5] =
+            {
+                #include <opcode.def>
+            };
+            #undef OPDEF
+
+            std::vector<OpCodeInfo> opCodes;
+            opCodes.reserve(lengthof(columns));
+            for (auto& column : columns)
+            {
+                OpCodeInfo opCode;
+                // the entries after the two byte opcodes (illegal, endmac and the prefix bytes) aren't opcodes
+                opCode.isValid = opCodes.size() < CEE_ILLEGAL && strncmp(column[0], "unused", 6) != 0;
+                opCode.pop = GetStackCount(column[1], "Pop0", "VarPop");
+                opCode.push = GetStackCount(column[2], "Push0", "VarPush");
+                opCode.operand = GetOperandKind(column[3]);
+                opCode.flow = GetFlowControl(column[4]);
+                opCodes.push_back(opCode);
+            }
+            return opCodes;
+        }
+
+        // PopRef+PopI+PopI is 3 values, Push1+Push1 is 2
+        static uint8_t GetStackCount(const char* column, const char* none, const char* variable)
+        {
+            if (strcmp(column, none) == 0)
+            {
+                return 0;
+            }
+            if (strcmp(column, variable) == 0)
+            {
+                return VariableStack;
+            }
+            uint8_t count = 1;
+            for (auto character = column; *character != '\0'; ++character)
+            {
+                if (*character == '+')
+                {
+                    ++count;
+                }
+            }
+            return count;
+        }
+
+        static OperandKind GetOperandKind(const char* operandName)
+        {
+            static const char* const tokenOperands[] = { "InlineMethod", "InlineField", "InlineType", "InlineString", "InlineSig", "InlineTok" };
+            for (auto tokenOperand : tokenOperands)
+            {
+                if (strcmp(operandName, tokenOperand) == 0)
+                {
+                    return Token;
+                }
+            }
+            if (strcmp(operandName, "InlineNone") == 0)
+            {
+                return NoOperand;
+            }
+            if (strcmp(operandName, "ShortInlineBrTarget") == 0)
+            {
+                return ShortBranchTarget;
+            }
+            if (strcmp(operandName, "InlineBrTarget") == 0)
+            {
+                return BranchTarget;
+            }
+            if (strcmp(operandName, "ShortInlineVar") == 0 || strcmp(operandName, "ShortInlineI") == 0)
+            {
+                return OneByte;
+            }
+            if (strcmp(operandName, "InlineVar") == 0)
+            {
+                return TwoBytes;
+            }
+            if (strcmp(operandName, "InlineI8") == 0 || strcmp(operandName, "InlineR") == 0)
+            {
+                return EightBytes;
+            }
+            if (strcmp(operandName, "InlineSwitch") == 0)
+            {
+                return Switch;
+            }
+            // InlineI and ShortInlineR
+            return FourBytes;
+        }
+
+        static FlowControl GetFlowControl(const char* flowName)
+        {
+            if (strcmp(flowName, "CALL") == 0)
+            {
+                return Call;
+            }
+            if (strcmp(flowName, "BRANCH") == 0)
+            {
+                return Branch;
+            }
+            if (strcmp(flowName, "COND_BRANCH") == 0)
+            {
+                return ConditionalBranch;
+            }
+            if (strcmp(flowName, "RETURN") == 0)
+            {
+                return Return;
+            }
+            if (strcmp(flowName, "THROW") == 0)
+            {
+                return Throw;
+            }
+            // NEXT, BREAK and META
+            return Next;
+        }
+    };
+}}}
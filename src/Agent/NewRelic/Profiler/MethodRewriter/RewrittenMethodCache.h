@@ -0,0 +1,940 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "../Common/Fnv1a.h"
+#include "../Common/Macros.h"
+#include "../Common/xplat.h"
+#include "../Configuration/InstrumentationPoint.h"
+#include "../Logging/Logger.h"
+#include "IFunction.h"
+#include "OpCodeInfo.h"
+
+#ifdef PAL_STDCPP_COMPAT
+#include <stdio.h>
+#else
+#include <Windows.h>
+#endif
+
+namespace NewRelic { namespace Profiler { namespace MethodRewriter
+{
+    // One call made to the tokenizer (or to IFunction::GetTokenFromSignature) while a method was rewritten, with everything needed
+    // to make the same call again in a later process.
+    struct TokenRecipe
+    {
+        enum Kind : uint8_t
+        {
+            AssemblyRef,
+            TypeRefByFullName,
+            TypeRefByName,
+            TypeDef,
+            TypeSpec,
+            MemberRefOrDef,
+            MethodDefinition,
+            MethodSpec,
+            String,
+            // a string that ends with the function id, see FunctionManipulator::LoadMethodInfo; first is everything before the id
+            FunctionIdString,
+            StandAloneSig,
+            KindCount
+        };
+
+        Kind kind = AssemblyRef;
+        xstring_t first;
+        xstring_t second;
+        xstring_t third;
+        ByteVector blob;
+        // the parent (or type definition) token of the call, or with parentIsRecipe the index of the earlier recipe that produced it
+        uint32_t parent = 0;
+        bool parentIsRecipe = false;
+        // the token the call returned when the method was rewritten
+        uint32_t token = 0;
+
+        // Type tokens are also found inside the signature blobs, which are replayed as they were recorded, so a method can only be
+        // replayed if each of its type tokens comes back the same.
+        bool IsTypeToken() const
+        {
+            return kind == TypeRefByFullName || kind == TypeRefByName || kind == TypeDef || kind == TypeSpec;
+        }
+
+        // the same formatting FunctionManipulator::LoadMethodInfo uses
+        static xstring_t FormatFunctionId(uintptr_t functionId)
+        {
+            return to_xstring((unsigned long)functionId);
+        }
+    };
+
+    // The place in a rewritten method where the token made by a recipe goes.
+    struct TokenRelocation
+    {
+        uint32_t offset;
+        uint32_t recipe;
+    };
+
+    // Everything a rewritten method depends on besides the recipes themselves: the module (by MVID, which changes whenever the
+    // module is rebuilt), the method in it, the method's original IL and the instrumentation applied to it.
+    struct RewrittenMethodKey
+    {
+        ByteVector moduleVersionId;
+        uint32_t methodToken = 0;
+        uint64_t methodBytesHash = 0;
+        uint64_t instrumentationHash = 0;
+
+        uint64_t Hash() const
+        {
+            return Fnv1aHasher()
+                .AddBytes(moduleVersionId.data(), moduleVersionId.size())
+                .Add(uint64_t(methodToken))
+                .Add(methodBytesHash)
+                .Add(instrumentationHash)
+                .Get();
+        }
+
+        bool operator==(const RewrittenMethodKey& other) const
+        {
+            return moduleVersionId == other.moduleVersionId && methodToken == other.methodToken && methodBytesHash == other.methodBytesHash && instrumentationHash == other.instrumentationHash;
+        }
+    };
+
+    // Finds the metadata tokens in a method: the token operands in its code, the local variable signature token in a fat header and
+    // the class tokens of typed exception clauses.
+    class MethodTokenScanner
+    {
+    public:
+        // Calls visitToken with the offset of every token, and visitInt64 with the offset of the operand of every ldc.i8.  false if
+        // the method isn't well formed, in which case some offsets may already have been visited.
+        template <typename VisitToken, typename VisitInt64>
+        static bool Scan(const ByteVector& method, VisitToken visitToken, VisitInt64 visitInt64)
+        {
+            if (method.empty())
+            {
+                return false;
+            }
+
+            size_t codeOffset = 0;
+            size_t codeSize = 0;
+            bool moreSections = false;
+            if ((method[0] & 0x3) == 0x2)
+            {
+                // tiny header, the code size is in the upper 6 bits
+                codeOffset = 1;
+                codeSize = method[0] >> 2;
+            }
+            else if ((method[0] & 0x7) == 0x3)
+            {
+                // fat header, the header size in 4 byte words is in the upper 4 bits of the flags
+                if (method.size() < 12)
+                {
+                    return false;
+                }
+                codeOffset = (method[1] >> 4) * 4;
+                codeSize = Read32(method, 4);
+                moreSections = (method[0] & 0x8) != 0;
+                if (codeOffset < 12)
+                {
+                    return false;
+                }
+                if (Read32(method, 8) != 0)
+                {
+                    visitToken(uint32_t(8));
+                }
+            }
+            else
+            {
+                return false;
+            }
+
+            if (codeOffset + codeSize > method.size() || !ScanCode(method, codeOffset, codeOffset + codeSize, visitToken, visitInt64))
+            {
+                return false;
+            }
+
+            // extra sections are 4 byte aligned and follow the code
+            auto sectionOffset = (codeOffset + codeSize + 3) & ~size_t(3);
+            while (moreSections)
+            {
+                if (sectionOffset + 4 > method.size())
+                {
+                    return false;
+                }
+                auto kind = method[sectionOffset];
+                bool isFat = (kind & 0x40) != 0;
+                size_t dataSize = isFat ? (Read32(method, sectionOffset) >> 8) : method[sectionOffset + 1];
+                if (dataSize < 4 || sectionOffset + dataSize > method.size())
+                {
+                    return false;
+                }
+
+                // exception handling clauses; a clause with flags of 0 is a typed catch and ends with the class token
+                if ((kind & 0x3f) == 0x1)
+                {
+                    size_t clauseSize = isFat ? 24 : 12;
+                    for (size_t clause = sectionOffset + 4; clause + clauseSize <= sectionOffset + dataSize; clause += clauseSize)
+                    {
+                        uint32_t flags = isFat ? Read32(method, clause) : uint32_t(method[clause] | (method[clause + 1] << 8));
+                        if (flags == 0x0000)
+                        {
+                            visitToken(uint32_t(clause + clauseSize - 4));
+                        }
+                    }
+                }
+
+                moreSections = (kind & 0x80) != 0;
+                sectionOffset = (sectionOffset + dataSize + 3) & ~size_t(3);
+            }
+            return true;
+        }
+
+        static uint32_t Read32(const ByteVector& bytes, size_t offset)
+        {
+            return OpCodeInfo::Read32(bytes, offset);
+        }
+
+        static uint64_t Read64(const ByteVector& bytes, size_t offset)
+        {
+            return uint64_t(Read32(bytes, offset)) | (uint64_t(Read32(bytes, offset + 4)) << 32);
+        }
+
+        static void Write32(ByteVector& bytes, size_t offset, uint32_t value)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                bytes[offset + i] = uint8_t(value >> (8 * i));
+            }
+        }
+
+        static void Write64(ByteVector& bytes, size_t offset, uint64_t value)
+        {
+            Write32(bytes, offset, uint32_t(value));
+            Write32(bytes, offset + 4, uint32_t(value >> 32));
+        }
+
+    private:
+        template <typename VisitToken, typename VisitInt64>
+        static bool ScanCode(const ByteVector& method, size_t offset, size_t end, VisitToken& visitToken, VisitInt64& visitInt64)
+        {
+            while (offset < end)
+            {
+                size_t index = 0;
+                size_t operandSize = 0;
+                auto opCode = OpCodeInfo::Decode(method, offset, end, index);
+                if (opCode == nullptr || !opCode->TryGetOperandSize(method, offset, end, operandSize))
+                {
+                    return false;
+                }
+
+                if (opCode->operand == OpCodeInfo::Token)
+                {
+                    visitToken(uint32_t(offset));
+                }
+                else if (index == CEE_LDC_I8)
+                {
+                    visitInt64(uint32_t(offset));
+                }
+                offset += operandSize;
+            }
+            return true;
+        }
+    };
+
+    // A method as the instrumentation rewrote it, kept as a template: the bytes that were written, the tokenizer calls that made
+    // the tokens in them, and where each of those tokens and the function id go.  Instantiating it makes the same calls in the
+    // current process and patches in whatever tokens they return, which is what rewriting the method again would produce as long
+    // as the type tokens are unchanged.
+    class RewrittenMethod
+    {
+    public:
+        // nullptr if the method can't be cached: the method written isn't well formed, or the original method loads a constant
+        // that equals the function id and so can't be told apart from the function id the instrumentation loads.
+        static std::shared_ptr<const RewrittenMethod> Create(const RewrittenMethodKey& key, uintptr_t functionId, const std::vector<TokenRecipe>& recipes, const ByteVector& method, const ByteVector& originalMethod)
+        {
+            bool loadsFunctionId = false;
+            bool originalIsValid = MethodTokenScanner::Scan(originalMethod, [](uint32_t) {},
+                [&](uint32_t offset) { loadsFunctionId = loadsFunctionId || MethodTokenScanner::Read64(originalMethod, offset) == uint64_t(functionId); });
+            if (!originalIsValid || loadsFunctionId)
+            {
+                return nullptr;
+            }
+
+            std::unordered_map<uint32_t, uint32_t> recipeByToken;
+            for (uint32_t recipe = 0; recipe < recipes.size(); ++recipe)
+            {
+                recipeByToken[recipes[recipe].token] = recipe;
+            }
+
+            auto rewrittenMethod = std::make_shared<RewrittenMethod>();
+            rewrittenMethod->_key = key;
+            rewrittenMethod->_functionId = functionId;
+            rewrittenMethod->_recipes = recipes;
+            rewrittenMethod->_method = method;
+            // a token the original method already used may come back from the tokenizer too; it is relocated like the others,
+            // which is harmless since the same call makes the same token
+            bool isValid = MethodTokenScanner::Scan(method,
+                [&](uint32_t offset)
+                {
+                    auto recipe = recipeByToken.find(MethodTokenScanner::Read32(method, offset));
+                    if (recipe != recipeByToken.end())
+                    {
+                        rewrittenMethod->_relocations.push_back({ offset, recipe->second });
+                    }
+                },
+                [&](uint32_t offset)
+                {
+                    if (MethodTokenScanner::Read64(method, offset) == uint64_t(functionId))
+                    {
+                        rewrittenMethod->_functionIdOffsets.push_back(offset);
+                    }
+                });
+            if (!isValid)
+            {
+                return nullptr;
+            }
+            return rewrittenMethod;
+        }
+
+        const RewrittenMethodKey& GetKey() const
+        {
+            return _key;
+        }
+
+        // Makes the method's tokens in the function's module and fills in the method to write.  false if a type token came back
+        // different, in which case the method has to be rewritten.
+        bool Instantiate(IFunction& function, ByteVector& method) const
+        {
+            auto tokenizer = function.GetTokenizer();
+            std::vector<uint32_t> tokens;
+            tokens.reserve(_recipes.size());
+            for (auto& recipe : _recipes)
+            {
+                auto token = MakeToken(recipe, tokens, *tokenizer, function);
+                if (recipe.IsTypeToken() && token != recipe.token)
+                {
+                    LogDebug(L"The rewrite cache can't be used for ", function.ToString(), L" because a type token changed.");
+                    return false;
+                }
+                tokens.push_back(token);
+            }
+
+            method = _method;
+            for (auto& relocation : _relocations)
+            {
+                MethodTokenScanner::Write32(method, relocation.offset, tokens[relocation.recipe]);
+            }
+            for (auto offset : _functionIdOffsets)
+            {
+                MethodTokenScanner::Write64(method, offset, uint64_t(function.GetFunctionId()));
+            }
+            return true;
+        }
+
+        void Serialize(ByteVector& bytes) const
+        {
+            AppendBytes(bytes, _key.moduleVersionId);
+            Append(bytes, _key.methodToken);
+            Append(bytes, _key.methodBytesHash);
+            Append(bytes, _key.instrumentationHash);
+            Append(bytes, uint64_t(_functionId));
+            AppendBytes(bytes, _method);
+
+            Append(bytes, uint32_t(_recipes.size()));
+            for (auto& recipe : _recipes)
+            {
+                bytes.push_back(recipe.kind);
+                bytes.push_back(recipe.parentIsRecipe ? 1 : 0);
+                Append(bytes, recipe.parent);
+                Append(bytes, recipe.token);
+                AppendString(bytes, recipe.first);
+                AppendString(bytes, recipe.second);
+                AppendString(bytes, recipe.third);
+                AppendBytes(bytes, recipe.blob);
+            }
+
+            Append(bytes, uint32_t(_relocations.size()));
+            for (auto& relocation : _relocations)
+            {
+                Append(bytes, relocation.offset);
+                Append(bytes, relocation.recipe);
+            }
+
+            Append(bytes, uint32_t(_functionIdOffsets.size()));
+            for (auto offset : _functionIdOffsets)
+            {
+                Append(bytes, offset);
+            }
+        }
+
+        // nullptr if the bytes aren't a method written by Serialize
+        static std::shared_ptr<const RewrittenMethod> Deserialize(const uint8_t* bytes, size_t size)
+        {
+            Reader reader(bytes, size);
+            auto rewrittenMethod = std::make_shared<RewrittenMethod>();
+            uint64_t functionId = 0;
+            uint32_t count = 0;
+            if (!reader.ReadBytes(rewrittenMethod->_key.moduleVersionId) || !reader.Read(rewrittenMethod->_key.methodToken) || !reader.Read(rewrittenMethod->_key.methodBytesHash) ||
+                !reader.Read(rewrittenMethod->_key.instrumentationHash) || !reader.Read(functionId) || !reader.ReadBytes(rewrittenMethod->_method) || !reader.Read(count))
+            {
+                return nullptr;
+            }
+            rewrittenMethod->_functionId = uintptr_t(functionId);
+
+            for (uint32_t index = 0; index < count; ++index)
+            {
+                TokenRecipe recipe;
+                uint8_t kind = 0;
+                uint8_t parentIsRecipe = 0;
+                if (!reader.Read(kind) || !reader.Read(parentIsRecipe) || !reader.Read(recipe.parent) || !reader.Read(recipe.token) ||
+                    !reader.ReadString(recipe.first) || !reader.ReadString(recipe.second) || !reader.ReadString(recipe.third) || !reader.ReadBytes(recipe.blob))
+                {
+                    return nullptr;
+                }
+                // a parent recipe always comes before its children
+                if (kind >= TokenRecipe::KindCount || (parentIsRecipe && recipe.parent >= index))
+                {
+                    return nullptr;
+                }
+                recipe.kind = TokenRecipe::Kind(kind);
+                recipe.parentIsRecipe = parentIsRecipe != 0;
+                rewrittenMethod->_recipes.push_back(std::move(recipe));
+            }
+
+            if (!reader.Read(count))
+            {
+                return nullptr;
+            }
+            for (uint32_t index = 0; index < count; ++index)
+            {
+                TokenRelocation relocation;
+                if (!reader.Read(relocation.offset) || !reader.Read(relocation.recipe) ||
+                    size_t(relocation.offset) + 4 > rewrittenMethod->_method.size() || relocation.recipe >= rewrittenMethod->_recipes.size())
+                {
+                    return nullptr;
+                }
+                rewrittenMethod->_relocations.push_back(relocation);
+            }
+
+            if (!reader.Read(count))
+            {
+                return nullptr;
+            }
+            for (uint32_t index = 0; index < count; ++index)
+            {
+                uint32_t offset = 0;
+                if (!reader.Read(offset) || size_t(offset) + 8 > rewrittenMethod->_method.size())
+                {
+                    return nullptr;
+                }
+                rewrittenMethod->_functionIdOffsets.push_back(offset);
+            }
+
+            if (!reader.AtEnd())
+            {
+                return nullptr;
+            }
+            return rewrittenMethod;
+        }
+
+    private:
+        RewrittenMethodKey _key;
+        uintptr_t _functionId = 0;
+        ByteVector _method;
+        std::vector<TokenRecipe> _recipes;
+        std::vector<TokenRelocation> _relocations;
+        std::vector<uint32_t> _functionIdOffsets;
+
+        static uint32_t MakeToken(const TokenRecipe& recipe, const std::vector<uint32_t>& tokens, sicily::codegen::ITokenizer& tokenizer, IFunction& function)
+        {
+            uint32_t parent = recipe.parentIsRecipe ? tokens[recipe.parent] : recipe.parent;
+            switch (recipe.kind)
+            {
+                case TokenRecipe::AssemblyRef: return tokenizer.GetAssemblyRefToken(recipe.first);
+                case TokenRecipe::TypeRefByFullName: return tokenizer.GetTypeRefToken(recipe.first, recipe.second);
+                case TokenRecipe::TypeRefByName: return tokenizer.GetTypeRefToken(recipe.first, recipe.second, recipe.third);
+                case TokenRecipe::TypeDef: return tokenizer.GetTypeDefToken(recipe.first);
+                case TokenRecipe::TypeSpec: return tokenizer.GetTypeSpecToken(recipe.blob);
+                case TokenRecipe::MemberRefOrDef: return tokenizer.GetMemberRefOrDefToken(parent, recipe.first, recipe.blob);
+                case TokenRecipe::MethodDefinition: return tokenizer.GetMethodDefinitionToken(parent, recipe.first, recipe.blob);
+                case TokenRecipe::MethodSpec: return tokenizer.GetMethodSpecToken(parent, recipe.blob);
+                case TokenRecipe::String: return tokenizer.GetStringToken(recipe.first);
+                case TokenRecipe::FunctionIdString: return tokenizer.GetStringToken(recipe.first + TokenRecipe::FormatFunctionId(function.GetFunctionId()));
+                case TokenRecipe::StandAloneSig: return function.GetTokenFromSignature(recipe.blob);
+                default: return 0;
+            }
+        }
+
+        // little endian, like the rest of the method
+        template <typename T>
+        static void Append(ByteVector& bytes, T value)
+        {
+            for (size_t i = 0; i < sizeof(T); ++i)
+            {
+                bytes.push_back(uint8_t(value >> (8 * i)));
+            }
+        }
+
+        static void AppendBytes(ByteVector& bytes, const ByteVector& value)
+        {
+            Append(bytes, uint32_t(value.size()));
+            bytes.insert(bytes.end(), value.begin(), value.end());
+        }
+
+        static void AppendString(ByteVector& bytes, const xstring_t& value)
+        {
+            Append(bytes, uint32_t(value.size()));
+            for (auto character : value)
+            {
+                Append(bytes, uint16_t(character));
+            }
+        }
+
+        // reads what the Append functions write, failing rather than reading past the end
+        class Reader
+        {
+        public:
+            Reader(const uint8_t* bytes, size_t size) :
+                _bytes(bytes),
+                _size(size)
+            {}
+
+            template <typename T>
+            bool Read(T& value)
+            {
+                if (_size - _offset < sizeof(T))
+                {
+                    return false;
+                }
+                value = 0;
+                for (size_t i = 0; i < sizeof(T); ++i)
+                {
+                    value |= T(T(_bytes[_offset++]) << (8 * i));
+                }
+                return true;
+            }
+
+            bool ReadBytes(ByteVector& value)
+            {
+                uint32_t size = 0;
+                if (!Read(size) || _size - _offset < size)
+                {
+                    return false;
+                }
+                value.assign(_bytes + _offset, _bytes + _offset + size);
+                _offset += size;
+                return true;
+            }
+
+            bool ReadString(xstring_t& value)
+            {
+                uint32_t size = 0;
+                if (!Read(size) || (_size - _offset) / 2 < size)
+                {
+                    return false;
+                }
+                value.resize(size);
+                for (uint32_t i = 0; i < size; ++i)
+                {
+                    uint16_t character = 0;
+                    Read(character);
+                    value[i] = xchar_t(character);
+                }
+                return true;
+            }
+
+            bool AtEnd() const
+            {
+                return _offset == _size;
+            }
+
+        private:
+            const uint8_t* _bytes;
+            size_t _size;
+            size_t _offset = 0;
+        };
+    };
+    typedef std::shared_ptr<const RewrittenMethod> RewrittenMethodPtr;
+
+    // Passes everything through to the function being rewritten, recording the tokenizer calls the rewrite makes and the method it
+    // writes so that they can be cached as a RewrittenMethod.
+    class RecordingFunction : public IFunction
+    {
+    public:
+        RecordingFunction(IFunctionPtr function) :
+            _function(function)
+        {}
+
+        const std::vector<TokenRecipe>& GetRecipes() const { return _recipes; }
+        // nullptr if the rewrite didn't write the method
+        ByteVectorPtr GetWrittenMethod() const { return _writtenMethod; }
+
+        virtual uintptr_t GetFunctionId() override { return _function->GetFunctionId(); }
+        virtual const xstring_t& GetAssemblyName() override { return _function->GetAssemblyName(); }
+        virtual xstring_t GetModuleName() override { return _function->GetModuleName(); }
+        virtual xstring_t GetAppDomainName() override { return _function->GetAppDomainName(); }
+        virtual const xstring_t& GetTypeName() override { return _function->GetTypeName(); }
+        virtual const xstring_t& GetFunctionName() override { return _function->GetFunctionName(); }
+        virtual uint32_t GetMethodToken() override { return _function->GetMethodToken(); }
+        virtual uint32_t GetTypeToken() override { return _function->GetTypeToken(); }
+        virtual DWORD GetClassAttributes() override { return _function->GetClassAttributes(); }
+        virtual DWORD GetMethodAttributes() override { return _function->GetMethodAttributes(); }
+        virtual FunctionHeaderInfoPtr GetFunctionHeaderInfo() override { return _function->GetFunctionHeaderInfo(); }
+        virtual bool Preprocess() override { return _function->Preprocess(); }
+        virtual bool ShouldTrace() override { return _function->ShouldTrace(); }
+        virtual ASSEMBLYMETADATA GetAssemblyProps() override { return _function->GetAssemblyProps(); }
+        virtual bool IsValid() override { return _function->IsValid(); }
+        virtual bool IsCoreClr() override { return _function->IsCoreClr(); }
+        virtual uint32_t GetTracerFlags() override { return _function->GetTracerFlags(); }
+        virtual ByteVectorPtr GetModuleVersionId() override { return _function->GetModuleVersionId(); }
+        virtual ByteVectorPtr GetSignature() override { return _function->GetSignature(); }
+        virtual ByteVectorPtr GetMethodBytes() override { return _function->GetMethodBytes(); }
+        virtual SignatureParser::ITokenResolverPtr GetTokenResolver() override { return _function->GetTokenResolver(); }
+        virtual ByteVectorPtr GetSignatureFromToken(uint32_t token) override { return _function->GetSignatureFromToken(token); }
+        virtual xstring_t ToString() override { return _function->ToString(); }
+        virtual bool IsGenericType() override { return _function->IsGenericType(); }
+        virtual bool ShouldInjectMethodInstrumentation() override { return _function->ShouldInjectMethodInstrumentation(); }
+
+        virtual sicily::codegen::ITokenizerPtr GetTokenizer() override
+        {
+            if (_tokenizer == nullptr)
+            {
+                _tokenizer = std::make_shared<RecordingTokenizer>(*this, _function->GetTokenizer());
+            }
+            return _tokenizer;
+        }
+
+        virtual uint32_t GetTokenFromSignature(const ByteVector& signature) override
+        {
+            TokenRecipe recipe;
+            recipe.kind = TokenRecipe::StandAloneSig;
+            recipe.blob = signature;
+            return Record(std::move(recipe), _function->GetTokenFromSignature(signature));
+        }
+
+        virtual void WriteMethod(const ByteVector& method) override
+        {
+            _function->WriteMethod(method);
+            _writtenMethod = std::make_shared<ByteVector>(method);
+        }
+
+    private:
+        class RecordingTokenizer : public sicily::codegen::ITokenizer
+        {
+        public:
+            RecordingTokenizer(RecordingFunction& function, sicily::codegen::ITokenizerPtr tokenizer) :
+                _function(function),
+                _tokenizer(tokenizer)
+            {}
+
+            virtual uint32_t GetAssemblyRefToken(const xstring_t& assemblyName) override
+            {
+                return _function.Record(MakeRecipe(TokenRecipe::AssemblyRef, assemblyName), _tokenizer->GetAssemblyRefToken(assemblyName));
+            }
+
+            virtual uint32_t GetTypeRefToken(const xstring_t& assemblyName, const xstring_t& fullyQualifiedName) override
+            {
+                return _function.Record(MakeRecipe(TokenRecipe::TypeRefByFullName, assemblyName, fullyQualifiedName), _tokenizer->GetTypeRefToken(assemblyName, fullyQualifiedName));
+            }
+
+            virtual uint32_t GetTypeRefToken(const xstring_t& assemblyName, const xstring_t& name, const xstring_t& namespaceName) override
+            {
+                return _function.Record(MakeRecipe(TokenRecipe::TypeRefByName, assemblyName, name, namespaceName), _tokenizer->GetTypeRefToken(assemblyName, name, namespaceName));
+            }
+
+            virtual uint32_t GetTypeDefToken(const xstring_t& fullName) override
+            {
+                return _function.Record(MakeRecipe(TokenRecipe::TypeDef, fullName), _tokenizer->GetTypeDefToken(fullName));
+            }
+
+            virtual uint32_t GetTypeSpecToken(const ByteVector& instantiationSignature) override
+            {
+                auto recipe = MakeRecipe(TokenRecipe::TypeSpec);
+                recipe.blob = instantiationSignature;
+                return _function.Record(std::move(recipe), _tokenizer->GetTypeSpecToken(instantiationSignature));
+            }
+
+            virtual uint32_t GetMemberRefOrDefToken(uint32_t parent, const xstring_t& methodName, const ByteVector& signature) override
+            {
+                auto recipe = MakeRecipe(TokenRecipe::MemberRefOrDef, methodName);
+                recipe.blob = signature;
+                _function.SetParent(recipe, parent);
+                return _function.Record(std::move(recipe), _tokenizer->GetMemberRefOrDefToken(parent, methodName, signature));
+            }
+
+            virtual uint32_t GetMethodDefinitionToken(const uint32_t& typeDefinitionToken, const xstring_t& name, const ByteVector& signature) override
+            {
+                auto recipe = MakeRecipe(TokenRecipe::MethodDefinition, name);
+                recipe.blob = signature;
+                _function.SetParent(recipe, typeDefinitionToken);
+                return _function.Record(std::move(recipe), _tokenizer->GetMethodDefinitionToken(typeDefinitionToken, name, signature));
+            }
+
+            virtual uint32_t GetMethodSpecToken(uint32_t methodDefOrRefOrSpecToken, const ByteVector& instantiationSignature) override
+            {
+                auto recipe = MakeRecipe(TokenRecipe::MethodSpec);
+                recipe.blob = instantiationSignature;
+                _function.SetParent(recipe, methodDefOrRefOrSpecToken);
+                return _function.Record(std::move(recipe), _tokenizer->GetMethodSpecToken(methodDefOrRefOrSpecToken, instantiationSignature));
+            }
+
+            virtual uint32_t GetStringToken(const xstring_t& string) override
+            {
+                auto recipe = MakeRecipe(TokenRecipe::String, string);
+                auto functionId = _X("_") + TokenRecipe::FormatFunctionId(_function.GetFunctionId());
+                if (string.size() > functionId.size() && string.compare(string.size() - functionId.size(), functionId.size(), functionId) == 0)
+                {
+                    recipe.kind = TokenRecipe::FunctionIdString;
+                    recipe.first = string.substr(0, string.size() - functionId.size() + 1);
+                }
+                return _function.Record(std::move(recipe), _tokenizer->GetStringToken(string));
+            }
+
+        private:
+            RecordingFunction& _function;
+            sicily::codegen::ITokenizerPtr _tokenizer;
+
+            static TokenRecipe MakeRecipe(TokenRecipe::Kind kind, const xstring_t& first = xstring_t(), const xstring_t& second = xstring_t(), const xstring_t& third = xstring_t())
+            {
+                TokenRecipe recipe;
+                recipe.kind = kind;
+                recipe.first = first;
+                recipe.second = second;
+                recipe.third = third;
+                return recipe;
+            }
+        };
+
+        IFunctionPtr _function;
+        sicily::codegen::ITokenizerPtr _tokenizer;
+        std::vector<TokenRecipe> _recipes;
+        // the latest recipe to make each token
+        std::unordered_map<uint32_t, uint32_t> _recipeByToken;
+        ByteVectorPtr _writtenMethod;
+
+        void SetParent(TokenRecipe& recipe, uint32_t parent)
+        {
+            auto parentRecipe = _recipeByToken.find(parent);
+            recipe.parentIsRecipe = parentRecipe != _recipeByToken.end();
+            recipe.parent = recipe.parentIsRecipe ? parentRecipe->second : parent;
+        }
+
+        uint32_t Record(TokenRecipe recipe, uint32_t token)
+        {
+            recipe.token = token;
+            _recipeByToken[token] = uint32_t(_recipes.size());
+            _recipes.push_back(std::move(recipe));
+            return token;
+        }
+    };
+
+    // An optional file of rewritten methods, so that a process doesn't have to repeat the rewrites an earlier process with the same
+    // modules and instrumentation already made.  Each method is appended as a single record that carries its own length and
+    // checksum.  Bytes that don't check out are skipped until the next record that does, so a torn write from a process that died
+    // (or a record another process is still appending) costs that method a rewrite, nothing more.  Several processes share the
+    // file, so it is only ever appended to, and no process appends once it has grown to MaxFileSize; a process that starts with
+    // the file past MaxFileSize starts it over.  Deleting the file clears the cache.  Safe to use from any thread.
+    class RewrittenMethodCache
+    {
+    public:
+        static const uint32_t MaxFileSize = 64 * 1024 * 1024;
+
+        // settingsKey covers whatever outside the instrumentation point and the function changes the rewritten methods, such as
+        // the build of the profiler and whether app domain caching is disabled
+        RewrittenMethodCache(const xstring_t& filePath, uint64_t settingsKey) :
+            _filePath(filePath),
+            _settingsKey(settingsKey)
+        {
+            Read();
+        }
+
+        // false if the function can't be cached, because its module has no MVID
+        bool TryGetKey(IFunction& function, const Configuration::InstrumentationPoint& instrumentationPoint, const xstring_t& corePath, RewrittenMethodKey& key) const
+        {
+            auto moduleVersionId = function.GetModuleVersionId();
+            if (moduleVersionId == nullptr || moduleVersionId->empty())
+            {
+                return false;
+            }
+            auto methodBytes = function.GetMethodBytes();
+
+            key.moduleVersionId = *moduleVersionId;
+            key.methodToken = function.GetMethodToken();
+            key.methodBytesHash = Fnv1a::HashBytes(methodBytes->data(), methodBytes->size());
+            key.instrumentationHash = Fnv1aHasher()
+                .Add(_settingsKey)
+                .Add(corePath)
+                .Add(function.IsCoreClr())
+                .Add(function.GetAssemblyName())
+                .Add(function.GetTypeName())
+                .Add(function.GetFunctionName())
+                .Add(instrumentationPoint.TracerFactoryName.str())
+                .Add(instrumentationPoint.MetricName.str())
+                .Add(instrumentationPoint.MetricType.str())
+                .Add(uint64_t(instrumentationPoint.TracerFactoryArgs))
+                .Get();
+            return true;
+        }
+
+        // Writes the cached method for the key to the function.  false if there is none or it can't be used in this process.
+        bool TryWriteMethod(const RewrittenMethodKey& key, IFunction& function)
+        {
+            RewrittenMethodPtr rewrittenMethod;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto found = _methods.find(key.Hash());
+                if (found == _methods.end() || !(found->second->GetKey() == key))
+                {
+                    return false;
+                }
+                rewrittenMethod = found->second;
+            }
+
+            ByteVector method;
+            if (!rewrittenMethod->Instantiate(function, method))
+            {
+                return false;
+            }
+            function.WriteMethod(method);
+            return true;
+        }
+
+        // Adds the rewrite the function recorded.  The file is written best effort; a failure is logged and otherwise ignored.
+        void Put(const RewrittenMethodKey& key, RecordingFunction& function, const ByteVector& originalMethod)
+        {
+            auto writtenMethod = function.GetWrittenMethod();
+            if (writtenMethod == nullptr)
+            {
+                return;
+            }
+            auto rewrittenMethod = RewrittenMethod::Create(key, function.GetFunctionId(), function.GetRecipes(), *writtenMethod, originalMethod);
+            if (rewrittenMethod == nullptr)
+            {
+                LogDebug(L"Not caching the rewrite of ", function.ToString());
+                return;
+            }
+
+            ByteVector record(sizeof(RecordHeader));
+            rewrittenMethod->Serialize(record);
+            RecordHeader header = { Magic, Version, uint32_t(record.size() - sizeof(RecordHeader)), Checksum(record.data() + sizeof(RecordHeader), record.size() - sizeof(RecordHeader)) };
+            memcpy(record.data(), &header, sizeof(header));
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _methods[key.Hash()] = rewrittenMethod;
+
+            std::ofstream file(to_pathstring(_filePath), std::ios::binary | std::ios::app);
+            // the size now, including what other processes have appended since this one started
+            file.seekp(0, std::ios::end);
+            const auto fileSize = file.tellp();
+            if (!file || uint64_t(fileSize) + record.size() > MaxFileSize)
+            {
+                return;
+            }
+            file.write(reinterpret_cast<const char*>(record.data()), record.size());
+            if (!file)
+            {
+                LogDebug(L"Unable to write to the rewrite cache at ", _filePath);
+            }
+        }
+
+        size_t GetMethodCount()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _methods.size();
+        }
+
+    private:
+        static const uint32_t Magic = 0x4352524e; // "NRRC"
+        // bump whenever the layout of a record, the way its key is hashed or the IL the instrumentation emits changes
+        static const uint32_t Version = 2;
+
+        //!!!ON DISK LAYOUT!!!
+        struct RecordHeader
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t size;
+            uint32_t checksum;
+        };
+        static_assert(sizeof(RecordHeader) == 16, "RecordHeader is part of the on disk layout");
+
+        xstring_t _filePath;
+        uint64_t _settingsKey;
+        std::mutex _mutex;
+        std::unordered_map<uint64_t, RewrittenMethodPtr> _methods;
+
+        void Read()
+        {
+            std::ifstream file(to_pathstring(_filePath), std::ios::binary);
+            if (!file)
+            {
+                return;
+            }
+            std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            file.close();
+
+            if (bytes.size() > MaxFileSize)
+            {
+                LogDebug(L"Deleting the rewrite cache at ", _filePath, L" because it is full.");
+                DeleteCacheFile(_filePath);
+                return;
+            }
+
+            size_t offset = 0;
+            size_t skippedBytes = 0;
+            while (bytes.size() - offset >= sizeof(RecordHeader))
+            {
+                RecordHeader header;
+                memcpy(&header, bytes.data() + offset, sizeof(header));
+                auto record = bytes.data() + offset + sizeof(header);
+                if (header.magic != Magic || bytes.size() - offset - sizeof(header) < header.size || Checksum(record, header.size) != header.checksum)
+                {
+                    // look for the next record a byte further on; the file is left as it is, since the bytes may belong to a record
+                    // another process is still writing
+                    ++offset;
+                    ++skippedBytes;
+                    continue;
+                }
+                offset += sizeof(header) + header.size;
+
+                // records of another version are skipped rather than read
+                if (header.version != Version)
+                {
+                    continue;
+                }
+                auto rewrittenMethod = RewrittenMethod::Deserialize(record, header.size);
+                if (rewrittenMethod == nullptr)
+                {
+                    continue;
+                }
+                _methods[rewrittenMethod->GetKey().Hash()] = rewrittenMethod;
+            }
+            skippedBytes += bytes.size() - offset;
+
+            if (skippedBytes != 0)
+            {
+                LogDebug(L"Skipped ", skippedBytes, L" bytes of the rewrite cache at ", _filePath, L" that are not a complete record.");
+            }
+        }
+
+        static uint32_t Checksum(const uint8_t* bytes, size_t size)
+        {
+            return Fnv1a::HashBytes32(bytes, size);
+        }
+
+        static void DeleteCacheFile(const xstring_t& filePath)
+        {
+#ifdef PAL_STDCPP_COMPAT
+            ::remove(to_pathstring(filePath).c_str());
+#else
+            ::DeleteFileW(filePath.c_str());
+#endif
+        }
+    };
+    typedef std::shared_ptr<RewrittenMethodCache> RewrittenMethodCachePtr;
+}}}
@@ -0,0 +1,430 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include "../Common/Macros.h"
+#include "OpCodeInfo.h"
+
+namespace NewRelic { namespace Profiler { namespace MethodRewriter
+{
+    // Works out the max stack of a method body, the deepest its evaluation stack gets (ECMA-335 III.1.7.4), by following every
+    // path through the code from the start of the method and of each exception handler.  Along the way it checks the things that
+    // would make the JIT reject the method: opcodes it doesn't know, branches outside the code or into the middle of an instruction,
+    // code that runs off the end, a stack that underflows, or one that reaches an instruction at two different depths.
+    class StackDepthAnalyzer
+    {
+    public:
+        // Given the token of a call, callvirt, newobj or jmp (a MethodDef, MemberRef or MethodSpec) or of a calli (a StandAloneSig),
+        // returns the signature of the method it calls, or nullptr if it can't be found.
+        typedef std::function<ByteVectorPtr(uint32_t token)> SignatureResolver;
+
+        // method is the header, code and extra sections, and returnsValue whether its own signature has a return type.  false if
+        // the method isn't well formed or a call's signature couldn't be resolved.
+        static bool TryGetMaxStack(const ByteVector& method, bool returnsValue, const SignatureResolver& resolveSignature, uint16_t& maxStack)
+        {
+            size_t codeOffset = 0;
+            size_t codeSize = 0;
+            std::vector<Handler> handlers;
+            if (!TryParseMethod(method, codeOffset, codeSize, handlers))
+            {
+                return false;
+            }
+
+            ByteVector code(method.begin() + codeOffset, method.begin() + codeOffset + codeSize);
+            std::vector<bool> instructionStarts;
+            if (!TryFindInstructionStarts(code, instructionStarts))
+            {
+                return false;
+            }
+
+            Analysis analysis(code, instructionStarts, returnsValue, resolveSignature);
+            if (!analysis.Enter(0, 0))
+            {
+                return false;
+            }
+            for (auto& handler : handlers)
+            {
+                if (!analysis.Enter(handler.offset, handler.depth))
+                {
+                    return false;
+                }
+            }
+            if (!analysis.Run() || analysis.maxDepth > 0xffff)
+            {
+                return false;
+            }
+            maxStack = uint16_t(analysis.maxDepth);
+            return true;
+        }
+
+        // The number of values a call to a method with this signature pops, counting the this pointer, and whether it pushes a
+        // return value.  false for a signature that isn't a method's.
+        static bool TryParseMethodSignature(const ByteVector& signature, uint32_t& argumentCount, bool& returnsValue)
+        {
+            size_t offset = 0;
+            if (signature.empty())
+            {
+                return false;
+            }
+            auto callingConvention = signature[offset++];
+            // field (6), locals (7), property (8) and generic instantiation (0xa) signatures
+            auto kind = callingConvention & 0xf;
+            if (kind > 5)
+            {
+                return false;
+            }
+
+            uint32_t count = 0;
+            if ((callingConvention & 0x10) != 0 && !TryReadCompressed(signature, offset, count))
+            {
+                return false;
+            }
+            if (!TryReadCompressed(signature, offset, count))
+            {
+                return false;
+            }
+
+            // custom modifiers (CMOD_REQD and CMOD_OPT) on the return type
+            while (offset < signature.size() && (signature[offset] == 0x1f || signature[offset] == 0x20))
+            {
+                uint32_t modifierToken = 0;
+                ++offset;
+                if (!TryReadCompressed(signature, offset, modifierToken))
+                {
+                    return false;
+                }
+            }
+            if (offset >= signature.size())
+            {
+                return false;
+            }
+
+            // HASTHIS puts the this pointer on the stack, unless EXPLICITTHIS already counts it as the first parameter
+            bool hasImplicitThis = (callingConvention & 0x20) != 0 && (callingConvention & 0x40) == 0;
+            argumentCount = count + (hasImplicitThis ? 1 : 0);
+            returnsValue = signature[offset] != 0x01;
+            return true;
+        }
+
+    private:
+        struct Handler
+        {
+            size_t offset;
+            uint32_t depth;
+        };
+
+        enum : int32_t { Unreached = -1 };
+
+        // The state of one analysis: the depth on entry to each instruction that has been reached, and the instructions that have
+        // been reached but not yet followed.
+        struct Analysis
+        {
+            const ByteVector& code;
+            const std::vector<bool>& instructionStarts;
+            bool returnsValue;
+            const SignatureResolver& resolveSignature;
+            std::vector<int32_t> depths;
+            std::vector<size_t> pending;
+            uint32_t maxDepth = 0;
+
+            Analysis(const ByteVector& code, const std::vector<bool>& instructionStarts, bool returnsValue, const SignatureResolver& resolveSignature) :
+                code(code),
+                instructionStarts(instructionStarts),
+                returnsValue(returnsValue),
+                resolveSignature(resolveSignature),
+                depths(code.size(), Unreached)
+            {}
+
+            // control reaches offset with depth values on the stack
+            bool Enter(int64_t offset, uint32_t depth)
+            {
+                if (offset < 0 || offset >= int64_t(code.size()) || !instructionStarts[size_t(offset)])
+                {
+                    return false;
+                }
+                auto& entryDepth = depths[size_t(offset)];
+                if (entryDepth == Unreached)
+                {
+                    entryDepth = int32_t(depth);
+                    maxDepth = std::max(maxDepth, depth);
+                    pending.push_back(size_t(offset));
+                    return true;
+                }
+                return entryDepth == int32_t(depth);
+            }
+
+            bool Run()
+            {
+                while (!pending.empty())
+                {
+                    auto offset = pending.back();
+                    pending.pop_back();
+                    if (!Follow(offset))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            // Steps through the instructions from offset until control leaves in some way other than falling through to an
+            // instruction that hasn't been reached yet.
+            bool Follow(size_t offset)
+            {
+                uint32_t depth = uint32_t(depths[offset]);
+                while (true)
+                {
+                    size_t index = 0;
+                    size_t operandSize = 0;
+                    auto opCode = OpCodeInfo::Decode(code, offset, code.size(), index);
+                    opCode->TryGetOperandSize(code, offset, code.size(), operandSize);
+                    auto next = offset + operandSize;
+
+                    uint32_t pop = opCode->pop;
+                    uint32_t push = opCode->push;
+                    if ((pop == OpCodeInfo::VariableStack || push == OpCodeInfo::VariableStack) && !TryGetVariableStack(index, offset, pop, push))
+                    {
+                        return false;
+                    }
+                    if (depth < pop)
+                    {
+                        return false;
+                    }
+                    depth = depth - pop + push;
+                    maxDepth = std::max(maxDepth, depth);
+
+                    switch (opCode->flow)
+                    {
+                        case OpCodeInfo::Branch:
+                            // leaving a protected block or handler empties the stack
+                            return Enter(GetBranchTarget(*opCode, offset, next), (index == CEE_LEAVE || index == CEE_LEAVE_S) ? 0 : depth);
+                        case OpCodeInfo::ConditionalBranch:
+                            if (!EnterBranchTargets(*opCode, offset, next, depth))
+                            {
+                                return false;
+                            }
+                            break;
+                        case OpCodeInfo::Return:
+                        case OpCodeInfo::Throw:
+                            return true;
+                        default:
+                            // jmp leaves the method
+                            if (index == CEE_JMP)
+                            {
+                                return true;
+                            }
+                            break;
+                    }
+
+                    // fall through, and stop if the next instruction has already been reached
+                    if (next >= code.size() || !instructionStarts[next])
+                    {
+                        return false;
+                    }
+                    if (depths[next] != Unreached)
+                    {
+                        return depths[next] == int32_t(depth);
+                    }
+                    depths[next] = int32_t(depth);
+                    offset = next;
+                }
+            }
+
+            bool TryGetVariableStack(size_t index, size_t operandOffset, uint32_t& pop, uint32_t& push)
+            {
+                if (index == CEE_RET)
+                {
+                    pop = returnsValue ? 1 : 0;
+                    return true;
+                }
+
+                ByteVectorPtr signature = resolveSignature ? resolveSignature(OpCodeInfo::Read32(code, operandOffset)) : nullptr;
+                uint32_t argumentCount = 0;
+                bool callReturnsValue = false;
+                if (signature == nullptr || !TryParseMethodSignature(*signature, argumentCount, callReturnsValue))
+                {
+                    return false;
+                }
+
+                if (index == CEE_NEWOBJ)
+                {
+                    // the constructor's this pointer is the new object, which isn't on the stack beforehand
+                    if (argumentCount == 0)
+                    {
+                        return false;
+                    }
+                    pop = argumentCount - 1;
+                    return true;
+                }
+                // calli pops the function pointer after the arguments
+                pop = argumentCount + (index == CEE_CALLI ? 1 : 0);
+                push = callReturnsValue ? 1 : 0;
+                return true;
+            }
+
+            int64_t GetBranchTarget(const OpCodeInfo& opCode, size_t operandOffset, size_t next)
+            {
+                if (opCode.operand == OpCodeInfo::ShortBranchTarget)
+                {
+                    return int64_t(next) + int8_t(code[operandOffset]);
+                }
+                return int64_t(next) + int32_t(OpCodeInfo::Read32(code, operandOffset));
+            }
+
+            bool EnterBranchTargets(const OpCodeInfo& opCode, size_t operandOffset, size_t next, uint32_t depth)
+            {
+                if (opCode.operand != OpCodeInfo::Switch)
+                {
+                    return Enter(GetBranchTarget(opCode, operandOffset, next), depth);
+                }
+                // switch targets are relative to the instruction after the whole table
+                auto targetCount = OpCodeInfo::Read32(code, operandOffset);
+                for (uint32_t target = 0; target < targetCount; ++target)
+                {
+                    if (!Enter(int64_t(next) + int32_t(OpCodeInfo::Read32(code, operandOffset + 4 + size_t(target) * 4)), depth))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+        };
+
+        // Finds the code and the entry points of the exception handlers: a catch or filter starts with the exception on the stack,
+        // a finally or fault with nothing.
+        static bool TryParseMethod(const ByteVector& method, size_t& codeOffset, size_t& codeSize, std::vector<Handler>& handlers)
+        {
+            if (method.empty())
+            {
+                return false;
+            }
+
+            bool moreSections = false;
+            if ((method[0] & 0x3) == 0x2)
+            {
+                // tiny header, the code size is in the upper 6 bits
+                codeOffset = 1;
+                codeSize = method[0] >> 2;
+            }
+            else if ((method[0] & 0x7) == 0x3)
+            {
+                // fat header, the header size in 4 byte words is in the upper 4 bits of the flags
+                if (method.size() < 12)
+                {
+                    return false;
+                }
+                codeOffset = (method[1] >> 4) * 4;
+                codeSize = OpCodeInfo::Read32(method, 4);
+                moreSections = (method[0] & 0x8) != 0;
+                if (codeOffset < 12)
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                return false;
+            }
+            if (codeSize == 0 || codeOffset + codeSize > method.size())
+            {
+                return false;
+            }
+
+            // extra sections are 4 byte aligned and follow the code
+            auto sectionOffset = (codeOffset + codeSize + 3) & ~size_t(3);
+            while (moreSections)
+            {
+                if (sectionOffset + 4 > method.size())
+                {
+                    return false;
+                }
+                auto kind = method[sectionOffset];
+                bool isFat = (kind & 0x40) != 0;
+                size_t dataSize = isFat ? (OpCodeInfo::Read32(method, sectionOffset) >> 8) : method[sectionOffset + 1];
+                if (dataSize < 4 || sectionOffset + dataSize > method.size())
+                {
+                    return false;
+                }
+
+                if ((kind & 0x3f) == 0x1)
+                {
+                    size_t clauseSize = isFat ? 24 : 12;
+                    for (size_t clause = sectionOffset + 4; clause + clauseSize <= sectionOffset + dataSize; clause += clauseSize)
+                    {
+                        uint32_t flags = isFat ? OpCodeInfo::Read32(method, clause) : uint32_t(method[clause] | (method[clause + 1] << 8));
+                        size_t handlerOffset = isFat ? OpCodeInfo::Read32(method, clause + 12) : size_t(method[clause + 5] | (method[clause + 6] << 8));
+                        // the last field is the class token of a catch or the filter's offset
+                        size_t lastField = OpCodeInfo::Read32(method, clause + clauseSize - 4);
+                        switch (flags)
+                        {
+                            case 0x0000:
+                                handlers.push_back({ handlerOffset, 1 });
+                                break;
+                            case 0x0001:
+                                handlers.push_back({ lastField, 1 });
+                                handlers.push_back({ handlerOffset, 1 });
+                                break;
+                            case 0x0002:
+                            case 0x0004:
+                                handlers.push_back({ handlerOffset, 0 });
+                                break;
+                            default:
+                                return false;
+                        }
+                    }
+                }
+
+                moreSections = (kind & 0x80) != 0;
+                sectionOffset = (sectionOffset + dataSize + 3) & ~size_t(3);
+            }
+            return true;
+        }
+
+        // IL decodes in a single pass from the start, so this is where every instruction begins whether or not it is reachable.
+        static bool TryFindInstructionStarts(const ByteVector& code, std::vector<bool>& instructionStarts)
+        {
+            instructionStarts.assign(code.size(), false);
+            size_t offset = 0;
+            while (offset < code.size())
+            {
+                instructionStarts[offset] = true;
+                size_t index = 0;
+                size_t operandSize = 0;
+                auto opCode = OpCodeInfo::Decode(code, offset, code.size(), index);
+                if (opCode == nullptr || !opCode->TryGetOperandSize(code, offset, code.size(), operandSize))
+                {
+                    return false;
+                }
+                offset += operandSize;
+            }
+            return true;
+        }
+
+        // ECMA-335 II.23.2, 1, 2 or 4 bytes depending on the high bits of the first
+        static bool TryReadCompressed(const ByteVector& signature, size_t& offset, uint32_t& value)
+        {
+            if (offset >= signature.size())
+            {
+                return false;
+            }
+            auto first = signature[offset];
+            size_t length = (first & 0x80) == 0 ? 1 : (first & 0xc0) == 0x80 ? 2 : (first & 0xe0) == 0xc0 ? 4 : 0;
+            if (length == 0 || offset + length > signature.size())
+            {
+                return false;
+            }
+            value = length == 1 ? first : length == 2 ? (first & 0x3f) : (first & 0x1f);
+            for (size_t i = 1; i < length; ++i)
+            {
+                value = (value << 8) | signature[offset + i];
+            }
+            offset += length;
+            return true;
+        }
+    };
+}}}
@@ -71,6 +71,137 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter { namespace T
             VerifyBytes(expectedBytes, actualBytes);
         }
 
+        TEST_METHOD(jump_that_fits_in_a_byte_is_shortened)
+        {
+            auto instructionSet = InstructionSet(nullptr, nullptr);
+
+            auto label = instructionSet.AppendJump(CEE_BRTRUE);
+            instructionSet.Append(CEE_LDNULL);
+            instructionSet.Append(CEE_POP);
+            instructionSet.AppendLabel(label);
+            instructionSet.Append(CEE_RET);
+
+            BYTEVECTOR(expectedBytes,
+                CEE_BRTRUE_S,
+                0x02,
+                CEE_LDNULL,
+                CEE_POP,
+                CEE_RET
+            );
+            auto actualBytes = instructionSet.GetBytes();
+
+            VerifyBytes(expectedBytes, actualBytes);
+        }
+
+        TEST_METHOD(backward_jump_is_shortened)
+        {
+            auto instructionSet = InstructionSet(nullptr, nullptr);
+
+            auto label = instructionSet.CreateLabel();
+            instructionSet.AppendLabel(label);
+            instructionSet.Append(CEE_NOP);
+            instructionSet.AppendJump(CEE_BR, label);
+
+            BYTEVECTOR(expectedBytes,
+                CEE_NOP,
+                CEE_BR_S,
+                0xFD
+            );
+            auto actualBytes = instructionSet.GetBytes();
+
+            VerifyBytes(expectedBytes, actualBytes);
+        }
+
+        TEST_METHOD(jump_that_does_not_fit_in_a_byte_stays_long)
+        {
+            auto instructionSet = InstructionSet(nullptr, nullptr);
+
+            auto label = instructionSet.AppendJump(CEE_LEAVE_S);
+            for (int i = 0; i < 128; ++i)
+            {
+                instructionSet.Append(CEE_NOP);
+            }
+            instructionSet.AppendLabel(label);
+
+            auto actualBytes = instructionSet.GetBytes();
+
+            Assert::AreEqual((size_t)133, actualBytes.size());
+            Assert::AreEqual((uint8_t)CEE_LEAVE, actualBytes[0]);
+            Assert::AreEqual((uint8_t)128, actualBytes[1]);
+            Assert::AreEqual((uint8_t)0, actualBytes[2]);
+        }
+
+        TEST_METHOD(shortening_one_jump_lets_another_fit)
+        {
+            auto instructionSet = InstructionSet(nullptr, nullptr);
+
+            // 128 bytes to the label with the second jump long, 125 once it is short
+            auto outer = instructionSet.AppendJump(CEE_BR);
+            auto inner = instructionSet.AppendJump(CEE_BR);
+            for (int i = 0; i < 123; ++i)
+            {
+                instructionSet.Append(CEE_NOP);
+            }
+            instructionSet.AppendLabel(inner);
+            instructionSet.AppendLabel(outer);
+
+            auto actualBytes = instructionSet.GetBytes();
+
+            Assert::AreEqual((size_t)127, actualBytes.size());
+            Assert::AreEqual((uint8_t)CEE_BR_S, actualBytes[0]);
+            Assert::AreEqual((uint8_t)125, actualBytes[1]);
+            Assert::AreEqual((uint8_t)CEE_BR_S, actualBytes[2]);
+            Assert::AreEqual((uint8_t)123, actualBytes[3]);
+        }
+
+        TEST_METHOD(jump_to_unplaced_label_jumps_to_next_instruction)
+        {
+            auto instructionSet = InstructionSet(nullptr, nullptr);
+
+            instructionSet.AppendJump(CEE_BRFALSE);
+            instructionSet.Append(CEE_RET);
+
+            BYTEVECTOR(expectedBytes,
+                CEE_BRFALSE_S,
+                0x00,
+                CEE_RET
+            );
+            auto actualBytes = instructionSet.GetBytes();
+
+            VerifyBytes(expectedBytes, actualBytes);
+        }
+
+        TEST_METHOD(exception_clause_and_user_code_move_with_shortened_jumps)
+        {
+            auto exceptionHandlerManipulator = std::make_shared<ExceptionHandlerManipulator>();
+            auto instructionSet = InstructionSet(nullptr, exceptionHandlerManipulator);
+
+            auto skip = instructionSet.AppendJump(CEE_BR);
+            instructionSet.AppendLabel(skip);
+            instructionSet.AppendTryStart();
+            instructionSet.AppendUserCode(ByteVector{ CEE_NOP, CEE_NOP });
+            auto afterCatch = instructionSet.AppendJump(CEE_LEAVE);
+            instructionSet.AppendTryEnd();
+            instructionSet.AppendCatchStart(uint32_t(0x01000001));
+            instructionSet.Append(CEE_POP);
+            instructionSet.AppendJump(CEE_LEAVE, afterCatch);
+            instructionSet.AppendCatchEnd();
+            instructionSet.AppendLabel(afterCatch);
+            instructionSet.Append(CEE_RET);
+
+            auto actualBytes = instructionSet.GetBytes();
+
+            Assert::AreEqual((size_t)10, actualBytes.size());
+            Assert::AreEqual((uint32_t)2, instructionSet.GetUserCodeOffset());
+            // flags and size, then the clause: flags, try offset, try length, handler offset, handler length, class token
+            auto extraSection = exceptionHandlerManipulator->GetExtraSectionBytes(instructionSet.GetUserCodeOffset());
+            Assert::AreEqual((size_t)28, extraSection->size());
+            Assert::AreEqual((uint8_t)2, extraSection->at(8));
+            Assert::AreEqual((uint8_t)4, extraSection->at(12));
+            Assert::AreEqual((uint8_t)6, extraSection->at(16));
+            Assert::AreEqual((uint8_t)3, extraSection->at(20));
+        }
+
     private:
         static void VerifyBytes(std::vector<uint8_t> expected, ByteVector actual)
         {
@@ -0,0 +1,65 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#include <stdint.h>
+#include "CppUnitTest.h"
+#include "../MethodRewriter/InstrumentationPrefilter.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic { namespace Profiler { namespace MethodRewriter { namespace Test
+{
+    TEST_CLASS(InstrumentationPrefilterTest)
+    {
+    public:
+        TEST_METHOD(added_names_are_let_through)
+        {
+            InstrumentationPrefilter prefilter;
+            prefilter.AddAssembly(_X("MyAssembly"));
+            prefilter.AddType(_X("MyNamespace.MyClass"));
+            prefilter.AddFunction(_X("MyMethod"));
+            prefilter.Compile();
+
+            xstring_t typeName(_X("MyNamespace.MyClass"));
+            xstring_t functionName(_X("MyMethod"));
+            Assert::IsTrue(prefilter.MayInstrumentAssembly(InstrumentationPrefilter::Hash(_X("MyAssembly"))));
+            Assert::IsTrue(prefilter.MayInstrumentType(typeName.c_str(), typeName.size()));
+            Assert::IsTrue(prefilter.MayInstrumentFunction(functionName.c_str(), functionName.size()));
+        }
+
+        TEST_METHOD(other_names_are_rejected)
+        {
+            InstrumentationPrefilter prefilter;
+            prefilter.AddAssembly(_X("MyAssembly"));
+            prefilter.AddType(_X("MyNamespace.MyClass"));
+            prefilter.AddFunction(_X("MyMethod"));
+            prefilter.Compile();
+
+            xstring_t typeName(_X("MyNamespace.MyOtherClass"));
+            xstring_t functionName(_X("MyMethodToo"));
+            Assert::IsFalse(prefilter.MayInstrumentAssembly(InstrumentationPrefilter::Hash(_X("myassembly"))));
+            Assert::IsFalse(prefilter.MayInstrumentType(typeName.c_str(), typeName.size()));
+            Assert::IsFalse(prefilter.MayInstrumentFunction(functionName.c_str(), functionName.size()));
+        }
+
+        TEST_METHOD(names_are_hashed_from_a_buffer_the_same_as_from_a_string)
+        {
+            // the metadata APIs fill a buffer that is longer than the name
+            xchar_t buffer[32] = _X("MyMethod");
+            Assert::AreEqual(InstrumentationPrefilter::Hash(_X("MyMethod")), InstrumentationPrefilter::Hash(buffer, 8));
+        }
+
+        TEST_METHOD(wildcards_let_every_name_through)
+        {
+            InstrumentationPrefilter prefilter;
+            prefilter.AllowAnyType();
+            prefilter.AllowAnyFunction();
+            prefilter.Compile();
+
+            xstring_t name(_X("Anything"));
+            Assert::IsTrue(prefilter.MayInstrumentType(name.c_str(), name.size()));
+            Assert::IsTrue(prefilter.MayInstrumentFunction(name.c_str(), name.size()));
+            Assert::IsFalse(prefilter.MayInstrumentAssembly(InstrumentationPrefilter::Hash(name)));
+        }
+    };
+}}}}
@@ -99,7 +99,7 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter { namespace T
         }
 
         std::wstring _assemblyName;
-        virtual std::wstring GetAssemblyName() override
+        virtual const std::wstring& GetAssemblyName() override
         {
             return _assemblyName;
         }
@@ -117,13 +117,13 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter { namespace T
         }
 
         std::wstring _typeName;
-        virtual std::wstring GetTypeName() override
+        virtual const std::wstring& GetTypeName() override
         {
             return _typeName;
         }
 
         std::wstring _functionName;
-        virtual std::wstring GetFunctionName() override 
+        virtual const std::wstring& GetFunctionName() override 
         {
             return _functionName;
         }
@@ -181,6 +181,12 @@ namespace NewRelic { namespace Profiler { namespace MethodRewriter { namespace T
             return 0;
         }
 
+        ByteVectorPtr _moduleVersionId;
+        virtual ByteVectorPtr GetModuleVersionId() override
+        {
+            return _moduleVersionId;
+        }
+
         virtual bool IsValid() override
         {
             return true;
@@ -0,0 +1,336 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#include <stdint.h>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include "CppUnitTest.h"
+#include "../MethodRewriter/RewrittenMethodCache.h"
+#include "MockFunction.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic { namespace Profiler { namespace MethodRewriter { namespace Test
+{
+    // Hands out the next token of the right table for each call, the way a module's metadata does as rows are added.
+    struct CountingTokenizer : public sicily::codegen::ITokenizer
+    {
+        CountingTokenizer(uint32_t firstRow) :
+            _nextRow(firstRow)
+        {}
+
+        uint32_t _nextRow;
+        // type tokens usually already exist in the module, so they stay the same unless a test changes them
+        uint32_t _typeRefToken = 0x01000005;
+        uint32_t _methodSpecParent = 0;
+
+        virtual uint32_t GetAssemblyRefToken(const std::wstring&) override { return 0x23000000 | _nextRow++; }
+        virtual uint32_t GetTypeRefToken(const std::wstring&, const std::wstring&) override { return _typeRefToken; }
+        virtual uint32_t GetTypeRefToken(const std::wstring&, const std::wstring&, const std::wstring&) override { return _typeRefToken; }
+        virtual uint32_t GetTypeDefToken(const std::wstring&) override { return 0x02000002; }
+        virtual uint32_t GetTypeSpecToken(const ByteVector&) override { return 0x1b000000 | _nextRow++; }
+        virtual uint32_t GetMemberRefOrDefToken(uint32_t, const std::wstring&, const ByteVector&) override { return 0x0a000000 | _nextRow++; }
+        virtual uint32_t GetMethodDefinitionToken(const uint32_t&, const std::wstring&, const ByteVector&) override { return 0x06000000 | _nextRow++; }
+
+        virtual uint32_t GetMethodSpecToken(uint32_t methodDefOrRefOrSpecToken, const ByteVector&) override
+        {
+            _methodSpecParent = methodDefOrRefOrSpecToken;
+            return 0x2b000000 | _nextRow++;
+        }
+
+        std::vector<std::wstring> _strings;
+        virtual uint32_t GetStringToken(const std::wstring& string) override
+        {
+            _strings.push_back(string);
+            return 0x70000000 | _nextRow++;
+        }
+    };
+
+    TEST_CLASS(RewrittenMethodCacheTest)
+    {
+    public:
+        TEST_METHOD(instantiating_makes_the_tokens_again_and_patches_them_in)
+        {
+            auto recorded = CreateFunction(0x1000, 0x10);
+            auto rewrittenMethod = Record(recorded);
+
+            auto function = CreateFunction(0x2000, 0x40);
+            ByteVector method;
+            Assert::IsTrue(rewrittenMethod->Instantiate(*function, method));
+
+            // the same calls, in the same order, against the new tokenizer
+            auto expected = BuildMethod(0x11000005, 0x70000041, 0x0a000040, 0x2b000042, 0x2000);
+            Assert::IsTrue(expected == method);
+        }
+
+        TEST_METHOD(parent_made_by_an_earlier_recipe_is_the_new_token)
+        {
+            auto rewrittenMethod = Record(CreateFunction(0x1000, 0x10));
+
+            auto function = CreateFunction(0x2000, 0x40);
+            ByteVector method;
+            rewrittenMethod->Instantiate(*function, method);
+
+            auto tokenizer = std::static_pointer_cast<CountingTokenizer>(function->_tokenizer);
+            Assert::AreEqual(0x0a000040u, tokenizer->_methodSpecParent);
+        }
+
+        TEST_METHOD(changed_type_token_means_the_method_has_to_be_rewritten)
+        {
+            auto rewrittenMethod = Record(CreateFunction(0x1000, 0x10));
+
+            auto function = CreateFunction(0x2000, 0x40);
+            std::static_pointer_cast<CountingTokenizer>(function->_tokenizer)->_typeRefToken = 0x01000006;
+            ByteVector method;
+            Assert::IsFalse(rewrittenMethod->Instantiate(*function, method));
+        }
+
+        TEST_METHOD(string_ending_in_the_function_id_is_made_for_the_new_function_id)
+        {
+            auto rewrittenMethod = Record(CreateFunction(0x1000, 0x10));
+
+            auto function = CreateFunction(0x2000, 0x40);
+            ByteVector method;
+            rewrittenMethod->Instantiate(*function, method);
+
+            auto tokenizer = std::static_pointer_cast<CountingTokenizer>(function->_tokenizer);
+            Assert::AreEqual(size_t(1), tokenizer->_strings.size());
+            Assert::AreEqual(std::wstring(L"MyClass.MyMethod_8192"), tokenizer->_strings[0]);
+        }
+
+        TEST_METHOD(original_method_that_loads_the_function_id_is_not_cached)
+        {
+            auto function = CreateFunction(0x1000, 0x10);
+            RecordingFunction recording(function);
+            auto method = RecordMethod(recording);
+
+            BYTEVECTOR(originalMethod,
+                0x2 | (10 << 2),
+                CEE_LDC_I8, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                CEE_RET
+            );
+            Assert::IsTrue(RewrittenMethod::Create(RewrittenMethodKey(), function->GetFunctionId(), recording.GetRecipes(), method, originalMethod) == nullptr);
+        }
+
+        TEST_METHOD(method_that_is_not_well_formed_is_not_cached)
+        {
+            auto function = CreateFunction(0x1000, 0x10);
+            RecordingFunction recording(function);
+            auto method = RecordMethod(recording);
+            method.pop_back();
+
+            Assert::IsTrue(RewrittenMethod::Create(RewrittenMethodKey(), function->GetFunctionId(), recording.GetRecipes(), method, GetOriginalMethod()) == nullptr);
+        }
+
+        TEST_METHOD(serialized_method_instantiates_the_same)
+        {
+            auto rewrittenMethod = Record(CreateFunction(0x1000, 0x10));
+            ByteVector bytes;
+            rewrittenMethod->Serialize(bytes);
+
+            auto deserialized = RewrittenMethod::Deserialize(bytes.data(), bytes.size());
+            Assert::IsTrue(deserialized != nullptr);
+            Assert::IsTrue(rewrittenMethod->GetKey() == deserialized->GetKey());
+
+            ByteVector method;
+            ByteVector deserializedMethod;
+            rewrittenMethod->Instantiate(*CreateFunction(0x2000, 0x40), method);
+            deserialized->Instantiate(*CreateFunction(0x2000, 0x40), deserializedMethod);
+            Assert::IsTrue(method == deserializedMethod);
+        }
+
+        TEST_METHOD(truncated_method_is_not_deserialized)
+        {
+            auto rewrittenMethod = Record(CreateFunction(0x1000, 0x10));
+            ByteVector bytes;
+            rewrittenMethod->Serialize(bytes);
+
+            for (size_t size = 0; size < bytes.size(); ++size)
+            {
+                Assert::IsTrue(RewrittenMethod::Deserialize(bytes.data(), size) == nullptr);
+            }
+        }
+
+        TEST_METHOD(scanner_finds_tokens_in_exception_clauses_and_skips_switch_targets)
+        {
+            BYTEVECTOR(method,
+                // fat header with more sections, 15 bytes of code and no locals
+                0x1b, 0x30, 0x08, 0x00, 0x0f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                CEE_SWITCH, 0x01, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x0a,
+                CEE_NEWOBJ, 0x01, 0x00, 0x00, 0x0a,
+                CEE_RET,
+                0x00,
+                // a small exception handling section with a typed catch and a finally
+                0x01, 0x1c, 0x00, 0x00,
+                0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x00, 0x01, 0x05, 0x00, 0x00, 0x01,
+                0x02, 0x00, 0x00, 0x00, 0x01, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00
+            );
+
+            std::vector<uint32_t> tokens;
+            Assert::IsTrue(MethodTokenScanner::Scan(method, [&](uint32_t offset) { tokens.push_back(offset); }, [](uint32_t) {}));
+
+            std::vector<uint32_t> expected = { 22, 40 };
+            Assert::IsTrue(expected == tokens);
+        }
+
+        TEST_METHOD(modules_without_an_mvid_are_not_cached)
+        {
+            RewrittenMethodCache cache(L"", 0);
+            auto function = CreateFunction(0x1000, 0x10);
+            function->_moduleVersionId = nullptr;
+            RewrittenMethodKey key;
+            Assert::IsFalse(cache.TryGetKey(*function, *function->GetInstrumentationPoint(), L"core.dll", key));
+        }
+
+        TEST_METHOD(keys_depend_on_the_instrumentation)
+        {
+            RewrittenMethodCache cache(L"", 0);
+            auto function = CreateFunction(0x1000, 0x10);
+            auto instrumentationPoint = function->GetInstrumentationPoint();
+            RewrittenMethodKey key;
+            Assert::IsTrue(cache.TryGetKey(*function, *instrumentationPoint, L"core.dll", key));
+
+            instrumentationPoint->TracerFactoryArgs = 1;
+            RewrittenMethodKey otherKey;
+            cache.TryGetKey(*function, *instrumentationPoint, L"core.dll", otherKey);
+            Assert::IsFalse(key == otherKey);
+
+            instrumentationPoint->TracerFactoryArgs = 0;
+            cache.TryGetKey(*function, *instrumentationPoint, L"other.dll", otherKey);
+            Assert::IsFalse(key == otherKey);
+
+            cache.TryGetKey(*function, *instrumentationPoint, L"core.dll", otherKey);
+            Assert::IsTrue(key == otherKey);
+        }
+
+        TEST_METHOD(damaged_bytes_are_skipped_without_losing_the_records_after_them)
+        {
+            std::wstring filePath = L"temp_rewrite_cache_damaged.bin";
+            std::ofstream(filePath, std::ios::binary | std::ios::trunc);
+            {
+                RewrittenMethodCache cache(filePath, 0);
+                Put(cache, 0x1000, 0);
+            }
+            {
+                // a record torn by a process that died while writing it
+                std::ofstream file(filePath, std::ios::binary | std::ios::app);
+                file.write("\x4e\x52\x52\x43\x01\x00", 6);
+            }
+            {
+                RewrittenMethodCache cache(filePath, 0);
+                Assert::AreEqual(size_t(1), cache.GetMethodCount());
+                Put(cache, 0x1000, 1);
+            }
+
+            RewrittenMethodCache cache(filePath, 0);
+            Assert::AreEqual(size_t(2), cache.GetMethodCount());
+        }
+
+        TEST_METHOD(nothing_is_appended_once_other_processes_have_filled_the_file)
+        {
+            std::wstring filePath = L"temp_rewrite_cache_full.bin";
+            std::ofstream(filePath, std::ios::binary | std::ios::trunc);
+            RewrittenMethodCache cache(filePath, 0);
+            {
+                // appended by another process after this one read the file
+                std::ofstream file(filePath, std::ios::binary | std::ios::app);
+                std::vector<char> bytes(RewrittenMethodCache::MaxFileSize - 8, 0);
+                file.write(bytes.data(), bytes.size());
+            }
+
+            Put(cache, 0x1000, 0);
+            Assert::AreEqual(size_t(1), cache.GetMethodCount());
+
+            {
+                std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+                Assert::AreEqual(int64_t(RewrittenMethodCache::MaxFileSize - 8), int64_t(file.tellg()));
+            }
+            std::ofstream(filePath, std::ios::binary | std::ios::trunc);
+        }
+
+    private:
+        static void Put(RewrittenMethodCache& cache, uintptr_t functionId, uint32_t tracerFactoryArgs)
+        {
+            auto function = CreateFunction(functionId, 0x10);
+            auto instrumentationPoint = function->GetInstrumentationPoint();
+            instrumentationPoint->TracerFactoryArgs = tracerFactoryArgs;
+            RewrittenMethodKey key;
+            Assert::IsTrue(cache.TryGetKey(*function, *instrumentationPoint, L"core.dll", key));
+
+            RecordingFunction recording(function);
+            RecordMethod(recording);
+            cache.Put(key, recording, GetOriginalMethod());
+        }
+
+        static MockFunctionPtr CreateFunction(uintptr_t functionId, uint32_t firstRow)
+        {
+            auto function = std::make_shared<MockFunction>();
+            function->_functionId = functionId;
+            function->_tokenizer = std::make_shared<CountingTokenizer>(firstRow);
+            function->_signatureToken = 0x11000000 | ((firstRow >> 4) + 1);
+            function->_methodBytes = std::make_shared<ByteVector>(GetOriginalMethod());
+            BYTEVECTOR(moduleVersionId, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10);
+            function->_moduleVersionId = std::make_shared<ByteVector>(moduleVersionId);
+            return function;
+        }
+
+        static ByteVector GetOriginalMethod()
+        {
+            BYTEVECTOR(method,
+                0x2 | (1 << 2),
+                CEE_RET
+            );
+            return method;
+        }
+
+        // what an instrumentation would do: ask for its tokens, then write a method that uses them
+        static ByteVector RecordMethod(RecordingFunction& function)
+        {
+            auto tokenizer = function.GetTokenizer();
+            auto typeRef = tokenizer->GetTypeRefToken(L"mscorlib", L"System.Object");
+            auto memberRef = tokenizer->GetMemberRefOrDefToken(typeRef, L"ToString", ByteVector(3, 0x20));
+            auto string = tokenizer->GetStringToken(L"MyClass.MyMethod_" + TokenRecipe::FormatFunctionId(function.GetFunctionId()));
+            auto methodSpec = tokenizer->GetMethodSpecToken(memberRef, ByteVector(2, 0x0a));
+            auto locals = function.GetTokenFromSignature(ByteVector(3, 0x07));
+
+            auto method = BuildMethod(locals, string, memberRef, methodSpec, function.GetFunctionId());
+            function.WriteMethod(method);
+            return method;
+        }
+
+        static RewrittenMethodPtr Record(MockFunctionPtr function)
+        {
+            RecordingFunction recording(function);
+            RecordMethod(recording);
+            auto rewrittenMethod = RewrittenMethod::Create(RewrittenMethodKey(), function->GetFunctionId(), recording.GetRecipes(), *recording.GetWrittenMethod(), GetOriginalMethod());
+            Assert::IsTrue(rewrittenMethod != nullptr);
+            return rewrittenMethod;
+        }
+
+        static ByteVector BuildMethod(uint32_t locals, uint32_t string, uint32_t memberRef, uint32_t methodSpec, uint64_t functionId)
+        {
+            ByteVector method = { 0x13, 0x30, 0x08, 0x00, 0x1a, 0x00, 0x00, 0x00 };
+            AppendLittleEndian(method, locals, 4);
+            method.push_back(CEE_LDSTR);
+            AppendLittleEndian(method, string, 4);
+            method.push_back(CEE_CALL);
+            AppendLittleEndian(method, memberRef, 4);
+            method.push_back(CEE_CALL);
+            AppendLittleEndian(method, methodSpec, 4);
+            method.push_back(CEE_LDC_I8);
+            AppendLittleEndian(method, functionId, 8);
+            method.push_back(CEE_POP);
+            method.push_back(CEE_RET);
+            return method;
+        }
+
+        static void AppendLittleEndian(ByteVector& bytes, uint64_t value, size_t size)
+        {
+            for (size_t i = 0; i < size; ++i)
+            {
+                bytes.push_back(uint8_t(value >> (8 * i)));
+            }
+        }
+    };
+}}}}
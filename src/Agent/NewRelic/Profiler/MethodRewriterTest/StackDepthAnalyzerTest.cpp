@@ -0,0 +1,257 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include "CppUnitTest.h"
+#include "../MethodRewriter/StackDepthAnalyzer.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic { namespace Profiler { namespace MethodRewriter { namespace Test
+{
+    TEST_CLASS(StackDepthAnalyzerTest)
+    {
+    public:
+        TEST_METHOD(straight_line_code_is_as_deep_as_its_deepest_instruction)
+        {
+            BYTEVECTOR(code,
+                CEE_LDC_I4_0,
+                CEE_DUP,
+                CEE_DUP,
+                CEE_POP,
+                CEE_POP,
+                0xfe, 0x09, 0x00, 0x00, // ldarg 0
+                CEE_ADD,
+                CEE_RET
+            );
+            uint16_t maxStack = 0;
+            Assert::IsTrue(StackDepthAnalyzer::TryGetMaxStack(WithTinyHeader(code), true, nullptr, maxStack));
+            Assert::AreEqual(uint16_t(3), maxStack);
+        }
+
+        TEST_METHOD(both_sides_of_a_branch_are_followed)
+        {
+            BYTEVECTOR(code,
+                CEE_LDARG_0,
+                CEE_BRTRUE_S, 0x03,
+                CEE_LDC_I4_1,
+                CEE_BR_S, 0x03,
+                CEE_LDC_I4_2,
+                CEE_LDC_I4_3,
+                CEE_ADD,
+                CEE_RET
+            );
+            uint16_t maxStack = 0;
+            Assert::IsTrue(StackDepthAnalyzer::TryGetMaxStack(WithTinyHeader(code), true, nullptr, maxStack));
+            Assert::AreEqual(uint16_t(2), maxStack);
+        }
+
+        TEST_METHOD(switch_targets_are_followed)
+        {
+            BYTEVECTOR(code,
+                CEE_LDARG_0,
+                CEE_SWITCH, 0x02, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00,
+                CEE_LDC_I4_0,
+                CEE_RET,
+                CEE_NOP,
+                CEE_LDC_I4_1,
+                CEE_RET,
+                CEE_LDC_I4_1,
+                CEE_LDC_I4_2,
+                CEE_ADD,
+                CEE_RET
+            );
+            uint16_t maxStack = 0;
+            Assert::IsTrue(StackDepthAnalyzer::TryGetMaxStack(WithTinyHeader(code), true, nullptr, maxStack));
+            Assert::AreEqual(uint16_t(2), maxStack);
+        }
+
+        TEST_METHOD(calls_pop_their_arguments_and_push_their_return_value)
+        {
+            BYTEVECTOR(code,
+                CEE_LDARG_0,
+                CEE_LDC_I4_1,
+                CEE_LDC_I4_2,
+                CEE_CALLVIRT, 0x01, 0x00, 0x00, 0x0a,
+                CEE_LDC_I4_3,
+                CEE_NEWOBJ, 0x02, 0x00, 0x00, 0x0a,
+                CEE_CALL, 0x03, 0x00, 0x00, 0x0a,
+                CEE_RET
+            );
+            auto resolveSignature = [](uint32_t token) -> ByteVectorPtr
+            {
+                switch (token)
+                {
+                    // instance int32 (int32, int32)
+                    case 0x0a000001: return std::make_shared<ByteVector>(ByteVector{ 0x20, 0x02, 0x08, 0x08, 0x08 });
+                    // instance void .ctor(int32)
+                    case 0x0a000002: return std::make_shared<ByteVector>(ByteVector{ 0x20, 0x01, 0x01, 0x08 });
+                    // static void (int32, object)
+                    case 0x0a000003: return std::make_shared<ByteVector>(ByteVector{ 0x00, 0x02, 0x01, 0x08, 0x1c });
+                    default: return nullptr;
+                }
+            };
+            uint16_t maxStack = 0;
+            Assert::IsTrue(StackDepthAnalyzer::TryGetMaxStack(WithTinyHeader(code), false, resolveSignature, maxStack));
+            Assert::AreEqual(uint16_t(3), maxStack);
+        }
+
+        TEST_METHOD(call_that_cannot_be_resolved_fails)
+        {
+            BYTEVECTOR(code,
+                CEE_CALL, 0x01, 0x00, 0x00, 0x0a,
+                CEE_RET
+            );
+            uint16_t maxStack = 0;
+            Assert::IsFalse(StackDepthAnalyzer::TryGetMaxStack(WithTinyHeader(code), false, [](uint32_t) { return ByteVectorPtr(); }, maxStack));
+            Assert::IsFalse(StackDepthAnalyzer::TryGetMaxStack(WithTinyHeader(code), false, nullptr, maxStack));
+        }
+
+        TEST_METHOD(catch_handler_starts_with_the_exception_on_the_stack)
+        {
+            BYTEVECTOR(method,
+                // fat header with more sections and 12 bytes of code
+                0x0b, 0x30, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                // try
+                CEE_LDC_I4_0,
+                CEE_POP,
+                CEE_NOP,
+                CEE_NOP,
+                CEE_LEAVE_S, 0x05,
+                // catch
+                CEE_LDC_I4_1,
+                CEE_POP,
+                CEE_POP,
+                CEE_LEAVE_S, 0x00,
+                CEE_RET,
+                // a small exception handling section with a typed catch
+                0x01, 0x10, 0x00, 0x00,
+                0x00, 0x00, 0x00, 0x00, 0x06, 0x06, 0x00, 0x05, 0x05, 0x00, 0x00, 0x01
+            );
+            uint16_t maxStack = 0;
+            Assert::IsTrue(StackDepthAnalyzer::TryGetMaxStack(method, false, nullptr, maxStack));
+            Assert::AreEqual(uint16_t(2), maxStack);
+        }
+
+        TEST_METHOD(finally_handler_starts_with_an_empty_stack)
+        {
+            BYTEVECTOR(method,
+                // fat header with more sections and 8 bytes of code
+                0x0b, 0x30, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                // try
+                CEE_NOP,
+                CEE_LEAVE_S, 0x04,
+                // finally, which pops a value that isn't there
+                CEE_POP,
+                CEE_ENDFINALLY,
+                CEE_NOP,
+                CEE_NOP,
+                CEE_RET,
+                // a fat exception handling section with a finally
+                0x41, 0x1c, 0x00, 0x00,
+                0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
+                0x03, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+            );
+            uint16_t maxStack = 0;
+            Assert::IsFalse(StackDepthAnalyzer::TryGetMaxStack(method, false, nullptr, maxStack));
+        }
+
+        TEST_METHOD(stack_underflow_fails)
+        {
+            BYTEVECTOR(code,
+                CEE_LDC_I4_0,
+                CEE_ADD,
+                CEE_RET
+            );
+            uint16_t maxStack = 0;
+            Assert::IsFalse(StackDepthAnalyzer::TryGetMaxStack(WithTinyHeader(code), true, nullptr, maxStack));
+        }
+
+        TEST_METHOD(different_depths_where_paths_meet_fails)
+        {
+            BYTEVECTOR(code,
+                CEE_LDARG_0,
+                CEE_BRTRUE_S, 0x01,
+                CEE_LDC_I4_1,
+                CEE_RET
+            );
+            uint16_t maxStack = 0;
+            Assert::IsFalse(StackDepthAnalyzer::TryGetMaxStack(WithTinyHeader(code), true, nullptr, maxStack));
+        }
+
+        TEST_METHOD(branch_into_the_middle_of_an_instruction_fails)
+        {
+            BYTEVECTOR(code,
+                CEE_BR_S, 0x01,
+                CEE_LDC_I4_S, CEE_NOP,
+                CEE_RET
+            );
+            uint16_t maxStack = 0;
+            Assert::IsFalse(StackDepthAnalyzer::TryGetMaxStack(WithTinyHeader(code), false, nullptr, maxStack));
+        }
+
+        TEST_METHOD(branch_outside_the_code_fails)
+        {
+            BYTEVECTOR(code,
+                CEE_BR_S, 0x7f,
+                CEE_RET
+            );
+            uint16_t maxStack = 0;
+            Assert::IsFalse(StackDepthAnalyzer::TryGetMaxStack(WithTinyHeader(code), false, nullptr, maxStack));
+        }
+
+        TEST_METHOD(running_off_the_end_of_the_code_fails)
+        {
+            BYTEVECTOR(code,
+                CEE_LDC_I4_0,
+                CEE_POP
+            );
+            uint16_t maxStack = 0;
+            Assert::IsFalse(StackDepthAnalyzer::TryGetMaxStack(WithTinyHeader(code), false, nullptr, maxStack));
+        }
+
+        TEST_METHOD(unknown_opcode_fails)
+        {
+            BYTEVECTOR(code,
+                0xa6,
+                CEE_RET
+            );
+            uint16_t maxStack = 0;
+            Assert::IsFalse(StackDepthAnalyzer::TryGetMaxStack(WithTinyHeader(code), false, nullptr, maxStack));
+        }
+
+        TEST_METHOD(method_signatures_are_parsed)
+        {
+            uint32_t argumentCount = 0;
+            bool returnsValue = false;
+
+            // instance void <T>(!!0)
+            Assert::IsTrue(StackDepthAnalyzer::TryParseMethodSignature(ByteVector{ 0x30, 0x01, 0x01, 0x01, 0x1e, 0x00 }, argumentCount, returnsValue));
+            Assert::AreEqual(2u, argumentCount);
+            Assert::IsFalse(returnsValue);
+
+            // int32 modopt(IsLong) ()
+            Assert::IsTrue(StackDepthAnalyzer::TryParseMethodSignature(ByteVector{ 0x00, 0x00, 0x20, 0x09, 0x08 }, argumentCount, returnsValue));
+            Assert::AreEqual(0u, argumentCount);
+            Assert::IsTrue(returnsValue);
+
+            // explicit this counts the this pointer as a parameter
+            Assert::IsTrue(StackDepthAnalyzer::TryParseMethodSignature(ByteVector{ 0x60, 0x01, 0x01, 0x1c }, argumentCount, returnsValue));
+            Assert::AreEqual(1u, argumentCount);
+
+            // a field signature
+            Assert::IsFalse(StackDepthAnalyzer::TryParseMethodSignature(ByteVector{ 0x06, 0x08 }, argumentCount, returnsValue));
+        }
+
+    private:
+        static ByteVector WithTinyHeader(const ByteVector& code)
+        {
+            ByteVector method;
+            method.push_back(uint8_t((code.size() << 2) | 0x2));
+            method.insert(method.end(), code.begin(), code.end());
+            return method;
+        }
+    };
+}}}}
@@ -5,6 +5,10 @@
 #pragma once
 #include <string>
 #include <array>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
 #include "../Common/CorStandIn.h"
 #include "../Common/Strings.h"
 #include "../Logging/Logger.h"
@@ -29,12 +33,21 @@ namespace NewRelic { namespace Profiler { namespace ModuleInjector
             {}
         };
 
-    public:
-        static void InjectIntoModule(IModule& module)
+        // a method to inject with its signature already parsed, so that only the tokens of the module it is injected into have to
+        // be looked up
+        struct ParsedMethodToInject
         {
-            //for background on the methodology and rationale, see:
-            //  https://social.msdn.microsoft.com/Forums/en-US/f8bf431a-7a83-4dfb-bbf7-ef23b1e30904/profiling-silverlight-with-securitysafecriticalattributesecuritycriticalattribute-and-injected-il
+            std::wstring TypeName;
+            std::wstring MethodName;
+            std::wstring Signature;
+            sicily::ast::TypePtr SignatureType;
+        };
 
+    public:
+        //for background on the methodology and rationale, see:
+        //  https://social.msdn.microsoft.com/Forums/en-US/f8bf431a-7a83-4dfb-bbf7-ef23b1e30904/profiling-silverlight-with-securitysafecriticalattributesecuritycriticalattribute-and-injected-il
+        ModuleInjector()
+        {
             // When injecting method REFERENCES into an assembly, theses references should have
             // the external assembly identifier to mscorlib
             constexpr std::array<ManagedMethodToInject, 6> methodReferencesToInject{
@@ -57,13 +70,62 @@ namespace NewRelic { namespace Profiler { namespace ModuleInjector
                 ManagedMethodToInject(L"System.CannotUnloadAppDomainException", L"StoreMethodInAppDomainStorageOrThrow", L"void", L"class System.Reflection.MethodInfo,string")
             };
 
+            _methodReferencesToInject = ParseSignatures(methodReferencesToInject);
+            _methodImplsToInject = ParseSignatures(methodImplsToInject);
+        }
+
+        // Injects the helper methods into mscorlib, or references to them into any other module.  The helper methods have to be
+        // in mscorlib before any of its types load, so mscorlib is injected into as soon as it loads.
+        void InjectIntoModule(uintptr_t moduleId, IModule& module)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _injectedModules.insert(moduleId);
+            Inject(module);
+        }
+
+        // Injects references to the helper methods into a module the first time a method in it is about to be instrumented.  Most
+        // modules never have a method instrumented, and are left alone.  getModule is only called if the module has not been
+        // injected into yet.
+        void InjectIntoModuleOnce(uintptr_t moduleId, std::function<IModulePtr()> getModule)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_injectedModules.find(moduleId) != _injectedModules.end())
+            {
+                return;
+            }
+            // a module that couldn't be injected into is not tried again
+            _injectedModules.insert(moduleId);
+
+            auto module = getModule();
+            if (module != nullptr)
+            {
+                Inject(*module);
+            }
+        }
+
+        // Module ids are reused once a module is unloaded.
+        void ModuleUnloaded(uintptr_t moduleId)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _injectedModules.erase(moduleId);
+        }
+
+    private:
+        std::vector<ParsedMethodToInject> _methodReferencesToInject;
+        std::vector<ParsedMethodToInject> _methodImplsToInject;
+        // injection into different modules is serialized, it happens once per instrumented module
+        std::mutex _mutex;
+        std::unordered_set<uintptr_t> _injectedModules;
+
+        void Inject(IModule& module)
+        {
             const auto is_mscorlib = module.GetIsThisTheMscorlibAssembly();
 
             // If instrumenting mscorlib, use local (to the assembly) references
             // otherwise use external references
-            auto methods = is_mscorlib
-                ? methodImplsToInject
-                : methodReferencesToInject;
+            const auto& methods = is_mscorlib
+                ? _methodImplsToInject
+                : _methodReferencesToInject;
 
             if (!is_mscorlib && !EnsureReferenceToMscorlib(module))
             {
@@ -75,19 +137,12 @@ namespace NewRelic { namespace Profiler { namespace ModuleInjector
 
             //inject the methods if mscorlib and inject references into all other assemblies. (pointer to member function to select method to call in loop)
             const auto workerFunc{ (is_mscorlib) ? &IModule::InjectStaticSecuritySafeMethod : &IModule::InjectMscorlibSecuritySafeMethodReference };
-            std::wstring signatum;
-            signatum.reserve(200);
+            sicily::codegen::ByteCodeGenerator generator(module.GetTokenizer());
             for (const auto& managedMethod : methods)
             {
                 try
                 {
-                    //create standard signature string
-                    signatum.assign(managedMethod.ReturnType)
-                        .append(1, L' ').append(managedMethod.TypeName)
-                        .append(L"::", 2).append(managedMethod.MethodName)
-                        .append(1, L'(').append(managedMethod.ParameterTypes)
-                        .append(1, L')');
-                    auto signature = ToSignature(signatum, module.GetTokenizer());
+                    auto signature = generator.TypeToBytes(managedMethod.SignatureType);
 
                     //inject method or references...
                     (module.*workerFunc)(managedMethod.MethodName, managedMethod.TypeName, signature);
@@ -98,24 +153,37 @@ namespace NewRelic { namespace Profiler { namespace ModuleInjector
                     //if is mscorlib, allow the loop to proceed.  if not, break out of the loop
                     if (is_mscorlib)
                     {
-                        LogError(L"Failed to tokenize method signature: ", signatum, L". Proceeding to next method.");
+                        LogError(L"Failed to tokenize method signature: ", managedMethod.Signature, L". Proceeding to next method.");
                     }
                     else 
                     {
-                        LogTrace(L"Failed to tokenize method signature: ", signatum, L". Skipping injection of other method references for this module.");
+                        LogTrace(L"Failed to tokenize method signature: ", managedMethod.Signature, L". Skipping injection of other method references for this module.");
                     }
                 }
             }
         }
 
-    private:
-        static ByteVector ToSignature(const std::wstring& signature, const sicily::codegen::ITokenizerPtr& tokenizer)
+        // the signatures are the same for every module, only their tokens differ, so they are parsed once
+        template <size_t Count>
+        static std::vector<ParsedMethodToInject> ParseSignatures(const std::array<ManagedMethodToInject, Count>& methods)
         {
-            sicily::Scanner scanner(signature);
-            sicily::Parser parser;
-            sicily::ast::TypePtr type = parser.Parse(scanner);
-            sicily::codegen::ByteCodeGenerator generator(tokenizer);
-            return generator.TypeToBytes(type);
+            std::vector<ParsedMethodToInject> parsedMethods;
+            parsedMethods.reserve(Count);
+            for (const auto& managedMethod : methods)
+            {
+                //create standard signature string
+                std::wstring signatum;
+                signatum.assign(managedMethod.ReturnType)
+                    .append(1, L' ').append(managedMethod.TypeName)
+                    .append(L"::", 2).append(managedMethod.MethodName)
+                    .append(1, L'(').append(managedMethod.ParameterTypes)
+                    .append(1, L')');
+
+                sicily::Scanner scanner(signatum);
+                sicily::Parser parser;
+                parsedMethods.push_back(ParsedMethodToInject{ managedMethod.TypeName, managedMethod.MethodName, signatum, parser.Parse(scanner) });
+            }
+            return parsedMethods;
         }
 
         static bool EnsureReferenceToMscorlib(IModule& module)
@@ -3,19 +3,30 @@
 
 #pragma once
 #include <atomic>
+#include <chrono>
 #include <cor.h>
 #include <corprof.h>
 
 #include "../Configuration/Configuration.h"
 #include "../Configuration/InstrumentationConfiguration.h"
+#include "../Configuration/InstrumentationDiff.h"
+#include "../Configuration/InstrumentationIndex.h"
+#include "../Configuration/ShouldInstrumentCache.h"
 #include "../Logging/Logger.h"
 #include "../MethodRewriter/CustomInstrumentation.h"
 #include "../MethodRewriter/MethodRewriter.h"
 #include "../SignatureParser/Exceptions.h"
 #include "../ThreadProfiler/ThreadProfiler.h"
 #include "../Common/FileUtils.h"
+#include "../Common/Fnv1a.h"
+#include "../Common/ParallelFor.h"
+#include "ExtensionsWatcher.h"
 #include "Function.h"
 #include "FunctionResolver.h"
+#include "GcStatistics.h"
+#include "InstrumentationRefreshProgress.h"
+#include "JitPrefilter.h"
+#include "MetaDataEnumeration.h"
 #include "Win32Helpers.h"
 #include "guids.h"
 #include <fstream>
@@ -40,7 +51,6 @@ namespace NewRelic { namespace Profiler {
 #pragma warning(push)
 #pragma warning(disable : 4100)
 
-    const ULONG METHOD_ENUM_BATCH_SIZE = 5;
     const ULONG MODULE_ENUM_BATCH_SIZE = 100;
     using NewRelic::Profiler::MethodRewriter::FilePaths;
 
@@ -100,7 +110,21 @@ namespace NewRelic { namespace Profiler {
         virtual HRESULT __stdcall AssemblyUnloadStarted(AssemblyID assemblyId) override { return S_OK; }
         virtual HRESULT __stdcall AssemblyUnloadFinished(AssemblyID assemblyId, HRESULT hrStatus) override { return S_OK; }
         virtual HRESULT __stdcall ModuleLoadStarted(ModuleID moduleId) override { return S_OK; }
-        virtual HRESULT __stdcall ModuleUnloadStarted(ModuleID moduleId) override { return S_OK; }
+        virtual HRESULT __stdcall ModuleUnloadStarted(ModuleID moduleId) override
+        {
+            if (_attributeIndexes) {
+                _attributeIndexes->Remove(moduleId);
+            }
+            if (_jitPrefilter) {
+                _jitPrefilter->ModuleUnloaded(moduleId);
+            }
+#ifndef PAL_STDCPP_COMPAT
+            if (_moduleInjector) {
+                _moduleInjector->ModuleUnloaded(moduleId);
+            }
+#endif
+            return S_OK;
+        }
         virtual HRESULT __stdcall ModuleUnloadFinished(ModuleID moduleId, HRESULT hrStatus) override { return S_OK; }
         virtual HRESULT __stdcall ModuleAttachedToAssembly(ModuleID moduleId, AssemblyID AssemblyId) override { return S_OK; }
         virtual HRESULT __stdcall ClassLoadStarted(ClassID classId) override { return S_OK; }
@@ -114,7 +138,6 @@ namespace NewRelic { namespace Profiler {
         virtual HRESULT __stdcall JITFunctionPitched(FunctionID functionId) override { return S_OK; }
         virtual HRESULT __stdcall JITInlining(FunctionID callerId, FunctionID calleeId, BOOL* pfShouldInline) override { return S_OK; }
         virtual HRESULT __stdcall ThreadCreated(ThreadID threadId) override { return S_OK; }
-        virtual HRESULT __stdcall ThreadAssignedToOSThread(ThreadID managedThreadId, DWORD osThreadId) override { return S_OK; }
         virtual HRESULT __stdcall RemotingClientInvocationStarted() override { return S_OK; }
         virtual HRESULT __stdcall RemotingClientSendingMessage(GUID* pCookie, BOOL fIsAsync) override { return S_OK; }
         virtual HRESULT __stdcall RemotingClientReceivingReply(GUID* pCookie, BOOL fIsAsync) override { return S_OK; }
@@ -125,11 +148,7 @@ namespace NewRelic { namespace Profiler {
         virtual HRESULT __stdcall RemotingServerSendingReply(GUID* pCookie, BOOL fIsAsync) override { return S_OK; }
         virtual HRESULT __stdcall UnmanagedToManagedTransition(FunctionID functionId, COR_PRF_TRANSITION_REASON reason) override { return S_OK; }
         virtual HRESULT __stdcall ManagedToUnmanagedTransition(FunctionID functionId, COR_PRF_TRANSITION_REASON reason) override { return S_OK; }
-        virtual HRESULT __stdcall RuntimeSuspendStarted(COR_PRF_SUSPEND_REASON suspendReason) override { return S_OK; }
-        virtual HRESULT __stdcall RuntimeSuspendFinished() override { return S_OK; }
-        virtual HRESULT __stdcall RuntimeSuspendAborted() override { return S_OK; }
         virtual HRESULT __stdcall RuntimeResumeStarted() override { return S_OK; }
-        virtual HRESULT __stdcall RuntimeResumeFinished() override { return S_OK; }
         virtual HRESULT __stdcall RuntimeThreadSuspended(ThreadID threadId) override { return S_OK; }
         virtual HRESULT __stdcall RuntimeThreadResumed(ThreadID threadId) override { return S_OK; }
         virtual HRESULT __stdcall MovedReferences(ULONG cMovedObjectIDRanges, ObjectID oldObjectIDRangeStart[], ObjectID newObjectIDRangeStart[], ULONG cObjectIDRangeLength[]) override { return S_OK; }
@@ -158,8 +177,6 @@ namespace NewRelic { namespace Profiler {
 
         // Unimplemented ICorProfilerCallback2
         virtual HRESULT __stdcall FinalizeableObjectQueued(DWORD finalizerFlags, ObjectID objectID) override { return S_OK; }
-        virtual HRESULT __stdcall GarbageCollectionFinished(void) override { return S_OK; }
-        virtual HRESULT __stdcall GarbageCollectionStarted(int cGenerations, BOOL generationCollected[], COR_PRF_GC_REASON reason) override { return S_OK; }
         virtual HRESULT __stdcall HandleCreated(GCHandleID handleId, ObjectID initialObjectId) override { return S_OK; }
         virtual HRESULT __stdcall HandleDestroyed(GCHandleID handleId) override { return S_OK; }
         virtual HRESULT __stdcall RootReferences2(ULONG cRootRefs, ObjectID rootRefIds[], COR_PRF_GC_ROOT_KIND rootKinds[], COR_PRF_GC_ROOT_FLAGS rootFlags[], UINT_PTR rootIds[]) override { return S_OK; }
@@ -184,6 +201,10 @@ namespace NewRelic { namespace Profiler {
             DelayProfilerAttach();
 #endif
 
+            // startup is split into a gate phase, which only reads newrelic.config and decides whether this process should be
+            // instrumented at all, and a full phase, which loads the instrumentation and is skipped by every rejected process
+            const auto gatePhaseStart = std::chrono::steady_clock::now();
+
             // initialization stuff, they should be logging their own errors and only throwing up if they want to cancel activation
             try
             {
@@ -209,6 +230,24 @@ namespace NewRelic { namespace Profiler {
                     return CORPROF_E_PROFILER_CANCEL_ACTIVATION;
                 }
 
+                auto forceProfiling = _systemCalls->GetForceProfiling();
+                auto processPath = Strings::ToUpper(_systemCalls->GetProcessPath());
+                auto commandLine = _systemCalls->GetProgramCommandLine();
+                auto parentProcessPath = Strings::ToUpper(_systemCalls->GetParentProcessPath());
+                auto appPoolId = GetAppPoolId(_systemCalls);
+
+                // The decision cache is checked before the config files are read, so that a process it says not to instrument
+                // unloads the profiler without reading them (or writing to the log, which they configure).
+                uint64_t decisionCacheKey = 0;
+                bool hasCachedDecision = false;
+                bool cachedShouldInstrument = false;
+                if (!forceProfiling) {
+                    hasCachedDecision = TryGetCachedShouldInstrument(processPath, parentProcessPath, appPoolId, commandLine, decisionCacheKey, cachedShouldInstrument);
+                    if (hasCachedDecision && !cachedShouldInstrument) {
+                        return CORPROF_E_PROFILER_CANCEL_ACTIVATION;
+                    }
+                }
+
                 // A bit of a catch-22: we want to load the config file first in case there are logging
                 // settings, but we also want to log if there are issues with the config file.
                 // So first, we try to load the config file...
@@ -241,8 +280,27 @@ namespace NewRelic { namespace Profiler {
                     return CORPROF_E_PROFILER_CANCEL_ACTIVATION;
                 }
 
+                LogTrace("Checking to see if we should instrument this process.");
+                if (hasCachedDecision) {
+                    LogInfo(L"Using the cached decision in ", *_systemCalls->GetDecisionCachePath(), L" that this process should be instrumented. Delete the file to evaluate the configuration again.");
+                }
+                else if (!forceProfiling && !ShouldInstrumentThisProcess(*configuration, processPath, parentProcessPath, appPoolId, commandLine, decisionCacheKey)) {
+                    LogInfo("This process should not be instrumented, unloading profiler.");
+                    LogInfo(L"Profiler startup gate phase completed in ", GetElapsedMilliseconds(gatePhaseStart), L" ms");
+                    return CORPROF_E_PROFILER_CANCEL_ACTIVATION;
+                }
+
+                LogInfo(L"Profiler startup gate phase completed in ", GetElapsedMilliseconds(gatePhaseStart), L" ms");
+                const auto fullPhaseStart = std::chrono::steady_clock::now();
+
                 //Init does not start threads or requires cleanup. RequestProfile will create the threads for the TP.
                 _threadProfiler.Init(_corProfilerInfo4);
+                ConfigureThreadProfilerOverheadBudget();
+
+                if (_systemCalls->GetGcStatisticsEnabled()) {
+                    LogInfo(L"GC statistics collection is enabled.");
+                    _gcStatistics.reset(new GcStatistics());
+                }
 
 
                 HRESULT corePathInitResult = InitializeAndSetAgentCoreDllPath(_productName);
@@ -252,21 +310,13 @@ namespace NewRelic { namespace Profiler {
 
                 auto instrumentationConfiguration = InitializeInstrumentationConfig(configuration->GetIgnoreInstrumentationList());
                 instrumentationConfiguration->CheckForEnvironmentInstrumentationPoint();
-                auto methodRewriter = std::make_shared<MethodRewriter::MethodRewriter>(instrumentationConfiguration, _agentCoreDllPath);
+                InitializeRewrittenMethodCache();
+                auto methodRewriter = std::make_shared<MethodRewriter::MethodRewriter>(instrumentationConfiguration, _agentCoreDllPath, _rewrittenMethodCache);
                 this->SetMethodRewriter(methodRewriter);
 
-                LogTrace("Checking to see if we should instrument this process.");
-                auto forceProfiling = _systemCalls->GetForceProfiling();
-                auto processPath = Strings::ToUpper(_systemCalls->GetProcessPath());
-                auto commandLine = _systemCalls->GetProgramCommandLine();
-                auto parentProcessPath = Strings::ToUpper(_systemCalls->GetParentProcessPath());
-                auto appPoolId = GetAppPoolId(_systemCalls);
-                if (!forceProfiling && !configuration->ShouldInstrument(processPath, parentProcessPath, appPoolId, commandLine, _isCoreClr)) {
-                    LogInfo("This process should not be instrumented, unloading profiler.");
-                    return CORPROF_E_PROFILER_CANCEL_ACTIVATION;
-                }
-
                 _functionResolver = std::make_shared<FunctionResolver>(_corProfilerInfo4);
+                _attributeIndexes = std::make_shared<ModuleAttributeIndexCache>(_corProfilerInfo4);
+                _jitPrefilter = std::make_shared<JitPrefilter>(_corProfilerInfo4, _attributeIndexes);
 
                 ConfigureEventMask(pICorProfilerInfoUnk);
 
@@ -274,6 +324,9 @@ namespace NewRelic { namespace Profiler {
 
                 LogMessageIfAppDomainCachingIsDisabled();
 
+                StartExtensionsWatcher();
+
+                LogInfo(L"Profiler startup full phase completed in ", GetElapsedMilliseconds(fullPhaseStart), L" ms");
                 LogInfo(L"Profiler initialized");
                 return S_OK;
             }
@@ -285,6 +338,15 @@ namespace NewRelic { namespace Profiler {
 
         virtual HRESULT __stdcall ModuleLoadFinished(ModuleID moduleId, HRESULT hrStatus) override
         {
+            if (SUCCEEDED(hrStatus) && _jitPrefilter) {
+                try {
+                    _jitPrefilter->ModuleLoaded(moduleId, GetAssemblyName(moduleId));
+                }
+                catch (...) {
+                    // the prefilter lets every method of a module it doesn't know through
+                }
+            }
+
             if (_isCoreClr)
             {
                 if (SUCCEEDED(hrStatus)) {
@@ -294,8 +356,9 @@ namespace NewRelic { namespace Profiler {
                         if (GetMethodRewriter()->ShouldInstrumentAssembly(assemblyName)) {
                             LogTrace("Assembly module loaded: ", assemblyName);
 
-                            auto instrumentationPoints = std::make_shared<Configuration::InstrumentationPointSet>(GetMethodRewriter()->GetAssemblyInstrumentation(assemblyName));
-                            auto methodDefs = GetMethodDefs(moduleId, instrumentationPoints);
+                            auto methodRewriter = GetMethodRewriter();
+                            auto instrumentationPoints = std::make_shared<Configuration::InstrumentationPointSet>(methodRewriter->GetAssemblyInstrumentation(assemblyName));
+                            auto methodDefs = GetMethodDefs(moduleId, assemblyName, instrumentationPoints, *methodRewriter->GetInstrumentationConfiguration(), false);
 
                             if (methodDefs != nullptr) {
                                 RejitModuleFunctions(moduleId, methodDefs);
@@ -317,27 +380,31 @@ namespace NewRelic { namespace Profiler {
                     return hrStatus;
                 }
 
-                LogTrace("Module Injection Started. ", moduleId);
-
-                ModuleInjector::IModulePtr module;
+                // the helper methods are defined in mscorlib before any of its types load; every other module only gets references to
+                // them, and not until one of its methods is instrumented (see ProcessMethodJit)
                 try
                 {
-                    module = std::make_shared<Module>(_corProfilerInfo4, moduleId);
+                    if (GetAssemblyName(moduleId) != _X("mscorlib"))
+                    {
+                        return S_OK;
+                    }
                 }
-                catch (const NewRelic::Profiler::MessageException& exception)
+                catch (...)
                 {
-                    (void)exception;
                     return S_OK;
                 }
-                catch (...)
+
+                LogTrace("Module Injection Started. ", moduleId);
+
+                auto module = CreateModuleForInjection(moduleId);
+                if (module == nullptr)
                 {
-                    LogError(L"An exception was thrown while getting details about a module.");
-                    return E_FAIL;
+                    return S_OK;
                 }
 
                 try
                 {
-                    _moduleInjector->InjectIntoModule(*module);
+                    _moduleInjector->InjectIntoModule(moduleId, *module);
                 }
                 catch (...)
                 {
@@ -376,22 +443,44 @@ namespace NewRelic { namespace Profiler {
 
                 CComPtr<ICorProfilerInfo5> _corProfilerInfo5;
                 const DWORD COR_PRF_HIGH_DISABLE_TIERED_COMPILATION = 0x8;
+// 0x10 = COR_PRF_HIGH_BASIC_GC: GarbageCollectionStarted/Finished without the cost of COR_PRF_MONITOR_GC, which also disables concurrent GC.
+                const DWORD COR_PRF_HIGH_BASIC_GC = 0x10;
 
                 if (FAILED(pICorProfilerInfoUnk->QueryInterface(__uuidof(ICorProfilerInfo5), (void**)&_corProfilerInfo5))) {
                     LogDebug(L"Calling SetEventMask().");
-                    ThrowOnError(_corProfilerInfo4->SetEventMask, _eventMask);
+                    ThrowOnError(_corProfilerInfo4->SetEventMask, GetEventMaskWithoutBasicGcEvents());
+                }
+                else if (_gcStatistics && SUCCEEDED(_corProfilerInfo5->SetEventMask2(_eventMask | COR_PRF_MONITOR_SUSPENDS, COR_PRF_HIGH_DISABLE_TIERED_COMPILATION | COR_PRF_HIGH_BASIC_GC))) {
+                    LogDebug(L"Called SetEventMask2() with basic GC events.");
                 }
                 else {
                     LogDebug(L"Calling SetEventMask2().");
-                    ThrowOnError(_corProfilerInfo5->SetEventMask2, _eventMask, COR_PRF_HIGH_DISABLE_TIERED_COMPILATION);
+                    ThrowOnError(_corProfilerInfo5->SetEventMask2, GetEventMaskWithoutBasicGcEvents(), COR_PRF_HIGH_DISABLE_TIERED_COMPILATION);
                 }
             }
             else
             {
                 // register for events that we are interested in getting callbacks for
                 LogDebug(L"Calling SetEventMask().");
-                ThrowOnError(_corProfilerInfo4->SetEventMask, _eventMask);
+                ThrowOnError(_corProfilerInfo4->SetEventMask, GetEventMaskWithoutBasicGcEvents());
+            }
+        }
+
+        // The event mask to use when the runtime can't deliver basic GC events. GC statistics then need COR_PRF_MONITOR_GC, which
+        // disables concurrent garbage collection, so they are only collected when that has been asked for as well and are disabled
+        // otherwise.
+        DWORD GetEventMaskWithoutBasicGcEvents()
+        {
+            if (!_gcStatistics) {
+                return _eventMask;
+            }
+            if (!_systemCalls->GetGcStatisticsMonitorGcEnabled()) {
+                LogWarn(L"GC statistics are not supported on this runtime without COR_PRF_MONITOR_GC, which disables concurrent garbage collection. Set NEW_RELIC_PROFILER_GC_STATISTICS_MONITOR_GC_ENABLED to collect them anyway. GC statistics are disabled.");
+                _gcStatistics.reset();
+                return _eventMask;
             }
+            LogInfo(L"Collecting GC statistics with COR_PRF_MONITOR_GC, which disables concurrent garbage collection.");
+            return _eventMask | COR_PRF_MONITOR_SUSPENDS | COR_PRF_MONITOR_GC;
         }
 
         virtual xstring_t GetRuntimeExtensionsDirectoryName()
@@ -480,8 +569,12 @@ namespace NewRelic { namespace Profiler {
         // Requests a function ReJIT.
         HRESULT RejitFunction(Function& function)
         {
+            if (!_functionResolver->AddFunctionIfGeneric(function)) {
+                LogDebug(L"reJIT already requested for another instantiation: [", function.GetFunctionId(), "] ", function.ToString());
+                return S_OK;
+            }
+
             LogDebug(L"Request reJIT: [", function.GetFunctionId(), "] ", function.ToString());
-            _functionResolver->AddFunctionIfGeneric(function);
 
             ModuleID moduleIds = { function.GetModuleID() };
             mdMethodDef methodIds = { function.GetMethodToken() };
@@ -520,10 +613,14 @@ namespace NewRelic { namespace Profiler {
             std::function<HRESULT(Function&, LPCBYTE, ULONG)> setILFunctionBody)
         {
             auto methodRewriter = GetMethodRewriter();
-            MethodRewriter::IFunctionPtr function;
+            if (!_jitPrefilter->MayInstrument(functionId, methodRewriter->GetPrefilter())) {
+                return S_OK;
+            }
+
+            std::shared_ptr<Function> function;
             try {
                 // create the Function object for this method
-                function = Function::Create(_corProfilerInfo4, functionId, methodRewriter, injectMethodInstrumentation,
+                function = Function::Create(_corProfilerInfo4, functionId, methodRewriter, _attributeIndexes, injectMethodInstrumentation,
           setILFunctionBody,
                     [&](Function& function) { return RejitFunction(function); });
                 if (function == nullptr) {
@@ -535,6 +632,19 @@ namespace NewRelic { namespace Profiler {
                 return E_FAIL;
             }
 
+#ifndef PAL_STDCPP_COMPAT
+            if (_moduleInjector) {
+                try {
+                    // modules are only injected into once they have a method that may be instrumented
+                    auto moduleId = function->GetModuleID();
+                    _moduleInjector->InjectIntoModuleOnce(moduleId, [&]() { return CreateModuleForInjection(moduleId); });
+                } catch (...) {
+                    LogError(L"An exception was thrown while attempting to inject into a module.");
+                    return E_FAIL;
+                }
+            }
+#endif
+
             try {
                 // instrument the method
                 methodRewriter->Instrument(function);
@@ -560,6 +670,8 @@ namespace NewRelic { namespace Profiler {
         virtual HRESULT __stdcall Shutdown() override
         {
             LogInfo(L"Profiler shutting down");
+            _extensionsWatcher.reset();
+            _refreshWorker.Stop();
             _threadProfiler.Shutdown();
             LogInfo(L"Profiler shutdown");
             return S_OK;
@@ -571,19 +683,79 @@ namespace NewRelic { namespace Profiler {
             return _threadProfiler.ThreadDestroyed(threadId);
         }
 
+        // ICorProfilerCallback2. Only called when GC statistics are enabled (see ConfigureEventMask).
+        virtual HRESULT __stdcall GarbageCollectionStarted(int cGenerations, BOOL generationCollected[], COR_PRF_GC_REASON reason) override
+        {
+            if (_gcStatistics) {
+                _gcStatistics->GarbageCollectionStarted(cGenerations, generationCollected, static_cast<uint32_t>(reason));
+            }
+            return S_OK;
+        }
+
+        // ICorProfilerCallback2
+        virtual HRESULT __stdcall GarbageCollectionFinished(void) override
+        {
+            if (_gcStatistics) {
+                _gcStatistics->GarbageCollectionFinished();
+            }
+            return S_OK;
+        }
+
+        // ICorProfilerCallback. Only called when GC statistics are enabled (COR_PRF_MONITOR_SUSPENDS).
+        virtual HRESULT __stdcall RuntimeSuspendStarted(COR_PRF_SUSPEND_REASON suspendReason) override
+        {
+            if (_gcStatistics) {
+                _gcStatistics->RuntimeSuspendStarted(static_cast<uint32_t>(suspendReason));
+            }
+            return S_OK;
+        }
+
+        // ICorProfilerCallback
+        virtual HRESULT __stdcall RuntimeSuspendFinished() override
+        {
+            if (_gcStatistics) {
+                _gcStatistics->RuntimeSuspendFinished();
+            }
+            return S_OK;
+        }
+
+        // ICorProfilerCallback
+        virtual HRESULT __stdcall RuntimeSuspendAborted() override
+        {
+            if (_gcStatistics) {
+                _gcStatistics->RuntimeSuspendAborted();
+            }
+            return S_OK;
+        }
+
+        // ICorProfilerCallback
+        virtual HRESULT __stdcall RuntimeResumeFinished() override
+        {
+            if (_gcStatistics) {
+                _gcStatistics->RuntimeResumeFinished();
+            }
+            return S_OK;
+        }
+
+        // ICorProfilerCallback
+        virtual HRESULT __stdcall ThreadAssignedToOSThread(ThreadID managedThreadId, DWORD osThreadId) override
+        {
+            return _threadProfiler.ThreadAssignedToOSThread(managedThreadId, osThreadId);
+        }
+
         // Returns a map of assembly name to instrumentation points.
         std::shared_ptr<std::map<xstring_t, Configuration::InstrumentationPointSetPtr>> GroupByAssemblyName(Configuration::InstrumentationPointSetPtr allInstrumentationPoints)
         {
             std::shared_ptr<std::map<xstring_t, Configuration::InstrumentationPointSetPtr>> instrumentationPointsByAssembly = std::make_shared<std::map<xstring_t, Configuration::InstrumentationPointSetPtr>>();
             for (auto point : *allInstrumentationPoints) {
                 Configuration::InstrumentationPointSetPtr instrumentationPoints;
-                auto it = instrumentationPointsByAssembly->find(point->AssemblyName);
+                auto it = instrumentationPointsByAssembly->find(point->AssemblyName.str());
 
                 if (it != instrumentationPointsByAssembly->end()) {
                     instrumentationPoints = it->second;
                 } else {
                     instrumentationPoints = std::make_shared<Configuration::InstrumentationPointSet>();
-                    (*instrumentationPointsByAssembly)[point->AssemblyName] = instrumentationPoints;
+                    (*instrumentationPointsByAssembly)[point->AssemblyName.str()] = instrumentationPoints;
                 }
 
                 instrumentationPoints->emplace(point);
@@ -631,6 +803,68 @@ namespace NewRelic { namespace Profiler {
             // around the same time and we need the correct ignore list to be applied.
             std::lock_guard<std::mutex> lock(_instrumentationRefreshMutex);
 
+            _refreshProgress.Start();
+            auto result = RefreshInstrumentation(newIgnoreInstrumentationList);
+            _refreshProgress.Finish(result);
+
+            LogTrace("Leave: ", __func__);
+
+            return result;
+        }
+
+        // Queues a refresh on the refresh worker and returns without waiting for it (see Common/CoalescingWorker.h).
+        HRESULT InstrumentationRefreshAsync(bool reloadConfiguration, uint64_t* ticket) noexcept
+        {
+            if (ticket == nullptr) {
+                return E_INVALIDARG;
+            }
+
+            try {
+                *ticket = _refreshWorker.Post(reloadConfiguration);
+            }
+            catch (...) {
+                *ticket = 0;
+            }
+            return *ticket == 0 ? E_UNEXPECTED : S_OK;
+        }
+
+        HRESULT GetInstrumentationRefreshStatus(uint64_t ticket, InstrumentationRefreshStatus* status) noexcept
+        {
+            if (status == nullptr) {
+                return E_INVALIDARG;
+            }
+
+            try {
+                status->ticket = ticket;
+                status->state = static_cast<int32_t>(_refreshWorker.GetState(ticket));
+                _refreshProgress.Fill(*status);
+            }
+            catch (...) {
+                return E_UNEXPECTED;
+            }
+            return status->state == static_cast<int32_t>(CoalescingWorkState::Unknown) ? E_INVALIDARG : S_OK;
+        }
+
+        // called on the refresh worker
+        void RunQueuedInstrumentationRefresh(bool reloadConfiguration, uint64_t ticket)
+        {
+            LogInfo(L"Running queued instrumentation refresh ", ticket);
+            try {
+                if (reloadConfiguration) {
+                    ReloadConfiguration();
+                } else {
+                    InstrumentationRefresh();
+                }
+            }
+            catch (...) {
+                LogError(L"An exception was thrown while running queued instrumentation refresh ", ticket);
+                _refreshProgress.Finish(E_FAIL);
+            }
+        }
+
+        // must be called with _instrumentationRefreshMutex held
+        HRESULT RefreshInstrumentation(Configuration::IgnoreInstrumentationListPtr newIgnoreInstrumentationList)
+        {
             auto instrumentationXmls = GetInstrumentationXmlsFromDisk(_systemCalls);
             auto customXml = _customInstrumentation.GetCustomInstrumentationXml();
             for (auto xmlPair : *customXml) {
@@ -645,6 +879,8 @@ namespace NewRelic { namespace Profiler {
                 newIgnoreInstrumentationList = oldIgnoreList;
             }
 
+            // the new configuration compiles its own ignore matcher and is only published together with the new method rewriter, so a
+            // JIT thread sees either the old ignore list or the new one, never a partially rebuilt one
             auto instrumentationConfiguration = std::make_shared<Configuration::InstrumentationConfiguration>(instrumentationXmls, newIgnoreInstrumentationList, _systemCalls);
             if (instrumentationConfiguration->GetInvalidFileCount() > 0) {
                 LogError(L"Unable to parse one or more instrumentation files.  Instrumentation will not be refreshed.");
@@ -653,18 +889,26 @@ namespace NewRelic { namespace Profiler {
 
             auto oldInstrumentationPoints = oldMethodRewriter->GetInstrumentationConfiguration()->GetInstrumentationPoints();
 
-            SetMethodRewriter(std::make_shared<MethodRewriter::MethodRewriter>(instrumentationConfiguration, _agentCoreDllPath));
+            SetMethodRewriter(std::make_shared<MethodRewriter::MethodRewriter>(instrumentationConfiguration, _agentCoreDllPath, _rewrittenMethodCache));
 
-            auto oldInstrumentationByAssembly = GroupByAssemblyName(oldInstrumentationPoints);
-            auto newInstrumentationByAssembly = GroupByAssemblyName(instrumentationConfiguration->GetInstrumentationPoints());
+            // only methods whose instrumentation changed are reverted or rejitted; the rest keep the code they already have.  A new
+            // ignore list can change what the wildcard points instrument without changing any point, so they are all redone then.
+            auto ignoreListChanged = !Configuration::IgnoreInstrumentation::AreEqual(oldIgnoreList, newIgnoreInstrumentationList);
+            Configuration::InstrumentationDiff diff(*oldInstrumentationPoints, *instrumentationConfiguration->GetInstrumentationPoints(), ignoreListChanged);
+            LogInfo(L"Instrumentation refresh added ", diff.GetAddedPoints()->size(), L" and removed ", diff.GetRemovedPoints()->size(), L" instrumentation points",
+                ignoreListChanged ? L", and the ignore list changed" : L"");
+            if (diff.IsEmpty()) {
+                return S_OK;
+            }
 
-            std::thread t1(&NewRelic::Profiler::CorProfilerCallbackImpl::RejitInstrumentationPoints, this, oldInstrumentationByAssembly, newInstrumentationByAssembly);
+            auto revertInstrumentationByAssembly = GroupByAssemblyName(diff.GetPointsToRevert());
+            auto rejitInstrumentationByAssembly = GroupByAssemblyName(diff.GetPointsToRejit());
+
+            std::thread t1(&NewRelic::Profiler::CorProfilerCallbackImpl::RejitInstrumentationPoints, this, revertInstrumentationByAssembly, rejitInstrumentationByAssembly);
 
             // block the calling managed thread until the worker thread has finished
             t1.join();
 
-            LogTrace("Leave: ", __func__);
-
             return S_OK;
         }
 
@@ -677,15 +921,19 @@ namespace NewRelic { namespace Profiler {
             return InstrumentationRefreshWithNewIgnoreList(newConfiguration->GetIgnoreInstrumentationList());
         }
 
+        // when reverting, methods that the new configuration still instruments are left alone; a wildcard that was removed can
+        // match methods that also have a point of their own
         std::shared_ptr<std::set<mdMethodDef>> GetMethodDefsForAssembly(
             ModuleID moduleId,
             xstring_t assemblyName,
-            std::shared_ptr<std::map<xstring_t, Configuration::InstrumentationPointSetPtr>> instrumentationByAssembly)
+            std::shared_ptr<std::map<xstring_t, Configuration::InstrumentationPointSetPtr>> instrumentationByAssembly,
+            const Configuration::InstrumentationConfiguration& newConfiguration,
+            bool revert)
         {
             auto oldIter = instrumentationByAssembly->find(assemblyName);
             if (oldIter != instrumentationByAssembly->end()) {
                 auto points = oldIter->second;
-                return GetMethodDefs(moduleId, points);
+                return GetMethodDefs(moduleId, assemblyName, points, newConfiguration, revert);
             }
 
             return nullptr;
@@ -701,14 +949,18 @@ namespace NewRelic { namespace Profiler {
             CComPtr<ICorProfilerModuleEnum> moduleEnum;
             TOE(_corProfilerInfo4->EnumModules(&moduleEnum));
 
+            // RefreshInstrumentation published the new configuration before starting this thread and waits for it to finish
+            auto newConfiguration = GetMethodRewriter()->GetInstrumentationConfiguration();
+
             ModuleID moduleIds[MODULE_ENUM_BATCH_SIZE];
             for (ULONG elementsFetched; SUCCEEDED(moduleEnum->Next(MODULE_ENUM_BATCH_SIZE, moduleIds, &elementsFetched)) && elementsFetched;) {
                 for (ULONG i = 0; i < elementsFetched; i++) {
+                    _refreshProgress.ModuleScanned();
                     try {
                         auto assemblyName = GetAssemblyName(moduleIds[i]);
 
-                        std::shared_ptr<std::set<mdMethodDef>> oldMethodDefs = GetMethodDefsForAssembly(moduleIds[i], assemblyName, oldInstrumentationByAssembly);
-                        std::shared_ptr<std::set<mdMethodDef>> newMethodDefs = GetMethodDefsForAssembly(moduleIds[i], assemblyName, newInstrumentationByAssembly);
+                        std::shared_ptr<std::set<mdMethodDef>> oldMethodDefs = GetMethodDefsForAssembly(moduleIds[i], assemblyName, oldInstrumentationByAssembly, *newConfiguration, true);
+                        std::shared_ptr<std::set<mdMethodDef>> newMethodDefs = GetMethodDefsForAssembly(moduleIds[i], assemblyName, newInstrumentationByAssembly, *newConfiguration, false);
 
                         // remove new (to be instrumented) methods from old methods
                         if (newMethodDefs != nullptr && oldMethodDefs != nullptr) {
@@ -720,6 +972,7 @@ namespace NewRelic { namespace Profiler {
                         RevertModuleFunctions(moduleIds[i], oldMethodDefs);
                         RejitModuleFunctions(moduleIds[i], newMethodDefs);
                     } catch (...) {
+                        _refreshProgress.Failed();
                     }
                 }
             }
@@ -727,7 +980,12 @@ namespace NewRelic { namespace Profiler {
             return S_OK;
         }
 
-        std::shared_ptr<std::set<mdMethodDef>> GetMethodDefs(ModuleID moduleId, NewRelic::Profiler::Configuration::InstrumentationPointSetPtr instrumentationPoints)
+        std::shared_ptr<std::set<mdMethodDef>> GetMethodDefs(
+            ModuleID moduleId,
+            const xstring_t& assemblyName,
+            NewRelic::Profiler::Configuration::InstrumentationPointSetPtr instrumentationPoints,
+            const Configuration::InstrumentationConfiguration& newConfiguration,
+            bool revert)
         {
             CComPtr<IMetaDataImport> pImport = nullptr;
             CComPtr<IUnknown> pUnk = nullptr;
@@ -737,36 +995,110 @@ namespace NewRelic { namespace Profiler {
                 return nullptr;
             }
 
-            std::shared_ptr<std::set<mdMethodDef>> methodDefs = std::make_shared<std::set<mdMethodDef>>();
+            // the points grouped by type, so that each type is found and its methods enumerated once however many points it has
+            std::map<xstring_t, std::set<xstring_t>> methodNamesByType;
+            // metadata can only be searched by exact name, so wildcard points are matched against every type in the module
+            Configuration::InstrumentationPatternMatcher patterns;
             for (const auto& instrumentationPoint : *instrumentationPoints) {
-                LogTrace("Fetching ", instrumentationPoint->ClassName, " methods");
+                if (Configuration::InstrumentationPatternMatcher::IsPattern(*instrumentationPoint)) {
+                    patterns.Add(instrumentationPoint);
+                    continue;
+                }
+                methodNamesByType[instrumentationPoint->ClassName.str()].insert(instrumentationPoint->MethodName.str());
+            }
+
+            std::shared_ptr<std::set<mdMethodDef>> methodDefs = std::make_shared<std::set<mdMethodDef>>();
+            // a method name that doesn't fit comes back as a truncation warning, and is longer than any name we instrument
+            WCHAR methodName[MAX_CLASS_NAME];
+            // adds the type's methods that are named in methodNames, or that a pattern matches if methodNames is null
+            auto addMethods = [&](mdTypeDef typeDef, const xstring_t& typeName, const std::set<xstring_t>* methodNames) -> size_t {
+                size_t methodsFound = 0;
+                EnumerateTokens<mdMethodDef>(pImport,
+                    [&](HCORENUM* enumerator, mdMethodDef* tokens, ULONG size, ULONG* count) { return pImport->EnumMethods(enumerator, typeDef, tokens, size, count); },
+                    [&](mdMethodDef methodDef) -> bool {
+                        ULONG methodNameLength = 0;
+                        if (pImport->GetMethodProps(methodDef, nullptr, methodName, MAX_CLASS_NAME, &methodNameLength, nullptr, nullptr, nullptr, nullptr, nullptr) != S_OK || methodNameLength == 0) {
+                            return true;
+                        }
+                        xstring_t name(methodName, methodNameLength - 1);
+                        bool selected = methodNames != nullptr
+                            ? methodNames->find(name) != methodNames->end()
+                            : patterns.MatchesNames(assemblyName, typeName, name);
+                        if (selected && (!revert || !newConfiguration.HasInstrumentationPoints(assemblyName, typeName, name))) {
+                            methodDefs->emplace(methodDef);
+                            ++methodsFound;
+                        }
+                        return true;
+                    });
+                return methodsFound;
+            };
+
+            for (const auto& type : methodNamesByType) {
+                LogTrace("Fetching ", type.first, " methods");
 
                 mdTypeDef typeDef{};
-                HRESULT hr = pImport->FindTypeDefByName(instrumentationPoint->ClassName.c_str(), mdTypeDefNil, &typeDef);
+                HRESULT hr = pImport->FindTypeDefByName(type.first.c_str(), mdTypeDefNil, &typeDef);
                 if (FAILED(hr)) {
-                    LogInfo("Unable to find ", instrumentationPoint->ClassName, " for rejit. HR:", hr);
-                } else {
-                    HCORENUM enumerator = nullptr;
-                    OnDestruction Conan([&] {if (enumerator) pImport->CloseEnum(enumerator); });
-                    mdMethodDef methodIds[METHOD_ENUM_BATCH_SIZE];
-                    for (ULONG fetchSize = 0; SUCCEEDED(pImport->EnumMethodsWithName(&enumerator, typeDef, instrumentationPoint->MethodName.c_str(), methodIds, METHOD_ENUM_BATCH_SIZE, &fetchSize)) && fetchSize;) {
-                        LogDebug("Found ", fetchSize, " method(s) matching ", instrumentationPoint->MethodName);
-                        for (ULONG i = 0; i < fetchSize; i++) {
-                            methodDefs->emplace(methodIds[i]);
-                        }
-                    }
+                    LogInfo("Unable to find ", type.first, " for rejit. HR:", hr);
+                    continue;
                 }
+
+                auto methodsFound = addMethods(typeDef, type.first, &type.second);
+                LogDebug("Found ", methodsFound, " method(s) of ", type.first, " matching instrumentation");
+            }
+
+            if (!patterns.IsEmpty()) {
+                size_t methodsFound = 0;
+                EnumerateTokens<mdTypeDef>(pImport,
+                    [&](HCORENUM* enumerator, mdTypeDef* tokens, ULONG size, ULONG* count) { return pImport->EnumTypeDefs(enumerator, tokens, size, count); },
+                    [&](mdTypeDef typeDef) {
+                        xstring_t typeName;
+                        // an ignored class is never instrumented, so there is nothing to rejit
+                        if (TryGetTypeName(pImport, typeDef, typeName) && patterns.MatchesClass(assemblyName, typeName) &&
+                            (revert || !newConfiguration.IsIgnored(assemblyName, typeName))) {
+                            methodsFound += addMethods(typeDef, typeName, nullptr);
+                        }
+                        return true;
+                    });
+                LogDebug("Found ", methodsFound, " method(s) of ", assemblyName, " matching wildcard instrumentation");
             }
 
             return methodDefs;
         }
 
+        // the name the type is instrumented by, including the types it is nested in (see Function::GetTypeName)
+        static bool TryGetTypeName(IMetaDataImport* metaDataImport, mdTypeDef typeDef, xstring_t& typeName)
+        {
+            WCHAR name[MAX_CLASS_NAME];
+            ULONG nameLength = 0;
+            DWORD typeAttributes = 0;
+            if (metaDataImport->GetTypeDefProps(typeDef, name, MAX_CLASS_NAME, &nameLength, &typeAttributes, nullptr) != S_OK || nameLength == 0) {
+                return false;
+            }
+            typeName.assign(name, nameLength - 1);
+
+            while (typeAttributes & (CorTypeAttr::tdNestedPublic | CorTypeAttr::tdNestedFamily)) {
+                mdTypeDef enclosingTypeDef = mdTypeDefNil;
+                if (FAILED(metaDataImport->GetNestedClassProps(typeDef, &enclosingTypeDef)) ||
+                    metaDataImport->GetTypeDefProps(enclosingTypeDef, name, MAX_CLASS_NAME, &nameLength, &typeAttributes, nullptr) != S_OK || nameLength == 0) {
+                    return false;
+                }
+                typeName = xstring_t(name, nameLength - 1) + _X("+") + typeName;
+                typeDef = enclosingTypeDef;
+            }
+            return true;
+        }
+
         void RejitModuleFunctions(ModuleID moduleId, std::shared_ptr<std::set<mdMethodDef>> methodsToRejit)
         {
             auto rejit =
                 [&](ULONG numberMethods, ModuleID* moduleIds, mdMethodDef* methodIds) {
                     HRESULT hr = _corProfilerInfo4->RequestReJIT(numberMethods, moduleIds, methodIds);
                     LogDebug("ReJit ", (SUCCEEDED(hr) ? "success" : "failed"));
+                    _refreshProgress.RejitRequested(numberMethods);
+                    if (FAILED(hr)) {
+                        _refreshProgress.Failed();
+                    }
                 };
             PerformOnMethods(moduleId, methodsToRejit, rejit);
         }
@@ -778,6 +1110,10 @@ namespace NewRelic { namespace Profiler {
                     HRESULT* success = nullptr;
                     HRESULT hr = _corProfilerInfo4->RequestRevert(numberMethods, moduleIds, methodIds, success);
                     LogDebug("Revert ", (SUCCEEDED(hr) ? "success" : "failed"));
+                    _refreshProgress.RevertRequested(numberMethods);
+                    if (FAILED(hr)) {
+                        _refreshProgress.Failed();
+                    }
                 };
             PerformOnMethods(moduleId, methodsToRevert, revert);
         }
@@ -804,6 +1140,26 @@ namespace NewRelic { namespace Profiler {
             }
         }
 
+#ifndef PAL_STDCPP_COMPAT
+        // nullptr if the module has no metadata to inject into (a resource module) or its details could not be read
+        ModuleInjector::IModulePtr CreateModuleForInjection(ModuleID moduleId)
+        {
+            try
+            {
+                return std::make_shared<Module>(_corProfilerInfo4, moduleId);
+            }
+            catch (const NewRelic::Profiler::MessageException&)
+            {
+                return nullptr;
+            }
+            catch (...)
+            {
+                LogError(L"An exception was thrown while getting details about a module.");
+                return nullptr;
+            }
+        }
+#endif
+
         xstring_t GetAssemblyName(ModuleID& moduleId)
         {
             auto f = __func__;
@@ -846,6 +1202,48 @@ namespace NewRelic { namespace Profiler {
             _threadProfiler.ReleaseProfile();
         }
 
+        HRESULT RequestProfileSnapshot(void** snapshot, int* length) noexcept
+        {
+            return _threadProfiler.RequestProfileSnapshot(snapshot, length);
+        }
+
+        void ReleaseProfileSnapshot(void* snapshot) noexcept
+        {
+            _threadProfiler.ReleaseProfileSnapshot(snapshot);
+        }
+
+        HRESULT HarvestGcStatistics(void** statistics, int* length) noexcept
+        {
+            if (statistics == nullptr || length == nullptr) {
+                return E_INVALIDARG;
+            }
+            *statistics = nullptr;
+            *length = 0;
+
+            if (!_gcStatistics) {
+                return E_NOTIMPL;
+            }
+
+            try {
+                uint32_t totalSize{};
+                auto block = _gcStatistics->Harvest(totalSize);
+                *length = static_cast<int>(totalSize);
+                *statistics = block.release();
+            }
+            catch (const std::bad_alloc&) {
+                return E_OUTOFMEMORY;
+            }
+            catch (...) {
+                return E_UNEXPECTED;
+            }
+            return S_OK;
+        }
+
+        void ReleaseGcStatistics(void* statistics) noexcept
+        {
+            delete[] static_cast<uint8_t*>(statistics);
+        }
+
         uintptr_t GetCurrentThreadId() noexcept
         {
             ThreadID tid;
@@ -864,10 +1262,16 @@ namespace NewRelic { namespace Profiler {
 
     protected:
         MethodRewriter::MethodRewriterPtr _methodRewriter;
+        // null unless NEW_RELIC_PROFILER_REWRITE_CACHE_PATH is set
+        MethodRewriter::RewrittenMethodCachePtr _rewrittenMethodCache;
         CComPtr<ICorProfilerInfo4> _corProfilerInfo4;
         ThreadProfiler::ThreadProfiler _threadProfiler;
+        // null unless GC statistics are enabled
+        std::unique_ptr<GcStatistics> _gcStatistics;
         std::shared_ptr<SystemCalls> _systemCalls;
         std::shared_ptr<FunctionResolver> _functionResolver;
+        ModuleAttributeIndexCachePtr _attributeIndexes;
+        JitPrefilterPtr _jitPrefilter;
         MethodRewriter::CustomInstrumentationBuilder _customInstrumentationBuilder;
         MethodRewriter::CustomInstrumentation _customInstrumentation;
         std::mutex _instrumentationRefreshMutex;
@@ -880,6 +1284,16 @@ namespace NewRelic { namespace Profiler {
 
         bool _isCoreClr = false;
 
+        InstrumentationRefreshProgress _refreshProgress;
+
+        // runs the refreshes queued by InstrumentationRefreshAsync; a queued reload of the configuration absorbs a queued refresh
+        CoalescingWorker<bool> _refreshWorker{
+            [this](bool reloadConfiguration, uint64_t ticket) { RunQueuedInstrumentationRefresh(reloadConfiguration, ticket); },
+            [](bool pendingReload, bool reload) { return pendingReload || reload; } };
+
+        // null unless watching the extensions directory is enabled; declared last so it is stopped before anything its callback uses
+        std::unique_ptr<ExtensionsWatcher> _extensionsWatcher;
+
         MethodRewriter::MethodRewriterPtr GetMethodRewriter()
         {
             return std::atomic_load(&_methodRewriter);
@@ -938,23 +1352,41 @@ namespace NewRelic { namespace Profiler {
         }
 
         Configuration::InstrumentationXmlSetPtr GetInstrumentationXmlsFromDisk(std::shared_ptr<SystemCalls> systemCalls)
+        {
+            return GetInstrumentationXmlsFromDisk(GetXmlFilesInExtensionsDirectory(systemCalls));
+        }
+
+        static Configuration::InstrumentationXmlSetPtr GetInstrumentationXmlsFromDisk(const FilePaths& filePaths)
         {
             Configuration::InstrumentationXmlSetPtr instrumentationXmls(new Configuration::InstrumentationXmlSet());
 
-            auto filePaths = GetXmlFilesInExtensionsDirectory(systemCalls);
+            std::vector<xstring_t> orderedFilePaths(filePaths.begin(), filePaths.end());
 
-            for (auto filePath : filePaths) {
+            // read the files on a small worker pool; each file has its own slot so the set is built in the same order either way
+            std::vector<std::unique_ptr<xstring_t>> xmls(orderedFilePaths.size());
+            ParallelFor(orderedFilePaths.size(), [&orderedFilePaths, &xmls](size_t index)
+            {
                 try {
-                    auto xml = ReadFile(filePath);
-                    instrumentationXmls->emplace(filePath, xml);
+                    xmls[index] = std::make_unique<xstring_t>(ReadFile(orderedFilePaths[index]));
                 } catch (...) {
-                    LogError(L"An exception was thrown while reading instrumentation file: ", filePath, L" - ignoring this file.");
+                    LogError(L"An exception was thrown while reading instrumentation file: ", orderedFilePaths[index], L" - ignoring this file.");
+                }
+            });
+
+            for (size_t index = 0; index < orderedFilePaths.size(); ++index) {
+                if (xmls[index] != nullptr) {
+                    instrumentationXmls->emplace(orderedFilePaths[index], std::move(*xmls[index]));
                 }
             }
 
             return instrumentationXmls;
         }
 
+        static double GetElapsedMilliseconds(std::chrono::steady_clock::time_point start)
+        {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
         static xstring_t GetAppPoolId(std::shared_ptr<MethodRewriter::ISystemCalls> systemCalls)
         {
             auto appPoolId = TryGetAppPoolIdFromEnvironmentVariable(systemCalls);
@@ -1033,9 +1465,29 @@ namespace NewRelic { namespace Profiler {
             throw ProfilerException();
         }
 
+        static xstring_t GetExtensionsDirectory(std::shared_ptr<SystemCalls> systemCalls)
+        {
+            return GetNewRelicHomePath(systemCalls) + PATH_SEPARATOR + _X("extensions");
+        }
+
+        // opt in: refresh instrumentation whenever the xml in the extensions directories changes
+        void StartExtensionsWatcher()
+        {
+            if (!_systemCalls->GetWatchExtensionsEnabled()) {
+                return;
+            }
+
+            auto rootExtensionsDirectory = GetExtensionsDirectory(_systemCalls);
+            std::vector<xstring_t> directories{ rootExtensionsDirectory, rootExtensionsDirectory + PATH_SEPARATOR + GetRuntimeExtensionsDirectoryName() };
+            _extensionsWatcher.reset(new ExtensionsWatcher(directories, [this]() { _refreshWorker.Post(false); }));
+            if (!_extensionsWatcher->Start()) {
+                _extensionsWatcher.reset();
+            }
+        }
+
         FilePaths GetXmlFilesInExtensionsDirectory(std::shared_ptr<SystemCalls> systemCalls)
         {
-            auto rootExtensionsDirectory = GetNewRelicHomePath(systemCalls) + PATH_SEPARATOR + _X("extensions");
+            auto rootExtensionsDirectory = GetExtensionsDirectory(systemCalls);
             if (!systemCalls->DirectoryExists(rootExtensionsDirectory)) {
                 LogWarn(L"Unable to find the New Relic Agent extensions directory (", rootExtensionsDirectory, L").  No methods will be instrumented except those decorated with [Transaction] or [Trace] attributes in conjunction with the New Relic agent API.");
             } else {
@@ -1104,6 +1556,92 @@ namespace NewRelic { namespace Profiler {
             }
         }
 
+        // the cache outlives the method rewriters since its keys include the instrumentation each method was rewritten with
+        void InitializeRewrittenMethodCache()
+        {
+            auto rewriteCachePath = _systemCalls->GetRewriteCachePath();
+            if (rewriteCachePath == nullptr || rewriteCachePath->empty()) {
+                return;
+            }
+
+            // app domain caching changes the IL emitted for every instrumented method, and so can any other build of the profiler or
+            // of the agent core it calls into.  Both builds are told apart by their files, like the config files of the decision cache.
+            FileStamp profilerStamp;
+            auto profilerPath = _systemCalls->GetProfilerModulePath();
+            if (profilerPath != nullptr) {
+                TryGetFileStamp(*profilerPath, profilerStamp);
+            }
+            FileStamp coreStamp;
+            TryGetFileStamp(_agentCoreDllPath, coreStamp);
+            auto settingsKey = Fnv1aHasher()
+                .Add(_systemCalls->GetIsAppDomainCachingDisabled())
+                .Add(profilerPath != nullptr ? *profilerPath : xstring_t())
+                .Add(profilerStamp.size)
+                .Add(uint64_t(profilerStamp.lastWriteTime))
+                .Add(uint64_t(profilerStamp.lastWriteTimeNanoseconds))
+                .Add(coreStamp.size)
+                .Add(uint64_t(coreStamp.lastWriteTime))
+                .Add(uint64_t(coreStamp.lastWriteTimeNanoseconds))
+                .Get();
+            _rewrittenMethodCache = std::make_shared<MethodRewriter::RewrittenMethodCache>(*rewriteCachePath, settingsKey);
+            LogInfo(L"Caching rewritten methods in ", *rewriteCachePath, L", ", _rewrittenMethodCache->GetMethodCount(), L" methods cached so far. Delete the file to rewrite every method again.");
+        }
+
+        // Looks this process up in the decision cache, when one is configured, without reading the config files: the key covers
+        // them by path, size and last write time.  decisionCacheKey is set to the key the verdict should be cached under after a
+        // miss, and left 0 when there is no cache.
+        bool TryGetCachedShouldInstrument(const xstring_t& processPath, const xstring_t& parentProcessPath, const xstring_t& appPoolId, const xstring_t& commandLine, uint64_t& decisionCacheKey, bool& shouldInstrument)
+        {
+            auto decisionCachePath = _systemCalls->GetDecisionCachePath();
+            if (decisionCachePath == nullptr || decisionCachePath->empty()) {
+                return false;
+            }
+
+            try {
+                decisionCacheKey = GetShouldInstrumentCacheKey(processPath, parentProcessPath, appPoolId, commandLine);
+            } catch (...) {
+                // the config files can't be found either, which reading them will report
+                return false;
+            }
+
+            Configuration::ShouldInstrumentCache decisionCache(*decisionCachePath, _systemCalls->GetCurrentProcessId());
+            return decisionCache.TryGet(decisionCacheKey, shouldInstrument);
+        }
+
+        // Everything Configuration::ShouldInstrument depends on: its arguments, the config files it is read from and the environment
+        // variables that add to the process lists or that the Azure Functions checks read.
+        uint64_t GetShouldInstrumentCacheKey(const xstring_t& processPath, const xstring_t& parentProcessPath, const xstring_t& appPoolId, const xstring_t& commandLine)
+        {
+            Configuration::ShouldInstrumentCacheKey key;
+            key.Add(processPath).Add(parentProcessPath).Add(appPoolId).Add(commandLine).Add(_isCoreClr);
+
+            key.AddFile(GetNewRelicHomePath(_systemCalls) + PATH_SEPARATOR + _X("newrelic.config"));
+            key.AddFile(_systemCalls->GetProcessDirectoryPath() + PATH_SEPARATOR + _X("newrelic.config"));
+            key.AddFile(_systemCalls->GetProcessPath() + _X(".config"));
+
+            for (auto variableName : { _X("NEW_RELIC_INCLUDED_APPLICATION_NAMES"), _X("NEW_RELIC_EXCLUDED_APPLICATION_NAMES"), _X("FUNCTIONS_WORKER_RUNTIME"), _X("NEW_RELIC_AZURE_FUNCTION_MODE_ENABLED") })
+            {
+                auto value = _systemCalls->TryGetEnvironmentVariable(variableName);
+                key.Add(value != nullptr);
+                if (value != nullptr) {
+                    key.Add(*value);
+                }
+            }
+
+            return key.Get();
+        }
+
+        // decisionCacheKey is from TryGetCachedShouldInstrument; the verdict is cached under it unless it is 0
+        bool ShouldInstrumentThisProcess(Configuration::Configuration& configuration, const xstring_t& processPath, const xstring_t& parentProcessPath, const xstring_t& appPoolId, const xstring_t& commandLine, uint64_t decisionCacheKey)
+        {
+            auto shouldInstrument = configuration.ShouldInstrument(processPath, parentProcessPath, appPoolId, commandLine, _isCoreClr);
+            if (decisionCacheKey != 0) {
+                Configuration::ShouldInstrumentCache decisionCache(*_systemCalls->GetDecisionCachePath(), _systemCalls->GetCurrentProcessId());
+                decisionCache.Put(decisionCacheKey, shouldInstrument);
+            }
+            return shouldInstrument;
+        }
+
         std::shared_ptr<Configuration::Configuration> InitializeConfigAndSetLogLevel()
         {
             auto globalNewRelicConfigurationXml = GetGlobalConfigurationFromDisk(_systemCalls);
@@ -1134,7 +1672,16 @@ namespace NewRelic { namespace Profiler {
 
         std::shared_ptr<Configuration::InstrumentationConfiguration> InitializeInstrumentationConfig(NewRelic::Profiler::Configuration::IgnoreInstrumentationListPtr ignoreList)
         {
-            auto instrumentationXmls = GetInstrumentationXmlsFromDisk(_systemCalls);
+            auto filePaths = GetXmlFilesInExtensionsDirectory(_systemCalls);
+
+            auto instrumentationPoints = TryGetInstrumentationPointsFromIndex(filePaths);
+            if (instrumentationPoints != nullptr) {
+                auto instrumentationConfiguration = std::make_shared<Configuration::InstrumentationConfiguration>(instrumentationPoints, ignoreList, _systemCalls);
+                LogInfo("Identified ", instrumentationConfiguration->GetInstrumentationPoints()->size(), " Instrumentation points (not ignored) in the instrumentation index");
+                return instrumentationConfiguration;
+            }
+
+            auto instrumentationXmls = GetInstrumentationXmlsFromDisk(filePaths);
             auto instrumentationConfiguration = std::make_shared<Configuration::InstrumentationConfiguration>(instrumentationXmls, ignoreList, _systemCalls);
             if (instrumentationConfiguration->GetInvalidFileCount() > 0) {
                 LogWarn(L"Unable to parse one or more instrumentation files.  Live instrumentation reloading will not work until the unparsable file(s) are corrected or removed.");
@@ -1143,6 +1690,26 @@ namespace NewRelic { namespace Profiler {
             return instrumentationConfiguration;
         }
 
+        // returns nullptr if there is no instrumentation index for this runtime or it was not compiled from the current xml files
+        Configuration::InstrumentationPointSetPtr TryGetInstrumentationPointsFromIndex(const FilePaths& filePaths)
+        {
+            auto extensionsDirectory = GetExtensionsDirectory(_systemCalls);
+            auto indexPath = Configuration::GetInstrumentationIndexPath(extensionsDirectory, GetRuntimeExtensionsDirectoryName());
+            auto index = Configuration::InstrumentationIndex::TryOpen(indexPath);
+            if (index == nullptr) {
+                LogDebug(L"No instrumentation index found at ", indexPath, L", reading the instrumentation files.");
+                return nullptr;
+            }
+
+            if (!index->IsCurrent(extensionsDirectory, filePaths)) {
+                LogInfo(L"The instrumentation index ", indexPath, L" is out of date, reading the instrumentation files. Compile the index again to speed up startup.");
+                return nullptr;
+            }
+
+            LogInfo(L"Loading instrumentation from the instrumentation index ", indexPath);
+            return index->GetInstrumentationPoints();
+        }
+
         HRESULT InitializeAndSetAgentCoreDllPath(xstring_t expectedProductName)
         {
             auto agentCoreDllPath = GetAgentCoreDllPath();
@@ -1304,6 +1871,27 @@ namespace NewRelic { namespace Profiler {
             }
         }
 
+        // The thread profiler only limits its overhead when a budget is set with environment variables; 0 disables a limit.
+        void ConfigureThreadProfilerOverheadBudget()
+        {
+            ThreadProfiler::OverheadBudget budget;
+            try {
+                auto maxPause = _systemCalls->GetThreadProfilerMaxPauseMicroseconds();
+                if (maxPause != nullptr) {
+                    budget.maxPauseMicroseconds = static_cast<uint32_t>(std::max(0, xstoi(*maxPause)));
+                }
+                auto maxCpu = _systemCalls->GetThreadProfilerMaxCpuPercent();
+                if (maxCpu != nullptr) {
+                    budget.maxCpuPercent = static_cast<uint32_t>(std::max(0, xstoi(*maxCpu)));
+                }
+            }
+            catch (...) {
+                LogWarn(L"Invalid thread profiler overhead budget in the environment, using the defaults.");
+                budget = ThreadProfiler::OverheadBudget();
+            }
+            _threadProfiler.SetOverheadBudget(budget);
+        }
+
         void DelayProfilerAttach()
         {
             auto profilerDelay = _systemCalls->GetProfilerDelay();
@@ -1340,6 +1928,30 @@ namespace NewRelic { namespace Profiler {
         return profiler->ReloadConfiguration();
     }
 
+    // Called by managed code to queue an instrumentation refresh, or a reload of the newrelic.config files followed by one, without
+    // waiting for it.  A refresh queued while another is still waiting is merged into it.  The ticket can be passed to
+    // GetInstrumentationRefreshStatus.
+    extern "C" __declspec(dllexport) HRESULT __cdecl InstrumentationRefreshAsync(int reloadConfiguration, uint64_t* ticket) noexcept
+    {
+        auto profiler = CorProfilerCallbackImpl::GetSingletonish();
+        if (profiler == nullptr) {
+            LogError(L"InstrumentationRefreshAsync: entry point called before the profiler has been initialized");
+            return E_UNEXPECTED;
+        }
+        return profiler->InstrumentationRefreshAsync(reloadConfiguration != 0, ticket);
+    }
+
+    // Returns E_INVALIDARG for a ticket that was never issued (see Profiler/InstrumentationRefreshProgress.h).
+    extern "C" __declspec(dllexport) HRESULT __cdecl GetInstrumentationRefreshStatus(uint64_t ticket, InstrumentationRefreshStatus* status) noexcept
+    {
+        auto profiler = CorProfilerCallbackImpl::GetSingletonish();
+        if (profiler == nullptr) {
+            LogError(L"GetInstrumentationRefreshStatus: entry point called before the profiler has been initialized");
+            return E_UNEXPECTED;
+        }
+        return profiler->GetInstrumentationRefreshStatus(ticket, status);
+    }
+
     extern "C" __declspec(dllexport) HRESULT __cdecl AddCustomInstrumentation(const char* fileName, const char* xml)
     {
         LogTrace("Adding custom instrumentation");
@@ -1396,6 +2008,50 @@ namespace NewRelic { namespace Profiler {
         return profiler->RequestFunctionNames(functionIds, length, results);
     }
 
+    // called by managed code to request a thread profile as a single self-describing block (see ThreadProfiler/ProfileSnapshot.h).
+    // The block contains the type and method names for every frame, so RequestFunctionNames is not needed. It must be freed with ReleaseProfileSnapshot.
+    extern "C" __declspec(dllexport) HRESULT __cdecl RequestProfileSnapshot(void** snapshot, int* length) noexcept
+    {
+        auto profiler = CorProfilerCallbackImpl::GetSingletonish();
+        if (profiler == nullptr) {
+            LogError(L"RequestProfileSnapshot: entry point called before the profiler has been initialized");
+            return E_UNEXPECTED;
+        }
+        return profiler->RequestProfileSnapshot(snapshot, length);
+    }
+
+    extern "C" __declspec(dllexport) void __cdecl ReleaseProfileSnapshot(void* snapshot) noexcept
+    {
+        auto profiler = CorProfilerCallbackImpl::GetSingletonish();
+        if (profiler == nullptr) {
+            LogError(L"ReleaseProfileSnapshot: entry point called before the profiler has been initialized");
+            return;
+        }
+        profiler->ReleaseProfileSnapshot(snapshot);
+    }
+
+    // called by managed code to take the GC and suspension histograms collected since the previous call (see Profiler/GcStatistics.h).
+    // Returns E_NOTIMPL when GC statistics are not enabled. The block must be freed with ReleaseGcStatistics.
+    extern "C" __declspec(dllexport) HRESULT __cdecl HarvestGcStatistics(void** statistics, int* length) noexcept
+    {
+        auto profiler = CorProfilerCallbackImpl::GetSingletonish();
+        if (profiler == nullptr) {
+            LogError(L"HarvestGcStatistics: entry point called before the profiler has been initialized");
+            return E_UNEXPECTED;
+        }
+        return profiler->HarvestGcStatistics(statistics, length);
+    }
+
+    extern "C" __declspec(dllexport) void __cdecl ReleaseGcStatistics(void* statistics) noexcept
+    {
+        auto profiler = CorProfilerCallbackImpl::GetSingletonish();
+        if (profiler == nullptr) {
+            LogError(L"ReleaseGcStatistics: entry point called before the profiler has been initialized");
+            return;
+        }
+        profiler->ReleaseGcStatistics(statistics);
+    }
+
     extern "C" __declspec(dllexport) void __cdecl ShutdownThreadProfiler() noexcept
     {
         auto profiler = CorProfilerCallbackImpl::GetSingletonish();
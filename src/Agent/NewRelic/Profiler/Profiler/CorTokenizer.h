@@ -3,12 +3,15 @@
 
 #pragma once
 #include "../Common/Strings.h"
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include <map>
 #include <string>
+#include <tuple>
 #include <stdint.h>
 #include "../Common/OnDestruction.h"
+#include "MetaDataEnumeration.h"
 #include "Win32Helpers.h"
 #include "../Sicily/codegen/ITokenizer.h"
 
@@ -29,20 +32,31 @@ namespace NewRelic { namespace Profiler
 
         virtual uint32_t GetAssemblyRefToken(const xstring_t& assemblyName) override
         {
-            HCORENUM enumerator = nullptr;
-            mdAssemblyRef assemblyToken;
-            ULONG assembliesFound = 0;
-            OnDestruction enumerationCloser([&] { metaDataAssemblyImport->CloseEnum(enumerator); });
-            while (SUCCEEDED(metaDataAssemblyImport->EnumAssemblyRefs(&enumerator, &assemblyToken, 1, &assembliesFound)) && assembliesFound > 0)
+            auto cached = assemblyRefTokens.find(assemblyName);
+            if (cached != assemblyRefTokens.end())
             {
-                auto foundAssemblyName = GetAssemblyName(assemblyToken);
-                if (Strings::EndsWith(foundAssemblyName, assemblyName))
-                {
-                    return assemblyToken;
-                }
+                return cached->second;
             }
 
-            return S_FALSE;
+            // only references that were found are cached, since a missing one may be defined later
+            uint32_t foundToken = S_FALSE;
+            EnumerateTokens<mdAssemblyRef>(metaDataAssemblyImport,
+                [&](HCORENUM* enumerator, mdAssemblyRef* tokens, ULONG size, ULONG* count) { return metaDataAssemblyImport->EnumAssemblyRefs(enumerator, tokens, size, count); },
+                [&](mdAssemblyRef assemblyToken)
+                {
+                    if (!Strings::EndsWith(GetAssemblyName(assemblyToken), assemblyName))
+                    {
+                        return true;
+                    }
+                    foundToken = assemblyToken;
+                    return false;
+                });
+
+            if (foundToken != S_FALSE)
+            {
+                assemblyRefTokens[assemblyName] = foundToken;
+            }
+            return foundToken;
         }
 
         virtual uint32_t GetTypeRefToken(const xstring_t& assemblyName, const xstring_t& fullyQualifiedName) override
@@ -84,20 +98,29 @@ namespace NewRelic { namespace Profiler
 
         virtual uint32_t GetMemberRefOrDefToken(uint32_t parent, const xstring_t& methodName, const ByteVector& signature) override
         {
+            // instrumented methods ask for the same few members many times
+            auto key = std::make_tuple(parent, methodName, signature);
+            auto cached = memberTokens.find(key);
+            if (cached != memberTokens.end())
+                return cached->second;
+
             // try to find the member reference already defined for this module
-            auto foundMemberRef = FindMemberReference(parent, methodName, signature);
-            if (foundMemberRef != mdMemberRefNil)
-                return foundMemberRef;
+            uint32_t token = FindMemberReference(parent, methodName, signature);
 
             // try to find the member as a definition defined on this type, this occurs when the type is defined by this module
-            auto foundMethodDef = FindMethodDefinition(parent, methodName, signature);
-            if (foundMethodDef != mdMethodDefNil)
-                return foundMethodDef;
+            if (token == mdMemberRefNil)
+                token = FindMethodDefinition(parent, methodName, signature);
 
             // we couldn't find it already defined, so define a new reference
-            mdMemberRef createdMemberReference = mdMemberRefNil;
-            ThrowOnError(metaDataEmit->DefineMemberRef, parent, ToWindowsString(methodName), signature.data(), ULONG(signature.size()), &createdMemberReference);
-            return createdMemberReference;
+            if (token == mdMethodDefNil)
+            {
+                mdMemberRef createdMemberReference = mdMemberRefNil;
+                ThrowOnError(metaDataEmit->DefineMemberRef, parent, ToWindowsString(methodName), signature.data(), ULONG(signature.size()), &createdMemberReference);
+                token = createdMemberReference;
+            }
+
+            memberTokens.emplace(key, token);
+            return token;
         }
 
         virtual uint32_t GetMethodDefinitionToken(const uint32_t& typeDefinitionToken, const xstring_t& name, const ByteVector& signature) override
@@ -131,6 +154,9 @@ namespace NewRelic { namespace Profiler
         CComPtr<IMetaDataImport2> metaDataImport;
         CComPtr<IMetaDataAssemblyImport> metaDataAssemblyImport;
 
+        std::map<xstring_t, uint32_t> assemblyRefTokens;
+        std::map<std::tuple<uint32_t, xstring_t, ByteVector>, uint32_t> memberTokens;
+
         xstring_t GetAssemblyName(const mdAssemblyRef& assemblyReferenceToken)
         {
             ULONG assemblyNameLength = 0;
@@ -140,55 +166,40 @@ namespace NewRelic { namespace Profiler
             return ToStdWString(assemblyName.get());
         }
 
-        xstring_t GetMemberReferenceName(const mdMemberRef& memberReference)
+        // true if the name in the buffer, of the given length including the terminating null, is the name
+        static bool IsName(const WCHAR* foundName, ULONG foundNameLength, const xstring_t& name)
         {
-            ULONG memberNameLength = 0;
-            metaDataImport->GetMemberRefProps(memberReference, nullptr, nullptr, 0, &memberNameLength, nullptr, nullptr);
-            std::unique_ptr<WCHAR[]> memberName(new WCHAR[memberNameLength]);
-            metaDataImport->GetMemberRefProps(memberReference, nullptr, memberName.get(), memberNameLength, nullptr, nullptr, nullptr);
-            return ToStdWString(memberName.get());
+            return foundNameLength == name.size() + 1 && name.compare(0, name.size(), foundName, name.size()) == 0;
         }
 
-        ByteVector GetMemberReferenceSignature(const mdMemberRef& memberReference)
+        static bool IsSignature(PCCOR_SIGNATURE foundSignature, ULONG foundSignatureLength, const ByteVector& signature)
         {
-            const COR_SIGNATURE* signature;
-            ULONG signatureLength = 0;
-            metaDataImport->GetMemberRefProps(memberReference, nullptr, nullptr, 0, nullptr, &signature, &signatureLength);
-            return ByteVector(signature, signature + signatureLength);
-        }
-
-        xstring_t GetMethodDefinitionName(const mdMethodDef& methodDefinition)
-        {
-            ULONG methodNameLength = 0;
-            metaDataImport->GetMethodProps(methodDefinition, nullptr, nullptr, 0, &methodNameLength, nullptr, nullptr, nullptr, nullptr, nullptr);
-            std::unique_ptr<WCHAR[]> methodName(new WCHAR[methodNameLength]);
-            metaDataImport->GetMethodProps(methodDefinition, nullptr, methodName.get(), methodNameLength, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
-            return ToStdWString(methodName.get());
-        }
-
-        ByteVector GetMethodDefinitionSignature(const mdMethodDef& methodDefinition)
-        {
-            const COR_SIGNATURE* signature;
-            ULONG signatureLength = 0;
-            metaDataImport->GetMethodProps(methodDefinition, nullptr, nullptr, 0, nullptr, nullptr, &signature, &signatureLength, nullptr, nullptr);
-            return ByteVector(signature, signature + signatureLength);
+            return foundSignatureLength == signature.size() && std::equal(signature.begin(), signature.end(), foundSignature);
         }
 
         mdMemberRef FindMemberReference(const mdToken& parent, const xstring_t& methodNameToFind, const ByteVector& methodSignatureToFind)
         {
-            HCORENUM enumerator = nullptr;
-            mdMemberRef memberReference = mdMemberRefNil;
-            ULONG resultCount = 0;
-            OnDestruction enumerationCloser([&] { metaDataAssemblyImport->CloseEnum(enumerator); });
-            while (SUCCEEDED(metaDataImport->EnumMemberRefs(&enumerator, parent, &memberReference, 1, &resultCount)) && resultCount != 0)
-            {
-                auto foundMemberName = GetMemberReferenceName(memberReference);
-                auto foundSignature = GetMemberReferenceSignature(memberReference);
-                if (foundMemberName == methodNameToFind && foundSignature == methodSignatureToFind)
-                    return memberReference;
-            }
-
-            return mdMemberRefNil;
+            // names that don't fit the buffer can't be the one we are looking for, they come back as a truncation warning
+            WCHAR memberName[MAX_CLASS_NAME];
+            mdMemberRef foundMemberReference = mdMemberRefNil;
+            EnumerateTokens<mdMemberRef>(metaDataImport,
+                [&](HCORENUM* enumerator, mdMemberRef* tokens, ULONG size, ULONG* count) { return metaDataImport->EnumMemberRefs(enumerator, parent, tokens, size, count); },
+                [&](mdMemberRef memberReference)
+                {
+                    ULONG memberNameLength = 0;
+                    PCCOR_SIGNATURE signature;
+                    ULONG signatureLength = 0;
+                    if (metaDataImport->GetMemberRefProps(memberReference, nullptr, memberName, MAX_CLASS_NAME, &memberNameLength, &signature, &signatureLength) == S_OK &&
+                        IsName(memberName, memberNameLength, methodNameToFind) &&
+                        IsSignature(signature, signatureLength, methodSignatureToFind))
+                    {
+                        foundMemberReference = memberReference;
+                        return false;
+                    }
+                    return true;
+                });
+
+            return foundMemberReference;
         }
 
         mdMethodDef FindMethodDefinition(const mdTypeDef& parent, const xstring_t& methodNameToFind, const ByteVector& methodSignatureToFind)
@@ -196,19 +207,26 @@ namespace NewRelic { namespace Profiler
             if ((parent & 0xff000000) != CorTokenType::mdtTypeDef)
                 return mdMethodDefNil;
 
-            HCORENUM enumerator = nullptr;
-            OnDestruction Conan([&] {if (enumerator) metaDataImport->CloseEnum(enumerator); });
-            mdMethodDef methodDefinition = mdMethodDefNil;
-            ULONG resultCount = 0;
-            while (SUCCEEDED(metaDataImport->EnumMethods(&enumerator, parent, &methodDefinition, 1, &resultCount)) && resultCount != 0)
-            {
-                auto foundMethodName = GetMethodDefinitionName(methodDefinition);
-                auto foundSignature = GetMethodDefinitionSignature(methodDefinition);
-                if (foundMethodName == methodNameToFind && foundSignature == methodSignatureToFind)
-                    return methodDefinition;
-            }
-
-            return mdMethodDefNil;
+            WCHAR methodName[MAX_CLASS_NAME];
+            mdMethodDef foundMethodDefinition = mdMethodDefNil;
+            EnumerateTokens<mdMethodDef>(metaDataImport,
+                [&](HCORENUM* enumerator, mdMethodDef* tokens, ULONG size, ULONG* count) { return metaDataImport->EnumMethods(enumerator, parent, tokens, size, count); },
+                [&](mdMethodDef methodDefinition)
+                {
+                    ULONG methodNameLength = 0;
+                    PCCOR_SIGNATURE signature;
+                    ULONG signatureLength = 0;
+                    if (metaDataImport->GetMethodProps(methodDefinition, nullptr, methodName, MAX_CLASS_NAME, &methodNameLength, nullptr, &signature, &signatureLength, nullptr, nullptr) == S_OK &&
+                        IsName(methodName, methodNameLength, methodNameToFind) &&
+                        IsSignature(signature, signatureLength, methodSignatureToFind))
+                    {
+                        foundMethodDefinition = methodDefinition;
+                        return false;
+                    }
+                    return true;
+                });
+
+            return foundMethodDefinition;
         }
 
     };
@@ -0,0 +1,197 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../Common/xplat.h"
+#include "../Logging/Logger.h"
+
+#ifdef PAL_STDCPP_COMPAT
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace NewRelic { namespace Profiler
+{
+    // Watches the extensions directories for instrumentation xml being written, moved in or deleted, and calls back once the
+    // directories have been quiet for a moment, so a deployment that writes several files causes a single reload.
+    //
+    // Only implemented on Linux, with inotify.  Everywhere else Start returns false and the agent has to keep calling
+    // InstrumentationRefresh itself.
+    class ExtensionsWatcher
+    {
+    public:
+        // how long the directories have to be quiet after a change before the callback runs
+        static constexpr int QuietPeriodMilliseconds = 500;
+
+        ExtensionsWatcher(const std::vector<xstring_t>& directories, std::function<void()> onChanged) :
+            _directories(directories),
+            _onChanged(onChanged)
+        {}
+
+        ~ExtensionsWatcher()
+        {
+            Stop();
+        }
+
+        ExtensionsWatcher(const ExtensionsWatcher&) = delete;
+        ExtensionsWatcher& operator=(const ExtensionsWatcher&) = delete;
+
+#ifdef PAL_STDCPP_COMPAT
+        bool Start()
+        {
+            _inotify = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (_inotify < 0)
+            {
+                LogWarn(L"Unable to watch the extensions directory for changes. errno: ", errno);
+                return false;
+            }
+
+            auto watching = false;
+            for (auto& directory : _directories)
+            {
+                if (::inotify_add_watch(_inotify, to_pathstring(directory).c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) >= 0)
+                {
+                    LogInfo(L"Watching ", directory, L" for instrumentation changes");
+                    watching = true;
+                }
+            }
+
+            if (!watching || ::pipe2(_stopPipe, O_CLOEXEC) != 0)
+            {
+                CloseAll();
+                return false;
+            }
+
+            _thread = std::thread(&ExtensionsWatcher::Run, this);
+            return true;
+        }
+
+        void Stop()
+        {
+            if (_thread.joinable())
+            {
+                const char stop = 0;
+                while (::write(_stopPipe[1], &stop, 1) < 0 && errno == EINTR)
+                {}
+                _thread.join();
+            }
+            CloseAll();
+        }
+
+    private:
+        void Run()
+        {
+            auto pending = false;
+            while (true)
+            {
+                pollfd descriptors[] = { { _inotify, POLLIN, 0 }, { _stopPipe[0], POLLIN, 0 } };
+
+                // every event starts the quiet period over
+                auto ready = ::poll(descriptors, 2, pending ? QuietPeriodMilliseconds : -1);
+                if (ready < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    LogError(L"Stopped watching the extensions directory for changes. errno: ", errno);
+                    return;
+                }
+
+                if (descriptors[1].revents != 0)
+                {
+                    return;
+                }
+
+                if (ready == 0)
+                {
+                    pending = false;
+                    LogInfo(L"Instrumentation files changed, refreshing instrumentation");
+                    try
+                    {
+                        _onChanged();
+                    }
+                    catch (...)
+                    {
+                        LogError(L"An exception was thrown while refreshing instrumentation after the extensions directory changed.");
+                    }
+                    continue;
+                }
+
+                if ((descriptors[0].revents & POLLIN) != 0 && ReadEvents())
+                {
+                    pending = true;
+                }
+            }
+        }
+
+        // true if any of the events is for an xml file, or if events were lost
+        bool ReadEvents()
+        {
+            alignas(inotify_event) char buffer[4096];
+            auto changed = false;
+            while (true)
+            {
+                auto length = ::read(_inotify, buffer, sizeof(buffer));
+                if (length <= 0)
+                {
+                    return changed;
+                }
+
+                for (auto position = buffer; position < buffer + length; )
+                {
+                    auto event = reinterpret_cast<const inotify_event*>(position);
+                    if ((event->mask & IN_Q_OVERFLOW) != 0 || (event->len > 0 && IsXmlFile(event->name)))
+                    {
+                        changed = true;
+                    }
+                    position += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+
+        static bool IsXmlFile(const char* fileName)
+        {
+            const std::string name(fileName);
+            return name.size() >= 4 && name.compare(name.size() - 4, 4, ".xml") == 0;
+        }
+
+        void CloseAll()
+        {
+            for (auto descriptor : { &_inotify, &_stopPipe[0], &_stopPipe[1] })
+            {
+                if (*descriptor >= 0)
+                {
+                    ::close(*descriptor);
+                    *descriptor = -1;
+                }
+            }
+        }
+
+        int _inotify = -1;
+        int _stopPipe[2] = { -1, -1 };
+#else
+        bool Start()
+        {
+            LogInfo(L"Watching the extensions directory for changes is only supported on Linux.");
+            return false;
+        }
+
+        void Stop()
+        {}
+
+    private:
+#endif
+        std::vector<xstring_t> _directories;
+        std::function<void()> _onChanged;
+        std::thread _thread;
+    };
+}}
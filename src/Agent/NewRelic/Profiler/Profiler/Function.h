@@ -13,6 +13,7 @@
 #include "CorTokenResolver.h"
 #include "FunctionHeaderInfo.h"
 #include "FunctionPreprocessor.h"
+#include "ModuleAttributeIndex.h"
 #include "Win32Helpers.h"
 
 namespace NewRelic { namespace Profiler
@@ -25,12 +26,18 @@ namespace NewRelic { namespace Profiler
 #endif
 
     // Turns a FunctionID into a set of data describing a method.  This class is _*NOT*_ thread safe!
+    //
+    // Constructing one only gathers what is needed to decide whether the method is instrumented: its ids, tokens, names and
+    // attributes.  The rest (the IL, the emit interfaces, the module and AppDomain names, the assembly version, the async attribute,
+    // the tokenizer and token resolver) is fetched the first time it is asked for, which only happens for the few methods that are
+    // actually rewritten or logged.
     class Function : public MethodRewriter::IFunction
     {
     private:
         CComPtr<ICorProfilerInfo4> _profilerInfo;
-        CComPtr<IMetaDataEmit2> _metaDataEmit;
         CComPtr<IMetaDataImport2> _metaDataImport;
+        // the rest of the metadata interfaces are fetched together by GetMetaDataInterfaces
+        CComPtr<IMetaDataEmit2> _metaDataEmit;
         CComPtr<IMetaDataAssemblyEmit> _metaDataAssemblyEmit;
         CComPtr<IMetaDataAssemblyImport> _metaDataAssemblyImport;
 
@@ -39,28 +46,41 @@ namespace NewRelic { namespace Profiler
 
         FunctionID _functionId;
 
-        xstring_t _moduleName;
         xstring_t _assemblyName;
-        xstring_t _appDomainName;
         xstring_t _functionName;
         xstring_t _typeName;
+        // fetched together by GetNames
+        bool _hasNames;
+        xstring_t _moduleName;
+        xstring_t _appDomainName;
+        bool _isCoreClr;
+        // whether _appDomainName, and so _isCoreClr, could be fetched
+        HRESULT _appDomainInfoResult;
 
         ModuleID _moduleId; 
         ClassID _classId;
+        AppDomainID _appDomainId;
         mdToken _metaDataToken;
         mdTypeDef _typeDefinitionToken;
         DWORD _classAttributes;
         DWORD _methodAttributes;
-        FunctionHeaderInfoPtr _functionHeaderInfo;
         bool _shouldTrace;
         bool _valid;
-        bool _isCoreClr;
         bool _injectMethodInstrumentation;
+        // the async flag is added by GetTracerFlags
+        bool _hasAsyncFlag;
         uint32_t _tracerFlags;
+        ModuleAttributeIndexPtr _attributeIndex;
+        bool _hasAssemblyProps;
         ASSEMBLYMETADATA _assemblyProps;
 
+        // metadata owned by the runtime for the lifetime of the module; copied into _signature when first asked for
+        const uint8_t* _signatureBytes;
+        ULONG _signatureSize;
         ByteVectorPtr _signature;
+        // fetched together by GetMethod, along with _functionHeaderInfo
         ByteVectorPtr _method;
+        FunctionHeaderInfoPtr _functionHeaderInfo;
         std::function<HRESULT(Function&, LPCBYTE, ULONG)> _setILFunctionBody;
         std::function<HRESULT(Function&)> _rejitFunction;
 
@@ -76,7 +96,7 @@ namespace NewRelic { namespace Profiler
         }
 
         // Returns the Function representing the given functionId, or nullptr if this function should not be instrumented.
-        static std::shared_ptr<Function> Create(CComPtr<ICorProfilerInfo4> profilerInfo, const FunctionID functionId, std::shared_ptr<MethodRewriter::MethodRewriter> methodRewriter, bool injectMethodInstrumentation, std::function<HRESULT(Function&, LPCBYTE, ULONG)> setILFunctionBodyOrRejit, std::function<HRESULT(Function&)> rejitFunction)
+        static std::shared_ptr<Function> Create(CComPtr<ICorProfilerInfo4> profilerInfo, const FunctionID functionId, std::shared_ptr<MethodRewriter::MethodRewriter> methodRewriter, ModuleAttributeIndexCachePtr attributeIndexes, bool injectMethodInstrumentation, std::function<HRESULT(Function&, LPCBYTE, ULONG)> setILFunctionBodyOrRejit, std::function<HRESULT(Function&)> rejitFunction)
         {
             AssemblyID assemblyId = 0;
             AppDomainID appDomainId = 0;
@@ -101,13 +121,11 @@ namespace NewRelic { namespace Profiler
             StaticThrowOnError(profilerInfo->GetAssemblyInfo(assemblyId, assemblyNameLength, nullptr, assemblyName.get(), &appDomainId, nullptr));
 
             CComPtr<IMetaDataImport2> metaDataImport;
-            CComPtr<IMetaDataAssemblyImport> metaDataAssemblyImport;
 
-            // get the interfaces we need and the metadata token
+            // get the interface we need to look up names and the metadata token; the rest are only fetched if the method is rewritten
             StaticThrowOnError(profilerInfo->GetTokenAndMetaDataFromFunction(functionId, IID_IMetaDataImport2, (IUnknown**)&metaDataImport, nullptr));
-            StaticThrowOnError(profilerInfo->GetTokenAndMetaDataFromFunction(functionId, IID_IMetaDataAssemblyImport, (IUnknown**)&metaDataAssemblyImport, nullptr));
 
-            if (metaDataImport == nullptr || metaDataAssemblyImport == nullptr)
+            if (metaDataImport == nullptr)
             {
                 LogError("Unable to get function information for function ID ", functionId);
                 throw FailedToGetFunctionInformationException();
@@ -115,11 +133,15 @@ namespace NewRelic { namespace Profiler
 
             uint32_t tracerFlags = 0;
             bool hasTransactionOrTraceAttribute = false;
+            ModuleAttributeIndexPtr attributeIndex;
 
             // don't look for trace attributes in Microsoft code or our agent code
             if (!ShouldSkipAssemblyAttributes(assemblyName.get()))
             {
-                hasTransactionOrTraceAttribute = HasTransactionOrTraceAttribute(metaDataImport, metaDataToken, tracerFlags);
+                attributeIndex = attributeIndexes->Get(moduleId, metaDataImport);
+                hasTransactionOrTraceAttribute = attributeIndex != nullptr
+                    ? attributeIndex->HasTransactionOrTraceAttribute(metaDataToken, tracerFlags)
+                    : HasTransactionOrTraceAttribute(metaDataImport, metaDataToken, tracerFlags);
                 if (hasTransactionOrTraceAttribute)
                 {
                     tracerFlags |= NewRelic::Profiler::Configuration::TracerFlags::AttributeInstrumentation;
@@ -196,10 +218,10 @@ namespace NewRelic { namespace Profiler
                 return nullptr;
             }
 
-            return std::make_shared<Function>(profilerInfo, functionId, metaDataImport, metaDataAssemblyImport, methodRewriter,
+            return std::make_shared<Function>(profilerInfo, functionId, metaDataImport, methodRewriter,
                 appDomainId, signatureSize, signature, moduleId, classId, metaDataToken, typeDefinitionToken, ToStdWString(assemblyName.get()), 
                 typeName, ToStdWString(functionName.get()), classAttributes, methodAttributes, tracerFlags, 
-                hasTransactionOrTraceAttribute, injectMethodInstrumentation, setILFunctionBodyOrRejit, rejitFunction);
+                hasTransactionOrTraceAttribute, attributeIndex, injectMethodInstrumentation, setILFunctionBodyOrRejit, rejitFunction);
         }
 
         // We don't want to search Microsoft assemblies for our trace attributes
@@ -241,11 +263,20 @@ namespace NewRelic { namespace Profiler
             return result == S_OK;
         }
 
+        static bool HasAsyncStateMachineAttribute(CComPtr<IMetaDataImport2> metaDataImport, mdToken metaDataToken)
+        {
+            const BYTE *pVal = NULL;
+            ULONG cbVal = 0;
+
+            HRESULT attributeResult = metaDataImport->GetCustomAttributeByName(metaDataToken, _X("System.Runtime.CompilerServices.AsyncStateMachineAttribute"), (const void**)&pVal, &cbVal);
+            // It is not safe for us to use the SUCCEEDED macro on the result returned from GetCustomAttributeByName
+            return attributeResult == S_OK;
+        }
+
         Function(
             CComPtr<ICorProfilerInfo4> profilerInfo,
             const FunctionID functionId,
             CComPtr<IMetaDataImport2> metaDataImport,
-            CComPtr<IMetaDataAssemblyImport> metaDataAssemblyImport,
             std::shared_ptr<MethodRewriter::MethodRewriter>,
             AppDomainID appDomainId,
             ULONG signatureSize,
@@ -261,94 +292,39 @@ namespace NewRelic { namespace Profiler
             DWORD methodAttributes,
             uint32_t tracerFlags,
             bool shouldTrace,
+            ModuleAttributeIndexPtr attributeIndex,
             bool injectMethodInstrumentation,
             std::function<HRESULT(Function&, LPCBYTE, ULONG)> setILFunctionBody,
             std::function<HRESULT(Function&)> rejitFunction) :
             _functionId(functionId),
             _functionName(functionName),
             _profilerInfo(profilerInfo),
-            _signature(new ByteVector()),
-            _method(new ByteVector()),
             _metaDataImport(metaDataImport),
-            _metaDataAssemblyImport(metaDataAssemblyImport),
             _moduleId(moduleId),
             _classId(classId),
+            _appDomainId(appDomainId),
             _assemblyName(assemblyName),
             _typeName(typeName),
+            _hasNames(false),
+            _isCoreClr(false),
+            _appDomainInfoResult(E_FAIL),
             _metaDataToken(metaDataToken),
             _typeDefinitionToken(typeDefinitionToken),
             _classAttributes(classAttributes),
             _methodAttributes(methodAttributes),
             _shouldTrace(shouldTrace),
             _valid(true),
-            _isCoreClr(false),
+            _hasAsyncFlag(false),
             _tracerFlags(tracerFlags),
+            _attributeIndex(attributeIndex),
+            _hasAssemblyProps(false),
+            _assemblyProps(),
+            _signatureBytes(signature),
+            _signatureSize(signatureSize),
             _injectMethodInstrumentation(injectMethodInstrumentation),
             _setILFunctionBody(setILFunctionBody),
             _rejitFunction(rejitFunction)
         {
-            ProcessID processId = 0;
-            ULONG methodSize = 0;
-            const uint8_t* method;
-
-            // get the interfaces we need and the metadata token
-            ThrowOnError(_profilerInfo->GetTokenAndMetaDataFromFunction, functionId, IID_IMetaDataEmit2, (IUnknown**)&_metaDataEmit, nullptr);
-            ThrowOnError(_profilerInfo->GetTokenAndMetaDataFromFunction, functionId, IID_IMetaDataAssemblyEmit, (IUnknown**)&_metaDataAssemblyEmit, nullptr);
-
-            if (_metaDataEmit == nullptr || _metaDataAssemblyEmit == nullptr)
-            {
-                LogError("Unable to get function information for function ID ", functionId);
-                throw FailedToGetFunctionInformationException();
-            }
-
-            // get the name of the module
-            ULONG moduleNameLength = 0;
-            ThrowOnError(_profilerInfo->GetModuleInfo, _moduleId, nullptr, 0, &moduleNameLength, nullptr, nullptr);
-            std::unique_ptr<WCHAR[]> moduleName(new WCHAR[moduleNameLength]);
-            ThrowOnError(_profilerInfo->GetModuleInfo, _moduleId, nullptr, moduleNameLength, nullptr, moduleName.get(), nullptr);
-
-            // get the name of the AppDomain
-            ULONG appDomainNameLength = 0;
-            ThrowOnError(_profilerInfo->GetAppDomainInfo, appDomainId, 0, &appDomainNameLength, nullptr, nullptr);
-            std::unique_ptr<WCHAR[]> appDomainName(new WCHAR[appDomainNameLength]);
-            ThrowOnError(_profilerInfo->GetAppDomainInfo, appDomainId, appDomainNameLength, nullptr, appDomainName.get(), &processId);
-
-            _appDomainName = ToStdWString(appDomainName.get());
-            _isCoreClr = _appDomainName == _X("clrhost");
-
-            // create the tokenizer that will be used to generate instructions to inject
-            _tokenizer = CreateCorTokenizer(_metaDataAssemblyEmit, _metaDataEmit, _metaDataImport, _metaDataAssemblyImport, _isCoreClr);
-
-            // create the token resolver that will be used to get strings from tokens
-            _tokenResolver.reset(new CorTokenResolver(_metaDataImport));
-
-            // REVIEW : Why do we get the function bytes upfront before we know that we want to instrument the function?
-            // get the bytes that make up this method
-            ThrowOnError(_profilerInfo->GetILFunctionBody, _moduleId, _metaDataToken, &method, &methodSize);
-
-            _moduleName = ToStdWString(moduleName.get());
-            _method->assign(method, method + methodSize);
-            _signature->assign(signature, signature + signatureSize);
-
-            _functionHeaderInfo = CreateFunctionHeaderInfo(_method);
-
-            const BYTE *pVal = NULL;
-            ULONG cbVal = 0;
-
-            HRESULT attributeResult = _metaDataImport->GetCustomAttributeByName(_metaDataToken, _X("System.Runtime.CompilerServices.AsyncStateMachineAttribute"), (const void**)&pVal, &cbVal);
-            // It is not safe for us to use the SUCCEEDED macro on the result returned from GetCustomAttributeByName
-            if (attributeResult == S_OK)
-            {
-                LogDebug(L"Async method detected: ", this->ToString());
-                _tracerFlags |= NewRelic::Profiler::Configuration::TracerFlags::AsyncMethod;
-            }
-
-            mdAssembly mda = 0;
-            ThrowOnError(_metaDataAssemblyImport->GetAssemblyFromScope, &mda);
-
-            _assemblyProps = ASSEMBLYMETADATA();
-            ThrowOnError(_metaDataAssemblyImport->GetAssemblyProps, mda, 0, 0, 0, nullptr, 0, nullptr, &_assemblyProps, 0);
-
 #ifdef DEBUG_PREPROCESSOR
             auto isMsCorLib = assemblyName == _X("mscorlib");
             if (!isMsCorLib && 
@@ -365,6 +341,7 @@ namespace NewRelic { namespace Profiler
 
         virtual bool Preprocess() override
         {
+            GetMethod();
             if (_functionHeaderInfo == nullptr) {
                 return false;
             }
@@ -391,16 +368,48 @@ namespace NewRelic { namespace Profiler
 
         virtual uint32_t GetTracerFlags() override
         {
+            if (!_hasAsyncFlag)
+            {
+                _hasAsyncFlag = true;
+                // the module's attribute index is only built for assemblies that are searched for trace attributes
+                bool isAsync = _attributeIndex != nullptr
+                    ? _attributeIndex->HasAsyncStateMachineAttribute(_metaDataToken)
+                    : HasAsyncStateMachineAttribute(_metaDataImport, _metaDataToken);
+                if (isAsync)
+                {
+                    LogDebug(L"Async method detected: ", this->ToString());
+                    _tracerFlags |= NewRelic::Profiler::Configuration::TracerFlags::AsyncMethod;
+                }
+            }
             return _tracerFlags;
         }
 
+        virtual ByteVectorPtr GetModuleVersionId() override
+        {
+            GUID moduleVersionId;
+            if (FAILED(_metaDataImport->GetScopeProps(nullptr, 0, nullptr, &moduleVersionId)))
+            {
+                return nullptr;
+            }
+            auto bytes = reinterpret_cast<const uint8_t*>(&moduleVersionId);
+            return std::make_shared<ByteVector>(bytes, bytes + sizeof(moduleVersionId));
+        }
+
         virtual bool IsValid() override
         {
             return _valid;
         }
 
+        // Throws if the AppDomain can't be fetched: unlike the names, which are only logged, this decides which core library the
+        // rewritten method references.
         virtual bool IsCoreClr() override
         {
+            GetNames();
+            if (FAILED(_appDomainInfoResult))
+            {
+                LogError(L"Unable to get the AppDomain for function ID ", _functionId, L".  HRESULT: ", _appDomainInfoResult);
+                throw FailedToGetFunctionInformationException();
+            }
             return _isCoreClr;
         }
 
@@ -411,6 +420,15 @@ namespace NewRelic { namespace Profiler
 
         virtual ASSEMBLYMETADATA GetAssemblyProps() override
         {
+            if (!_hasAssemblyProps)
+            {
+                GetMetaDataInterfaces();
+
+                mdAssembly mda = 0;
+                ThrowOnError(_metaDataAssemblyImport->GetAssemblyFromScope, &mda);
+                ThrowOnError(_metaDataAssemblyImport->GetAssemblyProps, mda, 0, 0, 0, nullptr, 0, nullptr, &_assemblyProps, 0);
+                _hasAssemblyProps = true;
+            }
             return _assemblyProps;
         }
 
@@ -438,25 +456,27 @@ namespace NewRelic { namespace Profiler
 
         virtual xstring_t GetModuleName() override
         {
+            GetNames();
             return _moduleName;
         }
 
-        virtual xstring_t GetAssemblyName() override
+        virtual const xstring_t& GetAssemblyName() override
         {
             return _assemblyName;
         }
 
         virtual xstring_t GetAppDomainName() override
         {
+            GetNames();
             return _appDomainName;
         }
 
-        virtual xstring_t GetTypeName() override
+        virtual const xstring_t& GetTypeName() override
         {
             return _typeName;
         }
 
-        virtual xstring_t GetFunctionName() override
+        virtual const xstring_t& GetFunctionName() override
         {
             return _functionName;
         }
@@ -484,28 +504,43 @@ namespace NewRelic { namespace Profiler
         // get the signature for this method
         virtual ByteVectorPtr GetSignature() override
         {
+            if (_signature == nullptr)
+            {
+                _signature = std::make_shared<ByteVector>(_signatureBytes, _signatureBytes + _signatureSize);
+            }
             return _signature;
         }
 
         // returns the bytes that make up this method, this includes the header and the code
         virtual ByteVectorPtr GetMethodBytes() override
         {
+            GetMethod();
             return _method;
         }
 
         virtual FunctionHeaderInfoPtr GetFunctionHeaderInfo() override
         {
+            GetMethod();
             return _functionHeaderInfo;
         }
 
         // get the tokenizer that should be used to modify the code bytes
         virtual sicily::codegen::ITokenizerPtr GetTokenizer() override
         {
+            if (_tokenizer == nullptr)
+            {
+                GetMetaDataInterfaces();
+                _tokenizer = CreateCorTokenizer(_metaDataAssemblyEmit, _metaDataEmit, _metaDataImport, _metaDataAssemblyImport, IsCoreClr());
+            }
             return _tokenizer;
         }
 
         virtual SignatureParser::ITokenResolverPtr GetTokenResolver() override
         {
+            if (_tokenResolver == nullptr)
+            {
+                _tokenResolver.reset(new CorTokenResolver(_metaDataImport));
+            }
             return _tokenResolver;
         }
 
@@ -530,6 +565,7 @@ namespace NewRelic { namespace Profiler
             auto parsedSignature = SignatureParser::SignatureParser::ParseMethodSignature(signature->begin(), signature->end());
             auto signatureString = parsedSignature->ToString(GetTokenResolver());
             
+            GetNames();
             return xstring_t(_X("(Module: ")) + _moduleName + _X(", AppDomain: ") + _appDomainName + _X(")[") + _assemblyName + _X("]") + _typeName + _X(".") + _functionName + _X("(") + signatureString + _X(")");
         }
 
@@ -537,12 +573,31 @@ namespace NewRelic { namespace Profiler
         {
             ULONG signatureLength;
             uint8_t* signature;
-            ThrowOnError(_metaDataImport->GetSigFromToken, token, (PCCOR_SIGNATURE*)&signature, &signatureLength);
+            switch (token & 0xff000000)
+            {
+                case CorTokenType::mdtMethodDef:
+                    ThrowOnError(_metaDataImport->GetMethodProps, token, nullptr, nullptr, 0, nullptr, nullptr, (PCCOR_SIGNATURE*)&signature, &signatureLength, nullptr, nullptr);
+                    break;
+                case CorTokenType::mdtMemberRef:
+                    ThrowOnError(_metaDataImport->GetMemberRefProps, token, nullptr, nullptr, 0, nullptr, (PCCOR_SIGNATURE*)&signature, &signatureLength);
+                    break;
+                case CorTokenType::mdtMethodSpec:
+                {
+                    // the MethodSpec's own signature is only its type arguments
+                    mdToken genericMethod = mdTokenNil;
+                    ThrowOnError(_metaDataImport->GetMethodSpecProps, token, &genericMethod, nullptr, nullptr);
+                    return GetSignatureFromToken(genericMethod);
+                }
+                default:
+                    ThrowOnError(_metaDataImport->GetSigFromToken, token, (PCCOR_SIGNATURE*)&signature, &signatureLength);
+                    break;
+            }
             return std::make_shared<ByteVector>(signature, signature + signatureLength);
         }
 
         virtual mdToken GetTokenFromSignature(const ByteVector& signature) override
         {
+            GetMetaDataInterfaces();
             mdToken signatureToken = 0;
             ThrowOnError(_metaDataEmit->GetTokenFromSig, signature.data(), ULONG(signature.size()), &signatureToken);
             return signatureToken;
@@ -553,6 +608,86 @@ namespace NewRelic { namespace Profiler
             return(_classId == 0);
         }
     
+    private:
+        void GetMetaDataInterfaces()
+        {
+            if (_metaDataEmit != nullptr)
+            {
+                return;
+            }
+
+            CComPtr<IMetaDataEmit2> metaDataEmit;
+            CComPtr<IMetaDataAssemblyEmit> metaDataAssemblyEmit;
+            CComPtr<IMetaDataAssemblyImport> metaDataAssemblyImport;
+            ThrowOnError(_profilerInfo->GetTokenAndMetaDataFromFunction, _functionId, IID_IMetaDataEmit2, (IUnknown**)&metaDataEmit, nullptr);
+            ThrowOnError(_profilerInfo->GetTokenAndMetaDataFromFunction, _functionId, IID_IMetaDataAssemblyEmit, (IUnknown**)&metaDataAssemblyEmit, nullptr);
+            ThrowOnError(_profilerInfo->GetTokenAndMetaDataFromFunction, _functionId, IID_IMetaDataAssemblyImport, (IUnknown**)&metaDataAssemblyImport, nullptr);
+
+            if (metaDataEmit == nullptr || metaDataAssemblyEmit == nullptr || metaDataAssemblyImport == nullptr)
+            {
+                LogError("Unable to get function information for function ID ", _functionId);
+                throw FailedToGetFunctionInformationException();
+            }
+
+            _metaDataAssemblyEmit = metaDataAssemblyEmit;
+            _metaDataAssemblyImport = metaDataAssemblyImport;
+            _metaDataEmit = metaDataEmit;
+        }
+
+        // Doesn't throw since ToString uses the names while handling exceptions; a name that can't be fetched is left empty.  A failure
+        // to fetch the AppDomain name is kept in _appDomainInfoResult for IsCoreClr.
+        void GetNames()
+        {
+            if (_hasNames)
+            {
+                return;
+            }
+            _hasNames = true;
+
+            // get the name of the module
+            ULONG moduleNameLength = 0;
+            if (SUCCEEDED(_profilerInfo->GetModuleInfo(_moduleId, nullptr, 0, &moduleNameLength, nullptr, nullptr)))
+            {
+                std::unique_ptr<WCHAR[]> moduleName(new WCHAR[moduleNameLength]);
+                if (SUCCEEDED(_profilerInfo->GetModuleInfo(_moduleId, nullptr, moduleNameLength, nullptr, moduleName.get(), nullptr)))
+                {
+                    _moduleName = ToStdWString(moduleName.get());
+                }
+            }
+
+            // get the name of the AppDomain
+            ULONG appDomainNameLength = 0;
+            _appDomainInfoResult = _profilerInfo->GetAppDomainInfo(_appDomainId, 0, &appDomainNameLength, nullptr, nullptr);
+            if (SUCCEEDED(_appDomainInfoResult))
+            {
+                std::unique_ptr<WCHAR[]> appDomainName(new WCHAR[appDomainNameLength]);
+                _appDomainInfoResult = _profilerInfo->GetAppDomainInfo(_appDomainId, appDomainNameLength, nullptr, appDomainName.get(), nullptr);
+                if (SUCCEEDED(_appDomainInfoResult))
+                {
+                    _appDomainName = ToStdWString(appDomainName.get());
+                }
+            }
+
+            _isCoreClr = _appDomainName == _X("clrhost");
+        }
+
+        // gets the bytes that make up this method
+        void GetMethod()
+        {
+            if (_method != nullptr)
+            {
+                return;
+            }
+
+            ULONG methodSize = 0;
+            const uint8_t* method;
+            ThrowOnError(_profilerInfo->GetILFunctionBody, _moduleId, _metaDataToken, &method, &methodSize);
+
+            _method = std::make_shared<ByteVector>(method, method + methodSize);
+            _functionHeaderInfo = CreateFunctionHeaderInfo(_method);
+        }
+
+    public:
         static std::unique_ptr<WCHAR[]> GetClassNameFromToken(CComPtr<IMetaDataImport2> metaDataImport, mdTypeDef typeDefinitionToken)
         {
             ULONG typeNameLength = 0;
@@ -3,7 +3,7 @@
 
 #pragma once
 
-#include <map>
+#include "../Common/ReJITFunctionTable.h"
 #include "../Logging/Logger.h"
 #include "Function.h"
 #include <cor.h>
@@ -12,27 +12,6 @@
 namespace NewRelic { namespace Profiler
 {
 
-    struct ModuleAndMethodID {
-        ModuleID moduleID;
-        mdMethodDef methodID;
-
-        ModuleAndMethodID(ModuleID moduleID, mdMethodDef methodID)
-        {
-            this->moduleID = moduleID;
-            this->methodID = methodID;
-        }
-
-        bool operator==(const ModuleAndMethodID& other) const
-        {
-            return moduleID == other.moduleID && methodID == other.methodID;
-        }
-
-        bool operator<(const ModuleAndMethodID& other) const
-        {
-            return moduleID < other.moduleID || methodID < other.methodID;
-        }
-    };
-
     const FunctionID INVALID_FUNCTION_ID = 0;
 
     // Most of our JIT logic works off of FunctionIDs, but we see method reJITs through the GetReJITParameters
@@ -50,91 +29,39 @@ namespace NewRelic { namespace Profiler
     // 
     // Note that the bytecode for a given generic class / method *should* be the same regardless of the specific generic
     // type as noted by Broman (https://blogs.msdn.microsoft.com/davbr/2011/10/12/rejit-a-how-to-guide/).  For this reason
-    // we only map a single function id to a module/method.  This is okay because when we look up the class and method details
+    // the rejit of a module/method uses any one of its function ids.  This is okay because when we look up the class and method details
     // for a function id we use the apis that don't return the type specifics of the generic method.  That means that while 
     // multiple function ids may map to a single generic method, the AgentShim will see invocations for all of those function ids 
     // use a single function id.  For our purposes, at least for the current agent functionality we support, this is fine.
+    // Every instantiation seen before the rejit is kept, and only the first asks for the rejit, so a generic method with many
+    // instantiations is rejitted once rather than once per instantiation.
+    //
+    // Every method of this class is called from JIT and ReJIT callbacks on any thread; the state is in a ReJITFunctionTable.
     class FunctionResolver
     {
     private:
-        // We fall back on this map for generic methods when our calls to GetFunctionFromToken fail.
-        std::map<ModuleAndMethodID, FunctionID> _functionToMethod;
-        std::set<ModuleAndMethodID> _methodsToReJIT;
-
-        std::mutex _functionToMethodMutex;
-        std::mutex _methodsToReJITMutex;
+        // We fall back on this table for generic methods when our calls to GetFunctionFromToken fail.
+        ReJITFunctionTable _functions;
         CComPtr<ICorProfilerInfo4> _corProfilerInfo;
 
-        bool ShouldReJIT(FunctionID functionId, ModuleID moduleId, mdMethodDef methodId)
-        {
-            ModuleAndMethodID moduleAndMethodID(moduleId, methodId);
-
-            auto rejit = ShouldReJIT(moduleAndMethodID);
-            if (rejit)
-            {
-                AddUnderLock(functionId, moduleAndMethodID);
-            }
-            
-            return rejit;
-        }
-
-        bool ShouldReJIT(ModuleAndMethodID moduleAndMethodID)
-        {
-            std::lock_guard<std::mutex> rejitMethodsLock(_methodsToReJITMutex);
-            auto it = _methodsToReJIT.find(moduleAndMethodID);
-            if (it == _methodsToReJIT.end())
-            {
-                return false;
-            }
-
-            _methodsToReJIT.erase(it);
-            return true;
-        }
-
-        void AddUnderLock(FunctionID functionId, ModuleAndMethodID moduleAndMethodID)
-        {
-            std::lock_guard<std::mutex> lock(_functionToMethodMutex);
-            _functionToMethod[moduleAndMethodID] = functionId;
-        }
-
-        FunctionID GetGenericFunctionIdUnderLock(ModuleAndMethodID moduleAndMethodID)
-        {
-            std::lock_guard<std::mutex> lock(_functionToMethodMutex);
-
-            auto it = _functionToMethod.find(moduleAndMethodID);
-            if (it != _functionToMethod.end())
-            {
-                auto id = it->second;
-
-                // cool.  we found the id, now remove it from our map.
-                _functionToMethod.erase(it);
-                return id;
-            }
-            return INVALID_FUNCTION_ID;
-        }
-
-        void AddToReJITSetUnderLock(ModuleAndMethodID moduleAndMethodID)
-        {
-            std::lock_guard<std::mutex> rejitMethodsLock(_methodsToReJITMutex);
-            _methodsToReJIT.emplace(moduleAndMethodID);
-        }
-
     public:
         FunctionResolver(CComPtr<ICorProfilerInfo4> corProfilerInfo)
         {
             _corProfilerInfo = corProfilerInfo;
         }
 
-        // This adds the functionId->moduleId/methodId to a map if a call to GetFunctionFromToken fails.
-        void AddFunctionIfGeneric(Function& function)
+        // This adds the functionId->moduleId/methodId to the table if a call to GetFunctionFromToken fails.  Returns false if the
+        // function is another instantiation of a generic method whose reJIT has already been requested, so need not be again.
+        bool AddFunctionIfGeneric(Function& function)
         {
             FunctionID functionId;
             if (_corProfilerInfo->GetFunctionFromToken(function.GetModuleID(), function.GetMethodToken(), &functionId) == CORPROF_E_FUNCTION_IS_PARAMETERIZED)
             {
                 ModuleAndMethodID moduleAndMethodID(function.GetModuleID(), function.GetMethodToken());
 
-                AddUnderLock(function.GetFunctionId(), moduleAndMethodID);
+                return _functions.AddFunction(moduleAndMethodID, function.GetFunctionId());
             }
+            return true;
         }
 
         // Returns a FunctionID for the given moduleId and methodId, or 0 if it is not found.
@@ -175,7 +102,7 @@ namespace NewRelic { namespace Profiler
                 return;
             }
 
-            if (ShouldReJIT(functionId, moduleId, methodId))
+            if (_functions.TryResolvePending(ModuleAndMethodID(moduleId, methodId), functionId))
             {
                 LogDebug(L"Requesting a reJIT of a generic function");
                 _corProfilerInfo->RequestReJIT(1, &moduleId, &methodId);
@@ -184,13 +111,10 @@ namespace NewRelic { namespace Profiler
 
         FunctionID GetGenericFunctionId(ModuleID moduleId, mdMethodDef methodId)
         {
-            ModuleAndMethodID moduleAndMethodID(moduleId, methodId);
-
-            auto id = GetGenericFunctionIdUnderLock(moduleAndMethodID);
+            FunctionID id = _functions.TakeFunctionOrMarkPending(ModuleAndMethodID(moduleId, methodId));
             if (!IsValid(id))
             {
                 LogTrace(L"Generic function lookup failed, queued a reJIT");
-                AddToReJITSetUnderLock(moduleAndMethodID);
             }
 
             return id;
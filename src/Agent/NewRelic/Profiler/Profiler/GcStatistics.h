@@ -0,0 +1,270 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <cor.h>
+#include "../Common/Histogram.h"
+
+/*
+GC STATISTICS LAYOUT
+HarvestGcStatistics returns a single block of memory, released by ReleaseGcStatistics, that holds every non-empty histogram collected since
+the previous harvest.  All values are in microseconds and all offsets are relative to the start of the block.
+
+    GcStatisticsHeader
+    GcHistogramEntry[histogramCount]
+    GcHistogramBucket[bucketCount]      the non-empty buckets of every histogram, in histogram order
+
+Histograms
+    GcHistogramKindCollection           duration of a garbage collection, keyed by the highest generation collected (0-2) and
+                                        COR_PRF_GC_REASON
+    GcHistogramKindSuspension           time from RuntimeSuspendStarted to RuntimeResumeFinished (the pause seen by managed threads),
+                                        keyed by COR_PRF_SUSPEND_REASON
+    GcHistogramKindSuspensionLatency    time from RuntimeSuspendStarted to RuntimeSuspendFinished (the time taken to stop all managed
+                                        threads), keyed by COR_PRF_SUSPEND_REASON
+*/
+namespace NewRelic { namespace Profiler
+{
+    static constexpr uint32_t GcStatisticsMagic = 0x5347524E; // "NRGS"
+    static constexpr uint16_t GcStatisticsVersion = 1;
+
+    static constexpr uint32_t GcHistogramKindCollection = 1;
+    static constexpr uint32_t GcHistogramKindSuspension = 2;
+    static constexpr uint32_t GcHistogramKindSuspensionLatency = 3;
+
+#pragma region Marshaled Layouts
+    //!!!MARSHALED LAYOUT!!!
+    //These structures are read by the managed code.  Do not change without bumping GcStatisticsVersion and updating the managed reader.
+    struct GcStatisticsHeader
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t headerSize;
+        uint32_t totalSize;
+        uint32_t histogramCount;
+        uint32_t histogramTableOffset;
+        uint32_t bucketCount;
+        uint32_t bucketTableOffset;
+        uint32_t reserved;
+        //microseconds covered by this harvest
+        uint64_t intervalMicroseconds;
+    };
+    static_assert(sizeof(GcStatisticsHeader) == 40, "GcStatisticsHeader is part of the marshaled layout");
+
+    struct GcHistogramEntry
+    {
+        uint32_t kind;
+        //generation for GcHistogramKindCollection, unused otherwise
+        uint32_t generation;
+        uint32_t reason;
+        uint32_t firstBucket;
+        uint32_t bucketCount;
+        uint32_t reserved;
+        uint64_t count;
+        uint64_t totalMicroseconds;
+        uint64_t maxMicroseconds;
+    };
+    static_assert(sizeof(GcHistogramEntry) == 48, "GcHistogramEntry is part of the marshaled layout");
+
+    struct GcHistogramBucket
+    {
+        //values in [lowerBoundMicroseconds, next bucket's lowerBoundMicroseconds) were counted in this bucket
+        uint64_t lowerBoundMicroseconds;
+        uint64_t count;
+    };
+    static_assert(sizeof(GcHistogramBucket) == 16, "GcHistogramBucket is part of the marshaled layout");
+#pragma endregion
+
+    //Times garbage collections and runtime suspensions from the profiler callbacks and keeps them in lock-free histograms.
+    //The callbacks only read a monotonic clock and update atomics, so the collector is cheap enough to leave on.
+    class GcStatistics
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        //gen 0, 1 and 2; collections of the large and pinned object heaps are always gen 2 collections
+        static constexpr uint32_t GenerationCount = 3;
+        //COR_PRF_GC_REASON: COR_PRF_GC_OTHER, COR_PRF_GC_INDUCED
+        static constexpr uint32_t GcReasonCount = 2;
+        //COR_PRF_SUSPEND_REASON: COR_PRF_SUSPEND_OTHER .. COR_PRF_SUSPEND_FOR_PROFILER
+        static constexpr uint32_t SuspendReasonCount = 10;
+        //background gen 2 collections run concurrently with foreground ephemeral collections
+        static constexpr uint32_t MaxNestedCollections = 4;
+
+        GcStatistics() noexcept : _intervalStart(Now())
+        {}
+
+        void GarbageCollectionStarted(int generationCount, const BOOL generationCollected[], uint32_t reason) noexcept
+        {
+            uint32_t generation = 0;
+            for (int idx = 0; idx < generationCount && idx < static_cast<int>(GenerationCount); ++idx)
+            {
+                if (generationCollected[idx])
+                {
+                    generation = static_cast<uint32_t>(idx);
+                }
+            }
+
+            const auto depth = _collectionDepth.fetch_add(1);
+            if (depth < MaxNestedCollections)
+            {
+                _collections[depth].start = Now();
+                _collections[depth].generation = generation;
+                _collections[depth].reason = reason < GcReasonCount ? reason : 0;
+            }
+        }
+
+        void GarbageCollectionFinished() noexcept
+        {
+            const auto now = Now();
+            auto depth = _collectionDepth.load();
+            while (depth != 0 && !_collectionDepth.compare_exchange_weak(depth, depth - 1))
+            {
+            }
+            if (depth == 0 || depth > MaxNestedCollections)
+            {
+                return;
+            }
+
+            const auto& collection = _collections[depth - 1];
+            _collectionHistograms[collection.generation][collection.reason].Record(now - collection.start);
+        }
+
+        void RuntimeSuspendStarted(uint32_t reason) noexcept
+        {
+            _suspendStart = Now();
+            _suspendReason = reason < SuspendReasonCount ? reason : 0;
+        }
+
+        void RuntimeSuspendFinished() noexcept
+        {
+            const auto start = _suspendStart.load();
+            if (start != 0)
+            {
+                _suspensionLatencyHistograms[_suspendReason.load()].Record(Now() - start);
+            }
+        }
+
+        void RuntimeSuspendAborted() noexcept
+        {
+            _suspendStart = 0;
+        }
+
+        void RuntimeResumeFinished() noexcept
+        {
+            const auto start = _suspendStart.exchange(0);
+            if (start != 0)
+            {
+                _suspensionHistograms[_suspendReason.load()].Record(Now() - start);
+            }
+        }
+
+        //Take and reset every histogram and serialize the non-empty ones as described above.
+        std::unique_ptr<uint8_t[]> Harvest(uint32_t& totalSize)
+        {
+            const auto now = Now();
+            std::vector<GcHistogramEntry> entries;
+            std::vector<GcHistogramBucket> buckets;
+            Histogram::Snapshot snapshot;
+
+            for (uint32_t generation = 0; generation != GenerationCount; ++generation)
+            {
+                for (uint32_t reason = 0; reason != GcReasonCount; ++reason)
+                {
+                    _collectionHistograms[generation][reason].Harvest(snapshot);
+                    AddHistogram(entries, buckets, snapshot, GcHistogramKindCollection, generation, reason);
+                }
+            }
+            for (uint32_t reason = 0; reason != SuspendReasonCount; ++reason)
+            {
+                _suspensionHistograms[reason].Harvest(snapshot);
+                AddHistogram(entries, buckets, snapshot, GcHistogramKindSuspension, 0, reason);
+                _suspensionLatencyHistograms[reason].Harvest(snapshot);
+                AddHistogram(entries, buckets, snapshot, GcHistogramKindSuspensionLatency, 0, reason);
+            }
+
+            GcStatisticsHeader header{};
+            header.magic = GcStatisticsMagic;
+            header.version = GcStatisticsVersion;
+            header.headerSize = static_cast<uint16_t>(sizeof(GcStatisticsHeader));
+            header.intervalMicroseconds = now - _intervalStart.exchange(now);
+            header.histogramCount = static_cast<uint32_t>(entries.size());
+            header.histogramTableOffset = sizeof(GcStatisticsHeader);
+            header.bucketCount = static_cast<uint32_t>(buckets.size());
+            header.bucketTableOffset = header.histogramTableOffset + header.histogramCount * sizeof(GcHistogramEntry);
+            header.totalSize = header.bucketTableOffset + header.bucketCount * sizeof(GcHistogramBucket);
+
+            std::unique_ptr<uint8_t[]> block(new uint8_t[header.totalSize]());
+            std::memcpy(block.get(), &header, sizeof(header));
+            if (!entries.empty())
+            {
+                std::memcpy(block.get() + header.histogramTableOffset, entries.data(), entries.size() * sizeof(GcHistogramEntry));
+            }
+            if (!buckets.empty())
+            {
+                std::memcpy(block.get() + header.bucketTableOffset, buckets.data(), buckets.size() * sizeof(GcHistogramBucket));
+            }
+
+            totalSize = header.totalSize;
+            return block;
+        }
+
+    private:
+        struct Collection
+        {
+            uint64_t start = 0;
+            uint32_t generation = 0;
+            uint32_t reason = 0;
+        };
+
+        //microseconds on a monotonic clock
+        static uint64_t Now() noexcept
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count());
+        }
+
+        static void AddHistogram(std::vector<GcHistogramEntry>& entries, std::vector<GcHistogramBucket>& buckets, const Histogram::Snapshot& snapshot,
+            uint32_t kind, uint32_t generation, uint32_t reason)
+        {
+            if (snapshot.count == 0)
+            {
+                return;
+            }
+
+            GcHistogramEntry entry{};
+            entry.kind = kind;
+            entry.generation = generation;
+            entry.reason = reason;
+            entry.firstBucket = static_cast<uint32_t>(buckets.size());
+            entry.count = snapshot.count;
+            entry.totalMicroseconds = snapshot.sum;
+            entry.maxMicroseconds = snapshot.max;
+            for (uint32_t index = 0; index != Histogram::BucketCount; ++index)
+            {
+                if (snapshot.buckets[index] != 0)
+                {
+                    buckets.push_back(GcHistogramBucket{ Histogram::BucketLowerBound(index), snapshot.buckets[index] });
+                }
+            }
+            entry.bucketCount = static_cast<uint32_t>(buckets.size()) - entry.firstBucket;
+            entries.push_back(entry);
+        }
+
+        std::atomic<uint64_t> _intervalStart;
+
+        std::atomic<uint32_t> _collectionDepth{ 0 };
+        Collection _collections[MaxNestedCollections];
+        Histogram _collectionHistograms[GenerationCount][GcReasonCount];
+
+        std::atomic<uint64_t> _suspendStart{ 0 };
+        std::atomic<uint32_t> _suspendReason{ 0 };
+        Histogram _suspensionHistograms[SuspendReasonCount];
+        Histogram _suspensionLatencyHistograms[SuspendReasonCount];
+    };
+}}
@@ -0,0 +1,70 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include "../Common/CoalescingWorker.h"
+
+namespace NewRelic { namespace Profiler
+{
+#pragma region Marshaled Layouts
+    //!!!MARSHALED LAYOUT!!!
+    //Filled in by GetInstrumentationRefreshStatus and read by the managed code.  Do not change without updating the managed reader.
+    struct InstrumentationRefreshStatus
+    {
+        uint64_t ticket;
+        //a CoalescingWorkState
+        int32_t state;
+        //the HRESULT of the last refresh that finished, S_OK if none has
+        int32_t result;
+        //the counters of the refresh that is running, or of the last one that finished
+        uint32_t modulesScanned;
+        uint32_t methodsRejitRequested;
+        uint32_t methodsRevertRequested;
+        uint32_t failures;
+    };
+    static_assert(sizeof(InstrumentationRefreshStatus) == 32, "InstrumentationRefreshStatus is part of the marshaled layout");
+#pragma endregion
+
+    //What the current instrumentation refresh has done so far.  Written by the thread doing the refresh and read by
+    //GetInstrumentationRefreshStatus from any thread, so every counter is atomic; a reader may see a refresh half way through.
+    class InstrumentationRefreshProgress
+    {
+    public:
+        void Start()
+        {
+            _modulesScanned = 0;
+            _methodsRejitRequested = 0;
+            _methodsRevertRequested = 0;
+            _failures = 0;
+        }
+
+        void Finish(int32_t result)
+        {
+            _result = result;
+        }
+
+        void ModuleScanned() { ++_modulesScanned; }
+        void RejitRequested(uint32_t methodCount) { _methodsRejitRequested += methodCount; }
+        void RevertRequested(uint32_t methodCount) { _methodsRevertRequested += methodCount; }
+        void Failed() { ++_failures; }
+
+        void Fill(InstrumentationRefreshStatus& status) const
+        {
+            status.result = _result;
+            status.modulesScanned = _modulesScanned;
+            status.methodsRejitRequested = _methodsRejitRequested;
+            status.methodsRevertRequested = _methodsRevertRequested;
+            status.failures = _failures;
+        }
+
+    private:
+        std::atomic<int32_t> _result{ 0 };
+        std::atomic<uint32_t> _modulesScanned{ 0 };
+        std::atomic<uint32_t> _methodsRejitRequested{ 0 };
+        std::atomic<uint32_t> _methodsRevertRequested{ 0 };
+        std::atomic<uint32_t> _failures{ 0 };
+    };
+}}
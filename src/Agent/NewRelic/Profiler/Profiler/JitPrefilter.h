@@ -0,0 +1,142 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <mutex>
+#include <unordered_map>
+#include <corprof.h>
+#include "../Logging/Logger.h"
+#include "../MethodRewriter/InstrumentationPrefilter.h"
+#include "Function.h"
+#include "ModuleAttributeIndex.h"
+
+namespace NewRelic { namespace Profiler
+{
+    // Rejects methods on the JIT path before a Function is created for them, reading their names into buffers on the stack and
+    // checking them against the MethodRewriter's InstrumentationPrefilter.  What is known about a module is recorded when it loads,
+    // so that the check for a method in a module that isn't instrumented is a map lookup.  Methods that Function::Create would let
+    // through whatever their names (those with a Transaction or Trace attribute, the agent API, everything when logging at trace
+    // level) are always let through.  Safe to use from any thread.
+    class JitPrefilter
+    {
+    public:
+        JitPrefilter(CComPtr<ICorProfilerInfo4> profilerInfo, ModuleAttributeIndexCachePtr attributeIndexes) :
+            _profilerInfo(profilerInfo),
+            _attributeIndexes(attributeIndexes)
+        {}
+
+        void ModuleLoaded(ModuleID moduleId, const xstring_t& assemblyName)
+        {
+            ModuleInfo module;
+            module.assemblyNameHash = MethodRewriter::InstrumentationPrefilter::Hash(assemblyName);
+            module.alwaysInstrument = assemblyName == _X("NewRelic.Api.Agent");
+            module.searchAttributes = !Function::ShouldSkipAssemblyAttributes(assemblyName);
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _modules[moduleId] = module;
+        }
+
+        void ModuleUnloaded(ModuleID moduleId)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _modules.erase(moduleId);
+        }
+
+        // false if the method is certainly not instrumented, true if Function::Create has to decide.
+        bool MayInstrument(FunctionID functionId, const MethodRewriter::InstrumentationPrefilter& prefilter)
+        {
+#ifdef DEBUG_PREPROCESSOR
+            return true;
+#else
+            if (nrlog::Level::LEVEL_TRACE >= nrlog::StdLog.GetLevel())
+            {
+                return true;
+            }
+
+            ModuleID moduleId = 0;
+            mdToken methodToken = mdTokenNil;
+            if (FAILED(_profilerInfo->GetFunctionInfo(functionId, nullptr, &moduleId, &methodToken)))
+            {
+                return true;
+            }
+
+            ModuleInfo module;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto found = _modules.find(moduleId);
+                if (found == _modules.end())
+                {
+                    // loaded before we were watching, or an assembly name we could not get
+                    return true;
+                }
+                module = found->second;
+            }
+
+            if (module.alwaysInstrument || (module.searchAttributes && HasTransactionOrTraceAttribute(moduleId, methodToken)))
+            {
+                return true;
+            }
+
+            if (!prefilter.MayInstrumentAssembly(module.assemblyNameHash))
+            {
+                return false;
+            }
+
+            CComPtr<IMetaDataImport2> metaDataImport;
+            if (FAILED(_profilerInfo->GetModuleMetaData(moduleId, ofRead, IID_IMetaDataImport2, (IUnknown**)&metaDataImport)) || metaDataImport == nullptr)
+            {
+                return true;
+            }
+
+            // a name that doesn't fit comes back as a truncation warning rather than S_OK, and is left to Function::Create
+            WCHAR name[MAX_CLASS_NAME];
+            ULONG nameLength = 0;
+            mdTypeDef typeToken = mdTokenNil;
+            if (metaDataImport->GetMethodProps(methodToken, &typeToken, name, MAX_CLASS_NAME, &nameLength, nullptr, nullptr, nullptr, nullptr, nullptr) != S_OK || nameLength == 0)
+            {
+                return true;
+            }
+            // the length includes the terminating null
+            if (!prefilter.MayInstrumentFunction(name, nameLength - 1))
+            {
+                return false;
+            }
+
+            DWORD typeAttributes = 0;
+            if (metaDataImport->GetTypeDefProps(typeToken, name, MAX_CLASS_NAME, &nameLength, &typeAttributes, nullptr) != S_OK || nameLength == 0)
+            {
+                return true;
+            }
+            // the instrumented name of a nested type includes the types it is nested in, which Function::Create works out
+            if (IsTdNested(typeAttributes))
+            {
+                return true;
+            }
+            return prefilter.MayInstrumentType(name, nameLength - 1);
+#endif
+        }
+
+    private:
+        struct ModuleInfo
+        {
+            uint64_t assemblyNameHash = 0;
+            bool alwaysInstrument = false;
+            // see Function::ShouldSkipAssemblyAttributes
+            bool searchAttributes = false;
+        };
+
+        CComPtr<ICorProfilerInfo4> _profilerInfo;
+        ModuleAttributeIndexCachePtr _attributeIndexes;
+        std::mutex _mutex;
+        std::unordered_map<ModuleID, ModuleInfo> _modules;
+
+        bool HasTransactionOrTraceAttribute(ModuleID moduleId, mdToken methodToken)
+        {
+            auto attributeIndex = _attributeIndexes->Get(moduleId);
+            uint32_t tracerFlags = 0;
+            // without an index, the attributes are only looked up by Function::Create
+            return attributeIndex == nullptr || attributeIndex->HasTransactionOrTraceAttribute(methodToken, tracerFlags);
+        }
+    };
+    typedef std::shared_ptr<JitPrefilter> JitPrefilterPtr;
+}}
@@ -0,0 +1,36 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include "../Common/OnDestruction.h"
+#include "Win32Helpers.h"
+
+namespace NewRelic { namespace Profiler
+{
+    // The number of tokens fetched by each call to a metadata Enum* method.  Each call crosses into the runtime, so fetching one
+    // token at a time makes a scan of a large module cost a call per row.
+    const ULONG METADATA_ENUM_BATCH_SIZE = 256;
+
+    // Runs a metadata enumeration in batches of METADATA_ENUM_BATCH_SIZE and calls visit with each token until it returns false.
+    // enumerate calls the Enum* method with the enumerator, the token buffer, its size and the count it fills in.  metaData is the
+    // interface the enumerator is closed with.  Returns true if visit stopped the enumeration.
+    template <typename Token, typename MetaData, typename Enumerate, typename Visit>
+    bool EnumerateTokens(const CComPtr<MetaData>& metaData, Enumerate enumerate, Visit visit)
+    {
+        HCORENUM enumerator = nullptr;
+        OnDestruction enumerationCloser([&] { if (enumerator) metaData->CloseEnum(enumerator); });
+        Token tokens[METADATA_ENUM_BATCH_SIZE];
+        ULONG count = 0;
+        while (SUCCEEDED(enumerate(&enumerator, tokens, METADATA_ENUM_BATCH_SIZE, &count)) && count != 0)
+        {
+            for (ULONG i = 0; i < count; ++i)
+            {
+                if (!visit(tokens[i]))
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+}}
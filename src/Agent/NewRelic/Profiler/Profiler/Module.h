@@ -8,6 +8,7 @@
 #include "../Common/OnDestruction.h"
 #include "../ModuleInjector/IModule.h"
 #include "CorTokenizer.h"
+#include "MetaDataEnumeration.h"
 #include "Win32Helpers.h"
 
 namespace NewRelic { namespace Profiler
@@ -213,28 +214,27 @@ namespace NewRelic { namespace Profiler
             _hasRefNetStandard = false;
             _hasRefSysRuntime = false;
 
-            HCORENUM enumerator = nullptr;
-            mdAssemblyRef assemblyToken;
-            ULONG assembliesFound = 0;
-            OnDestruction enumerationCloser([&] { _metaDataAssemblyImport->CloseEnum(enumerator); });
-            while (SUCCEEDED(_metaDataAssemblyImport->EnumAssemblyRefs(&enumerator, &assemblyToken, 1, &assembliesFound)) && assembliesFound > 0)
-            {
-                auto foundAssemblyName = GetAssemblyName(assemblyToken);
-
-                if (Strings::EndsWith(foundAssemblyName, L"mscorlib"))
-                {
-                    _hasRefMscorlib = true;
-                    _mscorlibAssemblyRefToken = assemblyToken;
-                }
-                else if (Strings::EndsWith(foundAssemblyName, L"netstandard"s))
-                {
-                    _hasRefNetStandard = true;
-                }
-                else if (Strings::EndsWith(foundAssemblyName, L"System.Runtime"s))
+            EnumerateTokens<mdAssemblyRef>(_metaDataAssemblyImport,
+                [&](HCORENUM* enumerator, mdAssemblyRef* tokens, ULONG size, ULONG* count) { return _metaDataAssemblyImport->EnumAssemblyRefs(enumerator, tokens, size, count); },
+                [&](mdAssemblyRef assemblyToken)
                 {
-                    _hasRefSysRuntime = true;
-                }
-            }
+                    auto foundAssemblyName = GetAssemblyName(assemblyToken);
+
+                    if (Strings::EndsWith(foundAssemblyName, L"mscorlib"))
+                    {
+                        _hasRefMscorlib = true;
+                        _mscorlibAssemblyRefToken = assemblyToken;
+                    }
+                    else if (Strings::EndsWith(foundAssemblyName, L"netstandard"s))
+                    {
+                        _hasRefNetStandard = true;
+                    }
+                    else if (Strings::EndsWith(foundAssemblyName, L"System.Runtime"s))
+                    {
+                        _hasRefSysRuntime = true;
+                    }
+                    return true;
+                });
         }
 
         void CheckIfThisIsAFrameworkAssembly()
@@ -245,17 +245,21 @@ namespace NewRelic { namespace Profiler
 
         mdAssemblyRef GetAssemblyReference(const std::wstring& assemblyName)
         {
-            HCORENUM enumerator = nullptr;
-            mdAssemblyRef assemblyToken;
-            ULONG assembliesFound = 0;
-            OnDestruction enumerationCloser([&] { _metaDataAssemblyImport->CloseEnum(enumerator); });
-            while (SUCCEEDED(_metaDataAssemblyImport->EnumAssemblyRefs(&enumerator, &assemblyToken, 1, &assembliesFound)) && assembliesFound > 0)
-            {
-                auto foundAssemblyName = GetAssemblyName(assemblyToken);
-                if (Strings::EndsWith(foundAssemblyName, assemblyName))
+            mdAssemblyRef foundToken = mdAssemblyRefNil;
+            EnumerateTokens<mdAssemblyRef>(_metaDataAssemblyImport,
+                [&](HCORENUM* enumerator, mdAssemblyRef* tokens, ULONG size, ULONG* count) { return _metaDataAssemblyImport->EnumAssemblyRefs(enumerator, tokens, size, count); },
+                [&](mdAssemblyRef assemblyToken)
                 {
-                    return assemblyToken;
-                }
+                    if (!Strings::EndsWith(GetAssemblyName(assemblyToken), assemblyName))
+                    {
+                        return true;
+                    }
+                    foundToken = assemblyToken;
+                    return false;
+                });
+            if (foundToken != mdAssemblyRefNil)
+            {
+                return foundToken;
             }
 
             auto moduleName = GetModuleName();
@@ -0,0 +1,244 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <corprof.h>
+#include "../Configuration/TracerFlags.h"
+#include "../Logging/Logger.h"
+#include "MetaDataEnumeration.h"
+#include "Win32Helpers.h"
+
+namespace NewRelic { namespace Profiler
+{
+    // The methods of one module that carry the TransactionAttribute, TraceAttribute or AsyncStateMachineAttribute, found with a
+    // single pass over the module's CustomAttribute table.  Answers the same questions as GetCustomAttributeByName with a hash
+    // lookup, and without even that for the (common) module that has none of those attributes.  Immutable once built.
+    class ModuleAttributeIndex
+    {
+    public:
+        // Returns nullptr if the CustomAttribute table could not be read, in which case the attributes have to be looked up
+        // method by method.
+        static std::shared_ptr<const ModuleAttributeIndex> Build(CComPtr<IMetaDataImport2> metaDataImport)
+        {
+            auto index = std::make_shared<ModuleAttributeIndex>();
+            // each attribute constructor is resolved to its type name once, however many methods it is applied to
+            std::unordered_map<mdToken, uint32_t> constructorFlags;
+
+            bool failed = false;
+            // a scope of 0 enumerates every custom attribute in the module
+            EnumerateTokens<mdCustomAttribute>(metaDataImport,
+                [&](HCORENUM* enumerator, mdCustomAttribute* tokens, ULONG size, ULONG* count) { return metaDataImport->EnumCustomAttributes(enumerator, 0, 0, tokens, size, count); },
+                [&](mdCustomAttribute customAttribute)
+                {
+                    mdToken owner = mdTokenNil;
+                    mdToken constructor = mdTokenNil;
+                    const BYTE* value = nullptr;
+                    ULONG valueLength = 0;
+                    if (FAILED(metaDataImport->GetCustomAttributeProps(customAttribute, &owner, &constructor, (const void**)&value, &valueLength)))
+                    {
+                        failed = true;
+                        return false;
+                    }
+                    if ((owner & 0xff000000) != CorTokenType::mdtMethodDef)
+                    {
+                        return true;
+                    }
+
+                    auto flags = constructorFlags.find(constructor);
+                    if (flags == constructorFlags.end())
+                    {
+                        flags = constructorFlags.emplace(constructor, GetAttributeFlags(metaDataImport, constructor)).first;
+                    }
+                    if (flags->second == 0)
+                    {
+                        return true;
+                    }
+
+                    auto methodFlags = flags->second;
+                    //  The TransactionAttribute's value is 11 bytes when it has a "Web" property, and its last byte is that boolean.
+                    //  See HasTransactionOrTraceAttribute in Function.h.
+                    if ((methodFlags & Configuration::TracerFlags::OtherTransaction) && valueLength == 11 && value[10] == 1)
+                    {
+                        methodFlags = (methodFlags & ~Configuration::TracerFlags::OtherTransaction) | Configuration::TracerFlags::WebTransaction;
+                    }
+                    index->_methods[owner] |= methodFlags;
+                    return true;
+                });
+
+            if (failed)
+            {
+                return nullptr;
+            }
+            return index;
+        }
+
+        // Same result as Function::HasTransactionOrTraceAttribute.
+        bool HasTransactionOrTraceAttribute(mdMethodDef method, uint32_t& tracerFlags) const
+        {
+            auto flags = GetFlags(method);
+            if (flags & (Configuration::TracerFlags::OtherTransaction | Configuration::TracerFlags::WebTransaction))
+            {
+                // a TransactionAttribute takes precedence over a TraceAttribute on the same method
+                tracerFlags |= flags & (Configuration::TracerFlags::OtherTransaction | Configuration::TracerFlags::WebTransaction);
+                return true;
+            }
+            return (flags & Configuration::TracerFlags::AttributeInstrumentation) != 0;
+        }
+
+        bool HasAsyncStateMachineAttribute(mdMethodDef method) const
+        {
+            return (GetFlags(method) & Configuration::TracerFlags::AsyncMethod) != 0;
+        }
+
+        size_t GetMethodCount() const
+        {
+            return _methods.size();
+        }
+
+    private:
+        // Per method, the TracerFlags of its attributes: OtherTransaction or WebTransaction for a TransactionAttribute,
+        // AttributeInstrumentation for a TraceAttribute and AsyncMethod for an AsyncStateMachineAttribute.
+        std::unordered_map<mdMethodDef, uint32_t> _methods;
+
+        uint32_t GetFlags(mdMethodDef method) const
+        {
+            if (_methods.empty())
+            {
+                return 0;
+            }
+            auto flags = _methods.find(method);
+            return flags == _methods.end() ? 0 : flags->second;
+        }
+
+        // The flags for an attribute given the token of its constructor, 0 if the attribute is none of ours.
+        static uint32_t GetAttributeFlags(CComPtr<IMetaDataImport2> metaDataImport, mdToken constructor)
+        {
+            mdToken type = mdTokenNil;
+            HRESULT result = E_FAIL;
+            switch (constructor & 0xff000000)
+            {
+                case CorTokenType::mdtMemberRef:
+                    result = metaDataImport->GetMemberRefProps(constructor, &type, nullptr, 0, nullptr, nullptr, nullptr);
+                    break;
+                case CorTokenType::mdtMethodDef:
+                    result = metaDataImport->GetMethodProps(constructor, &type, nullptr, 0, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+                    break;
+            }
+            if (FAILED(result))
+            {
+                return 0;
+            }
+
+            // a name too long for the buffer can't be one of ours, and comes back as a truncation warning rather than S_OK
+            WCHAR typeName[MAX_CLASS_NAME];
+            switch (type & 0xff000000)
+            {
+                case CorTokenType::mdtTypeRef:
+                    result = metaDataImport->GetTypeRefProps(type, nullptr, typeName, MAX_CLASS_NAME, nullptr);
+                    break;
+                case CorTokenType::mdtTypeDef:
+                    result = metaDataImport->GetTypeDefProps(type, typeName, MAX_CLASS_NAME, nullptr, nullptr, nullptr);
+                    break;
+                default:
+                    // generic attributes are TypeSpecs, and none of ours are generic
+                    result = E_FAIL;
+                    break;
+            }
+            if (result != S_OK)
+            {
+                return 0;
+            }
+
+            auto name = ToStdWString(typeName);
+            if (name == _X("NewRelic.Api.Agent.TransactionAttribute"))
+            {
+                return Configuration::TracerFlags::OtherTransaction;
+            }
+            if (name == _X("NewRelic.Api.Agent.TraceAttribute"))
+            {
+                return Configuration::TracerFlags::AttributeInstrumentation;
+            }
+            if (name == _X("System.Runtime.CompilerServices.AsyncStateMachineAttribute"))
+            {
+                return Configuration::TracerFlags::AsyncMethod;
+            }
+            return 0;
+        }
+    };
+    typedef std::shared_ptr<const ModuleAttributeIndex> ModuleAttributeIndexPtr;
+
+    // The ModuleAttributeIndex of every module a method has been JIT compiled in, built the first time it is needed.  Safe to use
+    // from any thread.  Dynamic modules are never indexed since methods and attributes can be added to them after the index is built.
+    class ModuleAttributeIndexCache
+    {
+    public:
+        ModuleAttributeIndexCache(CComPtr<ICorProfilerInfo4> profilerInfo) :
+            _profilerInfo(profilerInfo)
+        {}
+
+        // Returns nullptr if the module's attributes have to be looked up method by method.
+        ModuleAttributeIndexPtr Get(ModuleID moduleId, CComPtr<IMetaDataImport2> metaDataImport)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto index = _indexes.find(moduleId);
+                if (index != _indexes.end())
+                {
+                    return index->second;
+                }
+            }
+
+            // built outside the lock so that JIT compilation in other modules doesn't wait on it; if two threads race to build the
+            // same index the first one stored wins
+            ModuleAttributeIndexPtr index;
+            DWORD moduleFlags = 0;
+            if (SUCCEEDED(_profilerInfo->GetModuleInfo2(moduleId, nullptr, 0, nullptr, nullptr, nullptr, &moduleFlags)) && !(moduleFlags & COR_PRF_MODULE_DYNAMIC))
+            {
+                index = ModuleAttributeIndex::Build(metaDataImport);
+                if (index != nullptr)
+                {
+                    LogTrace(L"Indexed ", index->GetMethodCount(), L" attributed methods in module ", moduleId);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _indexes.emplace(moduleId, index).first->second;
+        }
+
+        // As above, fetching the module's metadata if the index hasn't been built yet.
+        ModuleAttributeIndexPtr Get(ModuleID moduleId)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto index = _indexes.find(moduleId);
+                if (index != _indexes.end())
+                {
+                    return index->second;
+                }
+            }
+
+            CComPtr<IMetaDataImport2> metaDataImport;
+            if (FAILED(_profilerInfo->GetModuleMetaData(moduleId, ofRead, IID_IMetaDataImport2, (IUnknown**)&metaDataImport)) || metaDataImport == nullptr)
+            {
+                return nullptr;
+            }
+            return Get(moduleId, metaDataImport);
+        }
+
+        // Module ids are reused once a module is unloaded.
+        void Remove(ModuleID moduleId)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _indexes.erase(moduleId);
+        }
+
+    private:
+        CComPtr<ICorProfilerInfo4> _profilerInfo;
+        std::mutex _mutex;
+        std::unordered_map<ModuleID, ModuleAttributeIndexPtr> _indexes;
+    };
+    typedef std::shared_ptr<ModuleAttributeIndexCache> ModuleAttributeIndexCachePtr;
+}}
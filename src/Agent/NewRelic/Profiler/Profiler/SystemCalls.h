@@ -87,6 +87,27 @@ namespace NewRelic { namespace Profiler
             return moduleName;
         }
 
+        virtual std::unique_ptr<xstring_t> GetProfilerModulePath() override
+        {
+            // any address inside this module finds it
+            static const char marker = 0;
+            HMODULE module = nullptr;
+            if (!::GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT, reinterpret_cast<LPCWSTR>(&marker), &module))
+            {
+                return nullptr;
+            }
+
+            const int MAX_MODULE_PATH = 1024;
+            wchar_t moduleName[MAX_MODULE_PATH];
+            auto result = ::GetModuleFileNameW(module, moduleName, MAX_MODULE_PATH);
+            if (result == 0 || result == MAX_MODULE_PATH)
+            {
+                return nullptr;
+            }
+
+            return std::unique_ptr<xstring_t>(new xstring_t(moduleName));
+        }
+
         virtual xstring_t GetParentProcessPath()
         {
             const int MAX_PROCESS_PATH = 1024;
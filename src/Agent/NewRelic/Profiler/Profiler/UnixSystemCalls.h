@@ -17,6 +17,7 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <dirent.h>
+#include <dlfcn.h>
 #include <libgen.h>
 #include <codecvt>
 #include <locale>
@@ -118,6 +119,19 @@ namespace NewRelic { namespace Profiler
             return _X(".");
         }
 
+        virtual std::unique_ptr<xstring_t> GetProfilerModulePath() override
+        {
+            // any address inside this module finds it
+            static const char marker = 0;
+            Dl_info info;
+            if (dladdr(&marker, &info) == 0 || info.dli_fname == nullptr)
+            {
+                return nullptr;
+            }
+
+            return std::unique_ptr<xstring_t>(new xstring_t(ToWideString(const_cast<char*>(info.dli_fname))));
+        }
+
         virtual xstring_t GetParentProcessPath()
         {
             return _X(".");
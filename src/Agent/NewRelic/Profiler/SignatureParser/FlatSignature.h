@@ -0,0 +1,612 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "../Common/CorStandIn.h"
+#include "../Common/Macros.h"
+#include "../Common/xplat.h"
+#include "ITokenResolver.h"
+
+namespace NewRelic { namespace Profiler { namespace SignatureParser
+{
+    // A method signature parsed with the same grammar as SignatureParser, but into a single array of nodes rather than a tree of
+    // shared_ptr Types.  The nodes are in prefix order: a node is followed by its children, and spans the nodes of its whole
+    // subtree so that its next sibling is found by skipping over them.  Parsing again reuses the arrays, formatting and encoding
+    // append to buffers the caller owns, and nothing is reference counted, which makes it cheap enough to use for every method
+    // that is matched against the instrumentation.  ToString and AppendBytes give exactly what MethodSignature's ToString and
+    // ToBytes do.
+    class FlatSignature
+    {
+    public:
+        enum : uint8_t
+        {
+            // the node of a method signature (the root, and the child of a function pointer), which isn't an ELEMENT_TYPE
+            METHOD = 0xff
+        };
+
+        struct Node
+        {
+            // an ELEMENT_TYPE or METHOD; VOID, TYPEDBYREF and SENTINEL are only the return type or a parameter (or what a PTR
+            // points to, for VOID)
+            uint8_t _elementType;
+            // the return type or a parameter is passed by reference
+            bool _isByRef;
+            // the first byte of a METHOD
+            uint8_t _callingConvention;
+            // the type token of a CLASS or VALUETYPE, the number of a VAR or MVAR, the rank of an ARRAY, the argument count of a
+            // GENERICINST or the parameter count of a METHOD
+            uint32_t _value;
+            // where the sizes of an ARRAY start in _shapes, or the generic parameter count of a METHOD
+            uint32_t _extra;
+            // the nodes in this node's subtree, itself included
+            uint32_t _extent;
+        };
+
+        // false if the signature isn't well formed.  Whatever was parsed before is discarded, but the storage is kept.
+        bool TryParse(const ByteVector& signature)
+        {
+            _nodes.clear();
+            _shapes.clear();
+            auto current = signature.data();
+            return TryParseMethod(current, signature.data() + signature.size());
+        }
+
+        // The parameters as MethodSignature::ToString formats them, appended to parameters.
+        void AppendParameters(ITokenResolver& tokenResolver, xstring_t& parameters) const
+        {
+            AppendMethodParameters(0, tokenResolver, parameters);
+        }
+
+        xstring_t ToString(ITokenResolver& tokenResolver) const
+        {
+            xstring_t parameters;
+            AppendParameters(tokenResolver, parameters);
+            return parameters;
+        }
+
+        // The signature as MethodSignature::ToBytes encodes it, appended to bytes.  Like it, this drops custom modifiers.
+        void AppendBytes(ByteVector& bytes) const
+        {
+            AppendNodeBytes(0, bytes);
+        }
+
+        // Structural comparison, without formatting or encoding either signature.
+        bool Equals(const FlatSignature& other) const
+        {
+            if (_nodes.size() != other._nodes.size())
+            {
+                return false;
+            }
+            for (size_t i = 0; i < _nodes.size(); ++i)
+            {
+                auto& node = _nodes[i];
+                auto& otherNode = other._nodes[i];
+                if (node._elementType != otherNode._elementType || node._isByRef != otherNode._isByRef || node._callingConvention != otherNode._callingConvention ||
+                    node._value != otherNode._value || node._extent != otherNode._extent)
+                {
+                    return false;
+                }
+                if (node._elementType == METHOD && node._extra != otherNode._extra)
+                {
+                    return false;
+                }
+                if (node._elementType == ELEMENT_TYPE_ARRAY && GetShapeLength(node) != other.GetShapeLength(otherNode))
+                {
+                    return false;
+                }
+                if (node._elementType == ELEMENT_TYPE_ARRAY && !std::equal(_shapes.begin() + node._extra, _shapes.begin() + node._extra + GetShapeLength(node), other._shapes.begin() + otherNode._extra))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        std::vector<Node> _nodes;
+        // for each ARRAY, its size count, sizes, lower bound count and lower bounds
+        std::vector<uint32_t> _shapes;
+
+        uint32_t AddNode(uint8_t elementType)
+        {
+            _nodes.push_back({ elementType, false, 0, 0, 0, 1 });
+            return uint32_t(_nodes.size() - 1);
+        }
+
+        // called once all of a node's children have been added
+        void CloseNode(uint32_t index)
+        {
+            _nodes[index]._extent = uint32_t(_nodes.size() - index);
+        }
+
+        uint32_t GetShapeLength(const Node& array) const
+        {
+            auto sizeCount = _shapes[array._extra];
+            return 2 + sizeCount + _shapes[array._extra + 1 + sizeCount];
+        }
+
+        bool TryParseMethod(const uint8_t*& current, const uint8_t* end)
+        {
+            if (current == end)
+            {
+                return false;
+            }
+            auto index = AddNode(METHOD);
+            auto firstByte = *current++;
+            uint32_t genericParamCount = 0;
+            if ((firstByte & CorCallingConvention::IMAGE_CEE_CS_CALLCONV_GENERIC) && !TryUncompressData(current, end, genericParamCount))
+            {
+                return false;
+            }
+            uint32_t paramCount = 0;
+            if (!TryUncompressData(current, end, paramCount))
+            {
+                return false;
+            }
+            _nodes[index]._callingConvention = firstByte;
+            _nodes[index]._value = paramCount;
+            _nodes[index]._extra = genericParamCount;
+
+            if (!TryParseReturnType(current, end))
+            {
+                return false;
+            }
+            for (uint32_t i = 0; i < paramCount; ++i)
+            {
+                if (!TryParseParameter(current, end))
+                {
+                    return false;
+                }
+            }
+            CloseNode(index);
+            return true;
+        }
+
+        bool TryParseReturnType(const uint8_t*& current, const uint8_t* end)
+        {
+            if (!TrySkipCustomMods(current, end) || current == end)
+            {
+                return false;
+            }
+            if (*current == ELEMENT_TYPE_VOID || *current == ELEMENT_TYPE_TYPEDBYREF)
+            {
+                AddNode(*current++);
+                return true;
+            }
+            return TryParseByRefAndType(current, end);
+        }
+
+        bool TryParseParameter(const uint8_t*& current, const uint8_t* end)
+        {
+            if (!TrySkipCustomMods(current, end) || current == end)
+            {
+                return false;
+            }
+            if (*current == ELEMENT_TYPE_TYPEDBYREF || *current == ELEMENT_TYPE_SENTINEL)
+            {
+                AddNode(*current++);
+                return true;
+            }
+            return TryParseByRefAndType(current, end);
+        }
+
+        bool TryParseByRefAndType(const uint8_t*& current, const uint8_t* end)
+        {
+            bool isByRef = *current == ELEMENT_TYPE_BYREF;
+            if (isByRef)
+            {
+                ++current;
+            }
+            auto index = uint32_t(_nodes.size());
+            if (!TryParseType(current, end))
+            {
+                return false;
+            }
+            _nodes[index]._isByRef = isByRef;
+            return true;
+        }
+
+        bool TryParseType(const uint8_t*& current, const uint8_t* end)
+        {
+            // see SignatureParser::ParseType for why custom modifiers can come before any type
+            if (!TrySkipCustomMods(current, end) || current == end)
+            {
+                return false;
+            }
+
+            auto elementType = *current++;
+            auto index = AddNode(elementType);
+            uint32_t value = 0;
+            switch (elementType)
+            {
+                case ELEMENT_TYPE_BOOLEAN:
+                case ELEMENT_TYPE_CHAR:
+                case ELEMENT_TYPE_I1:
+                case ELEMENT_TYPE_U1:
+                case ELEMENT_TYPE_I2:
+                case ELEMENT_TYPE_U2:
+                case ELEMENT_TYPE_I4:
+                case ELEMENT_TYPE_U4:
+                case ELEMENT_TYPE_I8:
+                case ELEMENT_TYPE_U8:
+                case ELEMENT_TYPE_R4:
+                case ELEMENT_TYPE_R8:
+                case ELEMENT_TYPE_I:
+                case ELEMENT_TYPE_U:
+                case ELEMENT_TYPE_OBJECT:
+                case ELEMENT_TYPE_STRING:
+                    break;
+                case ELEMENT_TYPE_ARRAY:
+                {
+                    if (!TryParseType(current, end) || !TryUncompressData(current, end, value))
+                    {
+                        return false;
+                    }
+                    _nodes[index]._extra = uint32_t(_shapes.size());
+                    // the sizes, then the lower bounds, each preceded by their count
+                    for (int list = 0; list < 2; ++list)
+                    {
+                        uint32_t count = 0;
+                        if (!TryUncompressData(current, end, count))
+                        {
+                            return false;
+                        }
+                        _shapes.push_back(count);
+                        for (uint32_t i = 0; i < count; ++i)
+                        {
+                            uint32_t bound = 0;
+                            if (!TryUncompressData(current, end, bound))
+                            {
+                                return false;
+                            }
+                            _shapes.push_back(bound);
+                        }
+                    }
+                    break;
+                }
+                case ELEMENT_TYPE_CLASS:
+                case ELEMENT_TYPE_VALUETYPE:
+                    if (!TryUncompressToken(current, end, value))
+                    {
+                        return false;
+                    }
+                    break;
+                case ELEMENT_TYPE_FNPTR:
+                    if (!TryParseMethod(current, end))
+                    {
+                        return false;
+                    }
+                    break;
+                case ELEMENT_TYPE_GENERICINST:
+                {
+                    if (!TryParseType(current, end) || !TryUncompressData(current, end, value))
+                    {
+                        return false;
+                    }
+                    for (uint32_t i = 0; i < value; ++i)
+                    {
+                        if (!TryParseType(current, end))
+                        {
+                            return false;
+                        }
+                    }
+                    break;
+                }
+                case ELEMENT_TYPE_MVAR:
+                case ELEMENT_TYPE_VAR:
+                    if (!TryUncompressData(current, end, value))
+                    {
+                        return false;
+                    }
+                    break;
+                case ELEMENT_TYPE_PTR:
+                    if (!TrySkipCustomMods(current, end) || current == end)
+                    {
+                        return false;
+                    }
+                    if (*current == ELEMENT_TYPE_VOID)
+                    {
+                        AddNode(*current++);
+                    }
+                    else if (!TryParseType(current, end))
+                    {
+                        return false;
+                    }
+                    break;
+                case ELEMENT_TYPE_SZARRAY:
+                    if (!TryParseType(current, end))
+                    {
+                        return false;
+                    }
+                    break;
+                default:
+                    return false;
+            }
+            _nodes[index]._value = value;
+            CloseNode(index);
+            return true;
+        }
+
+        static bool TrySkipCustomMods(const uint8_t*& current, const uint8_t* end)
+        {
+            while (current != end && (*current == ELEMENT_TYPE_CMOD_OPT || *current == ELEMENT_TYPE_CMOD_REQD))
+            {
+                ++current;
+                uint32_t token = 0;
+                if (!TryUncompressToken(current, end, token))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // ECMA-335 II.23.2, 1, 2 or 4 bytes depending on the high bits of the first
+        static bool TryUncompressData(const uint8_t*& current, const uint8_t* end, uint32_t& value)
+        {
+            if (current == end)
+            {
+                return false;
+            }
+            auto first = *current;
+            size_t length = (first & 0x80) == 0 ? 1 : (first & 0xc0) == 0x80 ? 2 : (first & 0xe0) == 0xc0 ? 4 : 0;
+            if (length == 0 || size_t(end - current) < length)
+            {
+                return false;
+            }
+            value = length == 1 ? first : length == 2 ? (first & 0x3f) : (first & 0x1f);
+            for (size_t i = 1; i < length; ++i)
+            {
+                value = (value << 8) | current[i];
+            }
+            current += length;
+            return true;
+        }
+
+        // a TypeDefOrRefOrSpecEncoded token, the table in the low 2 bits
+        static bool TryUncompressToken(const uint8_t*& current, const uint8_t* end, uint32_t& token)
+        {
+            uint32_t data = 0;
+            if (!TryUncompressData(current, end, data))
+            {
+                return false;
+            }
+            static const uint32_t tables[] = { 0x02000000, 0x01000000, 0x1b000000, 0x72000000 };
+            token = tables[data & 0x3] | (data >> 2);
+            return true;
+        }
+
+        void AppendMethodParameters(uint32_t method, ITokenResolver& tokenResolver, xstring_t& out) const
+        {
+            // the first child is the return type
+            auto child = method + 1;
+            child += _nodes[child]._extent;
+            for (uint32_t i = 0; i < _nodes[method]._value; ++i)
+            {
+                if (i != 0)
+                {
+                    out.push_back(',');
+                }
+                AppendNodeString(child, tokenResolver, out);
+                child += _nodes[child]._extent;
+            }
+        }
+
+        void AppendNodeString(uint32_t index, ITokenResolver& tokenResolver, xstring_t& out) const
+        {
+            auto& node = _nodes[index];
+            switch (node._elementType)
+            {
+                case ELEMENT_TYPE_BOOLEAN: out += _X("System.Boolean"); break;
+                case ELEMENT_TYPE_CHAR: out += _X("System.Char"); break;
+                case ELEMENT_TYPE_I1: out += _X("System.SByte"); break;
+                case ELEMENT_TYPE_U1: out += _X("System.Byte"); break;
+                case ELEMENT_TYPE_I2: out += _X("System.Int16"); break;
+                case ELEMENT_TYPE_U2: out += _X("System.UInt16"); break;
+                case ELEMENT_TYPE_I4: out += _X("System.Int32"); break;
+                case ELEMENT_TYPE_U4: out += _X("System.UInt32"); break;
+                case ELEMENT_TYPE_I8: out += _X("System.Int64"); break;
+                case ELEMENT_TYPE_U8: out += _X("System.UInt64"); break;
+                case ELEMENT_TYPE_R4: out += _X("System.Single"); break;
+                case ELEMENT_TYPE_R8: out += _X("System.Double"); break;
+                case ELEMENT_TYPE_I: out += _X("System.IntPtr"); break;
+                case ELEMENT_TYPE_U: out += _X("System.UIntPtr"); break;
+                case ELEMENT_TYPE_OBJECT: out += _X("System.Object"); break;
+                case ELEMENT_TYPE_STRING: out += _X("System.String"); break;
+                case ELEMENT_TYPE_VOID: out += _X("void"); break;
+                case ELEMENT_TYPE_TYPEDBYREF: out += _X("System.TypedReference"); break;
+                case ELEMENT_TYPE_SENTINEL: out += _X("..."); break;
+                case ELEMENT_TYPE_CLASS:
+                case ELEMENT_TYPE_VALUETYPE:
+                    out += tokenResolver.GetTypeStringsFromTypeDefOrRefOrSpecToken(node._value);
+                    break;
+                case ELEMENT_TYPE_MVAR:
+                    out += _X("!!");
+                    AppendNumber(node._value, out);
+                    break;
+                case ELEMENT_TYPE_VAR:
+                    out.push_back('!');
+                    AppendNumber(node._value, out);
+                    break;
+                case ELEMENT_TYPE_PTR:
+                    // a void* is a PTR to VOID
+                    AppendNodeString(index + 1, tokenResolver, out);
+                    out.push_back('*');
+                    break;
+                case ELEMENT_TYPE_SZARRAY:
+                    AppendNodeString(index + 1, tokenResolver, out);
+                    out += _X("[]");
+                    break;
+                case ELEMENT_TYPE_FNPTR:
+                    out.push_back('(');
+                    AppendNodeString(index + 2, tokenResolver, out);
+                    out += _X(")(");
+                    AppendMethodParameters(index + 1, tokenResolver, out);
+                    out.push_back(')');
+                    break;
+                case ELEMENT_TYPE_GENERICINST:
+                {
+                    AppendNodeString(index + 1, tokenResolver, out);
+                    out.push_back('[');
+                    auto argument = index + 1 + _nodes[index + 1]._extent;
+                    for (uint32_t i = 0; i < node._value; ++i)
+                    {
+                        if (i != 0)
+                        {
+                            out.push_back(',');
+                        }
+                        AppendNodeString(argument, tokenResolver, out);
+                        argument += _nodes[argument]._extent;
+                    }
+                    out.push_back(']');
+                    break;
+                }
+                case ELEMENT_TYPE_ARRAY:
+                {
+                    AppendNodeString(index + 1, tokenResolver, out);
+                    out.push_back('[');
+                    auto sizes = &_shapes[node._extra];
+                    auto lowerBounds = sizes + 1 + sizes[0];
+                    for (uint32_t i = 0; i < node._value; ++i)
+                    {
+                        if (i != 0)
+                        {
+                            out.push_back(',');
+                        }
+                        if (sizes[0] <= i)
+                        {
+                            continue;
+                        }
+                        // unsigned arithmetic, as ArrayType::ToString does it
+                        auto size = sizes[1 + i];
+                        auto lowerBound = lowerBounds[0] <= i ? 0 : lowerBounds[1 + i];
+                        AppendNumber(lowerBound, out);
+                        out += _X("...");
+                        AppendNumber(lowerBound + size - 1, out);
+                    }
+                    out.push_back(']');
+                    break;
+                }
+            }
+            if (node._isByRef)
+            {
+                out.push_back('&');
+            }
+        }
+
+        static void AppendNumber(uint32_t number, xstring_t& out)
+        {
+            xchar_t digits[10];
+            size_t count = 0;
+            do
+            {
+                digits[count++] = xchar_t('0' + number % 10);
+                number /= 10;
+            } while (number != 0);
+            while (count != 0)
+            {
+                out.push_back(digits[--count]);
+            }
+        }
+
+        void AppendNodeBytes(uint32_t index, ByteVector& bytes) const
+        {
+            auto& node = _nodes[index];
+            if (node._elementType == METHOD)
+            {
+                // MethodSignature keeps the HASTHIS, EXPLICITTHIS and GENERIC bits and the calling convention kind
+                auto firstByte = uint8_t(node._callingConvention & 0x7f);
+                bytes.push_back(firstByte);
+                if ((firstByte & (CorCallingConvention::IMAGE_CEE_CS_CALLCONV_MASK | CorCallingConvention::IMAGE_CEE_CS_CALLCONV_GENERIC)) == CorCallingConvention::IMAGE_CEE_CS_CALLCONV_GENERIC)
+                {
+                    AppendCompressed(node._extra, bytes);
+                }
+                AppendCompressed(node._value, bytes);
+                for (auto child = index + 1; child < index + node._extent; child += _nodes[child]._extent)
+                {
+                    AppendNodeBytes(child, bytes);
+                }
+                return;
+            }
+
+            if (node._isByRef)
+            {
+                bytes.push_back(ELEMENT_TYPE_BYREF);
+            }
+            bytes.push_back(node._elementType);
+            switch (node._elementType)
+            {
+                case ELEMENT_TYPE_CLASS:
+                case ELEMENT_TYPE_VALUETYPE:
+                    AppendCompressedToken(node._value, bytes);
+                    break;
+                case ELEMENT_TYPE_MVAR:
+                case ELEMENT_TYPE_VAR:
+                    AppendCompressed(node._value, bytes);
+                    break;
+                case ELEMENT_TYPE_PTR:
+                case ELEMENT_TYPE_SZARRAY:
+                case ELEMENT_TYPE_FNPTR:
+                    AppendNodeBytes(index + 1, bytes);
+                    break;
+                case ELEMENT_TYPE_GENERICINST:
+                {
+                    AppendNodeBytes(index + 1, bytes);
+                    AppendCompressed(node._value, bytes);
+                    for (auto argument = index + 1 + _nodes[index + 1]._extent; argument < index + node._extent; argument += _nodes[argument]._extent)
+                    {
+                        AppendNodeBytes(argument, bytes);
+                    }
+                    break;
+                }
+                case ELEMENT_TYPE_ARRAY:
+                {
+                    AppendNodeBytes(index + 1, bytes);
+                    AppendCompressed(node._value, bytes);
+                    for (auto shape = node._extra; shape < node._extra + GetShapeLength(node); ++shape)
+                    {
+                        AppendCompressed(_shapes[shape], bytes);
+                    }
+                    break;
+                }
+            }
+        }
+
+        // values only ever come from TryUncompressData, so they always fit
+        static void AppendCompressed(uint32_t value, ByteVector& bytes)
+        {
+            if (value <= 0x7f)
+            {
+                bytes.push_back(uint8_t(value));
+            }
+            else if (value <= 0x3fff)
+            {
+                bytes.push_back(uint8_t((value >> 8) | 0x80));
+                bytes.push_back(uint8_t(value));
+            }
+            else
+            {
+                bytes.push_back(uint8_t((value >> 24) | 0xc0));
+                bytes.push_back(uint8_t(value >> 16));
+                bytes.push_back(uint8_t(value >> 8));
+                bytes.push_back(uint8_t(value));
+            }
+        }
+
+        static void AppendCompressedToken(uint32_t token, ByteVector& bytes)
+        {
+            uint32_t table = 0;
+            switch (token >> 24)
+            {
+                case 0x01: table = 0x1; break;
+                case 0x1b: table = 0x2; break;
+                case 0x72: table = 0x3; break;
+            }
+            AppendCompressed(((token & 0x00ffffff) << 2) | table, bytes);
+        }
+    };
+}}}
@@ -0,0 +1,185 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <CppUnitTest.h>
+#include <chrono>
+#include <sstream>
+#include "UnreferencedFunctions.h"
+#include "TestTemplates.h"
+#include "ByteVectorMacro.h"
+#include "../SignatureParser/FlatSignature.h"
+#include "../SignatureParser/SignatureParser.h"
+#include "MockTokenResolver.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic { namespace Profiler { namespace SignatureParser { namespace Test
+{
+    TEST_CLASS(FlatSignatureTest)
+    {
+    public:
+        TEST_METHOD(strings_and_bytes_match_the_tree)
+        {
+            auto tokenResolver = std::make_shared<MockTokenResolver>();
+            for (auto& signature : GetCorpus())
+            {
+                auto tree = SignatureParser::ParseMethodSignature(signature.begin(), signature.end());
+                FlatSignature flat;
+                Assert::IsTrue(flat.TryParse(signature));
+
+                Assert::AreEqual(tree->ToString(tokenResolver), flat.ToString(*tokenResolver));
+                ByteVector bytes;
+                flat.AppendBytes(bytes);
+                Assert::AreEqual(*tree->ToBytes(), bytes);
+            }
+        }
+
+        TEST_METHOD(parameters_are_appended_to_the_string)
+        {
+            BYTEVECTOR(signature,
+                0x20, // has this
+                0x03, // 3 parameters
+                0x01, // void return type
+                ELEMENT_TYPE_I4,
+                ELEMENT_TYPE_BYREF, ELEMENT_TYPE_STRING,
+                ELEMENT_TYPE_SZARRAY, ELEMENT_TYPE_MVAR, 0x00
+            );
+            FlatSignature flat;
+            Assert::IsTrue(flat.TryParse(signature));
+
+            MockTokenResolver tokenResolver;
+            xstring_t parameters(_X("Method("));
+            flat.AppendParameters(tokenResolver, parameters);
+            Assert::AreEqual(xstring_t(_X("Method(System.Int32,System.String&,!!0[]")), parameters);
+        }
+
+        TEST_METHOD(reparsing_replaces_the_previous_signature)
+        {
+            auto& corpus = GetCorpus();
+            FlatSignature flat;
+            Assert::IsTrue(flat.TryParse(corpus[2]));
+            Assert::IsTrue(flat.TryParse(corpus[0]));
+
+            ByteVector bytes;
+            flat.AppendBytes(bytes);
+            Assert::AreEqual(corpus[0], bytes);
+        }
+
+        TEST_METHOD(equal_only_to_the_same_structure)
+        {
+            auto& corpus = GetCorpus();
+            for (size_t i = 0; i < corpus.size(); ++i)
+            {
+                FlatSignature first;
+                Assert::IsTrue(first.TryParse(corpus[i]));
+                for (size_t j = 0; j < corpus.size(); ++j)
+                {
+                    FlatSignature second;
+                    Assert::IsTrue(second.TryParse(corpus[j]));
+                    Assert::AreEqual(i == j, first.Equals(second));
+                }
+            }
+
+            // arrays that differ only in their sizes
+            BYTEVECTOR(threeElements, 0x00, 0x01, 0x01, ELEMENT_TYPE_ARRAY, ELEMENT_TYPE_I4, 0x01, 0x01, 0x03, 0x00);
+            BYTEVECTOR(fourElements, 0x00, 0x01, 0x01, ELEMENT_TYPE_ARRAY, ELEMENT_TYPE_I4, 0x01, 0x01, 0x04, 0x00);
+            FlatSignature three;
+            FlatSignature four;
+            Assert::IsTrue(three.TryParse(threeElements));
+            Assert::IsTrue(four.TryParse(fourElements));
+            Assert::IsFalse(three.Equals(four));
+        }
+
+        TEST_METHOD(malformed_signatures_are_rejected)
+        {
+            FlatSignature flat;
+            Assert::IsFalse(flat.TryParse(ByteVector()));
+
+            // 2 parameters but only 1
+            BYTEVECTOR(missingParameter, 0x00, 0x02, 0x01, ELEMENT_TYPE_I4);
+            Assert::IsFalse(flat.TryParse(missingParameter));
+
+            // a class without its token
+            BYTEVECTOR(missingToken, 0x00, 0x01, 0x01, ELEMENT_TYPE_CLASS);
+            Assert::IsFalse(flat.TryParse(missingToken));
+
+            // an element type that can't be a parameter
+            BYTEVECTOR(unknownType, 0x00, 0x01, 0x01, 0x40);
+            Assert::IsFalse(flat.TryParse(unknownType));
+        }
+
+        // Not a test so much as a measurement: parses, formats and encodes the corpus many times with each representation and
+        // writes the times to the test output.
+        TEST_METHOD(benchmark_against_the_tree)
+        {
+            const int iterations = 20000;
+            auto tokenResolver = std::make_shared<MockTokenResolver>();
+            auto& corpus = GetCorpus();
+
+            size_t treeLength = 0;
+            auto treeStart = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; ++i)
+            {
+                for (auto& signature : corpus)
+                {
+                    auto tree = SignatureParser::ParseMethodSignature(signature.begin(), signature.end());
+                    treeLength += tree->ToString(tokenResolver).size() + tree->ToBytes()->size();
+                }
+            }
+            auto treeTime = std::chrono::steady_clock::now() - treeStart;
+
+            size_t flatLength = 0;
+            FlatSignature flat;
+            xstring_t parameters;
+            ByteVector bytes;
+            auto flatStart = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; ++i)
+            {
+                for (auto& signature : corpus)
+                {
+                    flat.TryParse(signature);
+                    parameters.clear();
+                    flat.AppendParameters(*tokenResolver, parameters);
+                    bytes.clear();
+                    flat.AppendBytes(bytes);
+                    flatLength += parameters.size() + bytes.size();
+                }
+            }
+            auto flatTime = std::chrono::steady_clock::now() - flatStart;
+
+            Assert::AreEqual(treeLength, flatLength);
+
+            std::wstringstream message;
+            message << iterations * corpus.size() << L" signatures parsed, formatted and encoded: tree "
+                << std::chrono::duration_cast<std::chrono::microseconds>(treeTime).count() << L"us, flat "
+                << std::chrono::duration_cast<std::chrono::microseconds>(flatTime).count() << L"us" << std::endl;
+            Microsoft::VisualStudio::CppUnitTestFramework::Logger::WriteMessage(message.str().c_str());
+        }
+
+    private:
+        // method signatures covering every kind of type, return type and parameter
+        static const std::vector<ByteVector>& GetCorpus()
+        {
+            static const std::vector<ByteVector> corpus =
+            {
+                // void ()
+                { 0x00, 0x00, 0x01 },
+                // instance int32 (bool, char, int8, uint8, int16, uint16, uint32, int64, uint64, float32, float64, native int, native uint, object, string)
+                { 0x20, 0x0f, 0x08, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x18, 0x19, 0x1c, 0x0e },
+                // class <2 generic parameters> (valuetype[], List<int32, !!1>, object&, !0)
+                { 0x30, 0x02, 0x04, 0x12, 0x05, 0x1d, 0x11, 0x09, 0x15, 0x12, 0x0d, 0x02, 0x08, 0x1e, 0x01, 0x10, 0x1c, 0x13, 0x00 },
+                // string[] (int32[0...3,2...4], void*, int32*, valuetype&)
+                { 0x00, 0x04, 0x1d, 0x0e, 0x14, 0x08, 0x02, 0x02, 0x04, 0x03, 0x02, 0x00, 0x02, 0x0f, 0x01, 0x0f, 0x08, 0x10, 0x11, 0x0d },
+                // typedref (typedref, int32 (*)(string, bool))
+                { 0x20, 0x02, 0x16, 0x16, 0x1b, 0x00, 0x02, 0x08, 0x0e, 0x02 },
+                // vararg void (int32, ..., string)
+                { 0x05, 0x03, 0x01, 0x08, 0x41, 0x0e },
+                // int32& (int32[,,], large class token)
+                { 0x00, 0x02, 0x10, 0x08, 0x14, 0x08, 0x03, 0x00, 0x00, 0x12, 0xc0, 0x01, 0x00, 0x05 },
+            };
+            return corpus;
+        }
+    };
+}}}}
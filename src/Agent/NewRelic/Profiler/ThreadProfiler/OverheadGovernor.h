@@ -0,0 +1,185 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <chrono>
+#include <algorithm>
+#include "ProfileSnapshot.h"
+
+namespace NewRelic { namespace Profiler { namespace ThreadProfiler
+{
+    using GovernorClock = std::chrono::steady_clock;
+
+    //Limits on the cost of sampling.  A value of zero disables that limit, and both are disabled unless configured, so by default
+    //every thread is walked in full on every request.
+    struct OverheadBudget
+    {
+        //longest time a single sample may keep threads suspended while their stacks are walked
+        uint32_t maxPauseMicroseconds = 0;
+        //share of wall clock time the profiler thread may spend sampling, in percent
+        uint32_t maxCpuPercent = 0;
+    };
+
+    //What the next sample is allowed to do.  adjustments is a combination of the SnapshotFlag* values.
+    struct SamplePlan
+    {
+        bool skip = false;
+        size_t maxThreads = SIZE_MAX;
+        uint32_t maxDepth = UINT32_MAX;
+        uint32_t adjustments = 0;
+    };
+
+    //What a sample actually cost.
+    struct SampleCost
+    {
+        GovernorClock::time_point start;
+        GovernorClock::duration duration;
+        size_t threadsSampled = 0;
+        size_t framesWalked = 0;
+    };
+
+    //Measures the cost of each sample and plans the next one so that the profiler stays within its OverheadBudget.
+    //  - the pause budget is met by sampling a rotating subset of the threads and, when even the minimum subset is too
+    //    expensive, by capping the stack depth (the frames nearest the root are kept).
+    //  - the cpu budget is met by skipping samples, which lowers the effective sampling frequency.
+    //Costs are tracked as exponentially weighted moving averages so a single slow sample does not cause over-correction.
+    //Not thread safe; only the profiler worker thread uses it.
+    class OverheadGovernor
+    {
+    public:
+        //never sample fewer threads than this, cap the depth instead
+        static constexpr size_t MinThreadsPerSample = 16;
+        //never cap the depth below this many frames
+        static constexpr uint32_t MinStackDepth = 32;
+        //never skip more than this many samples in a row, so the profile keeps making progress
+        static constexpr uint32_t MaxConsecutiveSkips = 4;
+
+        OverheadGovernor() = default;
+        explicit OverheadGovernor(const OverheadBudget& budget) noexcept : _budget(budget) {}
+
+        void SetBudget(const OverheadBudget& budget) noexcept
+        {
+            _budget = budget;
+        }
+
+        const OverheadBudget& GetBudget() const noexcept
+        {
+            return _budget;
+        }
+
+        SamplePlan Plan(size_t threadCount, GovernorClock::time_point now) noexcept
+        {
+            SamplePlan plan;
+            if (!_hasHistory)
+            {
+                return plan;
+            }
+
+            LimitPause(plan, threadCount);
+
+            if (ShouldSkip(plan, threadCount, now))
+            {
+                ++_consecutiveSkips;
+                plan = SamplePlan();
+                plan.skip = true;
+                plan.adjustments = SnapshotFlagSampleSkipped;
+                return plan;
+            }
+            _consecutiveSkips = 0;
+            return plan;
+        }
+
+        void Record(const SampleCost& cost) noexcept
+        {
+            const auto durationMicroseconds = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(cost.duration).count());
+            const auto threads = static_cast<double>(std::max<size_t>(cost.threadsSampled, 1));
+            const auto threadCost = durationMicroseconds / threads;
+            const auto depth = static_cast<double>(cost.framesWalked) / threads;
+
+            if (!_hasHistory)
+            {
+                _threadCostMicroseconds = threadCost;
+                _averageDepth = depth;
+                _hasHistory = true;
+            }
+            else
+            {
+                _threadCostMicroseconds = Smooth(_threadCostMicroseconds, threadCost);
+                _averageDepth = Smooth(_averageDepth, depth);
+            }
+            _lastSampleStart = cost.start;
+        }
+
+    private:
+        static constexpr double SmoothingFactor = 0.3;
+
+        static double Smooth(double average, double sample) noexcept
+        {
+            return average + SmoothingFactor * (sample - average);
+        }
+
+        //limit the number of threads, and if need be the depth of each walk, so the sample fits in the pause budget
+        void LimitPause(SamplePlan& plan, size_t threadCount) const noexcept
+        {
+            if (_budget.maxPauseMicroseconds == 0 || _threadCostMicroseconds <= 0.0)
+            {
+                return;
+            }
+
+            const auto affordableThreads = static_cast<size_t>(_budget.maxPauseMicroseconds / _threadCostMicroseconds);
+            if (affordableThreads >= threadCount)
+            {
+                return;
+            }
+
+            plan.maxThreads = std::max(affordableThreads, size_t{ MinThreadsPerSample });
+            if (plan.maxThreads < threadCount)
+            {
+                plan.adjustments |= SnapshotFlagThreadsSubset;
+            }
+
+            if (affordableThreads < MinThreadsPerSample && _averageDepth > 0.0)
+            {
+                //shrink the walk of every thread by the share of the minimum subset we cannot afford
+                const auto depth = static_cast<uint32_t>(_averageDepth * affordableThreads / MinThreadsPerSample);
+                const auto maxDepth = std::max(depth, uint32_t{ MinStackDepth });
+                if (maxDepth < _averageDepth)
+                {
+                    plan.maxDepth = maxDepth;
+                    plan.adjustments |= SnapshotFlagDepthCapped;
+                }
+            }
+        }
+
+        //skip when taking the planned sample now would push the share of time spent sampling since the previous sample over budget
+        bool ShouldSkip(const SamplePlan& plan, size_t threadCount, GovernorClock::time_point now) const noexcept
+        {
+            if (_budget.maxCpuPercent == 0 || _consecutiveSkips >= MaxConsecutiveSkips)
+            {
+                return false;
+            }
+
+            auto plannedCost = _threadCostMicroseconds * static_cast<double>(std::min(plan.maxThreads, threadCount));
+            if (plan.maxDepth != UINT32_MAX && _averageDepth > 0.0)
+            {
+                plannedCost *= std::min(1.0, plan.maxDepth / _averageDepth);
+            }
+
+            const auto elapsedMicroseconds = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(now - _lastSampleStart).count());
+            if (elapsedMicroseconds <= 0.0)
+            {
+                return true;
+            }
+            return (plannedCost * 100.0 / elapsedMicroseconds) > _budget.maxCpuPercent;
+        }
+
+        OverheadBudget _budget;
+        bool _hasHistory = false;
+        uint32_t _consecutiveSkips = 0;
+        double _threadCostMicroseconds = 0.0;
+        double _averageDepth = 0.0;
+        GovernorClock::time_point _lastSampleStart;
+    };
+}}}
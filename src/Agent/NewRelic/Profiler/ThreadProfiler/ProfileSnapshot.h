@@ -0,0 +1,299 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include "../Common/xplat.h"
+#include "../Common/Strings.h"
+
+/*
+SNAPSHOT LAYOUT
+A profile snapshot is a single, self-describing block of memory returned by RequestProfileSnapshot and released by ReleaseProfileSnapshot.
+Every section starts on an 8 byte boundary and every offset is relative to the start of the block, so the managed code can slice the block
+into spans without any per-frame marshaling.
+
+    SnapshotHeader
+    SnapshotThread[threadCount]         one entry per profiled managed thread
+    SnapshotNode[nodeCount]             stack nodes added since the previous snapshot, ids firstNodeId .. firstNodeId + nodeCount - 1
+    SnapshotFunction[functionCount]     functions added since the previous snapshot, indexes firstFunction .. firstFunction + functionCount - 1
+    char[stringTableSize]               UTF-8 string table (not null terminated) referenced by this snapshot's function table
+
+STACKS
+Stacks are interned as a tree shared by all threads and all snapshots of a profiling session.  A node is a function called from its parent
+node; a node without a parent (SnapshotNoStack) is the root frame of a stack.  Each thread refers to the node of its leaf frame and its
+stack is found by following the parents up to the root.  Identical stacks, and the common root portions of different stacks, are therefore
+stored once per session and each snapshot only carries the nodes and functions that are new since the previous snapshot.  The reader keeps
+the node and function tables of the session and appends the new entries of each snapshot to them.
+
+When SnapshotFlagReset is set the session has (re)started: the tables kept by the reader must be discarded before appending.
+
+Threads whose stack walk failed have stackNode == SnapshotNoStack and carry the failure in hresult.
+The header flags record the adjustments the overhead governor made to stay within its budget (SnapshotFlag*).
+*/
+namespace NewRelic { namespace Profiler { namespace ThreadProfiler
+{
+    static constexpr uint32_t SnapshotMagic = 0x5054524E; // "NRTP"
+    static constexpr uint16_t SnapshotVersion = 2;
+    static constexpr uint32_t SnapshotNoStack = 0xFFFFFFFF;
+
+    //only some of the managed threads were sampled
+    static constexpr uint32_t SnapshotFlagThreadsSubset = 0x1;
+    //stacks deeper than the governor's limit were truncated to the frames nearest the root (their hresult is S_FALSE)
+    static constexpr uint32_t SnapshotFlagDepthCapped = 0x2;
+    //the sample was skipped to lower the sampling frequency; the snapshot contains no threads
+    static constexpr uint32_t SnapshotFlagSampleSkipped = 0x4;
+    //the node and function tables start over with this snapshot
+    static constexpr uint32_t SnapshotFlagReset = 0x8;
+
+#pragma region Marshaled Layouts
+    //!!!MARSHALED LAYOUT!!!
+    //These structures are read by the managed code.  Do not change without bumping SnapshotVersion and updating the managed reader.
+    struct SnapshotHeader
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t headerSize;
+        uint32_t totalSize;
+        uint32_t flags;
+        uint32_t threadCount;
+        uint32_t threadTableOffset;
+        uint32_t firstNodeId;
+        uint32_t nodeCount;
+        uint32_t nodeTableOffset;
+        uint32_t firstFunction;
+        uint32_t functionCount;
+        uint32_t functionTableOffset;
+        uint32_t stringTableSize;
+        uint32_t stringTableOffset;
+    };
+    static_assert(sizeof(SnapshotHeader) == 56, "SnapshotHeader is part of the marshaled layout");
+
+    struct SnapshotThread
+    {
+        uint64_t threadId;
+        int32_t hresult;
+        uint32_t stackNode;
+    };
+    static_assert(sizeof(SnapshotThread) == 16, "SnapshotThread is part of the marshaled layout");
+
+    struct SnapshotNode
+    {
+        uint32_t parentNode;
+        uint32_t function;
+    };
+    static_assert(sizeof(SnapshotNode) == 8, "SnapshotNode is part of the marshaled layout");
+
+    struct SnapshotFunction
+    {
+        uint64_t functionId;
+        uint32_t typeNameOffset;
+        uint32_t typeNameLength;
+        uint32_t methodNameOffset;
+        uint32_t methodNameLength;
+    };
+    static_assert(sizeof(SnapshotFunction) == 24, "SnapshotFunction is part of the marshaled layout");
+#pragma endregion
+
+    //Interns thread stacks (as FunctionIDs) into the session's node tree and produces the contiguous snapshot block described above.
+    //The node and function tables persist from one Build to the next so that each snapshot only carries what is new; Reset starts a
+    //new session.  Not thread safe.
+    class ProfileSnapshotBuilder
+    {
+    public:
+        //returns the type and method name for a FunctionID.  The pointers only need to remain valid for the duration of the call.
+        using NameLookup = std::function<std::pair<const xchar_t*, const xchar_t*>(uintptr_t functionId)>;
+
+        //the session starts over once it holds this many nodes, which bounds the memory held by a long profiling session
+        static constexpr size_t MaxNodes = 1 << 20;
+
+        //functionIds is leaf frame first, as produced by the stack walk
+        void AddThread(uintptr_t threadId, int32_t hresult, const uintptr_t* functionIds, uint32_t length)
+        {
+            SnapshotThread thread{ threadId, hresult, SnapshotNoStack };
+            if (functionIds != nullptr && length != 0)
+            {
+                thread.stackNode = InternStack(functionIds, length);
+            }
+            _threads.push_back(thread);
+        }
+
+        //Serialize the threads added since the last Build together with the nodes and functions they introduced into a single allocation.
+        //The names of each new FunctionID are resolved exactly once per session through nameLookup.
+        std::unique_ptr<uint8_t[]> Build(const NameLookup& nameLookup, uint32_t& totalSize, uint32_t flags = 0)
+        {
+            std::string stringTable;
+            std::unordered_map<std::string, uint32_t> stringOffsets;
+            std::vector<SnapshotFunction> functionTable;
+            functionTable.reserve(_functionIds.size() - _publishedFunctions);
+            for (auto index = _publishedFunctions; index != _functionIds.size(); ++index)
+            {
+                const auto functionId = _functionIds[index];
+                const auto names = nameLookup(functionId);
+                SnapshotFunction function{ functionId, 0, 0, 0, 0 };
+                AppendString(stringTable, stringOffsets, names.first, function.typeNameOffset, function.typeNameLength);
+                AppendString(stringTable, stringOffsets, names.second, function.methodNameOffset, function.methodNameLength);
+                functionTable.push_back(function);
+            }
+
+            SnapshotHeader header{};
+            header.magic = SnapshotMagic;
+            header.version = SnapshotVersion;
+            header.headerSize = static_cast<uint16_t>(sizeof(SnapshotHeader));
+            header.flags = flags | (_published ? 0 : SnapshotFlagReset);
+
+            uint32_t offset = Align(sizeof(SnapshotHeader));
+            header.threadCount = static_cast<uint32_t>(_threads.size());
+            header.threadTableOffset = offset;
+            offset = Align(offset + header.threadCount * sizeof(SnapshotThread));
+            header.firstNodeId = static_cast<uint32_t>(_publishedNodes);
+            header.nodeCount = static_cast<uint32_t>(_nodes.size() - _publishedNodes);
+            header.nodeTableOffset = offset;
+            offset = Align(offset + header.nodeCount * sizeof(SnapshotNode));
+            header.firstFunction = static_cast<uint32_t>(_publishedFunctions);
+            header.functionCount = static_cast<uint32_t>(functionTable.size());
+            header.functionTableOffset = offset;
+            offset = Align(offset + header.functionCount * sizeof(SnapshotFunction));
+            header.stringTableSize = static_cast<uint32_t>(stringTable.size());
+            header.stringTableOffset = offset;
+            offset = Align(offset + header.stringTableSize);
+            header.totalSize = offset;
+
+            std::unique_ptr<uint8_t[]> block(new uint8_t[header.totalSize]());
+            auto base = block.get();
+            std::memcpy(base, &header, sizeof(header));
+            CopySection(base + header.threadTableOffset, _threads.data(), _threads.size());
+            CopySection(base + header.nodeTableOffset, _nodes.data() + _publishedNodes, header.nodeCount);
+            CopySection(base + header.functionTableOffset, functionTable.data(), functionTable.size());
+            if (!stringTable.empty())
+            {
+                std::memcpy(base + header.stringTableOffset, stringTable.data(), stringTable.size());
+            }
+
+            //everything up to here is now known to the reader
+            _threads.clear();
+            _publishedNodes = _nodes.size();
+            _publishedFunctions = _functionIds.size();
+            _published = true;
+
+            totalSize = header.totalSize;
+            return block;
+        }
+
+        //Forget the threads added since the last Build, e.g. after a failed Build
+        void DiscardThreads() noexcept
+        {
+            _threads.clear();
+        }
+
+        //Start a new session.  The next snapshot carries SnapshotFlagReset.
+        void Reset() noexcept
+        {
+            _threads.clear();
+            _nodes.clear();
+            _nodeIndexes.clear();
+            _functionIds.clear();
+            _functionIndexes.clear();
+            _publishedNodes = 0;
+            _publishedFunctions = 0;
+            _published = false;
+        }
+
+        //Start a new session if this one holds more than MaxNodes nodes.  Returns true if it did.
+        bool ResetIfFull() noexcept
+        {
+            if (_nodes.size() <= MaxNodes)
+            {
+                return false;
+            }
+            Reset();
+            return true;
+        }
+
+        size_t NodeCount() const noexcept
+        {
+            return _nodes.size();
+        }
+
+    private:
+        static uint32_t Align(size_t offset) noexcept
+        {
+            return static_cast<uint32_t>((offset + 7) & ~static_cast<size_t>(7));
+        }
+
+        template <typename T>
+        static void CopySection(uint8_t* destination, const T* section, size_t count)
+        {
+            if (count != 0)
+            {
+                std::memcpy(destination, section, count * sizeof(T));
+            }
+        }
+
+        static void AppendString(std::string& stringTable, std::unordered_map<std::string, uint32_t>& stringOffsets, const xchar_t* value, uint32_t& offset, uint32_t& length)
+        {
+            std::string utf8;
+            if (value != nullptr)
+            {
+                Strings::AppendUtf8(utf8, value, std::char_traits<xchar_t>::length(value));
+            }
+
+            auto found = stringOffsets.find(utf8);
+            if (found == stringOffsets.end())
+            {
+                found = stringOffsets.emplace(utf8, static_cast<uint32_t>(stringTable.size())).first;
+                stringTable.append(utf8);
+            }
+            offset = found->second;
+            length = static_cast<uint32_t>(utf8.size());
+        }
+
+        uint32_t InternFunction(uintptr_t functionId)
+        {
+            auto found = _functionIndexes.find(functionId);
+            if (found != _functionIndexes.end())
+            {
+                return found->second;
+            }
+            const auto index = static_cast<uint32_t>(_functionIds.size());
+            _functionIds.push_back(functionId);
+            _functionIndexes.emplace(functionId, index);
+            return index;
+        }
+
+        //Hash-cons the stack from the root frame to the leaf frame: a node is identified by its parent node and its function, so stacks
+        //that share their root portion share those nodes.  Returns the node of the leaf frame.
+        uint32_t InternStack(const uintptr_t* functionIds, uint32_t length)
+        {
+            uint32_t node = SnapshotNoStack;
+            for (auto idx = length; idx != 0; --idx)
+            {
+                const auto function = InternFunction(functionIds[idx - 1]);
+                const auto key = (static_cast<uint64_t>(node) << 32) | function;
+                auto found = _nodeIndexes.find(key);
+                if (found == _nodeIndexes.end())
+                {
+                    found = _nodeIndexes.emplace(key, static_cast<uint32_t>(_nodes.size())).first;
+                    _nodes.push_back(SnapshotNode{ node, function });
+                }
+                node = found->second;
+            }
+            return node;
+        }
+
+        std::vector<SnapshotThread> _threads;
+        std::vector<SnapshotNode> _nodes;
+        std::unordered_map<uint64_t, uint32_t> _nodeIndexes;
+        std::vector<uintptr_t> _functionIds;
+        std::unordered_map<uintptr_t, uint32_t> _functionIndexes;
+        size_t _publishedNodes = 0;
+        size_t _publishedFunctions = 0;
+        bool _published = false;
+    };
+}}}
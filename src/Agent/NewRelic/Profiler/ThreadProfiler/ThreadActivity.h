@@ -0,0 +1,89 @@
+/*
+* Copyright 2020 New Relic Corporation. All rights reserved.
+* SPDX-License-Identifier: Apache-2.0
+*/
+#pragma once
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef PAL_STDCPP_COMPAT
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace NewRelic { namespace Profiler { namespace ThreadProfiler
+{
+    //Reads the cumulative CPU time of the OS threads of this process so that the thread profiler can tell whether a thread
+    //has run since it was last sampled.  A thread that has not run cannot have a different managed stack.
+    //
+    //On Linux the time comes from /proc/self/task/<tid>/schedstat (nanoseconds on CPU).  Kernels without schedstat only report
+    //CPU time in clock ticks (/proc/self/task/<tid>/stat), and a thread can run for several milliseconds without a tick being
+    //charged to it, so an unchanged tick count does not show that the thread was idle.  There, as on other platforms,
+    //TryGetCpuTime always returns false and every thread is sampled.
+    class ThreadActivity
+    {
+    public:
+        ThreadActivity() noexcept
+        {
+#ifdef PAL_STDCPP_COMPAT
+            _useSchedStat = ::access("/proc/self/schedstat", R_OK) == 0;
+#endif
+        }
+
+        //returns false when the CPU time of the thread cannot be read (platform not supported, the thread has exited, ...)
+        bool TryGetCpuTime(uint32_t osThreadId, uint64_t& cpuTime) const noexcept
+        {
+#ifdef PAL_STDCPP_COMPAT
+            if (!_useSchedStat)
+            {
+                return false;
+            }
+
+            char path[64];
+            std::snprintf(path, sizeof(path), "/proc/self/task/%u/schedstat", osThreadId);
+
+            char buffer[512];
+            const auto length = ReadFile(path, buffer, sizeof(buffer) - 1);
+            if (length <= 0)
+            {
+                return false;
+            }
+            buffer[length] = '\0';
+
+            return ParseSchedStat(buffer, cpuTime);
+#else
+            (void)osThreadId;
+            (void)cpuTime;
+            return false;
+#endif
+        }
+
+        //"<ns on cpu> <ns waiting> <timeslices>"
+        static bool ParseSchedStat(const char* contents, uint64_t& cpuTime) noexcept
+        {
+            char* end = nullptr;
+            cpuTime = std::strtoull(contents, &end, 10);
+            return end != contents;
+        }
+
+    private:
+#ifdef PAL_STDCPP_COMPAT
+        //the profiler thread may read hundreds of these files per sample, so avoid the overhead of the stream classes
+        static ssize_t ReadFile(const char* path, char* buffer, size_t size) noexcept
+        {
+            const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                return -1;
+            }
+            const auto length = ::read(fd, buffer, size);
+            ::close(fd);
+            return length;
+        }
+
+        bool _useSchedStat = false;
+#endif
+    };
+}}}
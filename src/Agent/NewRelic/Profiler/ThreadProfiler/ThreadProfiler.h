@@ -6,6 +6,7 @@
 #include <mutex>
 #include <atomic>
 #include <thread>
+#include <unordered_map>
 
 #include <cor.h>
 
@@ -15,6 +16,9 @@
 #pragma warning(pop)
 
 #include "namecache.h"
+#include "ProfileSnapshot.h"
+#include "OverheadGovernor.h"
+#include "ThreadActivity.h"
 #include "../Logging/Logger.h"
 
 #include <corprof.h>
@@ -28,6 +32,7 @@ and an indicator of the last valid entry in the StackWalk.  It also serves as th
 references to the name cache and profiling COM interface.
 Profile            A collection of ThreadProfile(s) for all current managed threads.
 ActiveThreadID  A collection of ThreadIDs for all current managed threads.
+SamplePlan        The OverheadGovernor's decision for the next profile: skip it, or limit the number of threads and the depth of each StackWalk.
 
 CAVEATS
 Due to the requirement of not using dynamically allocated memory or taking any locks during the snapshot callback, the data structures are preallocated for use during profiling.
@@ -57,6 +62,22 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
         virtual void ReleaseProfile() noexcept
         {}
 
+        virtual HRESULT RequestProfileSnapshot(void** snapshot, int* length) noexcept
+        {
+            if (snapshot)
+            {
+                *snapshot = nullptr;
+            }
+            if (length)
+            {
+                *length = 0;
+            }
+            return E_NOTIMPL;
+        }
+
+        virtual void ReleaseProfileSnapshot(void* /*snapshot*/) noexcept
+        {}
+
         virtual HRESULT GetTypeAndMethodNames(const UINT_PTR* /*functionIds*/, int /*length*/, void** results) noexcept
         {
             if (results)
@@ -74,6 +95,11 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
             return E_NOTIMPL;
         }
 
+        virtual HRESULT ThreadAssignedToOSThread(ThreadID /*managedThreadId*/, DWORD /*osThreadId*/) noexcept
+        {
+            return E_NOTIMPL;
+        }
+
         ThreadProfilerBase() noexcept = default;
         virtual ~ThreadProfilerBase() noexcept = default;
         ThreadProfilerBase(const ThreadProfilerBase&) = delete;
@@ -118,6 +144,16 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
             }
         }
 
+        //Set the limits the overhead governor keeps each profile within.  Must be called before the first RequestProfile.
+        void SetOverheadBudget(const OverheadBudget& budget) noexcept
+        {
+            if (budget.maxPauseMicroseconds != 0 || budget.maxCpuPercent != 0)
+            {
+                LogInfo(L"TP: overhead budget: pause ", budget.maxPauseMicroseconds, L"us, cpu ", budget.maxCpuPercent, L"%");
+            }
+            _governor.SetBudget(budget);
+        }
+
         //Start the worker thread (if not already running; it will be terminated by calling Shutdown()).  Signal the worker thread that we are requesting profiling.
         // Wait for the profiling to be completed and return a pointer to the data in the marshal-ready data structure.
         // If _shuttingDown is true, abort waiting for the profiling to complete.
@@ -187,6 +223,72 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
             _marshaledProfiles.clear();
         }
 
+        //Profile all threads (see RequestProfile) and return the result, including the type and method names of every frame, as a
+        //single block laid out as described in ProfileSnapshot.h.  The block is owned by the caller and must be returned through
+        //ReleaseProfileSnapshot.  Stacks are interned for the whole profiling session (until Shutdown), so each block only carries the
+        //stack nodes and functions not seen in a previous block.
+        HRESULT RequestProfileSnapshot(void** snapshot, int* length) noexcept override
+        {
+            if (nullptr == snapshot || nullptr == length)
+            {
+                return E_INVALIDARG;
+            }
+            *snapshot = nullptr;
+            *length = 0;
+
+            void* profiles = nullptr;
+            int profileCount = 0;
+            const auto hr = RequestProfile(&profiles, &profileCount);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            try
+            {
+                std::lock_guard<std::mutex> l(_mtx_snapshotBuilder);
+                if (_snapshotBuilder.ResetIfFull())
+                {
+                    LogDebug(L"TP: stack node limit reached, starting a new snapshot session");
+                }
+
+                _snapshotBuilder.DiscardThreads();
+                for (const auto& marshaledProfile : _marshaledProfiles)
+                {
+                    _snapshotBuilder.AddThread(marshaledProfile.threadid, marshaledProfile.hresult, marshaledProfile.fids.get(),
+                        marshaledProfile.fids ? static_cast<uint32_t>(marshaledProfile.length) : 0);
+                }
+                ReleaseProfile();
+
+                uint32_t totalSize{};
+                auto block = _snapshotBuilder.Build([this](uintptr_t functionId)
+                {
+                    const auto& typeAndMethodNames = _nameCache[functionId];
+                    return std::make_pair(typeAndMethodNames.TypeName(), typeAndMethodNames.MethodName());
+                }, totalSize, _lastSampleAdjustments.load());
+
+                *length = static_cast<int>(totalSize);
+                *snapshot = block.release();
+            }
+            catch (const std::bad_alloc&)
+            {
+                ReleaseProfile();
+                return E_OUTOFMEMORY;
+            }
+            catch (const std::exception&)
+            {
+                ReleaseProfile();
+                return E_UNEXPECTED;
+            }
+            return S_OK;
+        }
+
+        //Free a block returned by RequestProfileSnapshot
+        void ReleaseProfileSnapshot(void* snapshot) noexcept override
+        {
+            delete[] static_cast<uint8_t*>(snapshot);
+        }
+
         //Get the type and method names for each of the provided FunctionIDs
         HRESULT GetTypeAndMethodNames(const UINT_PTR* functionIds, int length, void** results) noexcept override
         {
@@ -239,6 +341,11 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
                 ReleaseProfile();
                 ReleaseGetTypeAndMethodNamesResults();
                 _nameCache.clear();
+                _threadHistory.clear();
+                {
+                    std::lock_guard<std::mutex> l(_mtx_snapshotBuilder);
+                    _snapshotBuilder.Reset();
+                }
                 _profileCompleted.store(false);
                 _profileRequested.store(false);
                 _shuttingDown.store(false);
@@ -249,11 +356,16 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
         }
 
         //called by the Profiler when a thread is on its way out...  We receive this notification because we called SetEventMask(COR_PRF_MONITOR_THREADS...) during Initialize.
-        HRESULT ThreadDestroyed(ThreadID /*threadId*/) noexcept override
+        HRESULT ThreadDestroyed(ThreadID threadId) noexcept override
         {
             try
             {
                 std::lock_guard<std::mutex> l(_mtx_snapshotInProgress);
+                _threadHistory.erase(threadId);
+                {
+                    std::lock_guard<std::mutex> osThreadIdsLock(_mtx_osThreadIds);
+                    _osThreadIds.erase(threadId);
+                }
             }
             catch (const std::exception& e)
             {
@@ -262,6 +374,23 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
             return S_OK;
         }
 
+        //called by the Profiler when a managed thread starts running on an OS thread.  We receive this notification because we called
+        //SetEventMask(COR_PRF_MONITOR_THREADS...) during Initialize.  The OS thread id is used to find out whether a thread has run
+        //since it was last profiled.
+        HRESULT ThreadAssignedToOSThread(ThreadID managedThreadId, DWORD osThreadId) noexcept override
+        {
+            try
+            {
+                std::lock_guard<std::mutex> l(_mtx_osThreadIds);
+                _osThreadIds[managedThreadId] = osThreadId;
+            }
+            catch (const std::exception& e)
+            {
+                LogWarn(L"Exception caught in ThreadAssignedToOSThread:", e.what());
+            }
+            return S_OK;
+        }
+
         ThreadProfiler() = default;
         ~ThreadProfiler() = default;
         ThreadProfiler(const ThreadProfiler&) = delete;
@@ -312,9 +441,43 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
             StackWalk::iterator _frameNext{};
             HRESULT _errorCode{};
             ThreadID _managedTID;
-            ThreadProfile(ThreadID managedTID, ICorProfilerInfo4* corProfilerInfo, NameCache& nameCache, StackWalk& stackwalk) :
-                _managedTID(managedTID), _corProfilerInfo(corProfilerInfo), _nameCache(nameCache), _stackwalk(stackwalk), _frameNext(std::begin(_stackwalk))
+            //only the last this many frames of the walk, the ones nearest the root, are kept (set by the overhead governor)
+            uint32_t _maxDepth{};
+            bool _depthCapped{};
+            //the walk has gone past Capacity() frames and is overwriting the oldest (leaf) frames; _frameNext is then also the oldest kept frame
+            bool _wrapped{};
+            //every frame the walk visited, including those that were overwritten
+            size_t _framesWalked{};
+            ThreadProfile(ThreadID managedTID, ICorProfilerInfo4* corProfilerInfo, NameCache& nameCache, StackWalk& stackwalk, uint32_t maxDepth) :
+                _managedTID(managedTID), _corProfilerInfo(corProfilerInfo), _nameCache(nameCache), _stackwalk(stackwalk), _frameNext(std::begin(_stackwalk)), _maxDepth(maxDepth)
             {}
+
+            size_t Capacity() const noexcept
+            {
+                return std::min<size_t>(_maxDepth, _stackwalk.size());
+            }
+
+            //true if the governor limited the depth, in which case names are looked up after the walk for the kept frames only
+            bool IsDepthLimited() const noexcept
+            {
+                return Capacity() < _stackwalk.size();
+            }
+
+            size_t FrameCount() const noexcept
+            {
+                return _wrapped ? Capacity() : static_cast<size_t>(std::distance(std::begin(_stackwalk), _frameNext));
+            }
+
+            //visit the kept frames in the order they were walked, leaf first
+            template <typename Visit>
+            void ForEachFrame(Visit visit)
+            {
+                if (_wrapped)
+                {
+                    std::for_each(_frameNext, std::begin(_stackwalk) + Capacity(), visit);
+                }
+                std::for_each(std::begin(_stackwalk), _frameNext, visit);
+            }
             ~ThreadProfile() = default;
             ThreadProfile(ThreadProfile&&) = default;
 
@@ -333,7 +496,7 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
             HRESULT hresult{};
             int32_t length{};
             std::unique_ptr<uintptr_t[]> fids{};
-            MarshaledThreadProfile(ThreadProfile& tp) : threadid(tp._managedTID), hresult(tp._errorCode), length(static_cast<int32_t>(std::distance(std::begin(tp._stackwalk), tp._frameNext)))
+            MarshaledThreadProfile(ThreadProfile& tp) : threadid(tp._managedTID), hresult(tp._errorCode), length(static_cast<int32_t>(tp.FrameCount()))
             {
                 if (SUCCEEDED(hresult) && length)
                 {
@@ -342,14 +505,23 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
                     {
                         auto write_itr = fids.get();
                         //walk over the StackWalks and copy their FunctionID into the fids array
-                        for (int32_t idx = 0; idx != length; ++idx)
+                        tp.ForEachFrame([&](const StackFrame& funcdetails)
                         {
-                            const auto& funcdetails = tp._stackwalk.data()[idx];
                             *write_itr++ = funcdetails.functionId;
-                        }
+                        });
                     }
                 }
             }
+            //a copy of a stack captured by an earlier profile
+            MarshaledThreadProfile(ThreadID managedTID, HRESULT errorCode, const std::vector<uintptr_t>& functionIds) :
+                threadid(managedTID), hresult(errorCode), length(static_cast<int32_t>(functionIds.size()))
+            {
+                if (length)
+                {
+                    fids = std::make_unique<uintptr_t[]>(length);
+                    std::copy(functionIds.begin(), functionIds.end(), fids.get());
+                }
+            }
             ~MarshaledThreadProfile() = default;
             MarshaledThreadProfile(MarshaledThreadProfile&& other) = default;
 
@@ -393,6 +565,16 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
         //collection of all managed threads (from corProfilerInfo->EnumThreads)
         using ActiveThreadIDs = std::vector<ThreadID>;
 
+        //the result of the last successful walk of a thread and the CPU time the thread had used before it.  Used to reuse the
+        //result while the thread is idle.  walked is false when there is no result to reuse.
+        struct ThreadHistory
+        {
+            bool walked{};
+            uint64_t cpuTime{};
+            HRESULT hresult{};
+            std::vector<uintptr_t> fids;
+        };
+
         //collect of ThreadProfiles one is created for each managed thread 
         using ThreadProfiles = std::vector<ThreadProfile>;
 #pragma endregion 
@@ -441,6 +623,33 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
         //collection of marshal-ready FunctionID, type names and method names. This is the result of the GetTypeAndMethodNames() call
         MarshaledFunctionIDTypeNameMethodNameCollection _marshaledFunctionIDTypeNameMethodNames;
 
+        //measures the cost of each profile and plans the next one to stay within budget.  Only used by the worker thread.
+        OverheadGovernor _governor;
+
+        //number of managed threads seen by the last profile, the governor plans the next profile from it
+        size_t _lastThreadCount{};
+
+        //index into the thread list of the first thread to profile when only a subset of the threads is profiled.
+        //Rotates so that every thread is eventually profiled.
+        size_t _nextThreadOffset{};
+
+        //the SnapshotFlag* adjustments made by the governor for the last profile
+        std::atomic<uint32_t> _lastSampleAdjustments{};
+
+        //managed ThreadID to OS thread id, maintained by ThreadAssignedToOSThread and ThreadDestroyed
+        std::mutex _mtx_osThreadIds;
+        std::unordered_map<ThreadID, DWORD> _osThreadIds;
+
+        //the last walk of each managed thread.  Only accessed while holding _mtx_snapshotInProgress.
+        std::unordered_map<ThreadID, ThreadHistory> _threadHistory;
+
+        //reads the CPU time of OS threads
+        ThreadActivity _threadActivity;
+
+        //the stacks and functions interned for the current snapshot session.  Reset in Shutdown.
+        std::mutex _mtx_snapshotBuilder;
+        ProfileSnapshotBuilder _snapshotBuilder;
+
 #pragma endregion 
 
 #pragma region Private Methods
@@ -555,7 +764,10 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
         //Get the list of active managed threads (GetThreads) and call _corProfilerInfo->DoStackSnapshot for each one. Capture the StackWalk 
         //  (function id, type and method names; observing the name cache for previously captured names) in a preallocated data structure. 
         //  After a thread's StackWalk has been captured, copy this data into the name cache and copy the data into the marshal-ready collection.
-        void ProfileAllThreads()
+        //  A thread that has not run since it was last walked cannot have a different stack; its previous result is reused instead of walking it again.
+        //  Only plan.maxThreads threads are walked and each StackWalk is abandoned after plan.maxDepth frames; plan.adjustments is updated
+        //  with the limits that actually took effect.  The number of threads and frames walked are added to cost.
+        void ProfileAllThreads(SamplePlan& plan, SampleCost& cost)
         {
             ThreadProfiles profiles;
             profiles.reserve(ThreadCountForReservation);
@@ -566,16 +778,34 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
             std::lock_guard<std::mutex> l(_mtx_snapshotInProgress);
 
             const auto localActiveThreads = GetThreads();
-            for (const auto threadId : localActiveThreads)
+            _lastThreadCount = localActiveThreads.size();
+
+            plan.adjustments &= ~(SnapshotFlagThreadsSubset | SnapshotFlagDepthCapped);
+            const auto firstThread = localActiveThreads.empty() ? 0 : _nextThreadOffset % localActiveThreads.size();
+
+            size_t visited{};
+            size_t idleThreads{};
+            for (; visited != localActiveThreads.size() && cost.threadsSampled != plan.maxThreads; ++visited)
             {
                 if (HasShutdownBeenRequested()) {
                     break;
                 }
 
+                const auto threadId = localActiveThreads[(firstThread + visited) % localActiveThreads.size()];
                 try
                 {
+                    auto& history = _threadHistory[threadId];
+                    uint64_t cpuTime{};
+                    const auto cpuTimeKnown = TryGetCpuTime(threadId, cpuTime);
+                    if (cpuTimeKnown && history.walked && history.cpuTime == cpuTime)
+                    {
+                        ++idleThreads;
+                        _marshaledProfiles.emplace_back(threadId, history.hresult, history.fids);
+                        continue;
+                    }
+
                     // get or create the thread profile for this thread
-                    profiles.emplace_back(threadId, _corProfilerInfo, _nameCache, *stackwalk);
+                    profiles.emplace_back(threadId, _corProfilerInfo, _nameCache, *stackwalk, plan.maxDepth);
                     auto& threadProfile = profiles.back();
 
                     // LEGACY: on 64-bit architecture prefer native stack walking, see: StackWalk64
@@ -584,6 +814,16 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
                     const auto result = _corProfilerInfo->DoStackSnapshot(threadId, StaticStackFrameCallback,
                         COR_PRF_SNAPSHOT_INFO::COR_PRF_SNAPSHOT_DEFAULT, &threadProfile, nullptr, 0);
 
+                    ++cost.threadsSampled;
+                    cost.framesWalked += threadProfile._framesWalked;
+                    //only a successful walk is reused, and only while the thread's CPU time doesn't change from what it was before it
+                    history.walked = false;
+
+                    if (threadProfile._depthCapped)
+                    {
+                        plan.adjustments |= SnapshotFlagDepthCapped;
+                    }
+
                     //if DoStackSnapshot failed, we won't have a stackwalk.  this can happen if a managed thread does not currently 
                     //have any managed code frames on the stack. (A thread pool thread has returned to the waiting-for-work native code)
                     if (FAILED(result))
@@ -594,7 +834,15 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
                         continue;
                     }
 
-                    std::for_each(std::begin(threadProfile._stackwalk), threadProfile._frameNext, [&](const StackFrame& funcdetails)
+                    if (threadProfile.IsDepthLimited())
+                    {
+                        threadProfile.ForEachFrame([&](StackFrame& funcdetails)
+                        {
+                            LookUpNames(threadProfile, funcdetails);
+                        });
+                    }
+
+                    threadProfile.ForEachFrame([&](const StackFrame& funcdetails)
                     {
                         if (funcdetails.functionId && funcdetails.typeDef != 0)
                         {
@@ -605,6 +853,13 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
                     //transform the threadProfile into a snapshot to pass back to caller of RequestProfile
                     _marshaledProfiles.emplace_back(threadProfile);
 
+                    //remember the result in case the thread is still idle next time
+                    const auto& marshaledProfile = _marshaledProfiles.back();
+                    history.hresult = marshaledProfile.hresult;
+                    history.fids.assign(marshaledProfile.fids.get(), marshaledProfile.fids.get() + (marshaledProfile.fids ? marshaledProfile.length : 0));
+                    history.walked = cpuTimeKnown;
+                    history.cpuTime = cpuTime;
+
                     // LEGACY: check the result for certain failures and fall back on native stack walking to find the first managed function call and then try again
                 }
                 catch (...)
@@ -613,6 +868,63 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
                     LogTrace(L"TP: exception in ", __func__);
                 }
             }
+
+            _nextThreadOffset = firstThread + visited;
+            if (visited < localActiveThreads.size())
+            {
+                plan.adjustments |= SnapshotFlagThreadsSubset;
+            }
+            if (idleThreads != 0)
+            {
+                LogTrace(L"TP: reused the previous stacks of ", idleThreads, L" idle threads");
+            }
+        }
+
+        //The CPU time of the OS thread running threadId, false if it isn't known.
+        bool TryGetCpuTime(ThreadID threadId, uint64_t& cpuTime)
+        {
+            DWORD osThreadId{};
+            {
+                std::lock_guard<std::mutex> l(_mtx_osThreadIds);
+                const auto found = _osThreadIds.find(threadId);
+                if (found == _osThreadIds.end())
+                {
+                    return false;
+                }
+                osThreadId = found->second;
+            }
+            return _threadActivity.TryGetCpuTime(osThreadId, cpuTime);
+        }
+
+        //Ask the governor how the next profile may be taken, take it (suspending the runtime where required) and report its cost back
+        //to the governor.
+        void ProfileWithinBudget()
+        {
+            const auto sampleStart = GovernorClock::now();
+            auto plan = _governor.Plan(_lastThreadCount, sampleStart);
+            if (!plan.skip)
+            {
+#ifdef PAL_STDCPP_COMPAT
+                _corProfilerInfo10->SuspendRuntime();
+#endif
+                SampleCost cost;
+                ProfileAllThreads(plan, cost);
+#ifdef PAL_STDCPP_COMPAT
+                _corProfilerInfo10->ResumeRuntime();
+#endif
+                cost.start = sampleStart;
+                cost.duration = GovernorClock::now() - sampleStart;
+                _governor.Record(cost);
+            }
+
+            const auto previousAdjustments = _lastSampleAdjustments.exchange(plan.adjustments);
+            if (previousAdjustments != plan.adjustments)
+            {
+                LogDebug(L"TP: overhead governor adjustments changed to ", plan.adjustments,
+                    L" (subset=", (plan.adjustments & SnapshotFlagThreadsSubset) != 0,
+                    L", depth capped=", (plan.adjustments & SnapshotFlagDepthCapped) != 0,
+                    L", skipped=", (plan.adjustments & SnapshotFlagSampleSkipped) != 0, L")");
+            }
         }
 
         //worker thread method.  Initialize the thread for calling the Execution Engine.  Wait for RequestProfile to signal
@@ -645,13 +957,7 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
                         break;
                     }
 
-#ifdef PAL_STDCPP_COMPAT
-                    _corProfilerInfo10->SuspendRuntime();
-#endif
-                    ProfileAllThreads();
-#ifdef PAL_STDCPP_COMPAT
-                    _corProfilerInfo10->ResumeRuntime();
-#endif
+                    ProfileWithinBudget();
 
                     SignalProfileCompleted();
                 }
@@ -671,53 +977,26 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
                 const HRESULT StackTooDeep = S_FALSE; // HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
 
                 ThreadProfile& threadProfile = *static_cast<ThreadProfile*>(clientData);
-                // for now we just clear the whole thing and start counting again if we go 
-                // over since we *must* get the root of the stack but we can afford to lose leaves
 
-                if (threadProfile._frameNext == std::end(threadProfile._stackwalk))
+                // the walk goes from the leaf to the root, and we *must* get the root of the stack but we can afford to lose leaves, so
+                // once the StackWalk (or the depth the governor allows) is full the oldest frames are overwritten
+                ++threadProfile._framesWalked;
+                if (threadProfile._frameNext == std::begin(threadProfile._stackwalk) + threadProfile.Capacity())
                 {
                     threadProfile._frameNext = std::begin(threadProfile._stackwalk);
+                    threadProfile._wrapped = true;
+                    threadProfile._depthCapped = threadProfile.IsDepthLimited();
                     //this will overwrite a previous error code.
                     threadProfile._errorCode = StackTooDeep;
                 }
 
                 auto& thisframe = *threadProfile._frameNext;
                 thisframe.functionId = functionId;
-                const auto& nameCache = threadProfile._nameCache;
 
-                if (functionId && !nameCache.has_fid(functionId))
+                //most of the frames of a walk the governor limited are overwritten, so their names are only looked up once it is done
+                if (!threadProfile.IsDepthLimited())
                 {
-                    // get the interfaces we need and the metadata token
-                    CComPtr<IMetaDataImport2> metaDataImport;
-                    mdToken mdTokenForFunction{};
-                    HRESULT hr{};
-                    if (SUCCEEDED(hr = threadProfile._corProfilerInfo->GetTokenAndMetaDataFromFunction(functionId, IID_IMetaDataImport2, (IUnknown**)&metaDataImport, &mdTokenForFunction)) &&
-                        metaDataImport != nullptr)
-                    {
-                        auto& preallocMethodName = thisframe.methodName;
-                        //first is buffer, second is actual name length
-                        if (SUCCEEDED(hr = metaDataImport->GetMethodProps(mdTokenForFunction, &thisframe.typeDef,
-                            &preallocMethodName.first.front(), (ULONG)preallocMethodName.first.size(), &preallocMethodName.second,
-                            nullptr, nullptr, nullptr, nullptr, nullptr)))
-                        {
-                            auto& preallocTypeName = thisframe.typeName;
-                            auto& typeName = nameCache.typename_for(thisframe.typeDef);
-                            if (typeName == TypeAndMethodNames::GetUnknownTypeName())
-                            {
-                                // get the name of the class from the cache. Make a cache entry if not found.
-                                hr = metaDataImport->GetTypeDefProps(thisframe.typeDef, &preallocTypeName.first.front(), static_cast<ULONG>(preallocTypeName.first.size()), &preallocTypeName.second, nullptr, nullptr);
-                            }
-                            else
-                            {
-                                wcscpy_s(preallocTypeName.first.data(), static_cast<ULONG>(preallocTypeName.first.size()), typeName->c_str());
-                            }
-                        }
-                    }
-                    //don't overwrite StackTooDeep.  
-                    if (FAILED(hr) && StackTooDeep != threadProfile._errorCode)
-                    {
-                        threadProfile._errorCode = hr;
-                    }
+                    LookUpNames(threadProfile, thisframe);
                 }
 
                 //advance the index to the next slot
@@ -729,6 +1008,50 @@ namespace NewRelic { namespace Profiler { namespace ThreadProfiler
             }
             return S_OK;
         }
+
+        //Fill in the type and method names of the frame unless its function is already in the name cache.  Called from the snapshot
+        //callback, so it must not allocate or take locks.
+        static void LookUpNames(ThreadProfile& threadProfile, StackFrame& thisframe)
+        {
+            const HRESULT StackTooDeep = S_FALSE;
+            const auto functionId = thisframe.functionId;
+            const auto& nameCache = threadProfile._nameCache;
+
+            if (functionId && !nameCache.has_fid(functionId))
+            {
+                // get the interfaces we need and the metadata token
+                CComPtr<IMetaDataImport2> metaDataImport;
+                mdToken mdTokenForFunction{};
+                HRESULT hr{};
+                if (SUCCEEDED(hr = threadProfile._corProfilerInfo->GetTokenAndMetaDataFromFunction(functionId, IID_IMetaDataImport2, (IUnknown**)&metaDataImport, &mdTokenForFunction)) &&
+                    metaDataImport != nullptr)
+                {
+                    auto& preallocMethodName = thisframe.methodName;
+                    //first is buffer, second is actual name length
+                    if (SUCCEEDED(hr = metaDataImport->GetMethodProps(mdTokenForFunction, &thisframe.typeDef,
+                        &preallocMethodName.first.front(), (ULONG)preallocMethodName.first.size(), &preallocMethodName.second,
+                        nullptr, nullptr, nullptr, nullptr, nullptr)))
+                    {
+                        auto& preallocTypeName = thisframe.typeName;
+                        auto& typeName = nameCache.typename_for(thisframe.typeDef);
+                        if (typeName == TypeAndMethodNames::GetUnknownTypeName())
+                        {
+                            // get the name of the class from the cache. Make a cache entry if not found.
+                            hr = metaDataImport->GetTypeDefProps(thisframe.typeDef, &preallocTypeName.first.front(), static_cast<ULONG>(preallocTypeName.first.size()), &preallocTypeName.second, nullptr, nullptr);
+                        }
+                        else
+                        {
+                            wcscpy_s(preallocTypeName.first.data(), static_cast<ULONG>(preallocTypeName.first.size()), typeName->c_str());
+                        }
+                    }
+                }
+                //don't overwrite StackTooDeep.  
+                if (FAILED(hr) && StackTooDeep != threadProfile._errorCode)
+                {
+                    threadProfile._errorCode = hr;
+                }
+            }
+        }
 #pragma endregion
     };
 }}}
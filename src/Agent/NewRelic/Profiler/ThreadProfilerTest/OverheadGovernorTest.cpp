@@ -0,0 +1,148 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "../ThreadProfiler/OverheadGovernor.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic { namespace Profiler { namespace ThreadProfiler { namespace Test
+{
+    TEST_CLASS(OverheadGovernorTest)
+    {
+    public:
+        TEST_METHOD(nothing_is_limited_without_a_budget)
+        {
+            OverheadGovernor governor;
+            governor.Record(Cost(Start(), 1000000, 100, 100000));
+
+            auto plan = governor.Plan(100, Start() + std::chrono::milliseconds(1));
+            Assert::IsFalse(plan.skip);
+            Assert::AreEqual(size_t(SIZE_MAX), plan.maxThreads);
+            Assert::AreEqual(uint32_t(UINT32_MAX), plan.maxDepth);
+            Assert::AreEqual(0u, plan.adjustments);
+        }
+
+        TEST_METHOD(the_first_sample_is_not_limited)
+        {
+            OverheadGovernor governor(Budget(1000, 1));
+
+            auto plan = governor.Plan(100, Start());
+            Assert::IsFalse(plan.skip);
+            Assert::AreEqual(size_t(SIZE_MAX), plan.maxThreads);
+            Assert::AreEqual(0u, plan.adjustments);
+        }
+
+        TEST_METHOD(pause_budget_limits_the_number_of_threads)
+        {
+            OverheadGovernor governor(Budget(50000, 0));
+            // 1ms per thread
+            governor.Record(Cost(Start(), 100000, 100, 100 * 200));
+
+            auto plan = governor.Plan(100, Start() + std::chrono::seconds(1));
+            Assert::IsFalse(plan.skip);
+            Assert::AreEqual(size_t(50), plan.maxThreads);
+            Assert::AreEqual(uint32_t(UINT32_MAX), plan.maxDepth);
+            Assert::AreEqual(SnapshotFlagThreadsSubset, plan.adjustments);
+        }
+
+        TEST_METHOD(threads_that_fit_in_the_pause_budget_are_all_sampled)
+        {
+            OverheadGovernor governor(Budget(50000, 0));
+            governor.Record(Cost(Start(), 100000, 100, 100 * 200));
+
+            auto plan = governor.Plan(40, Start() + std::chrono::seconds(1));
+            Assert::AreEqual(size_t(SIZE_MAX), plan.maxThreads);
+            Assert::AreEqual(0u, plan.adjustments);
+        }
+
+        TEST_METHOD(depth_is_capped_when_the_minimum_subset_does_not_fit)
+        {
+            OverheadGovernor governor(Budget(10000, 0));
+            // 1ms per thread and 200 frames per thread, so only 10 of the minimum 16 threads fit
+            governor.Record(Cost(Start(), 100000, 100, 100 * 200));
+
+            auto plan = governor.Plan(100, Start() + std::chrono::seconds(1));
+            Assert::AreEqual(size_t(OverheadGovernor::MinThreadsPerSample), plan.maxThreads);
+            Assert::AreEqual(uint32_t(200 * 10 / 16), plan.maxDepth);
+            Assert::AreEqual(SnapshotFlagThreadsSubset | SnapshotFlagDepthCapped, plan.adjustments);
+        }
+
+        TEST_METHOD(depth_is_never_capped_below_the_minimum)
+        {
+            OverheadGovernor governor(Budget(1000, 0));
+            governor.Record(Cost(Start(), 100000, 100, 100 * 200));
+
+            auto plan = governor.Plan(100, Start() + std::chrono::seconds(1));
+            Assert::AreEqual(uint32_t(OverheadGovernor::MinStackDepth), plan.maxDepth);
+        }
+
+        TEST_METHOD(cpu_budget_skips_samples_until_enough_time_has_passed)
+        {
+            OverheadGovernor governor(Budget(0, 5));
+            // 10ms for 10 threads
+            governor.Record(Cost(Start(), 10000, 10, 100));
+
+            // 10ms in 100ms is 10%
+            auto plan = governor.Plan(10, Start() + std::chrono::milliseconds(100));
+            Assert::IsTrue(plan.skip);
+            Assert::AreEqual(SnapshotFlagSampleSkipped, plan.adjustments);
+
+            // 10ms in 300ms is under 5%
+            plan = governor.Plan(10, Start() + std::chrono::milliseconds(300));
+            Assert::IsFalse(plan.skip);
+            Assert::AreEqual(0u, plan.adjustments);
+        }
+
+        TEST_METHOD(only_so_many_samples_in_a_row_are_skipped)
+        {
+            OverheadGovernor governor(Budget(0, 5));
+            governor.Record(Cost(Start(), 10000, 10, 100));
+
+            const auto now = Start() + std::chrono::milliseconds(1);
+            for (uint32_t skip = 0; skip != OverheadGovernor::MaxConsecutiveSkips; ++skip)
+            {
+                Assert::IsTrue(governor.Plan(10, now).skip);
+            }
+            Assert::IsFalse(governor.Plan(10, now).skip);
+            Assert::IsTrue(governor.Plan(10, now).skip);
+        }
+
+        TEST_METHOD(one_slow_sample_does_not_replace_the_average)
+        {
+            OverheadGovernor governor(Budget(50000, 0));
+            governor.Record(Cost(Start(), 10000, 100, 100));
+            // ten times slower
+            governor.Record(Cost(Start() + std::chrono::seconds(1), 100000, 100, 100));
+
+            // 100us + 0.3 * 900us per thread
+            auto plan = governor.Plan(1000, Start() + std::chrono::seconds(2));
+            Assert::AreEqual(size_t(50000 / 370), plan.maxThreads);
+        }
+
+    private:
+        static OverheadBudget Budget(uint32_t maxPauseMicroseconds, uint32_t maxCpuPercent)
+        {
+            OverheadBudget budget;
+            budget.maxPauseMicroseconds = maxPauseMicroseconds;
+            budget.maxCpuPercent = maxCpuPercent;
+            return budget;
+        }
+
+        static GovernorClock::time_point Start()
+        {
+            return GovernorClock::time_point() + std::chrono::hours(1);
+        }
+
+        static SampleCost Cost(GovernorClock::time_point start, int64_t microseconds, size_t threads, size_t frames)
+        {
+            SampleCost cost;
+            cost.start = start;
+            cost.duration = std::chrono::microseconds(microseconds);
+            cost.threadsSampled = threads;
+            cost.framesWalked = frames;
+            return cost;
+        }
+    };
+}}}}
@@ -0,0 +1,271 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include <map>
+#include "../ThreadProfiler/ProfileSnapshot.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic { namespace Profiler { namespace ThreadProfiler { namespace Test
+{
+    // stands in for the runtime's type and method name lookup, and counts the lookups
+    struct FakeNames
+    {
+        std::map<uintptr_t, std::pair<xstring_t, xstring_t>> names;
+        size_t lookups = 0;
+
+        ProfileSnapshotBuilder::NameLookup Lookup()
+        {
+            return [this](uintptr_t functionId)
+            {
+                ++lookups;
+                const auto& name = names.at(functionId);
+                return std::make_pair(name.first.c_str(), name.second.c_str());
+            };
+        }
+    };
+
+    TEST_CLASS(ProfileSnapshotBuilderTest)
+    {
+    public:
+        TEST_METHOD(snapshot_without_threads_is_only_a_header)
+        {
+            ProfileSnapshotBuilder builder;
+            FakeNames names;
+            uint32_t totalSize = 0;
+            auto block = builder.Build(names.Lookup(), totalSize);
+
+            auto header = GetHeader(block.get());
+            Assert::AreEqual(SnapshotMagic, header.magic);
+            Assert::AreEqual(SnapshotVersion, header.version);
+            Assert::AreEqual(uint16_t(sizeof(SnapshotHeader)), header.headerSize);
+            Assert::AreEqual(uint32_t(sizeof(SnapshotHeader)), totalSize);
+            Assert::AreEqual(totalSize, header.totalSize);
+            Assert::AreEqual(SnapshotFlagReset, header.flags);
+            Assert::AreEqual(uint32_t(0), header.threadCount);
+            Assert::AreEqual(uint32_t(0), header.nodeCount);
+            Assert::AreEqual(uint32_t(0), header.functionCount);
+            Assert::AreEqual(uint32_t(0), header.stringTableSize);
+            Assert::AreEqual(totalSize, header.stringTableOffset);
+            Assert::AreEqual(size_t(0), names.lookups);
+        }
+
+        TEST_METHOD(sections_follow_each_other_on_8_byte_boundaries)
+        {
+            ProfileSnapshotBuilder builder;
+            auto names = CreateNames();
+            const uintptr_t stack[] = { 2, 1 };
+            builder.AddThread(100, 0, stack, 2);
+            builder.AddThread(101, -1, nullptr, 0);
+            builder.AddThread(102, 0, stack + 1, 1);
+            uint32_t totalSize = 0;
+            auto block = builder.Build(names.Lookup(), totalSize, SnapshotFlagDepthCapped);
+
+            auto header = GetHeader(block.get());
+            Assert::AreEqual(SnapshotFlagDepthCapped | SnapshotFlagReset, header.flags);
+            Assert::AreEqual(uint32_t(3), header.threadCount);
+            Assert::AreEqual(uint32_t(56), header.threadTableOffset);
+            Assert::AreEqual(uint32_t(0), header.firstNodeId);
+            Assert::AreEqual(uint32_t(2), header.nodeCount);
+            Assert::AreEqual(uint32_t(56 + 3 * 16), header.nodeTableOffset);
+            Assert::AreEqual(uint32_t(0), header.firstFunction);
+            Assert::AreEqual(uint32_t(2), header.functionCount);
+            Assert::AreEqual(uint32_t(104 + 2 * 8), header.functionTableOffset);
+            // "MyNamespace.MyClass", "MyMethod" and "MyOtherMethod"
+            Assert::AreEqual(uint32_t(19 + 8 + 13), header.stringTableSize);
+            Assert::AreEqual(uint32_t(120 + 2 * 24), header.stringTableOffset);
+            Assert::AreEqual(uint32_t(168 + 40), header.totalSize);
+            Assert::AreEqual(header.totalSize, totalSize);
+
+            auto failedThread = GetEntry<SnapshotThread>(block.get(), header.threadTableOffset, 1);
+            Assert::AreEqual(uint64_t(101), failedThread.threadId);
+            Assert::AreEqual(-1, failedThread.hresult);
+            Assert::AreEqual(SnapshotNoStack, failedThread.stackNode);
+        }
+
+        TEST_METHOD(names_shared_by_functions_are_stored_once)
+        {
+            ProfileSnapshotBuilder builder;
+            auto names = CreateNames();
+            const uintptr_t stack[] = { 2, 1 };
+            builder.AddThread(100, 0, stack, 2);
+            uint32_t totalSize = 0;
+            auto block = builder.Build(names.Lookup(), totalSize);
+
+            auto header = GetHeader(block.get());
+            auto first = GetEntry<SnapshotFunction>(block.get(), header.functionTableOffset, 0);
+            auto second = GetEntry<SnapshotFunction>(block.get(), header.functionTableOffset, 1);
+            Assert::AreEqual(uint64_t(1), first.functionId);
+            Assert::AreEqual(uint64_t(2), second.functionId);
+            Assert::AreEqual(first.typeNameOffset, second.typeNameOffset);
+            Assert::AreEqual(std::string("MyNamespace.MyClass"), GetString(block.get(), header, first.typeNameOffset, first.typeNameLength));
+            Assert::AreEqual(std::string("MyMethod"), GetString(block.get(), header, first.methodNameOffset, first.methodNameLength));
+            Assert::AreEqual(std::string("MyOtherMethod"), GetString(block.get(), header, second.methodNameOffset, second.methodNameLength));
+        }
+
+        TEST_METHOD(thread_stack_is_found_by_following_the_parents_to_the_root)
+        {
+            ProfileSnapshotBuilder builder;
+            auto names = CreateNames();
+            const uintptr_t stack[] = { 3, 2, 1 };
+            builder.AddThread(100, 0, stack, 3);
+            uint32_t totalSize = 0;
+            auto block = builder.Build(names.Lookup(), totalSize);
+
+            auto header = GetHeader(block.get());
+            auto thread = GetEntry<SnapshotThread>(block.get(), header.threadTableOffset, 0);
+            std::vector<uint64_t> functionIds;
+            for (auto node = thread.stackNode; node != SnapshotNoStack; )
+            {
+                Assert::IsTrue(node < header.nodeCount);
+                auto stackNode = GetEntry<SnapshotNode>(block.get(), header.nodeTableOffset, node);
+                functionIds.push_back(GetEntry<SnapshotFunction>(block.get(), header.functionTableOffset, stackNode.function).functionId);
+                node = stackNode.parentNode;
+            }
+            Assert::IsTrue(std::vector<uint64_t>{ 3, 2, 1 } == functionIds);
+        }
+
+        TEST_METHOD(next_snapshot_only_carries_what_is_new)
+        {
+            ProfileSnapshotBuilder builder;
+            auto names = CreateNames();
+            const uintptr_t stack[] = { 2, 1 };
+            const uintptr_t longerStack[] = { 3, 2, 1 };
+            builder.AddThread(100, 0, stack, 2);
+            uint32_t totalSize = 0;
+            builder.Build(names.Lookup(), totalSize);
+            builder.AddThread(100, 0, longerStack, 3);
+            auto block = builder.Build(names.Lookup(), totalSize);
+
+            auto header = GetHeader(block.get());
+            Assert::AreEqual(uint32_t(0), header.flags);
+            Assert::AreEqual(uint32_t(1), header.threadCount);
+            Assert::AreEqual(uint32_t(2), header.firstNodeId);
+            Assert::AreEqual(uint32_t(1), header.nodeCount);
+            Assert::AreEqual(uint32_t(2), header.firstFunction);
+            Assert::AreEqual(uint32_t(1), header.functionCount);
+            Assert::AreEqual(size_t(3), names.lookups);
+
+            auto node = GetEntry<SnapshotNode>(block.get(), header.nodeTableOffset, 0);
+            Assert::AreEqual(uint32_t(1), node.parentNode);
+            Assert::AreEqual(uint32_t(2), node.function);
+            Assert::AreEqual(uint32_t(2), GetEntry<SnapshotThread>(block.get(), header.threadTableOffset, 0).stackNode);
+        }
+
+        TEST_METHOD(stacks_share_the_nodes_of_their_common_root_frames)
+        {
+            ProfileSnapshotBuilder builder;
+            auto names = CreateNames();
+            const uintptr_t stack[] = { 3, 2, 1 };
+            const uintptr_t otherStack[] = { 4, 2, 1 };
+            builder.AddThread(100, 0, stack, 3);
+            builder.AddThread(101, 0, otherStack, 3);
+            builder.AddThread(102, 0, stack, 3);
+            uint32_t totalSize = 0;
+            auto block = builder.Build(names.Lookup(), totalSize);
+
+            auto header = GetHeader(block.get());
+            Assert::AreEqual(uint32_t(4), header.nodeCount);
+            auto leaf = GetEntry<SnapshotThread>(block.get(), header.threadTableOffset, 0).stackNode;
+            auto otherLeaf = GetEntry<SnapshotThread>(block.get(), header.threadTableOffset, 1).stackNode;
+            Assert::AreNotEqual(leaf, otherLeaf);
+            Assert::AreEqual(leaf, GetEntry<SnapshotThread>(block.get(), header.threadTableOffset, 2).stackNode);
+            Assert::AreEqual(GetEntry<SnapshotNode>(block.get(), header.nodeTableOffset, leaf).parentNode,
+                GetEntry<SnapshotNode>(block.get(), header.nodeTableOffset, otherLeaf).parentNode);
+        }
+
+        TEST_METHOD(function_called_from_different_parents_has_a_node_for_each)
+        {
+            ProfileSnapshotBuilder builder;
+            auto names = CreateNames();
+            const uintptr_t stack[] = { 3, 1 };
+            const uintptr_t otherStack[] = { 3, 2 };
+            builder.AddThread(100, 0, stack, 2);
+            builder.AddThread(101, 0, otherStack, 2);
+            uint32_t totalSize = 0;
+            auto block = builder.Build(names.Lookup(), totalSize);
+
+            auto header = GetHeader(block.get());
+            Assert::AreEqual(uint32_t(4), header.nodeCount);
+            Assert::AreEqual(uint32_t(3), header.functionCount);
+            auto leaf = GetEntry<SnapshotNode>(block.get(), header.nodeTableOffset, GetEntry<SnapshotThread>(block.get(), header.threadTableOffset, 0).stackNode);
+            auto otherLeaf = GetEntry<SnapshotNode>(block.get(), header.nodeTableOffset, GetEntry<SnapshotThread>(block.get(), header.threadTableOffset, 1).stackNode);
+            Assert::AreEqual(leaf.function, otherLeaf.function);
+            Assert::AreNotEqual(leaf.parentNode, otherLeaf.parentNode);
+        }
+
+        TEST_METHOD(session_starts_over_once_it_holds_more_than_MaxNodes_nodes)
+        {
+            ProfileSnapshotBuilder builder;
+            auto names = CreateNames();
+            const uintptr_t stack[] = { 2, 1 };
+            builder.AddThread(100, 0, stack, 2);
+            uint32_t totalSize = 0;
+            builder.Build(names.Lookup(), totalSize);
+
+            // one stack of distinct functions, deep enough to fill the session
+            std::vector<uintptr_t> deepStack;
+            for (uintptr_t functionId = 5; deepStack.size() < size_t(ProfileSnapshotBuilder::MaxNodes) - 2; ++functionId)
+            {
+                deepStack.push_back(functionId);
+            }
+            builder.AddThread(100, 0, deepStack.data(), static_cast<uint32_t>(deepStack.size()));
+            builder.DiscardThreads();
+            Assert::AreEqual(size_t(ProfileSnapshotBuilder::MaxNodes), builder.NodeCount());
+            Assert::IsFalse(builder.ResetIfFull());
+
+            builder.AddThread(100, 0, stack + 1, 1);
+            builder.AddThread(100, 0, stack, 2);
+            Assert::IsFalse(builder.ResetIfFull());
+            const uintptr_t newStack[] = { 3, 1 };
+            builder.AddThread(100, 0, newStack, 2);
+            Assert::IsTrue(builder.ResetIfFull());
+            Assert::AreEqual(size_t(0), builder.NodeCount());
+
+            builder.AddThread(100, 0, stack, 2);
+            auto block = builder.Build(names.Lookup(), totalSize);
+            auto header = GetHeader(block.get());
+            Assert::AreEqual(SnapshotFlagReset, header.flags);
+            Assert::AreEqual(uint32_t(1), header.threadCount);
+            Assert::AreEqual(uint32_t(0), header.firstNodeId);
+            Assert::AreEqual(uint32_t(2), header.nodeCount);
+            Assert::AreEqual(uint32_t(0), header.firstFunction);
+            Assert::AreEqual(uint32_t(2), header.functionCount);
+        }
+
+    private:
+        static FakeNames CreateNames()
+        {
+            FakeNames names;
+            names.names[1] = std::make_pair(xstring_t(_X("MyNamespace.MyClass")), xstring_t(_X("MyMethod")));
+            names.names[2] = std::make_pair(xstring_t(_X("MyNamespace.MyClass")), xstring_t(_X("MyOtherMethod")));
+            names.names[3] = std::make_pair(xstring_t(_X("MyNamespace.MyOtherClass")), xstring_t(_X("MyMethod")));
+            names.names[4] = std::make_pair(xstring_t(_X("MyNamespace.MyOtherClass")), xstring_t(_X("MyOtherMethod")));
+            return names;
+        }
+
+        static SnapshotHeader GetHeader(const uint8_t* block)
+        {
+            SnapshotHeader header;
+            std::memcpy(&header, block, sizeof(header));
+            return header;
+        }
+
+        template <typename T>
+        static T GetEntry(const uint8_t* block, uint32_t sectionOffset, uint32_t index)
+        {
+            Assert::AreEqual(uint32_t(0), sectionOffset % 8);
+            T entry;
+            std::memcpy(&entry, block + sectionOffset + index * sizeof(T), sizeof(T));
+            return entry;
+        }
+
+        static std::string GetString(const uint8_t* block, const SnapshotHeader& header, uint32_t offset, uint32_t length)
+        {
+            Assert::IsTrue(offset + length <= header.stringTableSize);
+            return std::string(reinterpret_cast<const char*>(block + header.stringTableOffset + offset), length);
+        }
+    };
+}}}}
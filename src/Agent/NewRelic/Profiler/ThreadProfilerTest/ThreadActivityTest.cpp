@@ -0,0 +1,44 @@
+// Copyright 2020 New Relic, Inc. All rights reserved.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "../ThreadProfiler/ThreadActivity.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace NewRelic { namespace Profiler { namespace ThreadProfiler { namespace Test
+{
+    TEST_CLASS(ThreadActivityTest)
+    {
+    public:
+        TEST_METHOD(schedstat_time_on_cpu_is_the_first_field)
+        {
+            uint64_t cpuTime = 0;
+            Assert::IsTrue(ThreadActivity::ParseSchedStat("1234567890123 456789 42\n", cpuTime));
+            Assert::AreEqual(uint64_t(1234567890123), cpuTime);
+        }
+
+        TEST_METHOD(schedstat_of_a_thread_that_has_not_run_is_zero)
+        {
+            uint64_t cpuTime = 1;
+            Assert::IsTrue(ThreadActivity::ParseSchedStat("0 0 0\n", cpuTime));
+            Assert::AreEqual(uint64_t(0), cpuTime);
+        }
+
+        TEST_METHOD(schedstat_without_a_number_is_rejected)
+        {
+            uint64_t cpuTime = 0;
+            Assert::IsFalse(ThreadActivity::ParseSchedStat("", cpuTime));
+            Assert::IsFalse(ThreadActivity::ParseSchedStat("\n", cpuTime));
+            Assert::IsFalse(ThreadActivity::ParseSchedStat("abc 1 2\n", cpuTime));
+        }
+
+        TEST_METHOD(cpu_time_is_not_known_for_a_thread_that_does_not_exist)
+        {
+            ThreadActivity threadActivity;
+            uint64_t cpuTime = 0;
+            Assert::IsFalse(threadActivity.TryGetCpuTime(0, cpuTime));
+        }
+    };
+}}}}